@@ -0,0 +1,80 @@
+#include "rbtree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+    노드 할당 방식 비교용 벤치마크
+    같은 소스를 풀(기본)과 -DRBTREE_NO_POOL(malloc) 두 가지로 빌드해서 비교한다
+    usage : ./bench-alloc [n] [rounds]
+*/
+
+#if defined(RBTREE_NO_POOL)
+#define ALLOC_NAME "malloc"
+#elif defined(RBTREE_COMPACT32)
+#define ALLOC_NAME "pool32"
+#else
+#define ALLOC_NAME "pool"
+#endif
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *phase, const size_t ops, const double sec) {
+  printf("%-8s %-10s %10zu ops %9.3f ms %8.1f ns/op\n", ALLOC_NAME, phase, ops,
+         sec * 1e3, sec * 1e9 / ops);
+}
+
+int main(int argc, char *argv[]) {
+  const size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  const size_t rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : 4;
+
+  printf("%-8s sizeof(node_t) = %zu\n", ALLOC_NAME, sizeof(node_t));
+  key_t *keys = malloc(n * sizeof(key_t));
+  node_t **nodes = malloc(n * sizeof(node_t *));
+  srand(17);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+  }
+
+  // 1. insert n개
+  rbtree *t = new_rbtree();
+  double start = now_sec();
+  for (size_t i = 0; i < n; i++) {
+    nodes[i] = rbtree_insert(t, keys[i]);
+  }
+  report("insert", n, now_sec() - start);
+
+  // 2. churn : 절반씩 지우고 다시 넣기를 반복
+  start = now_sec();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = r & 1; i < n; i += 2) {
+      rbtree_erase(t, nodes[i]);
+    }
+    for (size_t i = r & 1; i < n; i += 2) {
+      nodes[i] = rbtree_insert(t, keys[i]);
+    }
+  }
+  report("churn", rounds * n, now_sec() - start);
+
+  // 3. find : 노드가 힙에 얼마나 흩어져 있는지가 드러난다
+  start = now_sec();
+  size_t found = 0;
+  for (size_t i = 0; i < n; i++) {
+    found += rbtree_find(t, keys[i]) != NULL;
+  }
+  report("find", n, now_sec() - start);
+
+  // 4. delete
+  start = now_sec();
+  delete_rbtree(t);
+  report("delete", n, now_sec() - start);
+
+  free(nodes);
+  free(keys);
+  return found == n ? 0 : 1;
+}
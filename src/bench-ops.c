@@ -0,0 +1,678 @@
+#include "rbtree.h"
+#include "rbtree_btree.h"
+#include "rbtree_frozen.h"
+#include "rbtree_mmap.h"
+#include "rbtree_parallel.h"
+#include "rbtree_persist.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+    트리 연산별 마이크로벤치마크
+    key 분포 x 크기 마다 insert / find / find_many / freeze / frozen_find / min / max / to_array / erase
+    / 트리 합치기(merge_insert, union) / 정렬된 묶음 넣고 빼기(insert_batch, erase_batch)
+    / persistent 트리(persist_insert, snapshot, snap_find)
+    / 파일 저장과 mmap 다시 열기(save, open_mmap, mapped_find, thaw)
+    / top-down insert / erase 와 bottom-up 비교(insert_topdown, erase_key_topdown ...)
+    / 병렬 bulk 연산(from_sorted_par, to_array_par, delete_par, core 수만큼 thread) 을 재고
+    연산당 평균 시간과 latency percentile(p50 / p99 / p99.9 / max)을 CSV나 JSON으로 찍는다
+    버전끼리 결과 파일을 비교해서 성능이 떨어졌는지 확인하는 용도
+
+    usage : ./bench-ops [-f csv|json] [-s 1000,10000,...] [-d seq,random,zipf,dup]
+
+    key 분포
+    - seq    : 0, 1, 2 ... 순서대로
+    - random : 32bit 균등 난수
+    - zipf   : n개 key 중 순위 r이 1 / r^0.99 비율로 나온다 (핫 key가 몰림)
+    - dup    : n / 100 가지 key만 나온다 (key 하나당 평균 100개씩 중복)
+
+    latency는 연산 하나하나 앞뒤로 시계를 읽어서 잰다
+    시계를 읽는 비용은 미리 재서 빼고, 평균(ns_per_op)은 그 값을 뺀 전체 시간으로 낸다
+*/
+
+#if defined(RBTREE_NO_POOL)
+#define LAYOUT_NAME "malloc"
+#elif defined(RBTREE_COMPACT32)
+#define LAYOUT_NAME "compact32"
+#elif defined(RBTREE_COMPACT)
+#define LAYOUT_NAME "compact"
+#else
+#define LAYOUT_NAME "pool"
+#endif
+
+#define MAX_REPEAT_OPS 1000000  // min / max / to_array 를 반복할 때의 총 연산 수
+
+enum { DIST_SEQ, DIST_RANDOM, DIST_ZIPF, DIST_DUP, DIST_COUNT };
+static const char *dist_names[DIST_COUNT] = {"seq", "random", "zipf", "dup"};
+
+typedef struct {
+  uint64_t state;
+  int dist;
+  size_t n, next;
+  // zipf (YCSB의 ZipfianGenerator 방식 : 준비 O(n), 뽑기 O(1))
+  double theta, alpha, zetan, eta;
+} keygen_t;
+
+static int json_output;
+static int first_row = 1;
+static uint64_t timer_overhead;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15u);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+  return z ^ (z >> 31);
+}
+
+static void keygen_init(keygen_t *g, const int dist, const size_t n,
+                        const uint64_t seed) {
+  memset(g, 0, sizeof(*g));
+  g->state = seed;
+  g->dist = dist;
+  g->n = n;
+  if (dist == DIST_ZIPF) {
+    g->theta = 0.99;
+    for (size_t i = 1; i <= n; i++) {
+      g->zetan += 1.0 / pow((double)i, g->theta);
+    }
+    const double zeta2 = 1.0 + 1.0 / pow(2.0, g->theta);
+    g->alpha = 1.0 / (1.0 - g->theta);
+    g->eta = (1.0 - pow(2.0 / n, 1.0 - g->theta)) / (1.0 - zeta2 / g->zetan);
+  }
+}
+
+static key_t keygen_next(keygen_t *g) {
+  const uint64_t r = splitmix64(&g->state);
+  switch (g->dist) {
+    case DIST_SEQ:
+      return (key_t)g->next++;
+    case DIST_RANDOM:
+      return (key_t)(uint32_t)r;
+    case DIST_DUP:
+      return (key_t)(r % (g->n / 100 + 1));
+    default: {
+      const double u = (r >> 11) * (1.0 / 9007199254740992.0);
+      const double uz = u * g->zetan;
+      uint64_t rank;
+      if (uz < 1.0) {
+        rank = 0;
+      } else if (uz < 1.0 + pow(0.5, g->theta)) {
+        rank = 1;
+      } else {
+        rank = (uint64_t)(g->n * pow(g->eta * u - g->eta + 1.0, g->alpha));
+        if (rank >= g->n) {
+          rank = g->n - 1;
+        }
+      }
+      // 순위가 높은 key가 트리 한쪽에 몰리지 않도록 섞어준다
+      return (key_t)(uint32_t)(rank * 2654435761u);
+    }
+  }
+}
+
+static int comp_u32(const void *p1, const void *p2) {
+  const uint32_t a = *(const uint32_t *)p1, b = *(const uint32_t *)p2;
+  return (a > b) - (a < b);
+}
+
+static int comp_key(const void *p1, const void *p2) {
+  const key_t a = *(const key_t *)p1, b = *(const key_t *)p2;
+  return (a > b) - (a < b);
+}
+
+// 시계를 두번 연달아 읽을 때 걸리는 최소 시간
+static uint64_t measure_timer_overhead(void) {
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < 10000; i++) {
+    const uint64_t a = now_ns();
+    const uint64_t b = now_ns();
+    if (b - a < best) {
+      best = b - a;
+    }
+  }
+  return best;
+}
+
+/*
+    한 줄 결과 출력
+    lat이 NULL이면 (to_array처럼 한번에 재는 연산) percentile은 평균으로 채운다
+*/
+static void report(const char *dist, const size_t n, const char *op,
+                   const size_t ops, const uint64_t total_ns, uint32_t *lat) {
+  const double per_op = ops ? (double)total_ns / ops : 0;
+  double p50 = per_op, p99 = per_op, p999 = per_op, pmax = per_op;
+  if (lat != NULL && ops > 0) {
+    qsort(lat, ops, sizeof(uint32_t), comp_u32);
+    p50 = lat[ops / 2];
+    p99 = lat[(size_t)(ops * 0.99)];
+    p999 = lat[(size_t)(ops * 0.999)];
+    pmax = lat[ops - 1];
+  }
+  if (json_output) {
+    printf("%s\n  {\"layout\": \"%s\", \"dist\": \"%s\", \"n\": %zu, "
+           "\"op\": \"%s\", \"ops\": %zu, \"total_ms\": %.3f, "
+           "\"ns_per_op\": %.1f, \"p50_ns\": %.0f, \"p99_ns\": %.0f, "
+           "\"p999_ns\": %.0f, \"max_ns\": %.0f}",
+           first_row ? "[" : ",", LAYOUT_NAME, dist, n, op, ops,
+           total_ns / 1e6, per_op, p50, p99, p999, pmax);
+  } else {
+    if (first_row) {
+      printf("layout,dist,n,op,ops,total_ms,ns_per_op,p50_ns,p99_ns,p999_ns,"
+             "max_ns\n");
+    }
+    printf("%s,%s,%zu,%s,%zu,%.3f,%.1f,%.0f,%.0f,%.0f,%.0f\n", LAYOUT_NAME,
+           dist, n, op, ops, total_ns / 1e6, per_op, p50, p99, p999, pmax);
+  }
+  first_row = 0;
+  fflush(stdout);
+}
+
+// 연산 하나의 시간을 재서 lat[i]에 넣고 총합에 더한다
+#define TIMED(lat, i, total, stmt)                                   \
+  do {                                                               \
+    const uint64_t t0_ = now_ns();                                   \
+    stmt;                                                            \
+    const uint64_t d_ = now_ns() - t0_;                              \
+    const uint64_t c_ = d_ > timer_overhead ? d_ - timer_overhead : 0; \
+    (lat)[i] = c_ > UINT32_MAX ? UINT32_MAX : (uint32_t)c_;          \
+    (total) += c_;                                                   \
+  } while (0)
+
+static void bench_one(const int dist, const size_t n) {
+  const char *name = dist_names[dist];
+  key_t *keys = malloc(n * sizeof(key_t));
+  node_t **nodes = malloc(n * sizeof(node_t *));
+  uint32_t *lat = malloc(n * sizeof(uint32_t));
+  keygen_t g;
+  keygen_init(&g, dist, n, 17);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = keygen_next(&g);
+  }
+
+  // 1. insert
+  rbtree *t = new_rbtree();
+  uint64_t total = 0;
+  for (size_t i = 0; i < n; i++) {
+    TIMED(lat, i, total, nodes[i] = rbtree_insert(t, keys[i]));
+  }
+  report(name, n, "insert", n, total, lat);
+
+  // 2. find : 같은 분포에서 새로 뽑은 key (seq는 처음부터 다시)
+  //    random은 새로 뽑으면 거의 다 없는 key라서 넣었던 key 중에서 고른다
+  key_t *probes = malloc(n * sizeof(key_t));
+  keygen_init(&g, dist, n, 29);
+  for (size_t i = 0; i < n; i++) {
+    probes[i] = dist == DIST_RANDOM ? keys[splitmix64(&g.state) % n]
+                                    : keygen_next(&g);
+  }
+  size_t found = 0;
+  total = 0;
+  for (size_t i = 0; i < n; i++) {
+    TIMED(lat, i, total, found += rbtree_find(t, probes[i]) != NULL);
+  }
+  report(name, n, "find", n, total, lat);
+
+  uint64_t start;
+
+  // 2-1. find_many : batch 크기별. batch 하나를 재서 key 수로 나눈다
+  node_t **out = malloc(n * sizeof(node_t *));
+  static const size_t batches[] = {64, 512, 4096};
+  for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+    char op[32];
+    size_t many_found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i += batches[b]) {
+      const size_t len = n - i < batches[b] ? n - i : batches[b];
+      many_found += rbtree_find_many(t, probes + i, len, out + i);
+    }
+    snprintf(op, sizeof(op), "find_many%zu", batches[b]);
+    report(name, n, op, n, now_ns() - start, NULL);
+    if (many_found != found) {
+      fprintf(stderr, "%s n=%zu : find_many disagrees with find\n", name, n);
+    }
+  }
+  free(out);
+
+  // 2-2. freeze 스냅샷에서 같은 find
+  start = now_ns();
+  rbtree_frozen *f = rbtree_freeze(t);
+  report(name, n, "freeze", n, now_ns() - start, NULL);
+  size_t frozen_found = 0;
+  total = 0;
+  for (size_t i = 0; i < n; i++) {
+    TIMED(lat, i, total, frozen_found += rbtree_frozen_find(f, probes[i]) != NULL);
+  }
+  report(name, n, "frozen_find", n, total, lat);
+  rbtree_frozen_delete(f);
+  free(probes);
+  if (frozen_found != found) {
+    fprintf(stderr, "%s n=%zu : frozen_find disagrees with find\n", name, n);
+  }
+
+  // 3. min / max
+  const size_t reps = n < MAX_REPEAT_OPS ? n : MAX_REPEAT_OPS;
+  node_t *volatile sink;
+  total = 0;
+  for (size_t i = 0; i < reps; i++) {
+    TIMED(lat, i, total, sink = rbtree_min(t));
+  }
+  report(name, n, "min", reps, total, lat);
+  total = 0;
+  for (size_t i = 0; i < reps; i++) {
+    TIMED(lat, i, total, sink = rbtree_max(t));
+  }
+  report(name, n, "max", reps, total, lat);
+  (void)sink;
+
+  // 4. to_array : 복사한 노드 하나를 1 op로 센다
+  key_t *arr = malloc(n * sizeof(key_t));
+  const size_t rounds = MAX_REPEAT_OPS / n > 0 ? MAX_REPEAT_OPS / n : 1;
+  start = now_ns();
+  for (size_t r = 0; r < rounds; r++) {
+    rbtree_to_array(t, arr, n);
+  }
+  report(name, n, "to_array", rounds * n, now_ns() - start, NULL);
+  free(arr);
+
+  // 5. erase : insert 때 받은 노드를 섞어서 하나씩
+  for (size_t i = n; i > 1; i--) {
+    const size_t j = splitmix64(&g.state) % i;
+    node_t *tmp = nodes[i - 1];
+    nodes[i - 1] = nodes[j];
+    nodes[j] = tmp;
+  }
+  total = 0;
+  for (size_t i = 0; i < n; i++) {
+    TIMED(lat, i, total, rbtree_erase(t, nodes[i]));
+  }
+  report(name, n, "erase", n, total, lat);
+  delete_rbtree(t);
+
+  // 6. 같은 분포의 n개짜리 트리 두개를 합치기 (n개를 1 op로 센다)
+  //    merge_insert : 한쪽을 to_array 해서 다른 쪽에 하나씩 insert (예전 방식)
+  //    union / union_par : rbtree_union, thread 여러개인 rbtree_set_op
+  const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int mode = 0; mode < 3; mode++) {
+    static const char *ops[] = {"merge_insert", "union", "union_par"};
+    rbtree *t1 = new_rbtree();
+    rbtree *t2 = new_rbtree();
+    keygen_init(&g, dist, n, 41);
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(t1, keys[i]);
+      rbtree_insert(t2, keygen_next(&g));
+    }
+    start = now_ns();
+    if (mode == 0) {
+      key_t *buf = malloc(n * sizeof(key_t));
+      rbtree_to_array(t2, buf, n);
+      for (size_t i = 0; i < n; i++) {
+        rbtree_insert(t1, buf[i]);
+      }
+      free(buf);
+    } else {
+      rbtree_set_op(t1, t2, RBTREE_UNION, mode == 1 ? 1 : (int)cores);
+    }
+    report(name, n, ops[mode], n, now_ns() - start, NULL);
+    delete_rbtree(t1);
+    delete_rbtree(t2);
+  }
+
+  // 7. n개 트리에 정렬된 묶음 넣고 빼기 (key 하나를 1 op로 센다)
+  //    묶음 크기 n / 64 (finger search) 와 n (다시 잇기)
+  //    insert_loop / erase_loop : 같은 묶음을 rbtree_insert / find + erase 로 하나씩
+  for (int large = 0; large < 2; large++) {
+    const size_t b = large ? n : (n / 64 ? n / 64 : 1);
+    key_t *batch = malloc(b * sizeof(key_t));
+    keygen_init(&g, dist, n, 43);
+    for (size_t i = 0; i < b; i++) {
+      batch[i] = keygen_next(&g);
+    }
+    qsort(batch, b, sizeof(key_t), comp_key);
+    for (int mode = 0; mode < 2; mode++) {
+      static const char *ops[2][2][2] = {
+          {{"insert_loop_small", "erase_loop_small"}, {"insert_batch_small", "erase_batch_small"}},
+          {{"insert_loop_large", "erase_loop_large"}, {"insert_batch_large", "erase_batch_large"}}};
+      rbtree *bt = new_rbtree();
+      for (size_t i = 0; i < n; i++) {
+        rbtree_insert(bt, keys[i]);
+      }
+      start = now_ns();
+      if (mode == 0) {
+        for (size_t i = 0; i < b; i++) {
+          rbtree_insert(bt, batch[i]);
+        }
+      } else {
+        rbtree_insert_batch(bt, batch, b);
+      }
+      report(name, n, ops[large][mode][0], b, now_ns() - start, NULL);
+      start = now_ns();
+      if (mode == 0) {
+        for (size_t i = 0; i < b; i++) {
+          rbtree_erase(bt, rbtree_find(bt, batch[i]));
+        }
+      } else {
+        rbtree_erase_batch(bt, batch, b);
+      }
+      report(name, n, ops[large][mode][1], b, now_ns() - start, NULL);
+      delete_rbtree(bt);
+    }
+    free(batch);
+  }
+
+  // 8. persistent 트리 : insert (경로 복사) / snapshot 잡고 놓기 / snapshot에서 find
+  //    persist_insert_snap : 매 insert 전에 snapshot을 잡아둬서 복사된 원본이 바로 free 되지 않을 때
+  for (int hold = 0; hold < 2; hold++) {
+    rbtree_persist *p = rbtree_persist_new();
+    rbtree_snap *held = NULL;
+    total = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (hold) {
+        if (held != NULL) {
+          rbtree_snap_release(held);
+        }
+        held = rbtree_snapshot(p);
+      }
+      TIMED(lat, i, total, rbtree_persist_insert(p, keys[i]));
+    }
+    report(name, n, hold ? "persist_insert_snap" : "persist_insert", n, total, lat);
+    if (held != NULL) {
+      rbtree_snap_release(held);
+    }
+    if (hold) {
+      rbtree_persist_delete(p);
+      break;
+    }
+
+    total = 0;
+    for (size_t i = 0; i < n; i++) {
+      rbtree_snap *s;
+      TIMED(lat, i, total, s = rbtree_snapshot(p));
+      rbtree_snap_release(s);
+    }
+    report(name, n, "snapshot", n, total, lat);
+
+    rbtree_snap *s = rbtree_snapshot(p);
+    size_t snap_found = 0;
+    total = 0;
+    for (size_t i = 0; i < n; i++) {
+      TIMED(lat, i, total, snap_found += rbtree_snap_find(s, keys[n - 1 - i]));
+    }
+    report(name, n, "snap_find", n, total, lat);
+    found += snap_found == n;
+    rbtree_snap_release(s);
+    rbtree_persist_delete(p);
+  }
+
+  // 9. 파일로 저장하고 다시 열기 (save / thaw는 노드 하나를 1 op로 센다)
+  //    reload_insert : 예전처럼 key 배열을 하나씩 insert 해서 다시 만들 때
+  //    open_mmap은 header만 읽으므로 크기와 상관없이 한번, mapped_find는 page cache에 올라온 뒤
+  {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench-ops-%d.rbt", (int)getpid());
+    rbtree *st = new_rbtree();
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(st, keys[i]);
+    }
+    start = now_ns();
+    const int saved = rbtree_save(st, path);
+    if (saved) {
+      report(name, n, "save", n, now_ns() - start, NULL);
+    }
+    delete_rbtree(st);
+
+    start = now_ns();
+    st = new_rbtree();
+    for (size_t i = 0; i < n; i++) {
+      rbtree_insert(st, keys[i]);
+    }
+    report(name, n, "reload_insert", n, now_ns() - start, NULL);
+    delete_rbtree(st);
+
+    // /tmp가 가득 찼거나 읽기 전용이면 save / open_mmap이 실패한다. mmap 쪽은 건너뛴다
+    start = now_ns();
+    rbtree_mapped *m = saved ? rbtree_open_mmap(path) : NULL;
+    if (m == NULL) {
+      fprintf(stderr, "%s n=%zu : %s(%s) failed, skipping mmap\n", name, n,
+              saved ? "rbtree_open_mmap" : "rbtree_save", path);
+    } else {
+      report(name, n, "open_mmap", 1, now_ns() - start, NULL);
+      size_t mapped_found = 0;
+      total = 0;
+      for (size_t i = 0; i < n; i++) {
+        TIMED(lat, i, total, mapped_found += rbtree_mapped_find(m, keys[n - 1 - i]));
+      }
+      report(name, n, "mapped_find", n, total, lat);
+      found += mapped_found == n;
+
+      start = now_ns();
+      st = rbtree_mapped_thaw(m);
+      report(name, n, "thaw", n, now_ns() - start, NULL);
+      delete_rbtree(st);
+      rbtree_mapped_close(m);
+    }
+    unlink(path);
+  }
+
+  // 10. top-down insert / erase 와 bottom-up 비교 (같은 key, 같은 순서)
+  //     erase_key : bottom-up은 key로 지우려면 find 한 뒤 erase (erase_topdown은 key를 받는다)
+  {
+    key_t *order = malloc(n * sizeof(key_t));
+    memcpy(order, keys, n * sizeof(key_t));
+    for (size_t i = n; i > 1; i--) {
+      const size_t j = splitmix64(&g.state) % i;
+      const key_t tmp = order[i - 1];
+      order[i - 1] = order[j];
+      order[j] = tmp;
+    }
+    static const char *ops[2][2] = {{"insert_bottomup", "erase_key_bottomup"},
+                                    {"insert_topdown", "erase_key_topdown"}};
+    for (int td = 0; td < 2; td++) {
+      rbtree *tt = new_rbtree();
+      total = 0;
+      for (size_t i = 0; i < n; i++) {
+        if (td) {
+          TIMED(lat, i, total, rbtree_insert_topdown(tt, keys[i]));
+        } else {
+          TIMED(lat, i, total, rbtree_insert(tt, keys[i]));
+        }
+      }
+      report(name, n, ops[td][0], n, total, lat);
+      total = 0;
+      for (size_t i = 0; i < n; i++) {
+        if (td) {
+          TIMED(lat, i, total, rbtree_erase_topdown(tt, order[i]));
+        } else {
+          TIMED(lat, i, total, rbtree_erase(tt, rbtree_find(tt, order[i])));
+        }
+      }
+      report(name, n, ops[td][1], n, total, lat);
+      found += tt->root == tt->nil;
+      delete_rbtree(tt);
+    }
+    free(order);
+  }
+
+  // 11. 정렬된 배열로 만들기 / to_array / delete 를 한 thread와 core 수만큼의 thread로 (노드 하나를 1 op로 센다)
+  {
+    key_t *sorted = malloc(n * sizeof(key_t));
+    memcpy(sorted, keys, n * sizeof(key_t));
+    qsort(sorted, n, sizeof(key_t), comp_key);
+    rbtree_workers *w = rbtree_workers_new((int)cores);
+    static const char *ops[2][3] = {{"from_sorted", "to_array_seq", "delete"},
+                                    {"from_sorted_par", "to_array_par", "delete_par"}};
+    for (int par = 0; par < 2; par++) {
+      start = now_ns();
+      rbtree *tt = par ? rbtree_from_sorted_par(w, sorted, n) : rbtree_from_sorted(sorted, n);
+      report(name, n, ops[par][0], n, now_ns() - start, NULL);
+      start = now_ns();
+      if (par) {
+        rbtree_to_array_par(w, tt, sorted, n);
+      } else {
+        rbtree_to_array(tt, sorted, n);
+      }
+      report(name, n, ops[par][1], n, now_ns() - start, NULL);
+      start = now_ns();
+      if (par) {
+        delete_rbtree_par(w, tt);
+      } else {
+        delete_rbtree(tt);
+      }
+      report(name, n, ops[par][2], n, now_ns() - start, NULL);
+    }
+    rbtree_workers_delete(w);
+    free(sorted);
+  }
+
+  // 12. B+tree : 1 / 2 / 4 / erase_key_bottomup과 같은 key, 같은 순서
+  {
+    key_t *probes2 = malloc(n * sizeof(key_t));
+    keygen_init(&g, dist, n, 29);
+    for (size_t i = 0; i < n; i++) {
+      probes2[i] = dist == DIST_RANDOM ? keys[splitmix64(&g.state) % n]
+                                       : keygen_next(&g);
+    }
+    rbtree_btree *b = rbtree_btree_new();
+    total = 0;
+    for (size_t i = 0; i < n; i++) {
+      TIMED(lat, i, total, rbtree_btree_insert(b, keys[i]));
+    }
+    report(name, n, "btree_insert", n, total, lat);
+    size_t btree_found = 0;
+    total = 0;
+    for (size_t i = 0; i < n; i++) {
+      TIMED(lat, i, total, btree_found += rbtree_btree_find(b, probes2[i]));
+    }
+    report(name, n, "btree_find", n, total, lat);
+    if (btree_found != frozen_found) {
+      fprintf(stderr, "%s n=%zu : btree_find disagrees with find\n", name, n);
+    }
+    key_t *barr = malloc(n * sizeof(key_t));
+    const size_t brounds = MAX_REPEAT_OPS / n > 0 ? MAX_REPEAT_OPS / n : 1;
+    start = now_ns();
+    for (size_t r = 0; r < brounds; r++) {
+      rbtree_btree_to_array(b, barr, n);
+    }
+    report(name, n, "btree_to_array", brounds * n, now_ns() - start, NULL);
+    for (size_t i = n; i > 1; i--) {
+      const size_t j = splitmix64(&g.state) % i;
+      const key_t tmp = barr[i - 1];
+      barr[i - 1] = barr[j];
+      barr[j] = tmp;
+    }
+    total = 0;
+    for (size_t i = 0; i < n; i++) {
+      TIMED(lat, i, total, rbtree_btree_erase(b, barr[i]));
+    }
+    report(name, n, "btree_erase", n, total, lat);
+    rbtree_btree_delete(b);
+    free(barr);
+    free(probes2);
+  }
+
+#ifdef RBTREE_LAZY_DELETE
+  // 13. key로 지우기 : 바로 지우기 (find + erase) 와 tombstone (find + erase_lazy), 그 뒤 compact 한번
+  //     (compact는 tombstone 하나를 1 op로 센다. RBTREE_TOMBSTONE_RATIO=0 으로 빌드해야 따로 잰다)
+  {
+    key_t *order = malloc(n * sizeof(key_t));
+    memcpy(order, keys, n * sizeof(key_t));
+    for (size_t i = n; i > 1; i--) {
+      const size_t j = splitmix64(&g.state) % i;
+      const key_t tmp = order[i - 1];
+      order[i - 1] = order[j];
+      order[j] = tmp;
+    }
+    for (int lazy = 0; lazy < 2; lazy++) {
+      rbtree *tt = new_rbtree();
+      for (size_t i = 0; i < n; i++) {
+        rbtree_insert(tt, keys[i]);
+      }
+      total = 0;
+      for (size_t i = 0; i < n; i++) {
+        if (lazy) {
+          TIMED(lat, i, total, rbtree_erase_lazy(tt, rbtree_find(tt, order[i])));
+        } else {
+          TIMED(lat, i, total, rbtree_erase(tt, rbtree_find(tt, order[i])));
+        }
+      }
+      report(name, n, lazy ? "erase_key_lazy" : "erase_key", n, total, lat);
+      if (lazy) {
+        const size_t dead = tt->dead;
+        start = now_ns();
+        rbtree_compact(tt);
+        report(name, n, "compact", dead, now_ns() - start, NULL);
+      }
+      delete_rbtree(tt);
+    }
+    free(order);
+  }
+#endif
+
+  free(lat);
+  free(nodes);
+  free(keys);
+  if (found == 0) {
+    fprintf(stderr, "%s n=%zu : find never hit\n", name, n);
+  }
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage : %s [-f csv|json] [-s 1000,10000,...] [-d %s,%s,%s,%s]\n",
+          prog, dist_names[0], dist_names[1], dist_names[2], dist_names[3]);
+  exit(2);
+}
+
+int main(int argc, char *argv[]) {
+  char sizes[256] = "1000,10000,100000,1000000";
+  char dists[64] = "seq,random,zipf,dup";
+  int opt;
+  while ((opt = getopt(argc, argv, "f:s:d:")) != -1) {
+    if (opt == 'f' && (!strcmp(optarg, "csv") || !strcmp(optarg, "json"))) {
+      json_output = !strcmp(optarg, "json");
+    } else if (opt == 's' && strlen(optarg) < sizeof(sizes)) {
+      strcpy(sizes, optarg);
+    } else if (opt == 'd' && strlen(optarg) < sizeof(dists)) {
+      strcpy(dists, optarg);
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  timer_overhead = measure_timer_overhead();
+  for (char *d = strtok(dists, ","); d != NULL; d = strtok(NULL, ",")) {
+    int dist = 0;
+    while (dist < DIST_COUNT && strcmp(d, dist_names[dist])) {
+      dist++;
+    }
+    if (dist == DIST_COUNT) {
+      usage(argv[0]);
+    }
+    // strtok 중첩을 피하려고 sizes는 직접 자른다
+    for (const char *s = sizes; *s;) {
+      char *end;
+      const size_t n = strtoul(s, &end, 10);
+      if (end == s) {
+        usage(argv[0]);
+      }
+      if (n > 0) {
+        bench_one(dist, n);
+      }
+      s = *end == ',' ? end + 1 : end;
+    }
+  }
+  if (json_output) {
+    printf("%s\n", first_row ? "[]" : "\n]");
+  }
+  return 0;
+}
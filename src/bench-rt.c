@@ -0,0 +1,123 @@
+#include "rbtree.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+    실시간 경로용 latency 벤치마크 : 풀 트리(new_rbtree) vs static 트리(rbtree_init_static)
+    연산 하나하나의 시간을 재서 p50 / p99 / p99.9 / p99.99 / max 를 낸다
+    1. fill  : 빈 트리에 n개 insert (풀 트리는 chunk를 malloc 할 때 튄다)
+    2. churn : n개를 유지하면서 아무 노드 하나 erase, 새 key 하나 insert 를 ops번
+    static 트리의 버퍼는 재기 전에 한번 다 써서 page fault도 미리 낸다
+    usage : ./bench-rt [n] [ops]
+*/
+
+#if defined(RBTREE_COMPACT32)
+#define ALLOC_NAME "pool32"
+#else
+#define ALLOC_NAME "pool"
+#endif
+
+static uint64_t timer_overhead;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static int comp_u32(const void *p1, const void *p2) {
+  const uint32_t a = *(const uint32_t *)p1, b = *(const uint32_t *)p2;
+  return (a > b) - (a < b);
+}
+
+// 시계를 읽는 비용 (가장 작은 값)
+static uint64_t measure_timer_overhead(void) {
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < 10000; i++) {
+    const uint64_t t0 = now_ns();
+    const uint64_t d = now_ns() - t0;
+    best = d < best ? d : best;
+  }
+  return best;
+}
+
+static void report(const char *tree, const char *phase, uint32_t *lat, const size_t ops) {
+  qsort(lat, ops, sizeof(uint32_t), comp_u32);
+  printf("%-8s %-7s %-13s %9zu ops  p50 %6u  p99 %6u  p99.9 %6u  p99.99 %7u  max %8u ns\n",
+         ALLOC_NAME, tree, phase, ops, lat[ops / 2], lat[(size_t)(ops * 0.99)],
+         lat[(size_t)(ops * 0.999)], lat[(size_t)(ops * 0.9999)], lat[ops - 1]);
+}
+
+#define TIMED(lat, i, stmt)                                          \
+  do {                                                               \
+    const uint64_t t0_ = now_ns();                                   \
+    stmt;                                                            \
+    const uint64_t d_ = now_ns() - t0_;                              \
+    const uint64_t c_ = d_ > timer_overhead ? d_ - timer_overhead : 0; \
+    (lat)[i] = c_ > UINT32_MAX ? UINT32_MAX : (uint32_t)c_;          \
+  } while (0)
+
+static void run(const char *name, rbtree *t, const size_t n, const size_t ops) {
+  node_t **nodes = malloc(n * sizeof(node_t *));
+  uint32_t *lat = malloc((n > ops ? n : ops) * sizeof(uint32_t));
+  uint32_t *lat_erase = malloc(ops * sizeof(uint32_t));
+  uint64_t state = 17;
+
+  // 1.
+  for (size_t i = 0; i < n; i++) {
+    const key_t k = (key_t)splitmix64(&state);
+    TIMED(lat, i, nodes[i] = rbtree_insert(t, k));
+  }
+  report(name, "fill_insert", lat, n);
+
+  // 2.
+  for (size_t i = 0; i < ops; i++) {
+    const size_t j = splitmix64(&state) % n;
+    const key_t k = (key_t)splitmix64(&state);
+    TIMED(lat_erase, i, rbtree_erase(t, nodes[j]));
+    TIMED(lat, i, nodes[j] = rbtree_insert(t, k));
+  }
+  report(name, "churn_insert", lat, ops);
+  report(name, "churn_erase", lat_erase, ops);
+
+  free(lat_erase);
+  free(lat);
+  free(nodes);
+}
+
+int main(int argc, char *argv[]) {
+  const size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  const size_t ops = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+  if (n == 0 || ops == 0) {
+    fprintf(stderr, "usage : %s [n] [ops]\n", argv[0]);
+    return 2;
+  }
+  timer_overhead = measure_timer_overhead();
+
+  rbtree *t = new_rbtree();
+  run("heap", t, n, ops);
+  delete_rbtree(t);
+
+  rbtree st;
+  const size_t cap = RBTREE_STATIC_NODES(n);
+  node_t *buf = malloc(cap * sizeof(node_t));
+  if (buf == NULL || !rbtree_init_static(&st, buf, cap)) {
+    fprintf(stderr, "cannot set up %zu static nodes\n", cap);
+    return 1;
+  }
+  memset(buf + 1, 0, (cap - 1) * sizeof(node_t));  // sentinel은 init_static이 채웠다
+  run("static", &st, n, ops);
+  free(buf);
+  return 0;
+}
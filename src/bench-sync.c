@@ -0,0 +1,151 @@
+#include "rbtree.h"
+#include "rbtree_conc.h"
+#include "rbtree_sharded.h"
+#include "rbtree_sync.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+    여러 thread에서 같은 트리를 읽고 쓸 때의 처리량 비교
+    - mutex   : rbtree 호출마다 전역 mutex (지금까지 쓰던 방식)
+    - seqlock : rbtree_sync (reader는 lock 없음)
+    - coupled : rbtree_conc (writer도 경로의 노드만 잠근다. -DRBTREE_CONCURRENT로 빌드)
+    - sharded : rbtree_sharded (thread 수의 4배 shard. key가 [0, 2n)에 몰려있어서 경계가 재조정되며 퍼진다)
+    thread 수를 1, 2, 4 ... max 로 늘려가며 초당 처리한 연산 수를 찍는다
+    usage : ./bench-sync [n] [write%] [max threads] [ops per thread]
+*/
+
+typedef struct {
+  int mode;  // 0 : mutex, 1 : seqlock, 2 : coupled, 3 : sharded
+  rbtree *tree;
+  pthread_mutex_t *mutex;
+  rbtree_sync *sync;
+  rbtree_conc *conc;
+  rbtree_sharded *sharded;
+  size_t n, ops;
+  unsigned write_pct;
+  unsigned seed;
+  size_t found;
+} worker_t;
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// key 범위 [0, 2n) 에서 절반 정도가 들어있는 상태를 유지한다
+static void *worker(void *p) {
+  worker_t *w = p;
+  size_t found = 0;
+  for (size_t i = 0; i < w->ops; i++) {
+    const key_t key = rand_r(&w->seed) % (2 * w->n);
+    const int write = rand_r(&w->seed) % 100 < w->write_pct;
+    if (w->mode == 0) {
+      pthread_mutex_lock(w->mutex);
+      if (!write) {
+        found += rbtree_find(w->tree, key) != NULL;
+      } else if (key & 1) {
+        rbtree_insert(w->tree, key);
+      } else {
+        node_t *np = rbtree_find(w->tree, key);
+        if (np != NULL) {
+          rbtree_erase(w->tree, np);
+        }
+      }
+      pthread_mutex_unlock(w->mutex);
+    } else if (w->mode == 2) {
+      if (!write) {
+        found += rbtree_conc_find(w->conc, key);
+      } else if (key & 1) {
+        rbtree_conc_insert(w->conc, key);
+      } else {
+        rbtree_conc_erase(w->conc, key);
+      }
+    } else if (w->mode == 3) {
+      if (!write) {
+        found += rbtree_sharded_find(w->sharded, key);
+      } else if (key & 1) {
+        rbtree_sharded_insert(w->sharded, key);
+      } else {
+        rbtree_sharded_erase(w->sharded, key);
+      }
+    } else {
+      if (!write) {
+        found += rbtree_sync_find(w->sync, key);
+      } else if (key & 1) {
+        rbtree_sync_insert(w->sync, key);
+      } else {
+        rbtree_sync_erase(w->sync, key);
+      }
+    }
+  }
+  w->found = found;
+  return NULL;
+}
+
+static double run(const int mode, const size_t threads, const size_t n,
+                  const unsigned write_pct, const size_t ops) {
+  rbtree *t = new_rbtree();
+  rbtree_sync *s = rbtree_sync_new();
+  rbtree_conc *c = rbtree_conc_new();
+  rbtree_sharded *sh = rbtree_sharded_new(4 * threads);
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, 2 * i);
+    rbtree_sync_insert(s, 2 * i);
+    rbtree_conc_insert(c, 2 * i);
+    rbtree_sharded_insert(sh, 2 * i);
+  }
+
+  pthread_t *th = malloc(threads * sizeof(pthread_t));
+  worker_t *w = malloc(threads * sizeof(worker_t));
+  for (size_t i = 0; i < threads; i++) {
+    w[i] = (worker_t){mode, t, &mutex, s, c, sh, n, ops, write_pct, 17 + i, 0};
+  }
+  const double start = now_sec();
+  for (size_t i = 0; i < threads; i++) {
+    pthread_create(&th[i], NULL, worker, &w[i]);
+  }
+  for (size_t i = 0; i < threads; i++) {
+    pthread_join(th[i], NULL);
+  }
+  const double sec = now_sec() - start;
+
+  free(w);
+  free(th);
+  rbtree_sync_delete(s);
+  rbtree_conc_delete(c);
+  rbtree_sharded_delete(sh);
+  delete_rbtree(t);
+  return threads * ops / sec;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+  const unsigned write_pct = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+  const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  const size_t max_threads =
+      argc > 3 ? strtoul(argv[3], NULL, 10) : (cores > 0 ? cores : 1);
+  const size_t ops = argc > 4 ? strtoul(argv[4], NULL, 10) : 1000000;
+
+  printf("n = %zu, write = %u%%, %zu ops per thread, %ld cores\n", n, write_pct,
+         ops, cores);
+  printf("%-8s %12s %12s %12s %12s\n", "threads", "mutex", "seqlock", "coupled", "sharded");
+  for (size_t th = 1;; th = th * 2 < max_threads ? th * 2 : max_threads) {
+    const double m = run(0, th, n, write_pct, ops);
+    const double s = run(1, th, n, write_pct, ops);
+    const double c = run(2, th, n, write_pct, ops);
+    const double h = run(3, th, n, write_pct, ops);
+    printf("%-8zu %8.2f M/s %8.2f M/s %8.2f M/s %8.2f M/s\n", th, m / 1e6, s / 1e6,
+           c / 1e6, h / 1e6);
+    if (th >= max_threads) {
+      break;
+    }
+  }
+  return 0;
+}
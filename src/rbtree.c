@@ -1,62 +1,657 @@
 #include "rbtree.h"
 
+#include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
-
-node_t *new_node(color_t, key_t);
+#include <string.h>
+#ifdef RBTREE_COMPACT32
+#include <sys/mman.h>
+#endif
+
+node_t *new_node(rbtree *, color_t, key_t);
+void init_node(node_t *, color_t, key_t);
+node_t *reserve_nodes(rbtree *, size_t);
+void free_node(rbtree *, node_t *);
 void delete_node(rbtree *, node_t *);
 void left_rotate(rbtree *, node_t *);
 void right_rotate(rbtree *, node_t *);
-void rbtree_insert_fixup(const rbtree *, node_t *);
+void rbtree_insert_fixup(rbtree *, node_t *);
 void transplant(rbtree *, node_t *, node_t *);
 node_t *find_right_min(rbtree *, node_t *);
-void erase_fixup(rbtree *, node_t *);
-int inorder(const rbtree *, const node_t *, key_t *, int, const size_t );
+void erase_fixup(rbtree *, node_t *, node_t *);
+node_t *build_sorted(rbtree *, const key_t *, const size_t *, size_t, size_t, node_t *, int, int);
+static void left_rotate_at(rbtree *, node_t *, node_t **);
+static void right_rotate_at(rbtree *, node_t *, node_t **);
+static int insert_fixup_at(rbtree *, node_t *, node_t **);
+static node_t *insert_node(rbtree *, const key_t, const key_t);
+static node_t *successor(const rbtree *, const node_t *);
+static node_t *predecessor(const rbtree *, const node_t *);
+static node_t *lower_bound_at(const rbtree *, const key_t);
+static node_t *upper_bound_at(const rbtree *, const key_t);
+static void flush_tombstones(rbtree *);
+static void unbuild(rbtree *, node_t *, node_t *);
+#ifndef RBTREE_NO_POOL
+static int pool_init(node_pool_t *);
+static node_t *pool_alloc(node_pool_t *);
+static void pool_free(node_pool_t *, node_t *);
+static int pool_reserve(node_pool_t *, size_t);
+static void pool_destroy(node_pool_t *);
+#endif
+#if !defined(RBTREE_NO_POOL) && !defined(RBTREE_COMPACT32)
+static int pool_share(node_pool_t *, const node_pool_t *);
+node_chunk_t *release_chunks(rbtree *);
+#endif
+
+/*
+	계측 카운터 (RBTREE_STATS)
+	STAT_ADD / STAT_MAX는 t->stats의 필드를 올리고
+	STATS_ONLY(...)는 카운터용 지역 변수 같은 문장을 감싼다 
+	RBTREE_STATS가 없으면 모두 빈 문장이 된다 
+	find는 const 트리를 받으므로 카운터만 const를 떼고 쓴다 
+*/
+#ifdef RBTREE_STATS
+#define STAT_ADD(t, field, v) __atomic_fetch_add(&((rbtree *)(t))->stats.field, (v), __ATOMIC_RELAXED)
+#define STAT_MAX(t, field, v) stat_max(&((rbtree *)(t))->stats.field, (v))
+#define STATS_ONLY(...) __VA_ARGS__
+
+static inline void stat_max(size_t *field, const size_t v) {
+	size_t cur = __atomic_load_n(field, __ATOMIC_RELAXED);
+	while (v > cur && !__atomic_compare_exchange_n(field, &cur, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+#else
+#define STAT_ADD(t, field, v) ((void)0)
+#define STAT_MAX(t, field, v) ((void)0)
+#define STATS_ONLY(...)
+#endif
+
+/*
+	노드 수 (RBTREE_LAZY_DELETE : tombstone 비율을 보는 용도)
+	풀에서 꺼내고 반환하는 곳에서 센다. 병렬 집합 연산도 노드를 반환하므로 카운터처럼 atomic
+*/
+#ifdef RBTREE_LAZY_DELETE
+#define NODES_ADD(t, v) __atomic_fetch_add(&(t)->nodes, (v), __ATOMIC_RELAXED)
+#define NODES_SUB(t, v) __atomic_fetch_sub(&(t)->nodes, (v), __ATOMIC_RELAXED)
+#else
+#define NODES_ADD(t, v) ((void)0)
+#define NODES_SUB(t, v) ((void)0)
+#endif
+
+/*
+	FUNCTION : node_update	return : void
+	자식들을 보고 x의 augment 필드를 다시 계산 (RBTREE_ORDER_STAT : size, RBTREE_INTERVAL : max)
+	multiset이면 size는 노드 수가 아니라 count의 합
+	자식이 바뀐 노드마다 아래에서 위 순서로 불러준다 
+	augment 필드가 없으면 아무것도 하지 않는다 
+*/
+static inline void node_update(const rbtree *t, node_t *x) {
+#ifdef RBTREE_ORDER_STAT
+	x->size = rbtree_left(t, x)->size + rbtree_right(t, x)->size + rbtree_count(x);
+#endif
+#ifdef RBTREE_INTERVAL
+	key_t m = x->hi;
+	if (rbtree_left(t, x)->max > m) {
+		m = rbtree_left(t, x)->max;
+	}
+	if (rbtree_right(t, x)->max > m) {
+		m = rbtree_right(t, x)->max;
+	}
+	x->max = m;
+#endif
+}
+
+/*
+	FUNCTION : update_to_root	return : void
+	x부터 루트까지 올라가며 node_update
+*/
+static inline void update_to_root(const rbtree *t, node_t *x) {
+#if defined(RBTREE_ORDER_STAT) || defined(RBTREE_INTERVAL)
+	while (x != t->nil) {
+		node_update(t, x);
+		x = rbtree_parent(t, x);
+	}
+#endif
+}
+
+/*
+	FUNCTION : max_to_root	return : void
+	RBTREE_INTERVAL : x부터 루트까지 다시 계산 (아니면 아무것도 하지 않는다)
+	size는 내려가면서 +1 / -1 해두지만 max는 회전에서 다시 계산되면 그게 지워지므로
+	topdown / finger insert처럼 회전이 먼저 지나가는 곳은 다 붙인 뒤에 부른다 
+*/
+static inline void max_to_root(const rbtree *t, node_t *x) {
+#ifdef RBTREE_INTERVAL
+	update_to_root(t, x);
+#endif
+}
 
 /*
     FUNCTION : new    return : rbtree pointer
-    rbtree 생성 
+    rbtree 생성 (메모리가 부족하면 NULL)
     루트노드 생성은 insert에서 조건부로 담당
     구성요소에 NIL sentinel node 연결
     Sentinel node를 사용하여 구현했다면 test/Makefile에서 CFLAGS 변수에 -DSENTINEL이 추가되도록 comment를 제거해 줍니다.
 */
 rbtree *new_rbtree(void) {
     rbtree *p = (rbtree *)malloc(sizeof(rbtree));
+	if (p == NULL) {
+		return NULL;
+	}
+#ifdef RBTREE_STATS
+	memset(&p->stats, 0, sizeof(p->stats));
+#endif
+#ifdef RBTREE_LAZY_DELETE
+	p->nodes = 0;
+	p->dead = 0;
+#endif
+#ifndef RBTREE_NO_POOL
+	if (!pool_init(&p->pool)) {
+		free(p);
+		return NULL;
+	}
+#endif
     // sentinel node 
-    p->nil = new_node(RBTREE_BLACK, 0);
+    p->nil = new_node(p, RBTREE_BLACK, 0);
+	if (p->nil == NULL) {
+#ifndef RBTREE_NO_POOL
+		pool_destroy(&p->pool);
+#endif
+		free(p);
+		return NULL;
+	}
+#ifdef RBTREE_ORDER_STAT
+	p->nil->size = 0;
+#endif
+#ifdef RBTREE_INTERVAL
+	p->nil->max = INT_MIN;
+#endif
     p->root = p->nil;
+	p->version = 0;
     return p;
 
 }
 
 
 
+#ifndef RBTREE_NO_POOL
+/*
+	FUNCTION : init_static	return : fail 0 / success 1
+	부르는 쪽의 rbtree 구조체 t와 노드 배열 buf[capacity]로 빈 트리를 만든다 (malloc 없음)
+	1. 풀을 buf로 (chunk / mmap 대신)
+	2. sentinel은 buf[0]
+	capacity가 0이거나 (COMPACT32) index로 가리킬 수 없을 만큼 크면 0
+*/
+int rbtree_init_static(rbtree *t, node_t *buf, const size_t capacity) {
+	if (buf == NULL || capacity == 0) {
+		return 0;
+	}
+	// 1.
+#ifdef RBTREE_COMPACT32
+	if (capacity > ((size_t)1 << 31)) {	// parent index는 31bit
+		return 0;
+	}
+	t->pool.base = buf;
+	t->pool.cap = capacity;
+	t->pool.used = 0;
+	t->pool.free_list = 0;
+	t->pool.fixed = 1;
+#else
+	pool_init(&t->pool);
+	t->pool.fixed = buf;
+	t->pool.fixed_cap = capacity;
+#endif
+#ifdef RBTREE_STATS
+	memset(&t->stats, 0, sizeof(t->stats));
+#endif
+#ifdef RBTREE_LAZY_DELETE
+	t->nodes = 0;
+	t->dead = 0;
+#endif
+	// 2.
+	t->nil = new_node(t, RBTREE_BLACK, 0);
+#ifdef RBTREE_ORDER_STAT
+	t->nil->size = 0;
+#endif
+#ifdef RBTREE_INTERVAL
+	t->nil->max = INT_MIN;
+#endif
+	t->root = t->nil;
+	t->version = 0;
+	return 1;
+}
+#endif
+
+
+
+/*
+	FUNCTION : is_static	return : rbtree_init_static 트리면 1
+	노드를 다른 트리의 풀로 넘기거나 새 풀을 만드는 연산 (join / split / 집합 연산)은 하지 않는다
+*/
+static inline int is_static(const rbtree *t) {
+#if defined(RBTREE_NO_POOL)
+	return 0;
+#elif defined(RBTREE_COMPACT32)
+	return t->pool.fixed;
+#else
+	return t->pool.fixed != NULL;
+#endif
+}
+
+
+
+#if !defined(RBTREE_NO_POOL) && !defined(RBTREE_COMPACT32)
+// chunk 크기는 64개부터 시작해서 두배씩 키우되 최대 65536개
+#define POOL_CHUNK_MIN 64
+#define POOL_CHUNK_MAX 65536
+
+/*
+	FUNCTION : pool_init	return : fail 0 / success 1
+	빈 풀. group과 chunk는 첫 alloc 때 만든다 
+*/
+static int pool_init(node_pool_t *pool) {
+	pool->own = NULL;
+	pool->used = 0;
+	pool->free_list = NULL;
+	pool->shared = NULL;
+	pool->nshared = 0;
+	pool->shared_cap = 0;
+	pool->fixed = NULL;
+	pool->fixed_cap = 0;
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : pool_grow	return : fail 0 / success 1
+	cap개짜리 chunk를 새로 만들어 own group의 맨 앞에 붙인다 (group이 없으면 같이 만든다)
+*/
+static int pool_grow(node_pool_t *pool, const size_t cap) {
+	if (pool->own == NULL) {
+		pool->own = (node_group_t *)malloc(sizeof(node_group_t));
+		if (pool->own == NULL) {
+			return 0;
+		}
+		pool->own->chunks = NULL;
+		pool->own->refs = 1;
+	}
+	node_chunk_t *c = (node_chunk_t *)malloc(sizeof(node_chunk_t) + cap * sizeof(node_t));
+	if (c == NULL) {
+		return 0;
+	}
+	c->cap = cap;
+	c->next = pool->own->chunks;
+	pool->own->chunks = c;
+	pool->used = 0;
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : pool_alloc	return : node pointer
+	풀에서 노드 하나를 꺼내준다
+	1. free_list에 반환된 노드가 있으면 그것부터 재사용
+	2. 없으면 맨 앞 chunk에서 순서대로 꺼낸다
+	3. chunk가 다 찼으면 새 chunk를 만들어 맨 앞에 붙인다
+	fixed 배열 풀(rbtree_init_static)은 배열이 다 차면 NULL
+*/
+static node_t *pool_alloc(node_pool_t *pool) {
+	if (pool->free_list != NULL) {
+		node_t *np = pool->free_list;
+		pool->free_list = np->right;
+		return np;
+	}
+	if (pool->fixed != NULL) {
+		return pool->used < pool->fixed_cap ? &pool->fixed[pool->used++] : NULL;
+	}
+
+	node_chunk_t *head = pool->own != NULL ? pool->own->chunks : NULL;
+	if (head == NULL || pool->used == head->cap) {
+		size_t cap = POOL_CHUNK_MIN;
+		if (head != NULL && head->cap < POOL_CHUNK_MAX) {
+			cap = head->cap * 2;
+		} else if (head != NULL) {
+			cap = POOL_CHUNK_MAX;
+		}
+		if (!pool_grow(pool, cap)) {
+			return NULL;
+		}
+	}
+	return &pool->own->chunks->nodes[pool->used++];
+}
+
+
+
+/*
+	FUNCTION : pool_free	return : void
+	free_list 맨 앞에 (right 포인터로) 끼워둔다
+*/
+static void pool_free(node_pool_t *pool, node_t *np) {
+	RBTREE_STORE(np->right, pool->free_list);
+	pool->free_list = np;
+}
+
+
+
+/*
+	FUNCTION : pool_reserve	return : fail 0 / success 1
+	앞으로 n개의 노드를 하나의 연속된 chunk에서 꺼낼 수 있도록 준비
+	맨 앞 chunk의 남은 자리가 부족하면 딱 n개짜리 chunk를 새로 만든다
+	fixed 배열 풀은 남은 자리만 확인
+*/
+static int pool_reserve(node_pool_t *pool, size_t n) {
+	if (pool->fixed != NULL) {
+		return pool->fixed_cap - pool->used >= n;
+	}
+	if (pool->own != NULL && pool->own->chunks != NULL && pool->own->chunks->cap - pool->used >= n) {
+		return 1;
+	}
+	return pool_grow(pool, n < POOL_CHUNK_MIN ? POOL_CHUNK_MIN : n);
+}
+
+
+
+/*
+	FUNCTION : group_release	return : free 해야 할 chunk 목록 (group이 아직 쓰이면 NULL)
+	group을 든 트리가 하나 줄었다. 마지막이었으면 group을 풀고 chunk들을 돌려준다 
+*/
+static node_chunk_t *group_release(node_group_t *g) {
+	if (g == NULL || __atomic_sub_fetch(&g->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+		return NULL;
+	}
+	node_chunk_t *chunks = g->chunks;
+	free(g);
+	return chunks;
+}
+
+
+
+/*
+	FUNCTION : pool_release	return : free 해야 할 chunk 목록 (next로 연결)
+	풀이 든 group들을 모두 놓는다. 다른 트리가 아직 든 group의 chunk는 빠진다 
+	노드를 하나씩 풀어줄 필요 없이 돌려받은 chunk들만 free 하면 된다 
+	풀은 빈 풀이 된다 
+*/
+static node_chunk_t *pool_release(node_pool_t *pool) {
+	node_chunk_t *list = NULL;
+	for (size_t i = 0; i <= pool->nshared; i++) {
+		node_chunk_t *c = group_release(i == 0 ? pool->own : pool->shared[i - 1]);
+		while (c != NULL) {
+			node_chunk_t *next = c->next;
+			c->next = list;
+			list = c;
+			c = next;
+		}
+	}
+	free(pool->shared);
+	pool_init(pool);
+	return list;
+}
+
+// delete_rbtree_par가 chunk들을 나눠서 free 하도록
+node_chunk_t *release_chunks(rbtree *t) {
+	return pool_release(&t->pool);
+}
+
+
+
+/*
+	FUNCTION : pool_destroy	return : void
+	풀이 든 group을 놓고, 더 이상 아무도 들지 않은 chunk들을 통째로 free
+*/
+static void pool_destroy(node_pool_t *pool) {
+	node_chunk_t *c = pool_release(pool);
+	while (c != NULL) {
+		node_chunk_t *next = c->next;
+		free(c);
+		c = next;
+	}
+}
+
+
+
+/*
+	FUNCTION : pool_share	return : fail 0 / success 1
+	src 풀이 든 group들을 dst 풀도 들게 한다 (src의 노드를 dst로 넘기기 전에)
+	이미 든 group은 건너뛴다. group 수는 노드를 주고받은 트리 수 만큼이라 작다 
+	자리를 못 구하면 아무것도 바꾸지 않고 0
+*/
+static int pool_share(node_pool_t *dst, const node_pool_t *src) {
+	const size_t need = dst->nshared + src->nshared + 1;
+	if (need > dst->shared_cap) {
+		const size_t cap = need < 2 * dst->shared_cap ? 2 * dst->shared_cap : need;
+		node_group_t **shared = (node_group_t **)realloc(dst->shared, cap * sizeof(node_group_t *));
+		if (shared == NULL) {
+			return 0;
+		}
+		dst->shared = shared;
+		dst->shared_cap = cap;
+	}
+	for (size_t i = 0; i <= src->nshared; i++) {
+		node_group_t *g = i == 0 ? src->own : src->shared[i - 1];
+		int held = g == NULL || g == dst->own;
+		for (size_t j = 0; j < dst->nshared && !held; j++) {
+			held = dst->shared[j] == g;
+		}
+		if (!held) {
+			__atomic_add_fetch(&g->refs, 1, __ATOMIC_RELAXED);
+			dst->shared[dst->nshared++] = g;
+		}
+	}
+	return 1;
+}
+#endif
+
+
+
+#ifdef RBTREE_COMPACT32
+/*
+	FUNCTION : pool_init	return : fail 0 / success 1
+	RBTREE_COMPACT32_MAX_NODES 개 분량의 주소공간을 mmap으로 예약
+	MAP_NORESERVE라 실제로 건드린 page만 메모리를 차지한다 
+*/
+static int pool_init(node_pool_t *pool) {
+	pool->cap = RBTREE_COMPACT32_MAX_NODES;
+	if (pool->cap > ((size_t)1 << 31)) {	// parent index는 31bit
+		pool->cap = (size_t)1 << 31;
+	}
+	void *base = mmap(NULL, pool->cap * sizeof(node_t), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED) {
+		return 0;
+	}
+	pool->base = (node_t *)base;
+	pool->used = 0;
+	pool->free_list = 0;
+	pool->fixed = 0;
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : pool_alloc	return : node pointer
+	free_list 먼저, 없으면 배열 끝에서 하나 꺼낸다 
+	예약한 공간이 다 찼으면 NULL
+*/
+static node_t *pool_alloc(node_pool_t *pool) {
+	if (pool->free_list != 0) {
+		node_t *np = pool->base + pool->free_list;
+		pool->free_list = np->right;
+		return np;
+	}
+	if (pool->used == pool->cap) {
+		return NULL;
+	}
+	return pool->base + pool->used++;
+}
+
+
+
+/*
+	FUNCTION : pool_free	return : void
+	free_list 맨 앞에 (right index로) 끼워둔다
+*/
+static void pool_free(node_pool_t *pool, node_t *np) {
+	RBTREE_STORE(np->right, pool->free_list);
+	pool->free_list = (uint32_t)(np - pool->base);
+}
+
+
+
+/*
+	FUNCTION : pool_reserve	return : fail 0 / success 1
+	노드가 원래 배열 하나에 연속으로 있으므로 남은 자리만 확인
+*/
+static int pool_reserve(node_pool_t *pool, size_t n) {
+	return pool->cap - pool->used >= n;
+}
+
+
+
+/*
+	FUNCTION : pool_destroy	return : void
+	예약한 주소공간을 통째로 반환 (부르는 쪽 배열이면 그대로 둔다)
+*/
+static void pool_destroy(node_pool_t *pool) {
+	if (!pool->fixed) {
+		munmap(pool->base, pool->cap * sizeof(node_t));
+	}
+	pool->base = NULL;
+	pool->used = 0;
+	pool->free_list = 0;
+}
+#endif
+
+
+
 /*
     FUNCTION : new_node   return : node pointer 
     노드 생성 및 초기화 
+    트리의 노드 풀에서 꺼내온다 (RBTREE_NO_POOL이면 malloc)
+    풀이 가득 차면 NULL
 */
-node_t *new_node(color_t color, key_t key) {
+node_t *new_node(rbtree *t, color_t color, key_t key) {
+#ifndef RBTREE_NO_POOL
+    node_t *np = pool_alloc(&t->pool);
+#else
     node_t *np = (node_t *)malloc(sizeof(node_t));
-    np->color = color;
-    np->key = key;
-    np->left = NULL;
-    np->right = NULL;
-    np->parent = NULL;
+#endif
+    if (np == NULL) {
+        return NULL;
+    }
+    STAT_ADD(t, allocs, 1);
+    NODES_ADD(t, 1);
+    init_node(np, color, key);
     return np;
-}    
+}
+
+
+
+/*
+	FUNCTION : init_node	return : void
+	꺼내온 노드의 링크를 비우고 (NULL / index 0) 색, key, augment 필드를 채운다
+	재사용되는 노드는 rbtree_sync reader가 아직 밟고 있을 수 있어서 링크 / key / count는 relaxed atomic으로
+*/
+void init_node(node_t *np, color_t color, key_t key) {
+#if defined(RBTREE_COMPACT32)
+    // 링크는 모두 index 0 (= nil)
+    RBTREE_STORE(np->parent_color, 0);
+    RBTREE_STORE(np->left, 0);
+    RBTREE_STORE(np->right, 0);
+#elif defined(RBTREE_COMPACT)
+    RBTREE_STORE(np->parent_color, 0);
+    RBTREE_STORE(np->left, NULL);
+    RBTREE_STORE(np->right, NULL);
+#else
+    RBTREE_STORE(np->left, NULL);
+    RBTREE_STORE(np->right, NULL);
+    RBTREE_STORE(np->parent, NULL);
+#endif
+    rbtree_set_color(np, color);
+    RBTREE_STORE(np->key, key);
+#ifdef RBTREE_ORDER_STAT
+    np->size = 1;
+#endif
+#ifdef RBTREE_INTERVAL
+    np->hi = key;
+    np->max = key;
+#endif
+#ifdef RBTREE_MULTISET
+    RBTREE_STORE(np->count, 1);
+#endif
+#ifdef RBTREE_CONCURRENT
+    np->lock = 0;
+#endif
+#ifdef RBTREE_LAZY_DELETE
+    np->dead = 0;
+#endif
+}
+
+
+
+/*
+	FUNCTION : reserve_nodes	return : 연속된 노드 n개 중 첫 노드 / fail NULL
+	풀에서 노드 n개를 한 덩어리로 꺼낸다 (초기화는 부르는 쪽에서 init_node로)
+	자리만 먼저 잡아두면 여러 thread가 풀을 건드리지 않고 나눠서 채울 수 있다 (rbtree_parallel)
+	RBTREE_NO_POOL이면 연속된 자리가 없으므로 NULL
+*/
+node_t *reserve_nodes(rbtree *t, size_t n) {
+#ifndef RBTREE_NO_POOL
+	if (n == 0 || !pool_reserve(&t->pool, n)) {
+		return NULL;
+	}
+#ifdef RBTREE_COMPACT32
+	node_t *np = t->pool.base + t->pool.used;
+#else
+	node_t *np = t->pool.fixed != NULL ? &t->pool.fixed[t->pool.used] : &t->pool.own->chunks->nodes[t->pool.used];
+#endif
+	t->pool.used += n;
+	STAT_ADD(t, allocs, n);
+	NODES_ADD(t, n);
+	return np;
+#else
+	return NULL;
+#endif
+}
+
+
+
+/*
+	FUNCTION : free_node	return : void
+	노드 하나를 반환
+	풀을 쓰면 free_list로 돌려놓는다 
+*/
+void free_node(rbtree *t, node_t *np) {
+	STAT_ADD(t, frees, 1);
+	NODES_SUB(t, 1);
+#ifndef RBTREE_NO_POOL
+	pool_free(&t->pool, np);
+#else
+	free(np);
+#endif
+}
 
 
 
 /*
     FUNCTION : delete   return : void
     rbtree 전체 삭제 및 memory deallocation : free()
+    풀을 쓰면 노드를 순회하지 않고 chunk들만 free 한다
 */
 void delete_rbtree(rbtree *t) {
+#ifndef RBTREE_NO_POOL
+	// sentinel node도 풀 안에 있다
+	pool_destroy(&t->pool);
+#else
 	if (t->root != t->nil) {
 		// root node free -> subtree까지 free
 		delete_node(t, t->root);
 	}
     // sentinel node 까지 free
 	free(t->nil);
+#endif
     // finally, tree pointer free
     free(t);
 }
@@ -68,11 +663,12 @@ void delete_rbtree(rbtree *t) {
 	노드 내부 메모리 해방 
 	재귀적인 방식으로 l/r subtree 노드들 차례로 풀어준다 
 	이후 본인 free 
+	(RBTREE_NO_POOL 일 때만 사용)
 */
 void delete_node(rbtree* t, node_t *np) {
 	if (np != t->nil) {
-		delete_node(t, np->left);
-		delete_node(t, np->right);	
+		delete_node(t, rbtree_left(t, np));
+		delete_node(t, rbtree_right(t, np));	
 		free(np);
 	}
 }
@@ -92,34 +688,44 @@ void delete_node(rbtree* t, node_t *np) {
 	5. x부모까지 y로 설정 
 */
 void left_rotate(rbtree *t, node_t *x) {
-	node_t *y = x->right;	// set y
+	left_rotate_at(t, x, &t->root);
+}
+
+// 루트가 바뀌면 t->root 대신 *root에 쓴다 (떨어져 나온 서브트리용)
+static void left_rotate_at(rbtree *t, node_t *x, node_t **root) {
+	node_t *y = rbtree_right(t, x);	// set y
+	STAT_ADD(t, rotate_left, 1);
 
 	// 1. y의 서브트리를 x의 서브트리로 변환
-	x->right = y->left;		
+	rbtree_set_right(t, x, rbtree_left(t, y));		
 	// y의 왼쪽 서브트리가 있다면
 	// 그것을 x의 자식으로 설정 
 	// 없었으면 x 오른쪽 자식은 sentinel과 연결됨
-	if (y->left != t->nil) {
-		y->left->parent = x;	
+	if (rbtree_left(t, y) != t->nil) {
+		rbtree_set_parent(t, rbtree_left(t, y), x);	
 	}
 
 	// 2. y의 부모 설정
-	y->parent = x->parent;
+	rbtree_set_parent(t, y, rbtree_parent(t, x));
 
 	// 3. y 가 어느 위치의 자식인지 설정
-	if (x->parent == t->nil) {	//x가 루트노드였을 때
-		t->root = y;
-	} else if (x == x->parent->left) {//x가 왼쪽자식일 때 
-		x->parent->left = y;		//x의 부모 왼쪽자식에 y 연결
+	if (rbtree_parent(t, x) == t->nil) {	//x가 루트노드였을 때
+		RBTREE_STORE(*root, y);
+	} else if (x == rbtree_left(t, rbtree_parent(t, x))) {//x가 왼쪽자식일 때 
+		rbtree_set_left(t, rbtree_parent(t, x), y);		//x의 부모 왼쪽자식에 y 연결
 	} else {	// x가 오른쪽 자식일 때
-		x->parent->right = y;
+		rbtree_set_right(t, rbtree_parent(t, x), y);
 	}
 
 	// 4. y왼쪽에 x를 붙여준다 
-	y->left = x;
+	rbtree_set_left(t, y, x);
 
 	//5. x부모까지 y로 설정 
-	x->parent = y;
+	rbtree_set_parent(t, x, y);
+
+	// 6. 아래로 내려간 x부터 augment 필드 갱신
+	node_update(t, x);
+	node_update(t, y);
 }
 
 
@@ -136,34 +742,43 @@ void left_rotate(rbtree *t, node_t *x) {
 	5. y부모까지 x로 설정 
 */
 void right_rotate(rbtree *t, node_t *y) {
-	node_t *x = y->left;	// set x
+	right_rotate_at(t, y, &t->root);
+}
+
+static void right_rotate_at(rbtree *t, node_t *y, node_t **root) {
+	node_t *x = rbtree_left(t, y);	// set x
+	STAT_ADD(t, rotate_right, 1);
 
 	// 1. 베타를 y의 밑에 붙인다
-	y->left = x->right;
+	rbtree_set_left(t, y, rbtree_right(t, x));
 	// x의 오른쪽 서브트리가 있었다면
 	// 그것의 부모를 y로 설정 
 	// 없었으면 y의 왼쪽 자식은 sentinel 과 연결됨 
-	if (x->right != t->nil) {
-		x->right->parent = y;
+	if (rbtree_right(t, x) != t->nil) {
+		rbtree_set_parent(t, rbtree_right(t, x), y);
 	}
 
 	// 2. x의 부모를 설정하자 
-	x->parent = y->parent;
+	rbtree_set_parent(t, x, rbtree_parent(t, y));
 
 	// 3. x는 어느 위치의 자식인지 설정하자 
-	if (y->parent == t->nil) {	// y가 루트노드였을 때 
-		t->root = x;
-	} else if (y == y->parent->right) {//y가 오른쪽자식이었을때
-		y->parent->right = x;	// y의 부모 오른쪽에 x 연결 
+	if (rbtree_parent(t, y) == t->nil) {	// y가 루트노드였을 때 
+		RBTREE_STORE(*root, x);
+	} else if (y == rbtree_right(t, rbtree_parent(t, y))) {//y가 오른쪽자식이었을때
+		rbtree_set_right(t, rbtree_parent(t, y), x);	// y의 부모 오른쪽에 x 연결 
 	} else {	// y가 왼쪽자식이었을 때
-		y->parent->left = x;
+		rbtree_set_left(t, rbtree_parent(t, y), x);
 	}
 
 	// 4. x 오른쪽에 y를 붙여준다 
-	x->right = y;
+	rbtree_set_right(t, x, y);
 
 	// 5. y의 부모까지 x로 설정해준다 
-	y->parent = x;
+	rbtree_set_parent(t, y, x);
+
+	// 6. 아래로 내려간 y부터 augment 필드 갱신
+	node_update(t, y);
+	node_update(t, x);
 }
 
 
@@ -175,41 +790,98 @@ void right_rotate(rbtree *t, node_t *y) {
     BST 방식으로 노드가 들어갈 위치를 찾아준다 
     RED node 를 트리에 삽입해준다 
     **이미 같은 key의 값이 존재해도 하나 더 추가 합니다.**
+    (RBTREE_MULTISET이면 노드를 더 만들지 않고 그 노드의 count를 올려서 반환)
+    (RBTREE_LAZY_DELETE이면 내려가다 만난 같은 key의 tombstone을 되살려서 반환)
     삽입 후 insert_fixup 함수로 target node를 전달해서
     #4 성질이 깨진 트리 균형을 맞춰줄 것이다 
+    (RBTREE_INTERVAL이면 구간 [key, hi]. rbtree_insert는 [key, key])
 */
 node_t *rbtree_insert(rbtree *t, const key_t key) {
-    // key 키값을 가진 node 생성 
-	// insert시 색은 항상 RED
-	node_t *z = new_node(RBTREE_RED, key);
-	
+	return insert_node(t, key, key);
+}
+
+static node_t *insert_node(rbtree *t, const key_t key, const key_t hi) {
 	// TODO: implement insert
 	node_t *y = t->nil;
 	node_t *x = t->root;
+	STATS_ONLY(size_t depth = 0;)
 	while(x != t->nil) {
 		y = x;
-		if (z->key < x->key) {	// left branch로 진행
-			x = x->left;
+		STATS_ONLY(depth++;)
+#ifdef RBTREE_ORDER_STAT
+		x->size++;	// key가 이 서브트리에 들어간다 
+#endif
+#ifdef RBTREE_INTERVAL
+		if (x->max < hi) {	// 구간이 이 서브트리에 들어간다 
+			x->max = hi;
+		}
+#endif
+#ifdef RBTREE_LAZY_DELETE
+		if (key == x->key && x->dead) {	// 같은 key의 tombstone : 새 노드 대신 되살린다
+			x->dead = 0;
+			t->dead--;
+			STAT_ADD(t, inserts, 1);
+			STAT_ADD(t, insert_depth_sum, depth);
+			STAT_MAX(t, insert_depth_max, depth);
+			t->version++;
+			return x;
+		}
+#endif
+#ifdef RBTREE_MULTISET
+		if (key == x->key) {	// 이미 있는 key : count만 올린다 (경로의 size는 올려두었다)
+			RBTREE_STORE(x->count, x->count + 1);
+			STAT_ADD(t, inserts, 1);
+			STAT_ADD(t, insert_depth_sum, depth);
+			STAT_MAX(t, insert_depth_max, depth);
+			t->version++;
+			return x;
+		}
+#endif
+		if (key < x->key) {	// left branch로 진행
+			x = rbtree_left(t, x);
 		} else {
-			x = x->right;
+			x = rbtree_right(t, x);
+		}
+	}	//BST 방식으로 key가 들어갈 자리 찾기
+
+    // key 키값을 가진 node 생성 
+	// insert시 색은 항상 RED
+	node_t *z = new_node(t, RBTREE_RED, key);
+	if (z == NULL) {	// 풀이 가득 찼다 
+#ifdef RBTREE_ORDER_STAT
+		// 내려오며 올린 size를 되돌린다 
+		for (; y != t->nil; y = rbtree_parent(t, y)) {
+			y->size--;
 		}
-	}	//BST 방식으로 z가 들어갈 자리 찾기
-	z->parent = y;
+#endif
+		max_to_root(t, y);	// 내려오며 올린 max도 
+		return NULL;
+	}
+#ifdef RBTREE_INTERVAL
+	z->hi = hi;
+	z->max = hi;
+#endif
+	rbtree_set_parent(t, z, y);
 
 	if (y == t->nil) {	//CASE : root insert
-		t->root = z;
+		RBTREE_STORE(t->root, z);
 	} else if (z->key < y->key) {	//y의 left에 부착
-		y->left = z;
+		rbtree_set_left(t, y, z);
 	} else {	// zkey가 ykey보다 크거나같은 경우 right에 부착
-		y->right = z;
+		rbtree_set_right(t, y, z);
 	}
 	
 	//insert시에는 z가 항상 leafnode가 되므로, sentinel 연결해주기
-	z->left = t->nil;
-	z->right = t->nil;
+	rbtree_set_left(t, z, t->nil);
+	rbtree_set_right(t, z, t->nil);
+
+	STAT_ADD(t, inserts, 1);
+	STAT_ADD(t, insert_depth_sum, depth);
+	STAT_MAX(t, insert_depth_max, depth);
 
 	//insert fixup으로 자료전달
 	rbtree_insert_fixup(t, z);
+	t->version++;
 
     return z;
 }
@@ -223,50 +895,64 @@ node_t *rbtree_insert(rbtree *t, const key_t key) {
     CASE3로 수렴하도록 한다 
     CASE 3에서 graynode를 해결해 트리 균형을 맞춰준다 
 */
-void rbtree_insert_fixup(const rbtree *t, node_t *z) {
-	while (z->parent->color == RBTREE_RED) {
-		if (z->parent == z->parent->parent->left) {
+void rbtree_insert_fixup(rbtree *t, node_t *z) {
+	insert_fixup_at(t, z, &t->root);
+}
+
+// *root를 루트로 하는 (서브)트리에서 fixup
+// 마지막에 RED였던 루트를 BLACK으로 바꿨으면 (black height가 1 늘었으면) 1
+static int insert_fixup_at(rbtree *t, node_t *z, node_t **root) {
+	while (rbtree_color(rbtree_parent(t, z)) == RBTREE_RED) {
+		if (rbtree_parent(t, z) == rbtree_left(t, rbtree_parent(t, rbtree_parent(t, z)))) {
 			//z의 부모가 할아버지의 왼쪽자식일 때
-			node_t *y = z->parent->parent->right;
-			if (y->color == RBTREE_RED) {	//CASE 1 : angry uncle
-				z->parent->color = RBTREE_BLACK;
-				y->color = RBTREE_BLACK;
-				z->parent->parent->color = RBTREE_RED;
+			node_t *y = rbtree_right(t, rbtree_parent(t, rbtree_parent(t, z)));
+			if (rbtree_color(y) == RBTREE_RED) {	//CASE 1 : angry uncle
+				STAT_ADD(t, insert_case[0], 1);
+				rbtree_set_color(rbtree_parent(t, z), RBTREE_BLACK);
+				rbtree_set_color(y, RBTREE_BLACK);
+				rbtree_set_color(rbtree_parent(t, rbtree_parent(t, z)), RBTREE_RED);
 				// 이후 if-else문 탈출해서 다시 CASE확인 
 				// 할아버지에게 문제를 미룬다 
-				z = z->parent->parent;
+				z = rbtree_parent(t, rbtree_parent(t, z));
 			} else {
-				if (z == z->parent->right) {//CASE 2 : 삼각형
-					z = z->parent;
-					left_rotate(t, z);
+				if (z == rbtree_right(t, rbtree_parent(t, z))) {//CASE 2 : 삼각형
+					STAT_ADD(t, insert_case[1], 1);
+					z = rbtree_parent(t, z);
+					left_rotate_at(t, z, root);
 				}	// rotation 후 CASE 3으로 진행
 				//CASE 3 : 일직선
-				z->parent->color = RBTREE_BLACK;
-				z->parent->parent->color = RBTREE_RED;
-				right_rotate(t, z->parent->parent);
+				STAT_ADD(t, insert_case[2], 1);
+				rbtree_set_color(rbtree_parent(t, z), RBTREE_BLACK);
+				rbtree_set_color(rbtree_parent(t, rbtree_parent(t, z)), RBTREE_RED);
+				right_rotate_at(t, rbtree_parent(t, rbtree_parent(t, z)), root);
 			}
 		} else { //z의 부모가 할아버지의 오른쪽자식일 때
-			node_t *y = z->parent->parent->left;
-			if (y->color == RBTREE_RED) {	//CASE 1 : angry uncle
-				z->parent->color = RBTREE_BLACK;
-				y->color = RBTREE_BLACK;
-				z->parent->parent->color = RBTREE_RED;
+			node_t *y = rbtree_left(t, rbtree_parent(t, rbtree_parent(t, z)));
+			if (rbtree_color(y) == RBTREE_RED) {	//CASE 1 : angry uncle
+				STAT_ADD(t, insert_case[0], 1);
+				rbtree_set_color(rbtree_parent(t, z), RBTREE_BLACK);
+				rbtree_set_color(y, RBTREE_BLACK);
+				rbtree_set_color(rbtree_parent(t, rbtree_parent(t, z)), RBTREE_RED);
 				// 이후 if-else문 탈출해서 다시 CASE확인 
 				// 할아버지에게 문제를 미룬다 
-				z = z->parent->parent;
+				z = rbtree_parent(t, rbtree_parent(t, z));
 			} else {
-				if (z == z->parent->left) {//CASE 2 : 삼각형
-					z = z->parent;
-					right_rotate(t, z);
+				if (z == rbtree_left(t, rbtree_parent(t, z))) {//CASE 2 : 삼각형
+					STAT_ADD(t, insert_case[1], 1);
+					z = rbtree_parent(t, z);
+					right_rotate_at(t, z, root);
 				}	// rotation 후 CASE 3으로 진행
 				//CASE 3 : 일직선
-				z->parent->color = RBTREE_BLACK;
-				z->parent->parent->color = RBTREE_RED;
-				left_rotate(t, z->parent->parent);
+				STAT_ADD(t, insert_case[2], 1);
+				rbtree_set_color(rbtree_parent(t, z), RBTREE_BLACK);
+				rbtree_set_color(rbtree_parent(t, rbtree_parent(t, z)), RBTREE_RED);
+				left_rotate_at(t, rbtree_parent(t, rbtree_parent(t, z)), root);
 			}
 		}
 	}
-	t->root->color = RBTREE_BLACK;
+	const int grew = rbtree_color(*root) == RBTREE_RED;
+	rbtree_set_color(*root, RBTREE_BLACK);
+	return grew;
 }
 /*
 	CASE 1 의 목표 : z의 부모와 삼촌을 BLACK으로 바꾸고, 
@@ -285,91 +971,657 @@ void rbtree_insert_fixup(const rbtree *t, node_t *z) {
 
 
 
+//++++++++++++++++++++++++bulk load 구현++++++++++++++++++++++++++
+
 /*
-    FUNCTION : find   return : node pointer
-    readonly function
-    RB tree내에 해당 key가 있는지 탐색하여 있으면 해당 node pointer 반환
-    해당하는 node가 없으면 NULL 반환
+	FUNCTION : from_sorted	return : rbtree pointer
+	정렬된 배열로 균형잡힌 rbtree를 O(n)에 만든다
+	insert / insert_fixup / 회전을 전혀 쓰지 않는다 
+	1. 노드 n개를 풀의 chunk 하나에 한번에 확보
+	2. 가운데 원소를 루트로 삼아 좌우를 재귀적으로 만든다
+	   (좌우 서브트리 크기 차이가 1 이하라서 마지막 level만 덜 차있다)
+	3. 마지막 level이 꽉 차있지 않으면 그 level의 노드만 RED, 나머지는 BLACK
+	   -> 모든 NIL까지의 경로에 BLACK이 같은 수만큼 있다 
+	arr는 오름차순이어야 한다 (같은 key는 허용). 메모리가 부족하면 NULL
+	RBTREE_MULTISET이면 같은 key를 먼저 하나로 모으고 (key, count) 배열로 세운다 
 */
-node_t *rbtree_find(const rbtree *t, const key_t key) {
-	if (!t || !(t->root)) {	//tree 구성 전
-		return NULL;
-	} else {
-		node_t *temp = t->root;
-		while(temp != t->nil) {
-			if (key == temp->key) {//찾았다!
-				return temp;
-			} else if (key < temp->key) {	//left branch로 진행
-				temp = temp->left;
-			} else {	// right branch 로 진행
-				temp = temp->right;
-			}
-		} 
-		// 끝까지 찾았는데 없었다! ==> temp == t->nil
+rbtree *rbtree_from_sorted(const key_t *arr, size_t n) {
+	rbtree *t = new_rbtree();
+	if (t == NULL || n == 0) {
+		return t;
+	}
+	const size_t *counts = NULL;
+#ifdef RBTREE_MULTISET
+	key_t *uniq = (key_t *)malloc(n * sizeof(key_t));
+	size_t *runs = (size_t *)malloc(n * sizeof(size_t));
+	if (uniq == NULL || runs == NULL) {
+		free(uniq);
+		free(runs);
+		delete_rbtree(t);
 		return NULL;
 	}
-}
-
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (m > 0 && uniq[m - 1] == arr[i]) {
+			runs[m - 1]++;
+		} else {
+			uniq[m] = arr[i];
+			runs[m++] = 1;
+		}
+	}
+	arr = uniq;
+	counts = runs;
+	n = m;
+#endif
+#ifndef RBTREE_NO_POOL
+	if (!pool_reserve(&t->pool, n)) {
+		delete_rbtree(t);
+		t = NULL;
+	}
+#endif
 
+	if (t != NULL) {
+		// 가장 깊은 level (root = 0)
+		int depth = 0;
+		while (((size_t)2 << depth) - 1 < n) {
+			depth++;
+		}
+		// 꽉 찬 트리면 RED 노드가 필요없다 
+		int red_depth = (((size_t)2 << depth) - 1 == n) ? -1 : depth;
+
+		node_t *root = build_sorted(t, arr, counts, 0, n, t->nil, 0, red_depth);
+		if (root == NULL) {
+			// 만들다 만 노드는 build_sorted가 이미 반환했다
+			delete_rbtree(t);
+			t = NULL;
+		} else {
+			t->root = root;
+		}
+	}
+#ifdef RBTREE_MULTISET
+	free(uniq);
+	free(runs);
+#endif
+	return t;
+}
 
 
 
 /*
-    FUNCTION : find minimal   return : node pointer
-    입력받은 tree 전체에서 key최소값을 가지는 node 반환   
+	FUNCTION : build_sorted	return : subtree root node pointer / 노드를 못 만들면 NULL
+	arr[lo, hi) 구간으로 서브트리를 만들어 그 루트를 반환
+	counts는 multiset일 때 arr[i]의 개수 (아니면 NULL)
+	왼쪽 서브트리 -> 본인 -> 오른쪽 순서로 노드를 꺼내므로
+	chunk 안에서 노드들이 key 순서대로 나란히 놓인다 
 */
-node_t *rbtree_min(const rbtree *t) {
-	node_t *temp = t->root;
-	while (temp->left != t->nil) {
-		temp = temp->left;
+node_t *build_sorted(rbtree *t, const key_t *arr, const size_t *counts, size_t lo, size_t hi, node_t *parent, int depth, int red_depth) {
+	if (lo >= hi) {
+		return t->nil;
+	}
+	size_t mid = lo + (hi - lo) / 2;
+
+	node_t *left = build_sorted(t, arr, counts, lo, mid, t->nil, depth + 1, red_depth);
+	if (left == NULL) {
+		return NULL;
+	}
+	node_t *np = new_node(t, depth == red_depth ? RBTREE_RED : RBTREE_BLACK, arr[mid]);
+	if (np == NULL) {
+		unbuild(t, left, NULL);
+		return NULL;
+	}
+#ifdef RBTREE_MULTISET
+	np->count = counts[mid];
+#endif
+	rbtree_set_parent(t, np, parent);
+	rbtree_set_left(t, np, left);
+	if (left != t->nil) {
+		rbtree_set_parent(t, left, np);
 	}
-    return temp;
+	node_t *right = build_sorted(t, arr, counts, mid + 1, hi, np, depth + 1, red_depth);
+	if (right == NULL) {
+		unbuild(t, left, np);
+		return NULL;
+	}
+	rbtree_set_right(t, np, right);
+	node_update(t, np);
+	return np;
 }
 
 
 
 /*
-    FUNCTION : find maximum   return : node pointer
-    입력받은 tree 전체에서 key최대값을 가지는 node 반환   
+	FUNCTION : unbuild	return : void
+	build_sorted가 도중에 실패하면 이미 만든 서브트리 x와 노드 np (없으면 NULL)를 반환한다
+	풀을 쓰면 delete_rbtree가 chunk째로 반환하므로 할 일이 없다 (노드는 pool_reserve로 미리 확보돼서 실패하지도 않는다)
 */
-node_t *rbtree_max(const rbtree *t) {
-    node_t *temp = t->root;
-	while (temp->right != t->nil) {
-		temp = temp->right;
-	}
-    return temp;
+static void unbuild(rbtree *t, node_t *x, node_t *np) {
+#ifdef RBTREE_NO_POOL
+	delete_node(t, x);
+	free(np);
+#else
+	(void)t;
+	(void)x;
+	(void)np;
+#endif
 }
 
 
 
-/*
+static int key_comp(const void *p1, const void *p2) {
+	const key_t a = *(const key_t *)p1;
+	const key_t b = *(const key_t *)p2;
+	return (a > b) - (a < b);
+}
+
+/*
+	FUNCTION : from_unsorted	return : rbtree pointer
+	정렬되지 않은 배열을 복사해서 정렬한 뒤 from_sorted로 만든다 
+	원본 arr는 건드리지 않는다 
+*/
+rbtree *rbtree_from_unsorted(const key_t *arr, size_t n) {
+	key_t *sorted = (key_t *)malloc((n ? n : 1) * sizeof(key_t));
+	if (sorted == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < n; i++) {
+		sorted[i] = arr[i];
+	}
+	qsort(sorted, n, sizeof(key_t), key_comp);
+
+	rbtree *t = rbtree_from_sorted(sorted, n);
+	free(sorted);
+	return t;
+}
+
+
+
+/*
+	FUNCTION : skip_dead	return : node pointer
+	p부터 순회 방향(forward : 1 다음 / 0 이전)으로 처음 만나는 tombstone이 아닌 노드. 없으면 NULL
+	lazy delete mode가 아니면 p를 그대로 돌려준다
+*/
+static inline node_t *skip_dead(const rbtree *t, node_t *p, const int forward) {
+	while (p != NULL && rbtree_is_dead(p)) {
+		p = forward ? successor(t, p) : predecessor(t, p);
+	}
+	return p;
+}
+
+// key 노드들 중 tombstone이 아닌 첫 노드 (find가 tombstone을 만났을 때)
+static node_t *find_live(const rbtree *t, const key_t key) {
+	node_t *p = skip_dead(t, lower_bound_at(t, key), 1);
+	return p != NULL && p->key == key ? p : NULL;
+}
+
+
+
+/*
+    FUNCTION : find   return : node pointer
+    readonly function
+    RB tree내에 해당 key가 있는지 탐색하여 있으면 해당 node pointer 반환
+    해당하는 node가 없으면 NULL 반환
+    tombstone은 없는 노드로 본다
+*/
+node_t *rbtree_find(const rbtree *t, const key_t key) {
+	if (!t || !(t->root)) {	//tree 구성 전
+		return NULL;
+	} else {
+		node_t *temp = t->root;
+		STATS_ONLY(size_t depth = 0;)
+		while(temp != t->nil) {
+			STATS_ONLY(depth++;)
+			if (key == temp->key) {//찾았다!
+				STAT_ADD(t, finds, 1);
+				STAT_ADD(t, find_depth_sum, depth);
+				STAT_MAX(t, find_depth_max, depth);
+				if (rbtree_is_dead(temp)) {	// tombstone : 같은 key의 살아있는 노드가 있으면 그것
+					return find_live(t, key);
+				}
+				return temp;
+			} else if (key < temp->key) {	//left branch로 진행
+				temp = rbtree_left(t, temp);
+			} else {	// right branch 로 진행
+				temp = rbtree_right(t, temp);
+			}
+		} 
+		// 끝까지 찾았는데 없었다! ==> temp == t->nil
+		STAT_ADD(t, finds, 1);
+		STAT_ADD(t, find_depth_sum, depth);
+		STAT_MAX(t, find_depth_max, depth);
+		return NULL;
+	}
+}
+
+
+
+
+/*
+    FUNCTION : find_many   return : 찾은 key 개수
+    keys[i]를 찾은 노드(없으면 NULL)를 out[i]에 넣는다 (rbtree_find를 n번 부른 것과 같은 답)
+    find 하나는 매 level마다 다음 노드가 메모리에서 올 때까지 기다리므로
+    FIND_MANY_LANES 개의 key를 번갈아 한 level씩 내려간다 (AMAC)
+    1. 각 lane은 key 하나의 현재 노드를 들고있다
+    2. lane을 돌아가며 한 level 내려가고, 다음 노드를 prefetch만 해두고 다음 lane으로
+       그 노드는 다시 차례가 올 때쯤 cache에 와있다
+    3. 끝난 lane(찾았거나 NIL)에는 바로 다음 key를 넣어 lane들이 계속 일하게 한다
+*/
+#define FIND_MANY_LANES 16
+
+size_t rbtree_find_many(const rbtree *t, const key_t *keys, const size_t n, node_t **out) {
+	node_t *cur[FIND_MANY_LANES];
+	size_t idx[FIND_MANY_LANES];
+	size_t next = 0, active = 0, found = 0;
+
+	for (int l = 0; l < FIND_MANY_LANES; l++) {
+		if (next < n) {
+			cur[l] = t->root;
+			idx[l] = next++;
+			active++;
+		} else {
+			idx[l] = n;	// 빈 lane
+		}
+	}
+
+	while (active > 0) {
+		for (int l = 0; l < FIND_MANY_LANES; l++) {
+			if (idx[l] == n) {
+				continue;
+			}
+			node_t *x = cur[l];
+			const key_t key = keys[idx[l]];
+			if (x != t->nil && key != x->key) {	// 한 level 내려가고 prefetch
+				x = key < x->key ? rbtree_left(t, x) : rbtree_right(t, x);
+				__builtin_prefetch(x);
+				cur[l] = x;
+				continue;
+			}
+			// 이 key는 끝났다
+			if (x != t->nil && rbtree_is_dead(x)) {
+				x = find_live(t, key);
+				x = x == NULL ? t->nil : x;
+			}
+			if (x == t->nil) {
+				out[idx[l]] = NULL;
+			} else {
+				out[idx[l]] = x;
+				found++;
+			}
+			if (next < n) {
+				cur[l] = t->root;
+				idx[l] = next++;
+			} else {
+				idx[l] = n;
+				active--;
+			}
+		}
+	}
+	return found;
+}
+
+
+
+
+
+/*
+    FUNCTION : find minimal   return : node pointer
+    입력받은 tree 전체에서 key최소값을 가지는 node 반환   
+    tombstone은 건너뛴다 (전부 tombstone이면 NULL)
+*/
+node_t *rbtree_min(const rbtree *t) {
+	node_t *temp = t->root;
+	while (rbtree_left(t, temp) != t->nil) {
+		temp = rbtree_left(t, temp);
+	}
+    return skip_dead(t, temp, 1);
+}
+
+
+
+/*
+    FUNCTION : find maximum   return : node pointer
+    입력받은 tree 전체에서 key최대값을 가지는 node 반환   
+    tombstone은 건너뛴다 (전부 tombstone이면 NULL)
+*/
+node_t *rbtree_max(const rbtree *t) {
+    node_t *temp = t->root;
+	while (rbtree_right(t, temp) != t->nil) {
+		temp = rbtree_right(t, temp);
+	}
+    return skip_dead(t, temp, 0);
+}
+
+
+
+/*
     FUNCTION : to_array   return : fail 0 / success 1
     RB tree의 내용을 key 순서대로 주어진 array로 변환
     array의 크기는 n으로 주어지며 tree의 크기가 n 보다 큰 경우에는 순서대로 n개 까지만 변환
     array의 메모리 공간은 이 함수를 부르는 쪽에서 준비하고 그 크기를 n으로 알려줍니다.
+    재귀 없이 iterator로 순회하고, n개를 채우면 바로 멈춘다 
+    multiset이면 노드마다 key를 count번 채운다 
 */
 int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
-    if (inorder(t, t->root, arr, 0, n) > 0) {
-		return 1;
-	} else {
-		return 0;
+	size_t index = 0;
+	for (node_t *p = rbtree_iter_begin(t); p != NULL && index < n; p = rbtree_iter_next(t, p)) {
+		for (size_t c = rbtree_count(p); c > 0 && index < n; c--) {
+			arr[index++] = p->key;
+		}
 	}
+	return index > 0;
 }
 
-int inorder(const rbtree *t, const node_t *np, key_t *arr, int index, const size_t n) {
-	if (np == t->nil) {
-		return index;
-	} else if (index == n) {
-		return index;
+
+
+//++++++++++++++++++++++++iterator 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : iter_begin	return : node pointer
+	key가 가장 작은 노드 (순회 시작점)
+	빈 트리면 NULL
+*/
+node_t *rbtree_iter_begin(const rbtree *t) {
+	if (t->root == t->nil) {
+		return NULL;
 	}
+	return rbtree_min(t);
+}
 
-	index = inorder(t, np->left, arr, index, n);
-	*(arr + index) = np->key;
-	index += 1;
-	index = inorder(t, np->right, arr, index, n);
-	
-	return index;
+
+
+/*
+	FUNCTION : iter_last	return : node pointer
+	key가 가장 큰 노드 (역순회 시작점)
+	빈 트리면 NULL
+*/
+node_t *rbtree_iter_last(const rbtree *t) {
+	if (t->root == t->nil) {
+		return NULL;
+	}
+	return rbtree_max(t);
+}
+
+
+
+/*
+	FUNCTION : iter_next	return : node pointer
+	p의 successor를 부모 포인터를 따라 찾는다. 추가 메모리 O(1) 
+	1. 오른쪽 서브트리가 있으면 그 서브트리의 최소노드
+	2. 없으면 내가 왼쪽자식이 되는 조상이 나올 때까지 올라간다 
+	마지막 노드였으면 NULL
+	tombstone은 건너뛴다 (RBTREE_LAZY_DELETE)
+*/
+node_t *rbtree_iter_next(const rbtree *t, const node_t *p) {
+	return skip_dead(t, successor(t, p), 1);
+}
+
+
+
+/*
+	FUNCTION : iter_prev	return : node pointer
+	iter_next의 좌우 대칭 : p의 predecessor
+	첫 노드였으면 NULL
+*/
+node_t *rbtree_iter_prev(const rbtree *t, const node_t *p) {
+	return skip_dead(t, predecessor(t, p), 0);
+}
+
+
+
+// tombstone까지 모두 보는 successor / predecessor (iter_next / iter_prev가 감싼다)
+static node_t *successor(const rbtree *t, const node_t *p) {
+	if (rbtree_right(t, p) != t->nil) {
+		p = rbtree_right(t, p);
+		while (rbtree_left(t, p) != t->nil) {
+			p = rbtree_left(t, p);
+		}
+		return (node_t *)p;
+	}
+	node_t *y = rbtree_parent(t, p);
+	while (y != t->nil && p == rbtree_right(t, y)) {
+		p = y;
+		y = rbtree_parent(t, y);
+	}
+	return y == t->nil ? NULL : y;
+}
+
+
+
+static node_t *predecessor(const rbtree *t, const node_t *p) {
+	if (rbtree_left(t, p) != t->nil) {
+		p = rbtree_left(t, p);
+		while (rbtree_right(t, p) != t->nil) {
+			p = rbtree_right(t, p);
+		}
+		return (node_t *)p;
+	}
+	node_t *y = rbtree_parent(t, p);
+	while (y != t->nil && p == rbtree_left(t, y)) {
+		p = y;
+		y = rbtree_parent(t, y);
+	}
+	return y == t->nil ? NULL : y;
+}
+
+
+
+//++++++++++++++++++++++++범위 검색 구현++++++++++++++++++++++++++
+
+/*
+	FUNCTION : lower_bound	return : node pointer
+	key 이상인 노드 중 가장 작은 노드. 없으면 NULL
+	find처럼 루트부터 내려가되, 조건을 만족하는 후보를 기억하며 왼쪽으로 더 내려간다 
+	같은 key가 여러개면 그 중 순회상 첫번째 노드 
+	tombstone이면 그 다음의 살아있는 노드
+*/
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key) {
+	return skip_dead(t, lower_bound_at(t, key), 1);
+}
+
+static node_t *lower_bound_at(const rbtree *t, const key_t key) {
+	node_t *result = NULL;
+	node_t *temp = t->root;
+	while (temp != t->nil) {
+		if (temp->key >= key) {	// 후보! 더 작은게 있는지 왼쪽으로
+			result = temp;
+			temp = rbtree_left(t, temp);
+		} else {
+			temp = rbtree_right(t, temp);
+		}
+	}
+	return result;
+}
+
+
+
+/*
+	FUNCTION : upper_bound	return : node pointer
+	key 초과인 노드 중 가장 작은 노드. 없으면 NULL
+*/
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key) {
+	return skip_dead(t, upper_bound_at(t, key), 1);
+}
+
+static node_t *upper_bound_at(const rbtree *t, const key_t key) {
+	node_t *result = NULL;
+	node_t *temp = t->root;
+	while (temp != t->nil) {
+		if (temp->key > key) {
+			result = temp;
+			temp = rbtree_left(t, temp);
+		} else {
+			temp = rbtree_right(t, temp);
+		}
+	}
+	return result;
+}
+
+
+
+/*
+	FUNCTION : range	return : 복사한 key 개수
+	[lo, hi] 구간(양끝 포함)의 key들을 순서대로 out에 복사
+	최대 cap개까지만 복사한다 
+	lower_bound로 시작점을 찾고 iterator로 진행 : O(log n + k)
+	multiset이면 to_array처럼 key를 count번 복사한다 
+*/
+size_t rbtree_range(const rbtree *t, const key_t lo, const key_t hi, key_t *out, const size_t cap) {
+	size_t count = 0;
+	for (node_t *p = rbtree_lower_bound(t, lo); p != NULL && p->key <= hi && count < cap; p = rbtree_iter_next(t, p)) {
+		for (size_t c = rbtree_count(p); c > 0 && count < cap; c--) {
+			out[count++] = p->key;
+		}
+	}
+	return count;
+}
+
+
+
+/*
+	FUNCTION : range_foreach	return : 방문한 노드 개수
+	[lo, hi] 구간의 노드들을 순서대로 visit(node, arg)에 넘겨준다 (복사 없음)
+	visit이 0이 아닌 값을 돌려주면 거기서 멈춘다 
+	visit 안에서 트리를 수정하면 안된다 
+*/
+size_t rbtree_range_foreach(const rbtree *t, const key_t lo, const key_t hi, rbtree_visit_t visit, void *arg) {
+	size_t count = 0;
+	for (node_t *p = rbtree_lower_bound(t, lo); p != NULL && p->key <= hi; p = rbtree_iter_next(t, p)) {
+		count++;
+		if (visit(p, arg)) {
+			break;
+		}
+	}
+	return count;
+}
+
+
+
+#ifdef RBTREE_ORDER_STAT
+//++++++++++++++++++++++++order statistic 구현++++++++++++++++++++++++
+
+/*
+	FUNCTION : size	return : 트리의 노드 개수
+	루트의 size 필드라 O(1)
+*/
+size_t rbtree_size(const rbtree *t) {
+	return t->root->size;
+}
+
+
+
+/*
+	FUNCTION : select	return : node pointer
+	순회 순서로 k번째 (0부터 셈) 노드. k >= size 면 NULL
+	왼쪽 서브트리 크기와 비교하며 내려간다 : O(log n)
+	multiset이면 k번째 key를 들고있는 노드 (노드 하나가 count개 자리를 차지)
+	ex) p99 = rbtree_select(t, rbtree_size(t) * 99 / 100)
+*/
+node_t *rbtree_select(const rbtree *t, size_t k) {
+	node_t *temp = t->root;
+	while (temp != t->nil) {
+		size_t left = rbtree_left(t, temp)->size;
+		if (k < left) {
+			temp = rbtree_left(t, temp);
+		} else if (k < left + rbtree_count(temp)) {	//찾았다!
+			return temp;
+		} else {	// 왼쪽 서브트리와 본인을 건너뛴다 
+			k -= left + rbtree_count(temp);
+			temp = rbtree_right(t, temp);
+		}
+	}
+	return NULL;
+}
+
+
+
+/*
+	FUNCTION : rank	return : key보다 작은 key의 개수
+	= lower_bound(key)가 순회 순서로 몇번째인지 
+	오른쪽으로 내려갈 때마다 왼쪽 서브트리와 본인을 더해준다 : O(log n)
+*/
+size_t rbtree_rank(const rbtree *t, const key_t key) {
+	size_t rank = 0;
+	node_t *temp = t->root;
+	while (temp != t->nil) {
+		if (temp->key < key) {
+			rank += rbtree_left(t, temp)->size + rbtree_count(temp);
+			temp = rbtree_right(t, temp);
+		} else {
+			temp = rbtree_left(t, temp);
+		}
+	}
+	return rank;
+}
+#endif
+
+
+
+#ifdef RBTREE_INTERVAL
+//++++++++++++++++++++++++interval 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : insert_interval	return : 방금 넣은 노드 pointer (hi < lo 거나 노드를 못 만들면 NULL)
+	닫힌 구간 [lo, hi]를 key lo로 넣는다 (같은 lo도 하나 더)
+	내려가는 경로의 max를 hi로 올려두고 붙인 뒤 insert_fixup (회전은 max를 자식들로 다시 계산)
+*/
+node_t *rbtree_insert_interval(rbtree *t, const key_t lo, const key_t hi) {
+	if (hi < lo) {
+		return NULL;
+	}
+	return insert_node(t, lo, hi);
+}
+
+
+
+/*
+	FUNCTION : overlaps_at	return : visit이 멈추라고 했으면 1
+	서브트리 x에서 [lo, hi]와 겹치는 구간을 key 순서로 visit에 넘긴다
+	1. max < lo 면 이 서브트리의 구간은 모두 lo 전에 끝난다 
+	2. 왼쪽 서브트리 
+	3. key > hi 면 x와 오른쪽 서브트리의 구간은 모두 hi 뒤에 시작한다 
+	4. x가 lo 이후에 끝나면 겹친다. 오른쪽 서브트리는 반복으로 (재귀 깊이는 높이만큼)
+*/
+static int overlaps_at(const rbtree *t, const node_t *x, const key_t lo, const key_t hi,
+		rbtree_visit_t visit, void *arg, size_t *count) {
+	// 1.
+	for (; x != t->nil && x->max >= lo; x = rbtree_right(t, x)) {
+		// 2.
+		if (overlaps_at(t, rbtree_left(t, x), lo, hi, visit, arg, count)) {
+			return 1;
+		}
+		// 3.
+		if (x->key > hi) {
+			return 0;
+		}
+		// 4.
+		if (x->hi >= lo) {
+			(*count)++;
+			if (visit(x, arg)) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+
+/*
+	FUNCTION : overlaps	return : 방문한 노드 개수
+	[lo, hi]와 겹치는 (양끝 포함) 구간의 노드들을 key 순서로 visit(node, arg)에 넘겨준다 
+	점 하나를 물으려면 lo == hi
+	visit이 0이 아닌 값을 돌려주면 거기서 멈춘다. visit 안에서 트리를 수정하면 안된다 
+	겹치지 않는 서브트리는 max와 key로 건너뛰므로 k개를 찾는데 O(log n + k) 정도
+	(겹치는 구간들이 트리 여기저기 흩어져 있으면 최악 O(min(n, (k + 1) log n)))
+	to_array로 펼쳐서 전부 훑는 O(n) 대신 쓴다 
+*/
+size_t rbtree_overlaps(const rbtree *t, const key_t lo, const key_t hi, rbtree_visit_t visit, void *arg) {
+	size_t count = 0;
+	if (lo <= hi) {
+		overlaps_at(t, t->root, lo, hi, visit, arg, &count);
+	}
+	return count;
 }
+#endif
 
 
 
@@ -378,20 +1630,23 @@ int inorder(const rbtree *t, const node_t *np, key_t *arr, int index, const size
 /*
     FUNCTION : transplant   return : void
     v의 subtree를 u에 옮겨심는다 
-	v가 NIL node이더라도 v parent을 찾을 수 있다 
 	
 	node u의 부모가 node v의 부모가 된다 
 	u의 부모는 v를 (왼/오 검사를 해서)자식으로 가지게 된다   
+	v가 NIL이면 NIL의 parent는 건드리지 않는다 
+	(split한 트리끼리는 sentinel을 같이 쓰므로 NIL에는 쓰지 않는다. 부모는 부르는 쪽이 들고 있는다)
 */
 void transplant(rbtree *t, node_t *u, node_t *v) {
-	if (u->parent == t->nil) {	// u가 루트일 때 
-		t->root = v;
-	} else if (u == u->parent->left) {	//u 가 부모의 왼쪽자식일때
-		u->parent->left = v;
+	if (rbtree_parent(t, u) == t->nil) {	// u가 루트일 때 
+		RBTREE_STORE(t->root, v);
+	} else if (u == rbtree_left(t, rbtree_parent(t, u))) {	//u 가 부모의 왼쪽자식일때
+		rbtree_set_left(t, rbtree_parent(t, u), v);
 	} else {	//u가 부모의 오른쪽 자식일 때 
-		u->parent->right = v;
+		rbtree_set_right(t, rbtree_parent(t, u), v);
+	}
+	if (v != t->nil) {
+		rbtree_set_parent(t, v, rbtree_parent(t, u));
 	}
-	v->parent = u->parent;
 }
 
 
@@ -406,8 +1661,8 @@ void transplant(rbtree *t, node_t *u, node_t *v) {
 */
 node_t *find_right_min(rbtree *t, node_t *np) {
 	node_t *temp = np;
-	while (temp->left != t->nil) {
-		temp = temp->left;
+	while (rbtree_left(t, temp) != t->nil) {
+		temp = rbtree_left(t, temp);
 	}
 	return temp;
 }
@@ -418,51 +1673,73 @@ node_t *find_right_min(rbtree *t, node_t *np) {
     FUNCTION : erase  return : 0 
     지정된 node를 삭제하고 메모리 반환
     transplant 로 받은 노드들에 gray 부여하고 erase_fixup으로 전달
+    RBTREE_MULTISET이면 같은 key가 더 남아있을 때 count만 내린다 (노드는 그대로)
+    tombstone도 지울 수 있다 (rbtree_compact가 쓴다)
 */
 int rbtree_erase(rbtree *t, node_t *z) {
+#ifdef RBTREE_MULTISET
+	if (z->count > 1) {
+		RBTREE_STORE(z->count, z->count - 1);
+		update_to_root(t, z);
+		t->version++;
+		return 0;
+	}
+#endif
+#ifdef RBTREE_LAZY_DELETE
+	if (z->dead) {
+		t->dead--;
+	}
+#endif
     node_t *y = z;
-	color_t y_original_color = y->color;
+	color_t y_original_color = rbtree_color(y);
 	node_t *x;
+	node_t *xp;	// x의 부모 (x가 NIL이어도)
 	
-	if (z->left == t->nil) {	//target의 왼쪽자식이 없음 
-		x = z->right;
-		// transplant는 x가 NIL이라도 작동한다 
-		transplant(t, z, z->right);
-	} else if (z->right == t->nil) {
-		x = z->left;
-		transplant(t, z, z->left);
+	if (rbtree_left(t, z) == t->nil) {	//target의 왼쪽자식이 없음 
+		x = rbtree_right(t, z);
+		xp = rbtree_parent(t, z);
+		transplant(t, z, rbtree_right(t, z));
+	} else if (rbtree_right(t, z) == t->nil) {
+		x = rbtree_left(t, z);
+		xp = rbtree_parent(t, z);
+		transplant(t, z, rbtree_left(t, z));
 	} else {	// target은 자식이 두개다 
 		// target z의 right subtree가 반드시 존재한다는 가정하에, 
-		y = find_right_min(t, z->right);
+		y = find_right_min(t, rbtree_right(t, z));
 
 		// 삭제색 = successor의 색 
-		y_original_color = y->color;
-		x = y->right;
-		if (y->parent == z) {	//y가 z의 직계자식일 때 
-			x->parent = y;
+		y_original_color = rbtree_color(y);
+		x = rbtree_right(t, y);
+		if (rbtree_parent(t, y) == z) {	//y가 z의 직계자식일 때 
+			xp = y;
 		} else {	//직계자식이 아닐 경우
-			transplant(t, y, y->right);
-			y->right = z->right;
-			y->right->parent = y;
+			xp = rbtree_parent(t, y);
+			transplant(t, y, rbtree_right(t, y));
+			rbtree_set_right(t, y, rbtree_right(t, z));
+			rbtree_set_parent(t, rbtree_right(t, y), y);
 		}
 
 		transplant(t, z, y);
-		y->left = z->left;
-		y->left->parent = y;
-		y->color = z->color;
+		rbtree_set_left(t, y, rbtree_left(t, z));
+		rbtree_set_parent(t, rbtree_left(t, y), y);
+		rbtree_set_color(y, rbtree_color(z));
 	}
 
 	//삭제 대상인 z노드의 모든 데이터를 옮겼다 
 	// 이제 z memory deallocation
-	free(z);
+	free_node(t, z);
+
+	// 구조가 바뀐 x의 부모부터 루트까지 augment 필드 다시 계산
+	update_to_root(t, xp);
 
 
 	//삭제색을 지정, 전달, 노드 삭제까지 진행 한 후
 	//삭제색이 검정이면 fixup에 전달
 	//x 가 graynode 
 	if (y_original_color == RBTREE_BLACK) {
-		erase_fixup(t, x);
+		erase_fixup(t, x, xp);
 	}
+	t->version++;
 
     return 0;
 }
@@ -472,79 +1749,90 @@ int rbtree_erase(rbtree *t, node_t *z) {
 /*
     FUNCTION : erase_fixup  return : 0
     erase에서 전달한 graynode x를 중심으로 CASE를 나눠 트리 불균형 해결 
+    xp는 x의 부모. x가 NIL일 수 있어서 NIL의 parent 대신 따로 받는다 
     CASE4에 도달할 때 까지 while루프를 돌게 하는 것이 목표 
 */
 //   TODO : erase_fixup()
-void erase_fixup(rbtree *t, node_t *x) {
-	while (x != t->root && x->color == RBTREE_BLACK) {
-		if (x == x->parent->left) {	//x는 부모의 왼쪽자식임
+void erase_fixup(rbtree *t, node_t *x, node_t *xp) {
+	while (x != t->root && rbtree_color(x) == RBTREE_BLACK) {
+		if (x == rbtree_left(t, xp)) {	//x는 부모의 왼쪽자식임
 			// w는 x의 bro
-			node_t *w = x->parent->right;
-			if (w->color == RBTREE_RED) { // CASE1 : angry bro
-				w->color = RBTREE_BLACK;
-				x->parent->color = RBTREE_RED;
-				left_rotate(t, x->parent);
-				w = x->parent->right;	//회전 후 bro 다시 판정
+			node_t *w = rbtree_right(t, xp);
+			if (rbtree_color(w) == RBTREE_RED) { // CASE1 : angry bro
+				STAT_ADD(t, erase_case[0], 1);
+				rbtree_set_color(w, RBTREE_BLACK);
+				rbtree_set_color(xp, RBTREE_RED);
+				left_rotate(t, xp);
+				w = rbtree_right(t, xp);	//회전 후 bro 다시 판정
 				//이후 case 2, 3, 4로 진행함 
 			}
-			if ((w->left->color == RBTREE_BLACK) && (w->right->color == RBTREE_BLACK)) {	// CASE 2
+			if ((rbtree_color(rbtree_left(t, w)) == RBTREE_BLACK) && (rbtree_color(rbtree_right(t, w)) == RBTREE_BLACK)) {	// CASE 2
 				// bro is black && bro childs all black
-				w->color = RBTREE_RED;
-				x = x->parent;	// 부모에게 graynode 위임 
+				STAT_ADD(t, erase_case[1], 1);
+				rbtree_set_color(w, RBTREE_RED);
+				x = xp;	// 부모에게 graynode 위임 
+				xp = rbtree_parent(t, x);
 				// 이후 바뀐 x로 while을 다시 돌며 case검사를 한다
 			} else {
-				if (w->right->color == RBTREE_BLACK) {	// CASE 3
+				if (rbtree_color(rbtree_right(t, w)) == RBTREE_BLACK) {	// CASE 3
 					//bro w 의 꺾인 자녀가 red 
-					w->left->color = RBTREE_BLACK;
-					w->color = RBTREE_RED;
+					STAT_ADD(t, erase_case[2], 1);
+					rbtree_set_color(rbtree_left(t, w), RBTREE_BLACK);
+					rbtree_set_color(w, RBTREE_RED);
 					right_rotate(t, w);
 
 					// bro 다시 판정
-					w = x->parent->right;
+					w = rbtree_right(t, xp);
 
 					// 이후 그대로 CASE4로 진행하여 해결한다.
 				}
 				// CASE 4 : 여기서 해결한다 
-				w->color = x->parent->color;
-				x->parent->color = RBTREE_BLACK;
-				w->right->color = RBTREE_BLACK;
-				left_rotate(t, x->parent);
+				STAT_ADD(t, erase_case[3], 1);
+				rbtree_set_color(w, rbtree_color(xp));
+				rbtree_set_color(xp, RBTREE_BLACK);
+				rbtree_set_color(rbtree_right(t, w), RBTREE_BLACK);
+				left_rotate(t, xp);
 
 				// 해결완료! 
 				x = t->root;
 			}
 		} else {	//x는 부모의 오른쪽자식임 
 			// w는 x의 bro
-			node_t *w = x->parent->left;
-			if (w->color == RBTREE_RED) { // CASE1 : angry bro
-				w->color = RBTREE_BLACK;
-				x->parent->color = RBTREE_RED;
-				right_rotate(t, x->parent);
-				w = x->parent->left;	//회전 후 bro 다시 판정
+			node_t *w = rbtree_left(t, xp);
+			if (rbtree_color(w) == RBTREE_RED) { // CASE1 : angry bro
+				STAT_ADD(t, erase_case[0], 1);
+				rbtree_set_color(w, RBTREE_BLACK);
+				rbtree_set_color(xp, RBTREE_RED);
+				right_rotate(t, xp);
+				w = rbtree_left(t, xp);	//회전 후 bro 다시 판정
 				//이후 case 2, 3, 4로 진행함 
 			}
-			if ((w->left->color == RBTREE_BLACK) && (w->right->color == RBTREE_BLACK)) {	// CASE 2
+			if ((rbtree_color(rbtree_left(t, w)) == RBTREE_BLACK) && (rbtree_color(rbtree_right(t, w)) == RBTREE_BLACK)) {	// CASE 2
 				// bro is black && bro childs all black
-				w->color = RBTREE_RED;
-				x = x->parent;	// 부모에게 graynode 위임 
+				STAT_ADD(t, erase_case[1], 1);
+				rbtree_set_color(w, RBTREE_RED);
+				x = xp;	// 부모에게 graynode 위임 
+				xp = rbtree_parent(t, x);
 				// 이후 바뀐 x로 while을 다시 돌며 case검사를 한다
 			} else {
-				if (w->left->color == RBTREE_BLACK) {	// CASE 3
+				if (rbtree_color(rbtree_left(t, w)) == RBTREE_BLACK) {	// CASE 3
 					//bro w 의 꺾인 자녀가 red 
-					w->right->color = RBTREE_BLACK;
-					w->color = RBTREE_RED;
+					STAT_ADD(t, erase_case[2], 1);
+					rbtree_set_color(rbtree_right(t, w), RBTREE_BLACK);
+					rbtree_set_color(w, RBTREE_RED);
 					left_rotate(t, w);
 
 					// bro 다시 판정
-					w = x->parent->left;
+					w = rbtree_left(t, xp);
 
 					// 이후 그대로 CASE4로 진행하여 해결한다.
 				}
 				// CASE 4 : 여기서 해결한다 
-				w->color = x->parent->color;
-				x->parent->color = RBTREE_BLACK;
-				w->left->color = RBTREE_BLACK;
-				right_rotate(t, x->parent);
+				STAT_ADD(t, erase_case[3], 1);
+				rbtree_set_color(w, rbtree_color(xp));
+				rbtree_set_color(xp, RBTREE_BLACK);
+				rbtree_set_color(rbtree_left(t, w), RBTREE_BLACK);
+				right_rotate(t, xp);
 
 				// 해결완료! 
 				x = t->root;
@@ -552,8 +1840,10 @@ void erase_fixup(rbtree *t, node_t *x) {
 		}
 	}
 
-	// x는 root : always black
-	x->color = RBTREE_BLACK;
+	// x는 root : always black (NIL이면 트리가 비었다)
+	if (x != t->nil) {
+		rbtree_set_color(x, RBTREE_BLACK);
+	}
 }
 /*
 	CASE 1 목표 : graynode x의 bro 를 BLACK으로 만든 후, 
@@ -576,3 +1866,1576 @@ void erase_fixup(rbtree *t, node_t *x) {
 		모든 색 변환 후 부모를 기준으로 회전 
 */
 
+
+
+
+//++++++++++++++++++++++++lazy delete 구현++++++++++++++++++++++++++
+
+#ifdef RBTREE_LAZY_DELETE
+/*
+	FUNCTION : erase_lazy	return : 0
+	z에 tombstone 표시만 한다 O(1). 회전도 반환도 없으므로 트리 모양은 그대로
+	multiset이면 같은 key가 더 남아있을 때 count만 내린다
+	tombstone이 노드 수의 RBTREE_TOMBSTONE_RATIO % 를 넘으면 여기서 compact 한다 (z도 그때 반환된다)
+*/
+int rbtree_erase_lazy(rbtree *t, node_t *z) {
+#ifdef RBTREE_MULTISET
+	if (z->count > 1) {
+		z->count--;
+		t->version++;
+		return 0;
+	}
+#endif
+	if (z->dead) {
+		return 0;
+	}
+	z->dead = 1;
+	t->dead++;
+	t->version++;
+#if RBTREE_TOMBSTONE_RATIO > 0
+	if (t->dead * 100 > (t->nodes - 1) * RBTREE_TOMBSTONE_RATIO) {
+		rbtree_compact(t);
+	}
+#endif
+	return 0;
+}
+
+
+
+/*
+	FUNCTION : compact	return : 지운 tombstone 개수
+	순서대로 훑으며 tombstone을 rbtree_erase로 지운다 (회전과 반환을 여기서 몰아서 한다)
+	erase는 z 말고 다른 노드를 반환하지 않으므로 (자식이 둘이면 successor 노드가 z 자리로 옮겨갈 뿐)
+	지우기 전에 구해둔 다음 노드에서 그대로 이어간다
+	tombstone을 다 지웠으면 나머지는 보지 않는다
+*/
+size_t rbtree_compact(rbtree *t) {
+	size_t removed = 0;
+	if (t->root == t->nil) {
+		return 0;
+	}
+	node_t *p = t->root;
+	while (rbtree_left(t, p) != t->nil) {
+		p = rbtree_left(t, p);
+	}
+	while (p != NULL && t->dead > 0) {
+		node_t *next = successor(t, p);
+		if (p->dead) {
+			rbtree_erase(t, p);
+			removed++;
+		}
+		p = next;
+	}
+	return removed;
+}
+#endif
+
+
+
+/*
+	FUNCTION : flush_tombstones	return : void
+	노드를 key로 찾아 고치거나 다른 트리와 섞는 연산 (topdown / batch / join / split / 집합 연산)은
+	tombstone이 없는 트리에서 시작한다. 남은 tombstone이 있으면 먼저 compact
+*/
+static void flush_tombstones(rbtree *t) {
+#ifdef RBTREE_LAZY_DELETE
+	if (t->dead > 0) {
+		rbtree_compact(t);
+	}
+#endif
+}
+
+
+
+//++++++++++++++++++++++++top-down 삽입 / 삭제 구현++++++++++++++++++++++++
+
+/*
+	top-down insert / erase
+	rbtree_insert / rbtree_erase는 leaf까지 내려간 뒤 fixup이 parent를 따라 다시 올라온다 
+	여기서는 내려가는 길에 미리 색을 바꾸고 회전해서, 다 내려가면 더 고칠 것이 없게 만든다 
+	- 루트에서 leaf까지 한번만 지나간다 (올라오는 두번째 pass가 없다)
+	- 지금 노드 위로 부모 / 할아버지 밖에는 다시 건드리지 않으므로
+	  위쪽 lock을 놓으면서 내려가는 hand-over-hand locking이 가능하다 
+	ORDER_STAT의 size는 내려가면서 미리 +1 / -1 해둔다 
+	(회전은 자식들로 size를 다시 계산하므로 회전에 끼인 경로 노드만 다시 맞춘다)
+	key가 없거나 노드를 못 만들어서 결국 안 바뀌었을 때만 올라가며 되돌린다 
+	만들어지는 모양은 bottom-up과 다를 수 있지만 둘 다 올바른 red-black 트리라 섞어 써도 된다 
+*/
+
+// dir 0 : left, 1 : right
+static inline node_t *child_of(const rbtree *t, const node_t *x, const int dir) {
+	return dir ? rbtree_right(t, x) : rbtree_left(t, x);
+}
+
+// x를 dir 쪽으로 내리는 회전 (반대쪽 자식이 x 자리로 올라온다)
+static inline void rotate_down(rbtree *t, node_t *x, const int dir) {
+	if (dir) {
+		right_rotate(t, x);
+	} else {
+		left_rotate(t, x);
+	}
+}
+
+static inline int is_red(const node_t *x) {
+	return rbtree_color(x) == RBTREE_RED;
+}
+
+
+
+/*
+	FUNCTION : topdown_split_red	return : void
+	x와 부모 p가 둘 다 RED일 때 할아버지 g에서 회전해서 푼다 (insert CASE 2, 3과 같다)
+	삼촌은 항상 BLACK : RED였다면 g를 지날 때 이미 색을 뒤집었다 
+	회전이 끝나면 x는 그대로 경로 위에 있으므로 x부터 계속 내려가면 된다 
+	pending은 아직 x 아래에 붙지 않은 key 수 (ORDER_STAT : 삼각형이면 x의 size가 다시 계산되어 빠진다)
+*/
+static void topdown_split_red(rbtree *t, node_t *x, const int pending) {
+	node_t *p = rbtree_parent(t, x);
+	node_t *g = rbtree_parent(t, p);
+	const int pdir = p == rbtree_right(t, g);
+	if ((x == rbtree_right(t, p)) != pdir) {	// CASE 2 : 삼각형
+		STAT_ADD(t, insert_case[1], 1);
+		rotate_down(t, p, pdir);
+		p = x;
+	}
+	// CASE 3 : 일직선
+	STAT_ADD(t, insert_case[2], 1);
+	rbtree_set_color(p, RBTREE_BLACK);
+	rbtree_set_color(g, RBTREE_RED);
+	rotate_down(t, g, !pdir);
+#ifdef RBTREE_ORDER_STAT
+	if (p == x) {	// 삼각형 : x가 맨 위로 올라오면서 size가 자식들로 다시 계산되었다 
+		x->size += pending;
+	}
+#endif
+}
+
+
+
+/*
+	FUNCTION : insert_topdown	return : 방금 넣은 노드 포인터 (노드를 못 만들면 NULL)
+	rbtree_insert와 같은 결과(같은 key는 오른쪽에 하나 더, multiset이면 count만 올린다)를 fixup 없이 만든다 
+	1. 내려가며 자식 둘이 모두 RED인 노드를 만나면 색을 뒤집는다 (노드는 RED, 자식은 BLACK) : CASE 1
+	   루트면 다시 BLACK으로 (트리 전체의 black height가 1 늘어난다)
+	2. 그래서 부모와 RED가 겹치면 할아버지에서 회전 
+	3. leaf 자리에 RED 노드를 붙이고, 부모가 RED면 한번 더 2.
+*/
+node_t *rbtree_insert_topdown(rbtree *t, const key_t key) {
+	flush_tombstones(t);
+	if (t->root == t->nil) {
+		node_t *z = new_node(t, RBTREE_BLACK, key);
+		if (z == NULL) {
+			return NULL;
+		}
+		rbtree_set_parent(t, z, t->nil);
+		rbtree_set_left(t, z, t->nil);
+		rbtree_set_right(t, z, t->nil);
+		t->root = z;
+		STAT_ADD(t, inserts, 1);
+		t->version++;
+		return z;
+	}
+
+	node_t *x = t->root;
+	int dir;
+	STATS_ONLY(size_t depth = 0;)
+	for (;;) {
+#ifdef RBTREE_ORDER_STAT
+		x->size++;	// key가 이 서브트리에 들어간다 
+#endif
+#ifdef RBTREE_MULTISET
+		if (key == x->key) {
+			x->count++;
+			STAT_ADD(t, inserts, 1);
+			STAT_ADD(t, insert_depth_sum, depth);
+			STAT_MAX(t, insert_depth_max, depth);
+			t->version++;
+			return x;
+		}
+#endif
+		// 1.
+		if (is_red(rbtree_left(t, x)) && is_red(rbtree_right(t, x))) {
+			STAT_ADD(t, insert_case[0], 1);
+			rbtree_set_color(x, RBTREE_RED);
+			rbtree_set_color(rbtree_left(t, x), RBTREE_BLACK);
+			rbtree_set_color(rbtree_right(t, x), RBTREE_BLACK);
+			if (x == t->root) {
+				rbtree_set_color(x, RBTREE_BLACK);
+			} else if (is_red(rbtree_parent(t, x))) {	// 2.
+				topdown_split_red(t, x, 1);
+			}
+		}
+		dir = !(key < x->key);
+		node_t *next = child_of(t, x, dir);
+		if (next == t->nil) {
+			break;
+		}
+		x = next;
+		STATS_ONLY(depth++;)
+	}
+
+	// 3.
+	node_t *z = new_node(t, RBTREE_RED, key);
+	if (z == NULL) {	// 풀이 가득 찼다. 회전 / 색은 올바른 트리 그대로 두고 size만 되돌린다 
+#ifdef RBTREE_ORDER_STAT
+		for (; x != t->nil; x = rbtree_parent(t, x)) {
+			x->size--;
+		}
+#endif
+		return NULL;
+	}
+	rbtree_set_parent(t, z, x);
+	rbtree_set_left(t, z, t->nil);
+	rbtree_set_right(t, z, t->nil);
+	if (dir) {
+		rbtree_set_right(t, x, z);
+	} else {
+		rbtree_set_left(t, x, z);
+	}
+	if (is_red(x)) {
+		topdown_split_red(t, z, 0);
+	}
+	max_to_root(t, z);
+
+	STAT_ADD(t, inserts, 1);
+	STAT_ADD(t, insert_depth_sum, depth + 1);
+	STAT_MAX(t, insert_depth_max, depth + 1);
+	t->version++;
+	return z;
+}
+
+
+
+/*
+	FUNCTION : erase_topdown	return : 없으면 0 / 지웠으면 1
+	key 하나를 지운다 (같은 key가 여럿이면 그 중 하나, multiset이면 count만 1 내린다)
+	실제로 떼어낼 노드가 RED가 되도록 내려가는 길에 RED를 아래로 밀어준다 
+	1. 지금 노드 q와 q에서 내려갈 쪽 자식이 모두 BLACK이면 q를 RED로 만든다 
+	   - q의 반대쪽 자식 o가 RED : q를 내려갈 쪽으로 회전 (erase CASE 1)
+	   - 아니면 형제 s를 본다 (이 때 부모 p는 항상 RED, 루트만 예외)
+	     s의 자식이 모두 BLACK이면 색만 뒤집는다 (CASE 2)
+	     RED 자식이 있으면 p에서 한두번 회전 (CASE 3, 4)
+	2. key와 같은 노드 f를 만나도 계속 내려가서 f의 in-order 앞 노드 q까지 간다 
+	3. q는 RED leaf이므로 (루트 하나만 남은 경우 빼고) 떼어내기만 하면 되고 f 자리에 q를 옮겨 붙인다 
+	   key를 복사하지 않고 노드를 옮기므로 다른 노드를 가리키던 포인터는 그대로 유효하다 
+*/
+int rbtree_erase_topdown(rbtree *t, const key_t key) {
+	flush_tombstones(t);
+	node_t *f = t->nil;
+	node_t *q = t->nil;
+	node_t *next = t->root;
+	int dir = 0;
+	while (next != t->nil) {
+		const int last = dir;
+		q = next;
+		dir = q->key < key;
+#ifdef RBTREE_ORDER_STAT
+		q->size--;	// key가 이 서브트리에서 빠진다 (없으면 나중에 되돌린다)
+#endif
+		if (q->key == key) {	// 2.
+			f = q;
+#ifdef RBTREE_MULTISET
+			if (q->count > 1) {
+				q->count--;
+				rbtree_set_color(t->root, RBTREE_BLACK);
+				t->version++;
+				return 1;
+			}
+#endif
+		}
+
+		// 1.
+		if (!is_red(q) && !is_red(child_of(t, q, dir))) {
+			node_t *p = rbtree_parent(t, q);
+			node_t *o = child_of(t, q, !dir);
+			if (is_red(o)) {	// CASE 1
+				STAT_ADD(t, erase_case[0], 1);
+				rotate_down(t, q, dir);
+				rbtree_set_color(q, RBTREE_RED);
+				rbtree_set_color(o, RBTREE_BLACK);
+#ifdef RBTREE_ORDER_STAT
+				// 둘 다 자식들로 다시 계산되었다. 이제 o도 경로 위에 있다 
+				q->size--;
+				o->size--;
+#endif
+			} else if (p != t->nil && child_of(t, p, !last) != t->nil) {
+				node_t *s = child_of(t, p, !last);
+				if (!is_red(rbtree_left(t, s)) && !is_red(rbtree_right(t, s))) {	// CASE 2
+					STAT_ADD(t, erase_case[1], 1);
+					rbtree_set_color(p, RBTREE_BLACK);
+					rbtree_set_color(s, RBTREE_RED);
+					rbtree_set_color(q, RBTREE_RED);
+				} else {
+					node_t *top = s;
+					if (is_red(child_of(t, s, last))) {	// CASE 3 : s의 꺾인 자식이 RED
+						STAT_ADD(t, erase_case[2], 1);
+						top = child_of(t, s, last);
+						rotate_down(t, s, !last);
+					}
+					// CASE 4 : p를 q 쪽으로 내린다 
+					// q가 가장 아래에서 size를 들고 있으므로 다시 계산된 size가 그대로 맞다 
+					STAT_ADD(t, erase_case[3], 1);
+					rotate_down(t, p, last);
+					rbtree_set_color(q, RBTREE_RED);
+					rbtree_set_color(top, RBTREE_RED);
+					rbtree_set_color(rbtree_left(t, top), RBTREE_BLACK);
+					rbtree_set_color(rbtree_right(t, top), RBTREE_BLACK);
+				}
+			}
+		}
+		next = child_of(t, q, dir);
+	}
+
+	if (f == t->nil) {	// 없는 key : 색 / 모양은 올바른 트리 그대로 두고 size만 되돌린다 
+#ifdef RBTREE_ORDER_STAT
+		for (; q != t->nil; q = rbtree_parent(t, q)) {
+			q->size++;
+		}
+#endif
+		if (t->root != t->nil) {
+			rbtree_set_color(t->root, RBTREE_BLACK);
+		}
+		return 0;
+	}
+
+	// 3.
+#if defined(RBTREE_MULTISET) && defined(RBTREE_ORDER_STAT)
+	// q가 f 자리로 올라가면 q와 f 사이 노드들에서는 1개가 아니라 q의 count만큼 빠진다 
+	for (node_t *y = rbtree_parent(t, q); f != q && y != f; y = rbtree_parent(t, y)) {
+		y->size -= q->count - 1;
+	}
+#endif
+	// 떼어낸 자리 바로 위부터 max를 다시 (q가 f의 자식이었으면 f 자리로 올라간 q부터)
+	node_t *low = rbtree_parent(t, q) == f ? q : rbtree_parent(t, q);
+	transplant(t, q, rbtree_left(t, q) != t->nil ? rbtree_left(t, q) : rbtree_right(t, q));
+	if (f != q) {
+		transplant(t, f, q);
+		rbtree_set_left(t, q, rbtree_left(t, f));
+		rbtree_set_right(t, q, rbtree_right(t, f));
+		for (int d = 0; d < 2; d++) {
+			if (child_of(t, q, d) != t->nil) {
+				rbtree_set_parent(t, child_of(t, q, d), q);
+			}
+		}
+		rbtree_set_color(q, rbtree_color(f));
+		node_update(t, q);
+	}
+	max_to_root(t, low);
+	free_node(t, f);
+	if (t->root != t->nil) {
+		rbtree_set_color(t->root, RBTREE_BLACK);
+	}
+	t->version++;
+	return 1;
+}
+
+
+
+
+//++++++++++++++++++++++++join / split 구현++++++++++++++++++++++++++
+
+/*
+	아래 함수들은 한 트리(같은 nil, 같은 풀) 안에서 떨어져 나온 서브트리들을 다룬다 
+	- 서브트리의 루트는 parent가 nil이다 
+	- t->root는 건드리지 않고 nil의 필드는 읽기만 하므로 
+	  겹치지 않는 서브트리들은 여러 thread에서 동시에 다뤄도 된다 (집합 연산 병렬화)
+	- 노드는 새로 만들지 않고 있는 노드의 링크만 바꾼다 
+*/
+
+// x를 떨어져 나온 서브트리의 루트로 만든다
+static inline void detach(rbtree *t, node_t *x) {
+	if (x != t->nil) {
+		rbtree_set_parent(t, x, t->nil);
+	}
+}
+
+
+
+/*
+	FUNCTION : black_height	return : x에서 NIL까지 BLACK 노드 수 (x 포함, NIL 제외)
+	어느 경로로 내려가도 같으므로 왼쪽으로만 내려가며 센다 : O(log n)
+*/
+static int black_height(const rbtree *t, const node_t *x) {
+	int h = 0;
+	while (x != t->nil) {
+		h += rbtree_color(x) == RBTREE_BLACK;
+		x = rbtree_left(t, x);
+	}
+	return h;
+}
+
+
+
+/*
+	FUNCTION : join_nodes	return : 합쳐진 서브트리의 루트
+	l의 모든 key <= k->key <= r의 모든 key 일 때 l + k + r 을 하나의 rbtree로
+	hl, hr은 l, r의 black height. 결과의 black height는 *h 로
+	1. l, r의 루트를 BLACK으로 (루트 색은 언제든 BLACK으로 바꿀 수 있다)
+	2. black height가 큰 쪽(l이라 하면)의 오른쪽 가장자리를 따라 내려가서 
+	   black height가 r과 같은 BLACK 노드 c를 찾는다 
+	3. c 자리에 RED인 k를 넣고 c, r을 k의 자식으로 붙인다 
+	   -> 모든 경로의 BLACK 수는 그대로, k와 부모가 둘다 RED일 수만 있다 
+	4. 그건 insert_fixup과 똑같은 상황이라 그대로 해결
+	높이 차이만큼만 내려가므로 O(|hl - hr| + 1)
+	(black height를 매번 세면 O(log n)이라 호출하는 쪽에서 들고 다닌다)
+*/
+static node_t *join_nodes(rbtree *t, node_t *l, int hl, node_t *k, node_t *r, int hr, int *h) {
+	if (l != t->nil && rbtree_color(l) == RBTREE_RED) {
+		rbtree_set_color(l, RBTREE_BLACK);
+		hl++;
+	}
+	if (r != t->nil && rbtree_color(r) == RBTREE_RED) {
+		rbtree_set_color(r, RBTREE_BLACK);
+		hr++;
+	}
+	const int top = hl >= hr ? hl : hr;
+	node_t *root;
+	node_t *p = t->nil;
+	node_t *c;
+
+	if (hl >= hr) {
+		// 2. l의 오른쪽 가장자리 (NIL도 BLACK, black height 0)
+		root = l;
+		c = l;
+		while (hl > hr || rbtree_color(c) == RBTREE_RED) {
+			hl -= rbtree_color(c) == RBTREE_BLACK;
+			p = c;
+			c = rbtree_right(t, c);
+		}
+		// 3. c -> k의 왼쪽, r -> k의 오른쪽
+		rbtree_set_left(t, k, c);
+		rbtree_set_right(t, k, r);
+		if (p == t->nil) {
+			root = k;
+		} else {
+			rbtree_set_right(t, p, k);
+		}
+		detach(t, r);
+	} else {
+		// 2. r의 왼쪽 가장자리
+		root = r;
+		c = r;
+		while (hr > hl || rbtree_color(c) == RBTREE_RED) {
+			hr -= rbtree_color(c) == RBTREE_BLACK;
+			p = c;
+			c = rbtree_left(t, c);
+		}
+		// 3. l -> k의 왼쪽, c -> k의 오른쪽
+		rbtree_set_left(t, k, l);
+		rbtree_set_right(t, k, c);
+		if (p == t->nil) {
+			root = k;
+		} else {
+			rbtree_set_left(t, p, k);
+		}
+		detach(t, l);
+	}
+	rbtree_set_parent(t, k, p);
+	if (rbtree_left(t, k) != t->nil) {
+		rbtree_set_parent(t, rbtree_left(t, k), k);
+	}
+	if (rbtree_right(t, k) != t->nil) {
+		rbtree_set_parent(t, rbtree_right(t, k), k);
+	}
+	rbtree_set_color(k, RBTREE_RED);
+
+	// 4. k부터 루트까지 augment 필드를 맞추고 RED-RED 해결 
+	update_to_root(t, k);
+	*h = top + insert_fixup_at(t, k, &root);
+	return root;
+}
+
+
+
+/*
+	FUNCTION : split_nodes	return : void
+	서브트리 x(black height hx)를 key보다 작은 쪽 *l 과 나머지 *r 로 나눈다
+	inclusive면 key와 같은 것도 *l 로 보낸다. 각각의 black height는 *hl, *hr
+	1. x의 두 자식을 떼어낸다 (자식의 black height는 hx - (x가 BLACK이면 1))
+	2. x가 왼쪽으로 가야하면 오른쪽 자식을 다시 나누고, 
+	   왼쪽 자식 + x + (그 중 작은 쪽) 을 join
+	   (오른쪽으로 가야하면 반대로)
+	join 비용이 높이 차이만큼이라 다 합쳐도 O(log n)
+*/
+static void split_nodes(rbtree *t, node_t *x, const int hx, const key_t key, const int inclusive,
+		node_t **l, int *hl, node_t **r, int *hr) {
+	if (x == t->nil) {
+		*l = t->nil;
+		*r = t->nil;
+		*hl = 0;
+		*hr = 0;
+		return;
+	}
+	const int hc = hx - (rbtree_color(x) == RBTREE_BLACK);
+	node_t *a = rbtree_left(t, x);
+	node_t *b = rbtree_right(t, x);
+	detach(t, a);
+	detach(t, b);
+	if (x->key < key || (inclusive && x->key == key)) {
+		node_t *bl;
+		int hbl;
+		split_nodes(t, b, hc, key, inclusive, &bl, &hbl, r, hr);
+		*l = join_nodes(t, a, hc, x, bl, hbl, hl);
+	} else {
+		node_t *ar;
+		int har;
+		split_nodes(t, a, hc, key, inclusive, l, hl, &ar, &har);
+		*r = join_nodes(t, ar, har, x, b, hc, hr);
+	}
+}
+
+
+
+/*
+	FUNCTION : split_last	return : 가장 큰 노드 (떼어낸 상태)
+	서브트리 x에서 가장 큰 노드를 떼어내고 나머지를 *rest로 : O(log n)
+*/
+static node_t *split_last(rbtree *t, node_t *x, const int hx, node_t **rest, int *hrest) {
+	const int hc = hx - (rbtree_color(x) == RBTREE_BLACK);
+	node_t *a = rbtree_left(t, x);
+	node_t *b = rbtree_right(t, x);
+	detach(t, a);
+	detach(t, b);
+	if (b == t->nil) {
+		*rest = a;
+		*hrest = hc;
+		return x;
+	}
+	int hb;
+	node_t *m = split_last(t, b, hc, &b, &hb);
+	*rest = join_nodes(t, a, hc, x, b, hb, hrest);
+	return m;
+}
+
+
+
+/*
+	FUNCTION : join2	return : 합쳐진 서브트리의 루트
+	가운데 key 없이 l + r (l의 key <= r의 key)
+	l에서 가장 큰 노드를 떼어 가운데 key로 쓴다 
+*/
+static node_t *join2(rbtree *t, node_t *l, int hl, node_t *r, const int hr, int *h) {
+	if (l == t->nil) {
+		*h = hr;
+		return r;
+	}
+	node_t *m = split_last(t, l, hl, &l, &hl);
+	return join_nodes(t, l, hl, m, r, hr, h);
+}
+
+
+
+/*
+	FUNCTION : count_upto	return : min(서브트리 노드 수, limit)
+	RBTREE_ORDER_STAT이면 size 필드로 O(1)
+	(multiset의 size는 count의 합이라 노드 수가 아니므로 직접 센다)
+*/
+static size_t count_upto(const rbtree *t, const node_t *x, size_t limit) {
+#if defined(RBTREE_ORDER_STAT) && !defined(RBTREE_MULTISET)
+	return x->size < limit ? x->size : limit;
+#else
+	if (x == t->nil || limit == 0) {
+		return 0;
+	}
+	size_t c = 1 + count_upto(t, rbtree_left(t, x), limit - 1);
+	return c + count_upto(t, rbtree_right(t, x), limit - c);
+#endif
+}
+
+
+
+/*
+	FUNCTION : a_is_smaller	return : |a| <= |b| 면 1
+	limit를 두배씩 늘려가며 세서 작은 쪽 크기에 비례하는 시간만 쓴다 
+*/
+static int a_is_smaller(const rbtree *ta, const node_t *a, const rbtree *tb, const node_t *b) {
+	for (size_t limit = 64;; limit *= 2) {
+		size_t ca = count_upto(ta, a, limit);
+		size_t cb = count_upto(tb, b, limit);
+		if (ca < limit || cb < limit) {
+			return ca <= cb;
+		}
+	}
+}
+
+
+
+//++++++++++++++++++++++++트리 사이 노드 이동 구현++++++++++++++++++++++++
+
+/*
+	다른 트리의 노드를 붙이려면 그 노드들이 이 트리의 nil을 가리키고 
+	이 트리의 풀이 그 노드들의 메모리를 들고 있어야 한다 
+	- 기본 / RBTREE_COMPACT : 노드는 그 자리 그대로 두고 src 풀의 group들을 dst 풀도 든다 (할당 없음)
+	  split은 right가 t의 nil을 같이 쓰게 하므로 노드를 하나도 건드리지 않는다 
+	  join / 집합 연산은 nil이 같으면 (split으로 나눴던 트리끼리) 그대로 붙이고 
+	  다르면 옮기는 쪽의 NIL 링크만 dst의 nil로 바꾼다 
+	  sentinel을 같이 쓰는 트리들은 NIL을 읽기만 하므로 (erase도 NIL의 parent에 쓰지 않는다)
+	  각자 다른 lock 아래에서 동시에 고쳐도 된다 (rbtree_sharded)
+	- RBTREE_NO_POOL : 노드가 각자 malloc이고 nil은 트리마다 free 하므로 NIL 링크를 바꾼다 
+	- RBTREE_COMPACT32 : 링크가 풀 안의 index라서 dst 풀에 복사한다 (복사된 노드의 포인터는 무효가 된다)
+	NIL 링크를 바꾸거나 복사하는 일은 옮기는 노드 수에 비례하므로 항상 작은 쪽을 옮긴다 
+*/
+
+#ifndef RBTREE_COMPACT32
+// 서브트리 x의 NIL 링크를 from의 nil에서 to의 nil로
+static void repoint_nil(rbtree *to, const rbtree *from, node_t *x) {
+	while (x != from->nil) {
+		if (rbtree_left(to, x) == from->nil) {
+			rbtree_set_left(to, x, to->nil);
+		} else {
+			repoint_nil(to, from, rbtree_left(to, x));
+		}
+		node_t *right = rbtree_right(to, x);
+		if (right == from->nil) {
+			rbtree_set_right(to, x, to->nil);
+		}
+		x = right;
+	}
+}
+#endif
+
+
+
+#ifdef RBTREE_COMPACT32
+// src 서브트리 x를 dst 풀에 복사 (자리는 미리 pool_reserve 해둔다)
+static node_t *copy_subtree(rbtree *dst, const rbtree *src, const node_t *x, node_t *parent) {
+	if (x == src->nil) {
+		return dst->nil;
+	}
+	node_t *y = new_node(dst, rbtree_color(x), x->key);
+	rbtree_set_parent(dst, y, parent);
+	rbtree_set_left(dst, y, copy_subtree(dst, src, rbtree_left(src, x), y));
+	rbtree_set_right(dst, y, copy_subtree(dst, src, rbtree_right(src, x), y));
+#ifdef RBTREE_ORDER_STAT
+	y->size = x->size;
+#endif
+#ifdef RBTREE_INTERVAL
+	y->hi = x->hi;
+	y->max = x->max;
+#endif
+#ifdef RBTREE_MULTISET
+	y->count = x->count;
+#endif
+	return y;
+}
+
+
+
+// src 서브트리 x의 노드를 모두 src 풀에 반환
+static void free_subtree(rbtree *src, node_t *x) {
+	while (x != src->nil) {
+		free_subtree(src, rbtree_left(src, x));
+		node_t *right = rbtree_right(src, x);
+		free_node(src, x);
+		x = right;
+	}
+}
+#endif
+
+
+
+#if defined(RBTREE_NO_POOL) || defined(RBTREE_COMPACT32)
+/*
+	FUNCTION : move_subtree	return : fail 0 / success 1
+	src에서 떨어져 나온 서브트리 x를 dst의 노드로 만들어 *out 에 (루트의 parent는 dst nil)
+	RBTREE_COMPACT32면 복사하고 원래 노드는 src 풀에 반환, RBTREE_NO_POOL이면 링크만 바꾼다
+*/
+static int move_subtree(rbtree *dst, rbtree *src, node_t *x, node_t **out) {
+#ifdef RBTREE_NO_POOL
+	if (x == src->nil) {
+		*out = dst->nil;
+		return 1;
+	}
+	repoint_nil(dst, src, x);
+	rbtree_set_parent(dst, x, dst->nil);
+	*out = x;
+#ifdef RBTREE_LAZY_DELETE
+	const size_t moved = count_upto(dst, x, SIZE_MAX);
+	NODES_ADD(dst, moved);
+	NODES_SUB(src, moved);
+#endif
+#else
+	if (!pool_reserve(&dst->pool, count_upto(src, x, SIZE_MAX))) {
+		return 0;
+	}
+	*out = copy_subtree(dst, src, x, dst->nil);
+	free_subtree(src, x);
+#endif
+	return 1;
+}
+#endif
+
+
+
+#ifdef RBTREE_COMPACT32
+/*
+	FUNCTION : reset_empty	return : fail 0 / success 1
+	노드를 모두 넘겨준 트리를 새 풀, 새 nil을 가진 빈 트리로
+*/
+static int reset_empty(rbtree *t) {
+#ifdef RBTREE_LAZY_DELETE
+	t->nodes = 0;
+	t->dead = 0;
+#endif
+	if (!pool_init(&t->pool)) {
+		return 0;
+	}
+	t->nil = new_node(t, RBTREE_BLACK, 0);
+	if (t->nil == NULL) {
+		return 0;
+	}
+#ifdef RBTREE_ORDER_STAT
+	t->nil->size = 0;
+#endif
+#ifdef RBTREE_INTERVAL
+	t->nil->max = INT_MIN;
+#endif
+	t->root = t->nil;
+	return 1;
+}
+#endif
+
+
+
+/*
+	FUNCTION : adopt	return : fail 0 / success 1
+	src의 노드 전부를 dst의 노드로 만들고 그 루트를 *out 에. src는 빈 트리가 된다 
+	기본 / RBTREE_COMPACT에서는 nil이 같으면 O(1), 다르면 O(src 노드 수) (NIL 링크)
+*/
+static int adopt(rbtree *dst, rbtree *src, node_t **out) {
+#if defined(RBTREE_NO_POOL) || defined(RBTREE_COMPACT32)
+	if (!move_subtree(dst, src, src->root, out)) {
+		return 0;
+	}
+#ifdef RBTREE_COMPACT32
+	pool_destroy(&src->pool);
+	return reset_empty(src);
+#else
+	src->root = src->nil;
+	return 1;
+#endif
+#else
+	if (!pool_share(&dst->pool, &src->pool)) {
+		return 0;
+	}
+	*out = dst->nil;
+	if (src->root != src->nil) {
+		if (src->nil != dst->nil) {
+			repoint_nil(dst, src, src->root);
+			rbtree_set_parent(dst, src->root, dst->nil);
+		}
+		*out = src->root;
+	}
+#ifdef RBTREE_LAZY_DELETE
+	dst->nodes += src->nodes - 1;	// src의 sentinel은 src에 남는다
+	dst->dead += src->dead;
+	src->nodes = 1;
+	src->dead = 0;
+#endif
+	src->root = src->nil;	// src의 free_list와 group들은 그대로 src가 쓴다
+	return 1;
+#endif
+}
+
+
+
+// 트리 구조체 내용(루트, nil, 풀)을 통째로 맞바꾼다. 노드는 그대로
+static void swap_trees(rbtree *a, rbtree *b) {
+	rbtree tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+
+
+/*
+	FUNCTION : join	return : key 노드 pointer (실패하면 NULL)
+	t1의 모든 key <= key <= t2의 모든 key 일 때 t1 = t1 + key + t2
+	t2는 빈 트리가 된다 (delete_rbtree는 따로 불러야 함)
+	1. 노드 수가 적은 트리를 큰 트리의 노드로 옮긴다 (위의 트리 사이 노드 이동)
+	   split으로 나눴던 트리끼리는 sentinel이 같아서 옮길 것이 없으므로 t2를 t1로 : O(1)
+	2. 큰 트리 쪽에 key 노드를 만들고 join_nodes : O(log n)
+	3. 큰 트리가 t2였으면 구조체를 맞바꿔서 결과가 t1에 오게 한다 
+	4. multiset이면 k 양옆에 같은 key 노드(t1의 max, t2의 min)가 있었을 수 있으니 k 하나로 모은다
+	key 순서가 맞지 않거나 static 트리(rbtree_init_static)가 있으면 아무것도 하지 않고 NULL
+*/
+node_t *rbtree_join(rbtree *t1, const key_t key, rbtree *t2) {
+	if (is_static(t1) || is_static(t2)) {
+		return NULL;
+	}
+	flush_tombstones(t1);
+	flush_tombstones(t2);
+	if ((t1->root != t1->nil && rbtree_max(t1)->key > key) ||
+			(t2->root != t2->nil && rbtree_min(t2)->key < key)) {
+		return NULL;
+	}
+	// 1. 작은 쪽을 옮긴다
+	const int t1_small = t1->nil != t2->nil && a_is_smaller(t1, t1->root, t2, t2->root);
+	rbtree *big = t1_small ? t2 : t1;
+	rbtree *small = t1_small ? t1 : t2;
+	node_t *k = new_node(big, RBTREE_RED, key);
+	node_t *moved;
+	if (k == NULL) {
+		return NULL;
+	}
+	if (!adopt(big, small, &moved)) {
+		free_node(big, k);
+		return NULL;
+	}
+
+	// 2. join
+	int h;
+	if (big == t1) {
+		big->root = join_nodes(big, big->root, black_height(big, big->root), k, moved, black_height(big, moved), &h);
+	} else {
+		big->root = join_nodes(big, moved, black_height(big, moved), k, big->root, black_height(big, big->root), &h);
+	}
+
+	// 3. 결과는 t1에
+	if (big != t1) {
+		swap_trees(t1, t2);
+	}
+
+	// 4. 옆 노드를 지우기만 하므로 실패하지 않는다 (k는 erase로 옮겨지지 않는다)
+#ifdef RBTREE_MULTISET
+	for (int dir = 0; dir < 2; dir++) {
+		node_t *d = dir ? rbtree_iter_next(t1, k) : rbtree_iter_prev(t1, k);
+		if (d != NULL && d->key == key) {
+			k->count += d->count;
+			d->count = 1;
+			rbtree_erase(t1, d);
+			update_to_root(t1, k);
+		}
+	}
+#endif
+	t1->version++;
+	t2->version++;
+	return k;
+}
+
+
+
+/*
+	FUNCTION : split	return : fail 0 / success 1
+	t에서 key 이상인 노드들을 빈 트리 right로 옮긴다 (t에는 key 미만만 남는다)
+	1. split_nodes로 나눈다 : O(log n), 할당 없음
+	2. 기본 / RBTREE_COMPACT : right가 t의 sentinel과 풀의 group들을 같이 쓰게 한다 
+	   노드는 그 자리 그대로라 O(log n)이고 들고있던 노드 포인터도 계속 유효하다 
+	   (RBTREE_LAZY_DELETE면 노드 수를 맞추느라 right의 노드를 한번 센다)
+	   RBTREE_NO_POOL / RBTREE_COMPACT32 : 노드 수가 적은 쪽을 right의 노드로 옮기고 
+	   옮긴 쪽이 왼쪽이었으면 구조체를 맞바꾼다 : O(log n + 작은 쪽)
+	right가 비어있지 않거나 static 트리거나 옮길 자리를 못 구하면 t를 그대로 두고 0
+*/
+int rbtree_split(rbtree *t, const key_t key, rbtree *right) {
+	if (right->root != right->nil || is_static(t) || is_static(right)) {
+		return 0;
+	}
+	flush_tombstones(t);
+#if defined(RBTREE_NO_POOL) || defined(RBTREE_COMPACT32)
+	node_t *l, *r, *moved;
+	int hl, hr;
+	split_nodes(t, t->root, black_height(t, t->root), key, 0, &l, &hl, &r, &hr);
+
+	// 2. 작은 쪽을 옮긴다
+	const int move_right = !a_is_smaller(t, l, t, r) || r == t->nil;
+	if (!move_subtree(right, t, move_right ? r : l, &moved)) {
+		t->root = join2(t, l, hl, r, hr, &hl);
+		return 0;
+	}
+	t->root = move_right ? l : r;
+	right->root = moved;
+	if (!move_right) {
+		swap_trees(t, right);
+	}
+#else
+	if (!pool_share(&right->pool, &t->pool)) {
+		return 0;
+	}
+	node_t *l, *r;
+	int hl, hr;
+	split_nodes(t, t->root, black_height(t, t->root), key, 0, &l, &hl, &r, &hr);
+
+	// 2. right의 원래 sentinel은 다른 트리도 같이 쓰고 있을 수 있어서 반환하지 않는다
+	right->nil = t->nil;
+	t->root = l;
+	right->root = r;
+#ifdef RBTREE_LAZY_DELETE
+	const size_t moved = count_upto(t, r, SIZE_MAX);
+	t->nodes -= moved;
+	right->nodes = moved + 1;
+#endif
+#endif
+	t->version++;
+	right->version++;
+	return 1;
+}
+
+
+
+//++++++++++++++++++++++++집합 연산 구현++++++++++++++++++++++++++++
+
+/*
+	union / intersection / difference (t1 = t1 op t2, t2는 빈 트리가 된다)
+	- union        : t1과 t2의 노드 전부 (같은 key는 둘 다 남는다, insert를 반복한 것과 같음)
+	- intersection : t2에도 있는 key의 t1 노드들
+	- difference   : t2에 없는 key의 t1 노드들
+	두 트리를 한 풀로 모은 뒤 b(t2)의 루트 key로 a(t1)를 split하고
+	양쪽을 재귀로 처리해서 다시 join 한다 : O(m log(n/m + 1)), m <= n
+	재귀의 양쪽은 서로 겹치지 않는 서브트리라 thread를 나눠 돌릴 수 있다 
+
+	버려지는 노드(intersection / difference)는 재귀 도중 풀에 돌려주지 않고
+	garbage 목록에 모아뒀다가 끝에 한번에 반환한다 (풀은 thread-safe가 아니다)
+*/
+typedef struct {
+	node_t *head, *tail;	// right 링크로 연결, 끝은 nil
+} garbage_t;
+
+typedef struct {
+	rbtree *t;
+	rbtree_setop_t op;
+	node_t *a;
+	int ha;
+	node_t *b;
+	int hb;
+	int depth;
+	garbage_t garbage;
+	node_t *result;
+	int h;
+} setop_task_t;
+
+static node_t *setop_nodes(rbtree *, rbtree_setop_t, node_t *, int, node_t *, int, int, garbage_t *, int *);
+
+static void garbage_push(rbtree *t, garbage_t *g, node_t *x) {
+	rbtree_set_right(t, x, g->head);
+	if (g->head == t->nil) {
+		g->tail = x;
+	}
+	g->head = x;
+}
+
+static void garbage_subtree(rbtree *t, garbage_t *g, node_t *x) {
+	while (x != t->nil) {
+		garbage_subtree(t, g, rbtree_left(t, x));
+		node_t *right = rbtree_right(t, x);
+		garbage_push(t, g, x);
+		x = right;
+	}
+}
+
+// b 목록을 a 뒤에 잇는다
+static void garbage_concat(rbtree *t, garbage_t *a, const garbage_t *b) {
+	if (b->head == t->nil) {
+		return;
+	}
+	if (a->head == t->nil) {
+		*a = *b;
+		return;
+	}
+	rbtree_set_right(t, a->tail, b->head);
+	a->tail = b->tail;
+}
+
+static void *setop_thread(void *arg) {
+	setop_task_t *task = (setop_task_t *)arg;
+	task->result = setop_nodes(task->t, task->op, task->a, task->ha, task->b, task->hb, task->depth, &task->garbage, &task->h);
+	return NULL;
+}
+
+
+
+/*
+	FUNCTION : setop_nodes	return : 결과 서브트리의 루트
+	a, b는 같은 트리 t 안의 떨어진 서브트리 (black height ha, hb). 결과의 black height는 *h
+	1. 한쪽이 비었으면 바로 결정
+	2. b의 루트 k를 떼어내고, a를 (k 미만 / k와 같음 / k 초과)로 split
+	3. 왼쪽끼리, 오른쪽끼리 재귀 (depth > 0 이면 왼쪽은 새 thread에서)
+	4. op에 따라 k, a의 k와 같은 노드들을 남기거나 버리고 join
+*/
+static node_t *setop_nodes(rbtree *t, rbtree_setop_t op, node_t *a, int ha, node_t *b, int hb,
+		int depth, garbage_t *g, int *h) {
+	// 1.
+	if (b == t->nil) {
+		if (op == RBTREE_INTERSECTION) {
+			garbage_subtree(t, g, a);
+			*h = 0;
+			return t->nil;
+		}
+		*h = ha;
+		return a;
+	}
+	if (a == t->nil) {
+		if (op == RBTREE_UNION) {
+			*h = hb;
+			return b;
+		}
+		garbage_subtree(t, g, b);
+		*h = 0;
+		return t->nil;
+	}
+
+	// 2.
+	const key_t key = b->key;
+	const int hbc = hb - (rbtree_color(b) == RBTREE_BLACK);
+	node_t *bl = rbtree_left(t, b);
+	node_t *br = rbtree_right(t, b);
+	detach(t, bl);
+	detach(t, br);
+	node_t *al, *ae = t->nil, *ar;
+	int hal, hae = 0, har;
+	split_nodes(t, a, ha, key, 0, &al, &hal, &ar, &har);
+#ifndef RBTREE_MULTISET
+	if (op != RBTREE_UNION)
+#endif
+	{
+		split_nodes(t, ar, har, key, 1, &ae, &hae, &ar, &har);
+	}
+
+	// 3.
+	node_t *l, *r;
+	int hl, hr;
+	setop_task_t task = {t, op, al, hal, bl, hbc, depth - 1, {t->nil, t->nil}, NULL, 0};
+	pthread_t th;
+	if (depth > 0 && pthread_create(&th, NULL, setop_thread, &task) == 0) {
+		r = setop_nodes(t, op, ar, har, br, hbc, depth - 1, g, &hr);
+		pthread_join(th, NULL);
+		l = task.result;
+		hl = task.h;
+		garbage_concat(t, g, &task.garbage);
+	} else {
+		l = setop_nodes(t, op, al, hal, bl, hbc, depth - 1, g, &hl);
+		r = setop_nodes(t, op, ar, har, br, hbc, depth - 1, g, &hr);
+	}
+
+	// 4.
+	switch (op) {
+	case RBTREE_UNION:
+#ifdef RBTREE_MULTISET
+		// 같은 key 노드는 하나만 남긴다 : a쪽(많아야 하나)의 개수를 k에 더하고 버린다
+		if (ae != t->nil) {
+			b->count += ae->count;
+			garbage_push(t, g, ae);
+		}
+#endif
+		return join_nodes(t, l, hl, b, r, hr, h);
+	case RBTREE_INTERSECTION:
+		garbage_push(t, g, b);
+		l = join2(t, l, hl, ae, hae, &hl);
+		return join2(t, l, hl, r, hr, h);
+	default:	// RBTREE_DIFFERENCE
+		garbage_push(t, g, b);
+		garbage_subtree(t, g, ae);
+		return join2(t, l, hl, r, hr, h);
+	}
+}
+
+
+
+/*
+	FUNCTION : set_op	return : fail 0 / success 1
+	1. 노드 수가 적은 트리를 큰 트리의 노드로 옮긴다
+	2. setop_nodes (threads개까지 thread를 나눠 쓴다)
+	3. 버릴 노드들을 풀에 반환
+	4. 결과가 t2 구조체 쪽에 있으면 맞바꿔서 t1로
+	static 트리가 있으면 0
+*/
+int rbtree_set_op(rbtree *t1, rbtree *t2, const rbtree_setop_t op, const int threads) {
+	if (is_static(t1) || is_static(t2)) {
+		return 0;
+	}
+	flush_tombstones(t1);
+	flush_tombstones(t2);
+	// 1.
+	const int t1_small = a_is_smaller(t1, t1->root, t2, t2->root);
+	rbtree *big = t1_small ? t2 : t1;
+	rbtree *small = t1_small ? t1 : t2;
+	node_t *moved;
+	if (!adopt(big, small, &moved)) {
+		return 0;
+	}
+	node_t *a = big == t1 ? big->root : moved;
+	node_t *b = big == t1 ? moved : big->root;
+	big->root = big->nil;
+
+	// 2. thread 2^depth 개까지
+	int depth = 0;
+	while ((1 << depth) < threads) {
+		depth++;
+	}
+	garbage_t g = {big->nil, big->nil};
+	int h;
+	node_t *root = setop_nodes(big, op, a, black_height(big, a), b, black_height(big, b), depth, &g, &h);
+	if (root != big->nil) {
+		rbtree_set_color(root, RBTREE_BLACK);
+	}
+	big->root = root;
+
+	// 3.
+	for (node_t *x = g.head; x != big->nil;) {
+		node_t *next = rbtree_right(big, x);
+		free_node(big, x);
+		x = next;
+	}
+
+	// 4.
+	if (big != t1) {
+		swap_trees(t1, t2);
+	}
+	t1->version++;
+	t2->version++;
+	return 1;
+}
+
+int rbtree_union(rbtree *t1, rbtree *t2) {
+	return rbtree_set_op(t1, t2, RBTREE_UNION, 1);
+}
+
+int rbtree_intersection(rbtree *t1, rbtree *t2) {
+	return rbtree_set_op(t1, t2, RBTREE_INTERSECTION, 1);
+}
+
+int rbtree_difference(rbtree *t1, rbtree *t2) {
+	return rbtree_set_op(t1, t2, RBTREE_DIFFERENCE, 1);
+}
+
+
+
+//++++++++++++++++++++++++batch 구현++++++++++++++++++++++++++++
+
+/*
+	정렬된 key 묶음을 한번에 넣고 빼기
+	- 묶음이 트리에 비해 작으면 : 직전에 넣은(뺀) 자리에서 다음 자리를 찾는다 (finger search)
+	  다음 key는 바로 옆이거나 가까운 곳이라 루트부터 다시 내려가지 않는다
+	- 묶음이 트리의 1 / RBTREE_BATCH_REBUILD 이상이면 : 트리를 순서대로 펼쳐서
+	  묶음과 합친(뺀) 뒤 노드들을 균형잡힌 모양으로 다시 잇는다 : O(n + m)
+	어느 쪽이든 노드는 그대로 두고 링크만 바꾸므로 트리에 남은 노드 포인터는 계속 유효하다
+	정렬되지 않은 묶음은 하나씩 insert / erase 한다
+*/
+#ifndef RBTREE_BATCH_REBUILD
+#define RBTREE_BATCH_REBUILD 4
+#endif
+
+/*
+	FUNCTION : size_upto	return : min(트리 노드 수, limit)
+	세는 데 limit에 비례하는 시간이 드니 먼저 싸게 어림해서 limit을 넘으면 세지 않는다 
+	- black height가 bh면 노드가 2^bh - 1개 이상
+	- key 자리까지 내려간 깊이가 d면 노드는 대략 2^(d - 1)개 
+	  (어림이 틀려도 rebuild를 할지 말지만 바뀌고 결과는 같다)
+*/
+static size_t size_upto(const rbtree *t, const key_t key, const size_t limit) {
+	int d = 0;
+	for (const node_t *x = t->root; x != t->nil; d++) {
+		x = key < x->key ? rbtree_left(t, x) : rbtree_right(t, x);
+	}
+	const int bh = black_height(t, t->root);
+	const int lg = d - 1 > bh ? d - 1 : bh;
+	if (lg >= 63 || ((size_t)1 << lg) - 1 >= limit) {
+		return limit;
+	}
+	return count_upto(t, t->root, limit);
+}
+
+static int is_sorted(const key_t *keys, const size_t n) {
+	for (size_t i = 1; i < n; i++) {
+		if (keys[i] < keys[i - 1]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : relink_sorted	return : subtree root node pointer
+	build_sorted와 같은 모양으로, 새로 만들지 않고 nodes[lo, hi)를 다시 잇는다
+*/
+static node_t *relink_sorted(rbtree *t, node_t **nodes, size_t lo, size_t hi, node_t *parent, int depth, int red_depth) {
+	if (lo >= hi) {
+		return t->nil;
+	}
+	size_t mid = lo + (hi - lo) / 2;
+	node_t *np = nodes[mid];
+	rbtree_set_color(np, depth == red_depth ? RBTREE_RED : RBTREE_BLACK);
+	rbtree_set_parent(t, np, parent);
+	rbtree_set_left(t, np, relink_sorted(t, nodes, lo, mid, np, depth + 1, red_depth));
+	rbtree_set_right(t, np, relink_sorted(t, nodes, mid + 1, hi, np, depth + 1, red_depth));
+	node_update(t, np);
+	return np;
+}
+
+// nodes[0, n)로 트리 전체를 다시 만든다
+static void relink_all(rbtree *t, node_t **nodes, size_t n) {
+	int depth = 0;
+	while (((size_t)2 << depth) - 1 < n) {
+		depth++;
+	}
+	int red_depth = (((size_t)2 << depth) - 1 == n) ? -1 : depth;
+	t->root = relink_sorted(t, nodes, 0, n, t->nil, 0, red_depth);
+}
+
+
+
+/*
+	FUNCTION : rebuild_insert	return : fail 0 / success 1
+	트리(m개)를 순서대로 펼치면서 keys의 새 노드들을 사이사이에 끼우고 다시 잇는다
+	같은 key면 원래 있던 노드가 앞 (insert가 같은 key를 오른쪽에 두는 것과 같다)
+	multiset이면 같은 key끼리 노드 하나로 모으고, 트리에 이미 있는 key는 그 노드의 count에 더한다
+	노드를 다 만들지 못하면 트리는 그대로 두고 0
+*/
+static int rebuild_insert(rbtree *t, const key_t *keys, const size_t n, const size_t m) {
+	node_t **nodes = (node_t **)malloc((m + n) * sizeof(node_t *));
+	if (nodes == NULL) {
+		return 0;
+	}
+	// 1. 새 노드들을 배열 뒤쪽에 먼저 만든다
+	size_t fresh = 0;
+	for (size_t j = 0; j < n; j++) {
+#ifdef RBTREE_MULTISET
+		if (fresh > 0 && nodes[m + fresh - 1]->key == keys[j]) {
+			nodes[m + fresh - 1]->count++;
+			continue;
+		}
+#endif
+		nodes[m + fresh] = new_node(t, RBTREE_RED, keys[j]);
+		if (nodes[m + fresh] == NULL) {
+			while (fresh-- > 0) {
+				free_node(t, nodes[m + fresh]);
+			}
+			free(nodes);
+			return 0;
+		}
+		fresh++;
+	}
+	// 2. 앞에서부터 merge. 쓰는 위치(k)는 읽을 새 노드 위치(m + j)를 넘지 않는다
+	size_t k = 0, j = 0;
+	for (node_t *x = rbtree_iter_begin(t); x != NULL; x = rbtree_iter_next(t, x)) {
+		while (j < fresh && nodes[m + j]->key < x->key) {
+			nodes[k++] = nodes[m + j++];
+		}
+		nodes[k++] = x;
+#ifdef RBTREE_MULTISET
+		if (j < fresh && nodes[m + j]->key == x->key) {
+			x->count += nodes[m + j]->count;
+			free_node(t, nodes[m + j++]);
+		}
+#endif
+	}
+	while (j < fresh) {
+		nodes[k++] = nodes[m + j++];
+	}
+	// 3.
+	relink_all(t, nodes, k);
+	free(nodes);
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : finger_up	return : 다음 key가 있을 서브트리의 루트 (못 찾으면 NULL)
+	f(직전 위치)에서 RBTREE_FINGER_UP 단계까지만 위로 올라가며 찾는다 
+	before(p)는 key가 p보다 앞에 와야 하는지 (insert : key < p->key, lower_bound : key <= p->key)
+	어떤 노드의 왼쪽 자식에서 올라왔고 key가 그 노드보다 앞이면 지금 서브트리 안이다
+	더 멀리 있으면 루트부터 내려가는 것이 낫다 
+	(올라가는 걸음은 서로 의존하는 load라 멀리 떨어진 key는 오히려 느렸다)
+*/
+#ifndef RBTREE_FINGER_UP
+#define RBTREE_FINGER_UP 4
+#endif
+// 이만큼 연달아 finger를 못 쓰면 묶음이 트리에 비해 듬성듬성한 것이라 그만 쓴다
+#define FINGER_GIVE_UP 8
+
+static node_t *finger_up(const rbtree *t, node_t *f, const key_t key, const int inclusive) {
+	node_t *x = f;
+	for (int up = 0; up <= RBTREE_FINGER_UP && x != t->root; up++) {
+		node_t *p = rbtree_parent(t, x);
+		if (x == rbtree_left(t, p) && (key < p->key || (inclusive && key == p->key))) {
+			return x;
+		}
+		x = p;
+	}
+	return x == t->root ? x : NULL;
+}
+
+
+
+/*
+	FUNCTION : finger_insert	return : 넣은 노드 (노드를 못 만들면 NULL)
+	key를 f(직전에 넣은 노드, 없으면 nil) 다음 자리에 넣는다. key >= f->key 이어야 한다
+	finger를 썼으면 *used = 1, 루트부터 내려갔으면 0
+	1. finger_up으로 시작할 서브트리를 찾는다 
+	2. 거기서부터 insert와 같이 내려가서 붙이고 insert_fixup
+	   (multiset이면 내려가다 같은 key를 만나면 count만 올린다)
+*/
+static node_t *finger_insert(rbtree *t, node_t *f, const key_t key, int *used) {
+	// 1.
+	node_t *x = f == t->nil ? NULL : finger_up(t, f, key, 0);
+	*used = x != NULL;
+	if (x == NULL) {
+		x = t->root;
+	}
+
+	// 2.
+	node_t *y = t->nil;
+	while (x != t->nil) {
+		y = x;
+#ifdef RBTREE_MULTISET
+		if (key == x->key) {
+			x->count++;
+			update_to_root(t, x);
+			return x;
+		}
+#endif
+		x = key < x->key ? rbtree_left(t, x) : rbtree_right(t, x);
+	}
+	node_t *z = new_node(t, RBTREE_RED, key);
+	if (z == NULL) {
+		return NULL;
+	}
+	rbtree_set_parent(t, z, y);
+	if (y == t->nil) {
+		t->root = z;
+	} else if (z->key < y->key) {
+		rbtree_set_left(t, y, z);
+	} else {
+		rbtree_set_right(t, y, z);
+	}
+	rbtree_set_left(t, z, t->nil);
+	rbtree_set_right(t, z, t->nil);
+#ifdef RBTREE_ORDER_STAT
+	// 올라온 길 위쪽의 size도 늘어야 하므로 루트까지
+	for (node_t *p = y; p != t->nil; p = rbtree_parent(t, p)) {
+		p->size++;
+	}
+#endif
+	max_to_root(t, y);
+	rbtree_insert_fixup(t, z);
+	return z;
+}
+
+
+
+/*
+	FUNCTION : insert_batch	return : 넣은 key 개수
+	keys[0, n)를 모두 넣는다 (insert를 n번 부른 것과 같은 트리 내용)
+	메모리(풀)가 모자라면 넣을 수 있는 만큼만 넣는다 
+	1. 정렬되어 있지 않으면 하나씩 insert
+	2. 노드 n개 자리를 풀에 한번에 확보
+	3. 트리가 묶음에 비해 작으면 rebuild_insert
+	4. 아니면 finger_insert 반복 (FINGER_GIVE_UP 번 연달아 못 쓰면 루트부터)
+*/
+size_t rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n) {
+	size_t count = 0;
+	flush_tombstones(t);
+	// 1.
+	if (!is_sorted(keys, n)) {
+		for (size_t i = 0; i < n; i++) {
+			count += rbtree_insert(t, keys[i]) != NULL;
+		}
+		return count;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	// 2. 실패해도 노드마다 다시 시도하므로 결과는 보지 않는다
+#ifndef RBTREE_NO_POOL
+	pool_reserve(&t->pool, n);
+#endif
+
+	// 3.
+	const size_t m = size_upto(t, keys[n / 2], n * RBTREE_BATCH_REBUILD);
+	if (m < n * RBTREE_BATCH_REBUILD && rebuild_insert(t, keys, n, m)) {
+		t->version++;
+		return n;
+	}
+
+	// 4.
+	node_t *f = t->nil;
+	int misses = 0;
+	for (; count < n; count++) {
+		int used;
+		node_t *z = finger_insert(t, f, keys[count], &used);
+		if (z == NULL) {
+			break;
+		}
+		misses = used ? 0 : misses + 1;
+		f = misses < FINGER_GIVE_UP ? z : t->nil;
+	}
+	if (count > 0) {
+		t->version++;
+	}
+	return count;
+}
+
+
+
+/*
+	FUNCTION : rebuild_erase	return : 지운 key 개수
+	트리(m개)를 순서대로 펼치면서 keys에 있는 노드는 빼고 (key 하나당 노드 하나)
+	남은 노드들을 다시 잇는다
+	(multiset이면 key 하나당 count 하나를 내리고, count가 다 없어진 노드만 뺀다)
+	순회가 끝날 때까지 노드를 반환하면 안되므로 지울 노드는 배열 뒤쪽에 모아둔다 
+*/
+static size_t rebuild_erase(rbtree *t, const key_t *keys, const size_t n, const size_t m, node_t **nodes) {
+	size_t keep = 0, drop = m, j = 0, erased = 0;
+	for (node_t *x = rbtree_iter_begin(t); x != NULL; x = rbtree_iter_next(t, x)) {
+		while (j < n && keys[j] < x->key) {
+			j++;
+		}
+#ifdef RBTREE_MULTISET
+		for (; j < n && keys[j] == x->key && x->count > 1; j++) {
+			x->count--;
+			erased++;
+		}
+#endif
+		if (j < n && keys[j] == x->key) {
+			nodes[--drop] = x;
+			j++;
+			erased++;
+		} else {
+			nodes[keep++] = x;
+		}
+	}
+	relink_all(t, nodes, keep);
+	for (size_t i = drop; i < m; i++) {
+		free_node(t, nodes[i]);
+	}
+	return erased;
+}
+
+
+
+/*
+	FUNCTION : finger_lower_bound	return : node pointer (없으면 NULL)
+	key 이상인 첫 노드. f 앞의 노드들은 모두 key보다 작아야 한다 
+	finger_up으로 찾은 서브트리 안에 답이 없으면 답은 그 서브트리 바로 위 부모다
+	finger를 못 쓰면 lower_bound (*used = 0)
+*/
+static node_t *finger_lower_bound(const rbtree *t, node_t *f, const key_t key, int *used) {
+	if (f->key >= key) {
+		*used = 1;
+		return f;
+	}
+	node_t *x = finger_up(t, f, key, 1);
+	*used = x != NULL;
+	if (x == NULL) {
+		return rbtree_lower_bound(t, key);
+	}
+	node_t *result = x == t->root ? NULL : rbtree_parent(t, x);
+	while (x != t->nil) {
+		if (x->key >= key) {
+			result = x;
+			x = rbtree_left(t, x);
+		} else {
+			x = rbtree_right(t, x);
+		}
+	}
+	return result;
+}
+
+
+
+/*
+	FUNCTION : erase_batch	return : 지운 key 개수
+	keys의 key마다 그 key 노드를 하나씩 지운다 (없는 key는 건너뛴다)
+	(multiset이면 rbtree_erase와 같이 count부터 내린다)
+	1. 정렬되어 있지 않으면 하나씩 find + erase
+	2. 트리가 묶음에 비해 작으면 rebuild_erase
+	3. 아니면 지운 노드의 다음 노드를 finger로 삼아 다음 key를 찾는다 
+	   (erase는 노드를 옮기지 않고 링크만 바꾸므로 다음 노드는 그대로 살아있다)
+	   FINGER_GIVE_UP 번 연달아 못 쓰면 나머지는 루트부터
+*/
+size_t rbtree_erase_batch(rbtree *t, const key_t *keys, const size_t n) {
+	size_t count = 0;
+	flush_tombstones(t);
+	// 1.
+	if (!is_sorted(keys, n)) {
+		for (size_t i = 0; i < n; i++) {
+			node_t *np = rbtree_find(t, keys[i]);
+			if (np != NULL) {
+				rbtree_erase(t, np);
+				count++;
+			}
+		}
+		return count;
+	}
+	if (n == 0 || t->root == t->nil) {
+		return 0;
+	}
+
+	// 2.
+	const size_t m = size_upto(t, keys[n / 2], n * RBTREE_BATCH_REBUILD);
+	if (m < n * RBTREE_BATCH_REBUILD) {
+		node_t **nodes = (node_t **)malloc(m * sizeof(node_t *));
+		if (nodes != NULL) {
+			count = rebuild_erase(t, keys, n, m, nodes);
+			free(nodes);
+			t->version++;
+			return count;
+		}
+	}
+
+	// 3.
+	node_t *f = rbtree_lower_bound(t, keys[0]);
+	int misses = 0;
+	for (size_t i = 0; i < n; i++) {
+		node_t *z;
+		if (misses < FINGER_GIVE_UP) {
+			if (f == NULL) {	// 남은 노드가 모두 keys[i]보다 작다
+				break;
+			}
+			int used;
+			f = finger_lower_bound(t, f, keys[i], &used);
+			misses = used ? 0 : misses + 1;
+			if (f == NULL || f->key != keys[i]) {
+				continue;
+			}
+			z = f;
+			f = rbtree_count(z) > 1 ? z : rbtree_iter_next(t, z);	// multiset이면 z가 남을 수 있다
+		} else {	// finger가 필요없으니 다음 노드도 구하지 않는다
+			z = rbtree_find(t, keys[i]);
+			if (z == NULL) {
+				continue;
+			}
+		}
+		rbtree_erase(t, z);
+		count++;
+	}
+	return count;
+}
+
+
+
+#ifdef RBTREE_STATS
+//++++++++++++++++++++++++계측 구현++++++++++++++++++++++++++++
+
+// x를 루트로 하는 서브트리의 높이 (노드 수, NIL은 0)
+static size_t stats_height(const rbtree *t, const node_t *x) {
+	if (x == t->nil) {
+		return 0;
+	}
+	const size_t l = stats_height(t, rbtree_left(t, x));
+	const size_t r = stats_height(t, rbtree_right(t, x));
+	return (l > r ? l : r) + 1;
+}
+
+
+
+/*
+	FUNCTION : stats	return : void
+	지금까지 쌓인 카운터를 out에 복사하고 height / black_height를 채운다
+	height는 모든 노드를 훑으므로 O(n), black_height는 O(log n)
+	카운터는 0으로 돌리지 않는다 (구간을 보려면 두번 불러서 뺀다)
+*/
+void rbtree_stats(const rbtree *t, rbtree_stats_t *out) {
+	rbtree_stats_t *s = &((rbtree *)t)->stats;
+	size_t *dst = (size_t *)out;
+	const size_t *src = (const size_t *)s;
+	for (size_t i = 0; i < sizeof(rbtree_stats_t) / sizeof(size_t); i++) {
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+	}
+	out->height = stats_height(t, t->root);
+	out->black_height = (size_t)black_height(t, t->root);
+}
+#endif
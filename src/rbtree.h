@@ -2,41 +2,460 @@
 #define _RBTREE_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum { RBTREE_RED, RBTREE_BLACK } color_t;
 
 typedef int key_t;
 
+#if defined(RBTREE_COMPACT) && defined(RBTREE_COMPACT32)
+#error "RBTREE_COMPACT and RBTREE_COMPACT32 cannot be used together"
+#endif
+#if defined(RBTREE_COMPACT32) && defined(RBTREE_NO_POOL)
+#error "RBTREE_COMPACT32 needs the node pool"
+#endif
+#if defined(RBTREE_LAZY_DELETE) && defined(RBTREE_ORDER_STAT)
+#error "RBTREE_LAZY_DELETE cannot keep subtree sizes with an O(1) erase"
+#endif
+#if defined(RBTREE_INTERVAL) && (defined(RBTREE_MULTISET) || defined(RBTREE_LAZY_DELETE))
+#error "RBTREE_INTERVAL needs one node per interval and an exact subtree max"
+#endif
+
+#if defined(RBTREE_COMPACT) || defined(RBTREE_COMPACT32)
+typedef uint32_t node_size_t;	// compact layout에서는 size도 4바이트
+#else
+typedef size_t node_size_t;
+#endif
+
 
 /*
     노드 구조체 
     노드 색, value 값, 부모&자식 포인터 노드 로 구성됨 
+    -DRBTREE_ORDER_STAT 이면 서브트리 노드 개수(size)를 추가로 들고있다
+    (rank / select 용, NIL의 size는 0)
+
+    -DRBTREE_MULTISET 이면 같은 key를 노드 하나에 모으고 그 개수(count)를 들고있다
+    (같은 key가 많을 때 노드 수와 트리 높이가 줄어든다. 아래 multiset mode 참고)
+
+    -DRBTREE_CONCURRENT 이면 노드마다 lock byte를 하나 더 들고있다
+    (rbtree_conc의 writer들이 경로의 노드만 잠그고 내려가는 용도. 기본 layout은 40바이트가 된다)
+
+    -DRBTREE_LAZY_DELETE 이면 노드마다 지워진 표시(dead) byte를 하나 더 들고있다
+    (rbtree_erase_lazy 용. 아래 lazy delete mode 참고. 기본 layout은 40바이트, COMPACT는 padding 자리에 들어간다)
+
+    -DRBTREE_INTERVAL 이면 노드가 구간 [key, hi]를 들고 서브트리에서 가장 큰 hi(max)를 추가로 들고있다
+    (rbtree_overlaps 용. 아래 interval mode 참고. NIL의 max는 INT_MIN)
+
+    layout은 compile time에 고른다. 필드는 아래 접근자로만 읽고 쓴다 
+    - 기본 : color / key / 포인터 3개 (x86-64에서 32바이트)
+    - RBTREE_COMPACT : color를 parent 포인터의 최하위 bit에 넣는다 
+      (노드는 최소 4바이트 정렬이라 그 bit는 항상 0)
+      ORDER_STAT과 같이 쓰면 40 -> 32바이트 (MULTISET만 써도 count가 padding 자리에 들어가 32바이트)
+    - RBTREE_COMPACT32 : 노드는 트리의 풀(연속된 배열) 안에만 있고 
+      링크는 그 배열의 uint32_t index. parent index << 1 | color
+      노드 하나가 16바이트 (ORDER_STAT이면 20바이트)
 */
+#if defined(RBTREE_COMPACT)
+typedef struct node_t {
+	uintptr_t parent_color;
+	struct node_t *left, *right;
+	key_t key;
+#ifdef RBTREE_ORDER_STAT
+	node_size_t size;
+#endif
+#ifdef RBTREE_INTERVAL
+	key_t hi, max;
+#endif
+#ifdef RBTREE_MULTISET
+	node_size_t count;
+#endif
+#ifdef RBTREE_CONCURRENT
+	uint8_t lock;
+#endif
+#ifdef RBTREE_LAZY_DELETE
+	uint8_t dead;
+#endif
+} node_t;
+#elif defined(RBTREE_COMPACT32)
+typedef struct node_t {
+	uint32_t parent_color;
+	uint32_t left, right;
+	key_t key;
+#ifdef RBTREE_ORDER_STAT
+	node_size_t size;
+#endif
+#ifdef RBTREE_INTERVAL
+	key_t hi, max;
+#endif
+#ifdef RBTREE_MULTISET
+	node_size_t count;
+#endif
+#ifdef RBTREE_CONCURRENT
+	uint8_t lock;
+#endif
+#ifdef RBTREE_LAZY_DELETE
+	uint8_t dead;
+#endif
+} node_t;
+#else
 typedef struct node_t {
 	color_t color;
 	key_t key;
 	struct node_t *parent, *left, *right;
+#ifdef RBTREE_ORDER_STAT
+	node_size_t size;
+#endif
+#ifdef RBTREE_INTERVAL
+	key_t hi, max;
+#endif
+#ifdef RBTREE_MULTISET
+	node_size_t count;
+#endif
+#ifdef RBTREE_CONCURRENT
+	uint8_t lock;
+#endif
+#ifdef RBTREE_LAZY_DELETE
+	uint8_t dead;
+#endif
 } node_t;
+#endif
+
+
+#ifndef RBTREE_COMPACT32
+/*
+	노드 풀 chunk 구조체
+	노드들을 연속된 메모리 덩어리로 한번에 할당해서 들고있음
+	chunk끼리는 next로 연결되어 delete 시 chunk 단위로 free 한다
+*/
+typedef struct node_chunk_t {
+	struct node_chunk_t *next;
+	size_t cap;			// 이 chunk가 담을 수 있는 노드 수
+	node_t nodes[];
+} node_chunk_t;
+
+
+/*
+	chunk 묶음 (group)
+	트리는 자기 group을 하나 만들어서 새 chunk를 모두 거기에 붙인다 (붙이는 건 그 트리뿐)
+	split / join은 노드를 그 자리 그대로 다른 트리에 넘기므로 
+	트리는 자기 노드가 들어있을 수 있는 다른 트리의 group들도 들고 있고 (node_pool_t의 shared)
+	group의 chunk들은 그 group을 든 트리가 모두 delete 될 때 free 한다 
+	refs는 트리마다 다른 thread에서 delete 할 수 있어서 atomic으로 센다 
+*/
+typedef struct node_group_t {
+	node_chunk_t *chunks;	// 가장 최근에 만든 chunk가 맨 앞
+	size_t refs;			// 이 group을 든 트리 수
+} node_group_t;
+
+
+/*
+	트리별 노드 풀 (slab allocator)
+	반환된 노드는 free_list에 (right 포인터로) 연결해 두었다가 재사용
+	-DRBTREE_NO_POOL 로 빌드하면 노드마다 malloc/free 하는 기존 방식 사용
+	rbtree_init_static 트리는 chunk 대신 부르는 쪽 배열(fixed)에서만 꺼낸다
+*/
+typedef struct {
+	node_group_t *own;		// 이 트리가 chunk를 붙이는 group (첫 chunk를 만들 때 만든다)
+	size_t used;			// own의 맨 앞 chunk (fixed면 fixed 배열)에서 꺼내간 노드 수
+	node_t *free_list;		// erase로 반환된 노드들
+	node_group_t **shared;	// split / join으로 넘겨받은 노드가 있을 수 있는 다른 group들
+	size_t nshared, shared_cap;
+	node_t *fixed;			// rbtree_init_static의 노드 배열 (없으면 NULL)
+	size_t fixed_cap;
+} node_pool_t;
+#else
+/*
+	RBTREE_COMPACT32 노드 풀
+	index로 노드를 찾아야 하므로 노드 배열 하나만 쓴다 
+	new_rbtree에서 cap개 분량의 가상 주소를 예약해두고 (실제 메모리는 쓸 때 잡힘)
+	절대 옮기지 않으므로 노드 포인터는 계속 유효하다 
+	index 0 은 sentinel(nil), free_list 0 은 비어있음을 뜻한다 
+*/
+#ifndef RBTREE_COMPACT32_MAX_NODES
+#define RBTREE_COMPACT32_MAX_NODES ((size_t)1 << 26)
+#endif
+
+typedef struct {
+	node_t *base;
+	size_t cap;				// 예약한 노드 수
+	size_t used;			// 지금까지 꺼내간 노드 수
+	uint32_t free_list;		// erase로 반환된 노드들 (right index로 연결)
+	int fixed;				// base가 rbtree_init_static의 배열이면 1 (munmap 하지 않는다)
+} node_pool_t;
+#endif
+
+
+#ifdef RBTREE_STATS
+/*
+	트리별 계측 카운터 (-DRBTREE_STATS 일 때만 있다)
+	latency가 튀는 이유가 깊은 탐색인지 긴 fixup인지 보려는 용도
+	- 회전 수, fixup 반복을 CASE별로 
+	  (insert CASE 2는 항상 CASE 3으로 이어지므로 insert fixup 반복 수 = CASE 1 + CASE 3)
+	- rbtree_find / rbtree_insert가 비교한 노드 수 (합과 최대)
+	- 노드를 꺼내고 반환한 횟수 (sentinel 포함)
+	카운터는 relaxed atomic으로 올린다 (병렬 집합 연산의 회전 / 노드 반환, rbtree_conc writer들의 노드 꺼내기 / 반환,
+	lock 없이 같은 트리에 rbtree_find를 부르는 여러 thread)
+	height / black_height는 rbtree_stats가 부를 때 트리를 훑어서 채운다 
+*/
+typedef struct {
+	size_t rotate_left, rotate_right;
+	size_t insert_case[3];		// [0] : CASE 1 ... [2] : CASE 3
+	size_t erase_case[4];		// [0] : CASE 1 ... [3] : CASE 4
+	size_t finds, find_depth_sum, find_depth_max;
+	size_t inserts, insert_depth_sum, insert_depth_max;
+	size_t allocs, frees;
+	size_t height;				// 루트부터 가장 깊은 노드까지의 노드 수 (빈 트리 0)
+	size_t black_height;		// 루트부터 NIL까지의 BLACK 노드 수 (NIL 제외)
+} rbtree_stats_t;
+#endif
 
 
 /*
 	rbtree 트리 구조체 
 	루트노드, NIL을 담당하는 sentinel 노드로 구성됨 
+	version은 트리가 바뀔 때마다 (insert / erase) 1씩 올라간다 
+	(rbtree_freeze 스냅샷이 낡았는지 확인하는 용도)
 */
 typedef struct {
 	node_t *root;
 	node_t *nil;  // for sentinel
+	unsigned long version;
+#ifndef RBTREE_NO_POOL
+	node_pool_t pool;
+#endif
+#ifdef RBTREE_STATS
+	rbtree_stats_t stats;
+#endif
+#ifdef RBTREE_LAZY_DELETE
+	size_t nodes;		// 이 트리의 노드 수 (sentinel, tombstone 포함)
+	size_t dead;		// 그 중 tombstone 수
+#endif
 } rbtree;
 
+
+/*
+	노드 필드 접근자
+	layout과 상관없이 rbtree_parent / left / right / color 로 읽는다 
+	set_ 계열은 트리 구현 내부용 (함부로 부르면 트리가 깨진다)
+	링크는 relaxed atomic으로 쓴다 : rbtree_sync의 reader가 lock 없이 같이 읽기 때문
+	(x86-64 / arm64에서는 보통 store와 같은 명령. writer끼리는 여전히 lock이 필요하다)
+	_relaxed 계열은 그런 reader용 load (seq를 다시 확인하기 전까지 값은 믿을 수 없다)
+*/
+#define RBTREE_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define RBTREE_STORE(field, v) __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
+
+#if defined(RBTREE_COMPACT)
+static inline node_t *rbtree_parent(const rbtree *t, const node_t *n) {
+	return (node_t *)(n->parent_color & ~(uintptr_t)1);
+}
+static inline node_t *rbtree_left(const rbtree *t, const node_t *n) { return n->left; }
+static inline node_t *rbtree_right(const rbtree *t, const node_t *n) { return n->right; }
+static inline color_t rbtree_color(const node_t *n) { return (color_t)(n->parent_color & 1); }
+
+static inline node_t *rbtree_parent_relaxed(const rbtree *t, const node_t *n) {
+	return (node_t *)(RBTREE_LOAD(n->parent_color) & ~(uintptr_t)1);
+}
+static inline node_t *rbtree_left_relaxed(const rbtree *t, const node_t *n) { return RBTREE_LOAD(n->left); }
+static inline node_t *rbtree_right_relaxed(const rbtree *t, const node_t *n) { return RBTREE_LOAD(n->right); }
+
+static inline void rbtree_set_parent(const rbtree *t, node_t *n, node_t *p) {
+	RBTREE_STORE(n->parent_color, (uintptr_t)p | (n->parent_color & 1));
+}
+static inline void rbtree_set_left(const rbtree *t, node_t *n, node_t *v) { RBTREE_STORE(n->left, v); }
+static inline void rbtree_set_right(const rbtree *t, node_t *n, node_t *v) { RBTREE_STORE(n->right, v); }
+static inline void rbtree_set_color(node_t *n, color_t c) {
+	RBTREE_STORE(n->parent_color, (n->parent_color & ~(uintptr_t)1) | (uintptr_t)c);
+}
+#elif defined(RBTREE_COMPACT32)
+static inline node_t *rbtree_parent(const rbtree *t, const node_t *n) {
+	return t->pool.base + (n->parent_color >> 1);
+}
+static inline node_t *rbtree_left(const rbtree *t, const node_t *n) { return t->pool.base + n->left; }
+static inline node_t *rbtree_right(const rbtree *t, const node_t *n) { return t->pool.base + n->right; }
+static inline color_t rbtree_color(const node_t *n) { return (color_t)(n->parent_color & 1); }
+
+static inline node_t *rbtree_parent_relaxed(const rbtree *t, const node_t *n) {
+	return t->pool.base + (RBTREE_LOAD(n->parent_color) >> 1);
+}
+static inline node_t *rbtree_left_relaxed(const rbtree *t, const node_t *n) { return t->pool.base + RBTREE_LOAD(n->left); }
+static inline node_t *rbtree_right_relaxed(const rbtree *t, const node_t *n) { return t->pool.base + RBTREE_LOAD(n->right); }
+
+static inline void rbtree_set_parent(const rbtree *t, node_t *n, node_t *p) {
+	RBTREE_STORE(n->parent_color, (uint32_t)(p - t->pool.base) << 1 | (n->parent_color & 1));
+}
+static inline void rbtree_set_left(const rbtree *t, node_t *n, node_t *v) { RBTREE_STORE(n->left, (uint32_t)(v - t->pool.base)); }
+static inline void rbtree_set_right(const rbtree *t, node_t *n, node_t *v) { RBTREE_STORE(n->right, (uint32_t)(v - t->pool.base)); }
+static inline void rbtree_set_color(node_t *n, color_t c) {
+	RBTREE_STORE(n->parent_color, (n->parent_color & ~(uint32_t)1) | (uint32_t)c);
+}
+#else
+static inline node_t *rbtree_parent(const rbtree *t, const node_t *n) { return n->parent; }
+static inline node_t *rbtree_left(const rbtree *t, const node_t *n) { return n->left; }
+static inline node_t *rbtree_right(const rbtree *t, const node_t *n) { return n->right; }
+static inline color_t rbtree_color(const node_t *n) { return n->color; }
+
+static inline node_t *rbtree_parent_relaxed(const rbtree *t, const node_t *n) { return RBTREE_LOAD(n->parent); }
+static inline node_t *rbtree_left_relaxed(const rbtree *t, const node_t *n) { return RBTREE_LOAD(n->left); }
+static inline node_t *rbtree_right_relaxed(const rbtree *t, const node_t *n) { return RBTREE_LOAD(n->right); }
+
+static inline void rbtree_set_parent(const rbtree *t, node_t *n, node_t *p) { RBTREE_STORE(n->parent, p); }
+static inline void rbtree_set_left(const rbtree *t, node_t *n, node_t *v) { RBTREE_STORE(n->left, v); }
+static inline void rbtree_set_right(const rbtree *t, node_t *n, node_t *v) { RBTREE_STORE(n->right, v); }
+static inline void rbtree_set_color(node_t *n, color_t c) { n->color = c; }
+#endif
+
+// key / 트리의 root도 같은 이유로 (count는 아래 multiset mode)
+static inline key_t rbtree_key_relaxed(const node_t *n) { return RBTREE_LOAD(n->key); }
+static inline node_t *rbtree_root_relaxed(const rbtree *t) { return RBTREE_LOAD(t->root); }
+
+/*
+	multiset mode (-DRBTREE_MULTISET)
+	기본은 같은 key를 insert 할 때마다 노드가 하나씩 더 생긴다 (오른쪽으로)
+	multiset mode에서는 key마다 노드가 하나뿐이고 같은 key의 개수를 count에 센다 
+	- insert : 이미 있는 key면 그 노드의 count만 1 올리고 그 노드를 반환 (할당 없음)
+	- erase : count가 2 이상이면 1 내리기만 한다. 1이었으면 노드를 지운다
+	- to_array / range : 노드마다 key를 count번 복사한다
+	- ORDER_STAT의 size / select / rank는 count를 합친 개수로 센다
+	- iterator / find / range_foreach는 노드 단위 (노드 하나가 같은 key 전부)
+	rbtree_count(n)은 노드 하나에 모인 key 개수 (multiset이 아니면 항상 1)
+*/
+#ifdef RBTREE_MULTISET
+static inline size_t rbtree_count(const node_t *n) { return n->count; }
+static inline size_t rbtree_count_relaxed(const node_t *n) { return RBTREE_LOAD(n->count); }
+#else
+static inline size_t rbtree_count(const node_t *n) { return 1; }
+static inline size_t rbtree_count_relaxed(const node_t *n) { return 1; }
+#endif
+
+/*
+	lazy delete mode (-DRBTREE_LAZY_DELETE)
+	rbtree_erase는 노드를 떼어내고 erase_fixup으로 회전 / 색 바꾸기를 한 뒤 반환하므로
+	erase 하나의 시간이 들쭉날쭉하다 (요청 처리 경로의 tail latency)
+	- rbtree_erase_lazy : 노드에 dead 표시만 한다 (tombstone). O(1), 트리 모양은 그대로
+	  multiset이면 count가 2 이상일 때는 count만 내린다
+	- find / find_many / min / max / iterator / lower_bound / upper_bound / range / to_array는
+	  tombstone을 없는 노드로 보고 건너뛴다 (rbtree_save도 살아있는 key만 파일에 쓴다)
+	- rbtree_insert가 내려가다 같은 key의 tombstone을 만나면 새 노드 대신 그 노드를 되살린다
+	- rbtree_compact : tombstone들을 rbtree_erase로 실제로 지우고 반환한 개수를 돌려준다 O(n + d log n)
+	  살아있는 노드는 옮기지 않으므로 들고있던 노드 포인터는 계속 유효하다
+	  tombstone이 (sentinel을 뺀) 노드 수의 RBTREE_TOMBSTONE_RATIO % 를 넘으면 erase_lazy가 직접 부른다
+	  0으로 빌드하면 자동으로는 부르지 않는다 (요청 처리 경로 밖에서 직접 부른다)
+	- topdown / batch / join / split / 집합 연산은 먼저 compact 하고 시작한다
+	노드 수는 풀에서 꺼내고 반환할 때 센다. ORDER_STAT과는 같이 쓸 수 없다
+	(tombstone을 size에서 빼려면 루트까지 올라가야 한다)
+	rbtree_is_dead(n)은 tombstone이면 1 (lazy delete mode가 아니면 항상 0)
+*/
+#ifdef RBTREE_LAZY_DELETE
+#ifndef RBTREE_TOMBSTONE_RATIO
+#define RBTREE_TOMBSTONE_RATIO 25
+#endif
+static inline int rbtree_is_dead(const node_t *n) { return n->dead; }
+#else
+static inline int rbtree_is_dead(const node_t *n) { return 0; }
+#endif
+
+/*
+	interval mode (-DRBTREE_INTERVAL)
+	노드 하나가 닫힌 구간 [key, hi] 하나 (key가 시작점, 트리는 key 순서 그대로)
+	노드마다 서브트리의 hi 중 가장 큰 값(max)을 들고있어서 겹치는 구간만 찾아 내려갈 수 있다 
+	- rbtree_insert_interval(t, lo, hi) : 구간을 넣는다 (같은 lo도 하나 더). rbtree_insert(t, k)는 [k, k]
+	- rbtree_overlaps(t, lo, hi, visit, arg) : [lo, hi]와 겹치는 구간의 노드를 key 순서로 visit에 넘긴다
+	- max는 ORDER_STAT의 size처럼 회전 / transplant / 두 fixup을 지나며 node_update로 다시 계산한다
+	  (join / split / 집합 연산 / batch / topdown도 그대로 쓸 수 있다)
+	- frozen / persist / mmap 스냅샷과 from_sorted는 key만 다루므로 [key, key]가 된다
+	같은 key를 노드 하나에 모으는 MULTISET, max를 못 줄이는 LAZY_DELETE와는 같이 쓸 수 없다
+*/
+
+// range_foreach 등에서 노드를 하나씩 넘겨받는 callback. 0이 아니면 순회 중단
+typedef int (*rbtree_visit_t)(const node_t *, void *);
+
 rbtree *new_rbtree(void);
 void delete_rbtree(rbtree *);
 
+#ifndef RBTREE_NO_POOL
+/*
+	static mode : malloc을 부르면 안되는 thread용 (실시간 경로)
+	rbtree 구조체와 노드 배열을 부르는 쪽이 준비하고 rbtree_init_static(t, buf, capacity)
+	- sentinel도 buf[0]에 있다. key는 capacity - 1개까지 (RBTREE_STATIC_NODES(n)이 n개짜리 크기)
+	- 노드는 buf에서만 꺼내고, erase로 반환된 노드는 free_list로 다시 쓴다
+	- 자리가 없으면 insert / insert_topdown은 할당하지 않고 NULL을 돌려준다
+	- insert / erase는 비교 O(log n)에 회전 최대 2 / 3번, 노드 꺼내기 / 반환 O(1)
+	  (높이는 2 log2(capacity) 이하. RBTREE_LAZY_DELETE면 자동 compact가 O(n)이므로 RATIO 0으로)
+	- 다른 트리와 노드를 주고받는 join / split / 집합 연산은 실패를 돌려준다
+	  batch / from_sorted / to_array_par처럼 작업 버퍼를 malloc 하는 함수는 쓰지 않는다
+	- delete_rbtree를 부르지 않는다 (t와 buf는 부르는 쪽이 버린다). 다시 init_static 하면 빈 트리
+*/
+#define RBTREE_STATIC_NODES(n) ((size_t)(n) + 1)
+
+int rbtree_init_static(rbtree *, node_t *, const size_t);
+#endif
+
+rbtree *rbtree_from_sorted(const key_t *, size_t);
+rbtree *rbtree_from_unsorted(const key_t *, size_t);
+
 node_t *rbtree_insert(rbtree *, const key_t);
 node_t *rbtree_find(const rbtree *, const key_t);
+size_t rbtree_find_many(const rbtree *, const key_t *, const size_t, node_t **);
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
 int rbtree_erase(rbtree *, node_t *);
 
+// fixup으로 다시 올라오지 않고 내려가면서 균형을 맞추는 insert / erase (erase는 key로 지운다)
+node_t *rbtree_insert_topdown(rbtree *, const key_t);
+int rbtree_erase_topdown(rbtree *, const key_t);
+
+size_t rbtree_insert_batch(rbtree *, const key_t *, const size_t);
+size_t rbtree_erase_batch(rbtree *, const key_t *, const size_t);
+
 int rbtree_to_array(const rbtree *, key_t *, const size_t);
 
+node_t *rbtree_iter_begin(const rbtree *);
+node_t *rbtree_iter_last(const rbtree *);
+node_t *rbtree_iter_next(const rbtree *, const node_t *);
+node_t *rbtree_iter_prev(const rbtree *, const node_t *);
+
+node_t *rbtree_lower_bound(const rbtree *, const key_t);
+node_t *rbtree_upper_bound(const rbtree *, const key_t);
+size_t rbtree_range(const rbtree *, const key_t, const key_t, key_t *, const size_t);
+size_t rbtree_range_foreach(const rbtree *, const key_t, const key_t, rbtree_visit_t, void *);
+
+// rbtree_set_op 종류 (t1 = t1 op t2)
+typedef enum { RBTREE_UNION, RBTREE_INTERSECTION, RBTREE_DIFFERENCE } rbtree_setop_t;
+
+/*
+	join / split 비용과 노드 포인터
+	- 기본 / RBTREE_COMPACT : split은 O(log n). 노드를 옮기지 않고 두 트리가 sentinel과 풀의 chunk를 같이 쓴다
+	  (chunk는 둘 다 delete 된 뒤 free). join은 split으로 나눴던 트리끼리면 O(log n),
+	  아니면 작은 쪽 노드 수만큼 NIL 링크를 고친다. 어느 쪽이든 노드 포인터는 계속 유효하다
+	- RBTREE_NO_POOL : join / split 모두 O(log n + 작은 쪽). 노드 포인터는 계속 유효하다
+	- RBTREE_COMPACT32 : join / split 모두 작은 쪽 노드를 다른 트리의 풀로 복사한다 O(log n + 작은 쪽)
+	  복사된 쪽의 노드 포인터는 무효가 된다
+*/
+node_t *rbtree_join(rbtree *, const key_t, rbtree *);
+int rbtree_split(rbtree *, const key_t, rbtree *);
+int rbtree_union(rbtree *, rbtree *);
+int rbtree_intersection(rbtree *, rbtree *);
+int rbtree_difference(rbtree *, rbtree *);
+int rbtree_set_op(rbtree *, rbtree *, const rbtree_setop_t, const int);
+
+#ifdef RBTREE_ORDER_STAT
+size_t rbtree_size(const rbtree *);
+node_t *rbtree_select(const rbtree *, size_t);
+size_t rbtree_rank(const rbtree *, const key_t);
+#endif
+
+#ifdef RBTREE_INTERVAL
+node_t *rbtree_insert_interval(rbtree *, const key_t, const key_t);
+size_t rbtree_overlaps(const rbtree *, const key_t, const key_t, rbtree_visit_t, void *);
+#endif
+
+#ifdef RBTREE_STATS
+void rbtree_stats(const rbtree *, rbtree_stats_t *);
+#endif
+
+#ifdef RBTREE_LAZY_DELETE
+int rbtree_erase_lazy(rbtree *, node_t *);
+size_t rbtree_compact(rbtree *);
+#endif
+
 #endif  // _RBTREE_H_
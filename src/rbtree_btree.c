@@ -0,0 +1,401 @@
+#include "rbtree_btree.h"
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define K RBTREE_BTREE_KEYS
+// root가 아닌 노드의 최소 key 수 (leaf는 K개를 반씩 나누고, 안쪽 노드는 가운데를 부모로 올린다)
+#define LEAF_MIN (K / 2)
+#define INNER_MIN (K / 2 - 1)
+
+
+
+//++++++++++++++++++++++++노드 안 탐색 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : mask_less / mask_greater	return : bit i = (keys[i] < key) / (keys[i] > key)
+	노드의 key K개를 한번에 비교한다 (AVX2 : 8개씩, SSE2 : 4개씩, 아니면 하나씩)
+	쓰지 않는 자리([n, K))의 값도 비교되므로 부르는 쪽이 lanes(n)으로 가린다
+*/
+static inline uint32_t mask_less(const bnode_t *x, const key_t key) {
+	uint32_t mask = 0;
+#if defined(__AVX2__)
+	const __m256i kv = _mm256_set1_epi32(key);
+	for (int i = 0; i < K; i += 8) {
+		const __m256i v = _mm256_load_si256((const __m256i *)(x->keys + i));
+		mask |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(kv, v))) << i;
+	}
+#elif defined(__SSE2__)
+	const __m128i kv = _mm_set1_epi32(key);
+	for (int i = 0; i < K; i += 4) {
+		const __m128i v = _mm_load_si128((const __m128i *)(x->keys + i));
+		mask |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(kv, v))) << i;
+	}
+#else
+	for (int i = 0; i < K; i++) {
+		mask |= (uint32_t)(x->keys[i] < key) << i;
+	}
+#endif
+	return mask;
+}
+
+static inline uint32_t mask_greater(const bnode_t *x, const key_t key) {
+	uint32_t mask = 0;
+#if defined(__AVX2__)
+	const __m256i kv = _mm256_set1_epi32(key);
+	for (int i = 0; i < K; i += 8) {
+		const __m256i v = _mm256_load_si256((const __m256i *)(x->keys + i));
+		mask |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, kv))) << i;
+	}
+#elif defined(__SSE2__)
+	const __m128i kv = _mm_set1_epi32(key);
+	for (int i = 0; i < K; i += 4) {
+		const __m128i v = _mm_load_si128((const __m128i *)(x->keys + i));
+		mask |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, kv))) << i;
+	}
+#else
+	for (int i = 0; i < K; i++) {
+		mask |= (uint32_t)(x->keys[i] > key) << i;
+	}
+#endif
+	return mask;
+}
+
+static inline uint32_t lanes(const uint32_t n) {
+	return n >= 32 ? UINT32_MAX : (1u << n) - 1;
+}
+
+// leaf : key가 들어갈 자리 (key보다 작은 key 수)
+static inline uint32_t count_less(const bnode_t *x, const key_t key) {
+	return (uint32_t)__builtin_popcount(mask_less(x, key) & lanes(x->n));
+}
+
+// 안쪽 노드 : key가 있을 child (key 이하인 key 수)
+static inline uint32_t count_le(const bnode_t *x, const key_t key) {
+	return (uint32_t)__builtin_popcount(~mask_greater(x, key) & lanes(x->n));
+}
+
+
+
+//++++++++++++++++++++++++생성 / 삭제 구현++++++++++++++++++++++++++++
+
+static bnode_t *bnode_new(const int leaf) {
+	bnode_t *x = (bnode_t *)aligned_alloc(64, sizeof(bnode_t));
+	if (x == NULL) {
+		return NULL;
+	}
+	memset(x, 0, sizeof(bnode_t));
+	x->leaf = leaf;
+	return x;
+}
+
+static void bnode_free_all(bnode_t *x, const int height) {
+	if (height > 1) {
+		for (uint32_t i = 0; i <= x->n; i++) {
+			bnode_free_all(x->child[i], height - 1);
+		}
+	}
+	free(x);
+}
+
+/*
+	FUNCTION : btree_new	return : rbtree_btree pointer
+	빈 leaf 하나가 root
+*/
+rbtree_btree *rbtree_btree_new(void) {
+	rbtree_btree *b = (rbtree_btree *)malloc(sizeof(rbtree_btree));
+	if (b == NULL) {
+		return NULL;
+	}
+	b->root = bnode_new(1);
+	if (b->root == NULL) {
+		free(b);
+		return NULL;
+	}
+	b->head = b->root;
+	b->size = 0;
+	b->height = 1;
+	return b;
+}
+
+void rbtree_btree_delete(rbtree_btree *b) {
+	bnode_free_all(b->root, b->height);
+	free(b);
+}
+
+
+
+//++++++++++++++++++++++++find / min / max / to_array 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : btree_find	return : 있으면 1 / 없으면 0
+	노드마다 SIMD 비교 한번으로 내려갈 child를 고른다
+*/
+int rbtree_btree_find(const rbtree_btree *b, const key_t key) {
+	const bnode_t *x = b->root;
+	while (!x->leaf) {
+		x = x->child[count_le(x, key)];
+	}
+	const uint32_t p = count_less(x, key);
+	return p < x->n && x->keys[p] == key;
+}
+
+int rbtree_btree_min(const rbtree_btree *b, key_t *out) {
+	if (b->size == 0) {
+		return 0;
+	}
+	*out = b->head->keys[0];
+	return 1;
+}
+
+int rbtree_btree_max(const rbtree_btree *b, key_t *out) {
+	if (b->size == 0) {
+		return 0;
+	}
+	const bnode_t *x = b->root;
+	while (!x->leaf) {
+		x = x->child[x->n];
+	}
+	*out = x->keys[x->n - 1];
+	return 1;
+}
+
+/*
+	FUNCTION : btree_to_array	return : fail 0 / success 1
+	rbtree_to_array처럼 key 순서대로 n개 까지 (같은 key는 count번)
+	leaf들을 next로 따라가기만 한다
+*/
+int rbtree_btree_to_array(const rbtree_btree *b, key_t *arr, const size_t n) {
+	size_t index = 0;
+	for (const bnode_t *x = b->head; x != NULL && index < n; x = x->next) {
+		for (uint32_t i = 0; i < x->n && index < n; i++) {
+			for (uint32_t c = x->count[i]; c > 0 && index < n; c--) {
+				arr[index++] = x->keys[i];
+			}
+		}
+	}
+	return index > 0;
+}
+
+
+
+//++++++++++++++++++++++++insert 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : split_child	return : fail 0 / success 1
+	x의 꽉 찬 child[i]를 둘로 나누고 오른쪽 노드와 그 경계 key를 x의 i번째에 끼운다
+	- leaf : 뒤쪽 K/2개를 새 leaf로 옮기고 경계는 새 leaf의 첫 key
+	- 안쪽 노드 : 가운데 key를 x로 올리고 그 뒤를 새 노드로
+	x는 꽉 차있지 않아야 한다 (내려오면서 미리 나눠두므로)
+*/
+static int split_child(bnode_t *x, const uint32_t i) {
+	bnode_t *c = x->child[i];
+	bnode_t *r = bnode_new(c->leaf);
+	if (r == NULL) {
+		return 0;
+	}
+	key_t sep;
+	if (c->leaf) {
+		r->n = K - K / 2;
+		memcpy(r->keys, c->keys + K / 2, r->n * sizeof(key_t));
+		memcpy(r->count, c->count + K / 2, r->n * sizeof(uint32_t));
+		c->n = K / 2;
+		r->next = c->next;
+		c->next = r;
+		sep = r->keys[0];
+	} else {
+		const uint32_t mid = K / 2;
+		sep = c->keys[mid];
+		r->n = K - mid - 1;
+		memcpy(r->keys, c->keys + mid + 1, r->n * sizeof(key_t));
+		memcpy(r->child, c->child + mid + 1, (r->n + 1) * sizeof(bnode_t *));
+		c->n = mid;
+	}
+	memmove(x->keys + i + 1, x->keys + i, (x->n - i) * sizeof(key_t));
+	memmove(x->child + i + 2, x->child + i + 1, (x->n - i) * sizeof(bnode_t *));
+	x->keys[i] = sep;
+	x->child[i + 1] = r;
+	x->n++;
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : btree_insert	return : fail 0 / success 1
+	top-down : 내려가는 길의 꽉 찬 노드를 미리 나눠서 leaf에 항상 자리가 있게 한다
+	1. root가 꽉 찼으면 새 root를 위에 두고 나눈다 (높이가 1 늘어난다)
+	2. 내려갈 child가 꽉 찼으면 나누고 key에 맞는 쪽으로
+	3. leaf에 같은 key가 있으면 count만 올리고, 없으면 자리를 만들어 넣는다
+	나누기는 한번씩 끝나는 작업이라 노드를 못 만들어도 그때까지의 트리는 올바르다 (key만 안 들어간다)
+*/
+int rbtree_btree_insert(rbtree_btree *b, const key_t key) {
+	// 1.
+	if (b->root->n == K) {
+		bnode_t *r = bnode_new(0);
+		if (r == NULL) {
+			return 0;
+		}
+		r->child[0] = b->root;
+		if (!split_child(r, 0)) {
+			free(r);
+			return 0;
+		}
+		b->root = r;
+		b->height++;
+	}
+	// 2.
+	bnode_t *x = b->root;
+	while (!x->leaf) {
+		uint32_t i = count_le(x, key);
+		if (x->child[i]->n == K) {
+			if (!split_child(x, i)) {
+				return 0;
+			}
+			i += key >= x->keys[i];
+		}
+		x = x->child[i];
+	}
+	// 3.
+	const uint32_t p = count_less(x, key);
+	if (p < x->n && x->keys[p] == key) {
+		x->count[p]++;
+	} else {
+		memmove(x->keys + p + 1, x->keys + p, (x->n - p) * sizeof(key_t));
+		memmove(x->count + p + 1, x->count + p, (x->n - p) * sizeof(uint32_t));
+		x->keys[p] = key;
+		x->count[p] = 1;
+		x->n++;
+	}
+	b->size++;
+	return 1;
+}
+
+
+
+//++++++++++++++++++++++++erase 구현++++++++++++++++++++++++++++
+
+static inline uint32_t min_keys(const bnode_t *x) {
+	return x->leaf ? LEAF_MIN : INNER_MIN;
+}
+
+// child[i]가 왼쪽 형제의 마지막 key를 받는다 (안쪽 노드는 부모의 경계 key를 거쳐 돈다)
+static void borrow_left(bnode_t *x, const uint32_t i) {
+	bnode_t *c = x->child[i], *l = x->child[i - 1];
+	memmove(c->keys + 1, c->keys, c->n * sizeof(key_t));
+	if (c->leaf) {
+		memmove(c->count + 1, c->count, c->n * sizeof(uint32_t));
+		c->keys[0] = l->keys[l->n - 1];
+		c->count[0] = l->count[l->n - 1];
+		x->keys[i - 1] = c->keys[0];
+	} else {
+		memmove(c->child + 1, c->child, (c->n + 1) * sizeof(bnode_t *));
+		c->keys[0] = x->keys[i - 1];
+		c->child[0] = l->child[l->n];
+		x->keys[i - 1] = l->keys[l->n - 1];
+	}
+	l->n--;
+	c->n++;
+}
+
+// child[i]가 오른쪽 형제의 첫 key를 받는다
+static void borrow_right(bnode_t *x, const uint32_t i) {
+	bnode_t *c = x->child[i], *r = x->child[i + 1];
+	if (c->leaf) {
+		c->keys[c->n] = r->keys[0];
+		c->count[c->n] = r->count[0];
+		memmove(r->count, r->count + 1, (r->n - 1) * sizeof(uint32_t));
+		memmove(r->keys, r->keys + 1, (r->n - 1) * sizeof(key_t));
+		x->keys[i] = r->keys[0];
+	} else {
+		c->keys[c->n] = x->keys[i];
+		c->child[c->n + 1] = r->child[0];
+		x->keys[i] = r->keys[0];
+		memmove(r->keys, r->keys + 1, (r->n - 1) * sizeof(key_t));
+		memmove(r->child, r->child + 1, r->n * sizeof(bnode_t *));
+	}
+	c->n++;
+	r->n--;
+}
+
+// child[j + 1]을 child[j]에 붙이고 x에서 경계 key와 함께 뺀다
+static void merge_children(bnode_t *x, const uint32_t j) {
+	bnode_t *a = x->child[j], *d = x->child[j + 1];
+	if (a->leaf) {
+		memcpy(a->keys + a->n, d->keys, d->n * sizeof(key_t));
+		memcpy(a->count + a->n, d->count, d->n * sizeof(uint32_t));
+		a->n += d->n;
+		a->next = d->next;
+	} else {
+		a->keys[a->n] = x->keys[j];
+		memcpy(a->keys + a->n + 1, d->keys, d->n * sizeof(key_t));
+		memcpy(a->child + a->n + 1, d->child, (d->n + 1) * sizeof(bnode_t *));
+		a->n += d->n + 1;
+	}
+	free(d);
+	memmove(x->keys + j, x->keys + j + 1, (x->n - j - 1) * sizeof(key_t));
+	memmove(x->child + j + 1, x->child + j + 2, (x->n - j - 1) * sizeof(bnode_t *));
+	x->n--;
+}
+
+
+
+/*
+	FUNCTION : erase_at	return : 지웠으면 1 / 없으면 0
+	x의 서브트리에서 key 하나를 지운다
+	지운 뒤 child가 반 아래로 줄었으면 옆 형제에게 빌리고, 형제도 여유가 없으면 합친다
+	(노드를 새로 만들지 않으므로 실패하지 않는다)
+	안쪽 노드의 경계 key는 leaf에서 지워진 key라도 그대로 둔다 (길 안내로는 여전히 맞다)
+*/
+static int erase_at(bnode_t *x, const key_t key) {
+	if (x->leaf) {
+		const uint32_t p = count_less(x, key);
+		if (p >= x->n || x->keys[p] != key) {
+			return 0;
+		}
+		if (--x->count[p] == 0) {
+			memmove(x->keys + p, x->keys + p + 1, (x->n - p - 1) * sizeof(key_t));
+			memmove(x->count + p, x->count + p + 1, (x->n - p - 1) * sizeof(uint32_t));
+			x->n--;
+		}
+		return 1;
+	}
+	const uint32_t i = count_le(x, key);
+	if (!erase_at(x->child[i], key)) {
+		return 0;
+	}
+	if (x->child[i]->n < min_keys(x->child[i])) {
+		if (i > 0 && x->child[i - 1]->n > min_keys(x->child[i - 1])) {
+			borrow_left(x, i);
+		} else if (i < x->n && x->child[i + 1]->n > min_keys(x->child[i + 1])) {
+			borrow_right(x, i);
+		} else {
+			merge_children(x, i > 0 ? i - 1 : i);
+		}
+	}
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : btree_erase	return : 지웠으면 1 / 없으면 0
+	같은 key가 여러개면 하나만 지운다
+	root(안쪽 노드)의 key가 다 빠졌으면 하나 남은 child를 root로 (높이가 1 준다)
+*/
+int rbtree_btree_erase(rbtree_btree *b, const key_t key) {
+	if (!erase_at(b->root, key)) {
+		return 0;
+	}
+	if (!b->root->leaf && b->root->n == 0) {
+		bnode_t *old = b->root;
+		b->root = old->child[0];
+		free(old);
+		b->height--;
+	}
+	b->size--;
+	return 1;
+}
@@ -0,0 +1,63 @@
+#ifndef _RBTREE_BTREE_H_
+#define _RBTREE_BTREE_H_
+
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+	노드 하나에 key 여러개를 담는 트리 (B+tree)
+
+	rbtree는 find 한번에 노드를 log2(n)개 거치고, 노드마다 cache miss가 거의 하나씩 난다
+	여기서는 노드 하나에 key를 RBTREE_BTREE_KEYS개까지 넣어서 높이를 log_K(n)로 줄인다
+	- 노드의 key 배열은 cache line 시작에 있고 (64바이트 정렬)
+	  노드 안의 위치는 key 전체를 SIMD로 한번에 비교해서 (AVX2면 8개, SSE2면 4개씩) 센다
+	- key는 leaf에만 있고 leaf들은 순서대로 이어져 있다 (min / to_array는 leaf만 따라간다)
+	  안쪽 노드의 key는 길 안내용 (child[i]에는 keys[i-1] 이상 keys[i] 미만)
+	- 같은 key는 RBTREE_MULTISET처럼 한 자리에 모아 개수(count)를 센다
+	  (insert를 반복한 것과 같은 결과. erase는 하나씩 줄이고 0이 되면 자리를 없앤다)
+	- root가 아닌 노드는 항상 반 이상 차있다. 모자라면 옆 노드에서 빌리거나 합친다
+	rbtree와 같은 연산 (insert / find / erase / min / max / to_array)을 key로 주고받는다
+	key가 노드 사이를 옮겨다니므로 노드 포인터는 밖으로 내주지 않는다
+
+	RBTREE_BTREE_KEYS는 8의 배수로 8 ~ 32 (기본 16 : key 배열이 cache line 하나)
+*/
+#ifndef RBTREE_BTREE_KEYS
+#define RBTREE_BTREE_KEYS 16
+#endif
+#if RBTREE_BTREE_KEYS % 8 != 0 || RBTREE_BTREE_KEYS < 8 || RBTREE_BTREE_KEYS > 32
+#error "RBTREE_BTREE_KEYS must be 8, 16, 24 or 32"
+#endif
+
+typedef struct bnode_t {
+	key_t keys[RBTREE_BTREE_KEYS];
+	uint32_t n;						// 쓰고 있는 key 수
+	uint32_t leaf;
+	union {
+		struct bnode_t *child[RBTREE_BTREE_KEYS + 1];	// 안쪽 노드
+		struct {										// leaf
+			uint32_t count[RBTREE_BTREE_KEYS];
+			struct bnode_t *next;
+		};
+	};
+} __attribute__((aligned(64))) bnode_t;
+
+typedef struct {
+	bnode_t *root;
+	bnode_t *head;		// 가장 왼쪽 leaf (처음 만든 leaf가 끝까지 맨 왼쪽이다)
+	size_t size;		// 같은 key도 하나씩 센 개수
+	int height;			// leaf만 있으면 1
+} rbtree_btree;
+
+rbtree_btree *rbtree_btree_new(void);
+void rbtree_btree_delete(rbtree_btree *);
+
+int rbtree_btree_insert(rbtree_btree *, const key_t);
+int rbtree_btree_find(const rbtree_btree *, const key_t);
+int rbtree_btree_erase(rbtree_btree *, const key_t);
+
+int rbtree_btree_min(const rbtree_btree *, key_t *);
+int rbtree_btree_max(const rbtree_btree *, key_t *);
+int rbtree_btree_to_array(const rbtree_btree *, key_t *, const size_t);
+
+#endif  // _RBTREE_BTREE_H_
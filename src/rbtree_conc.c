@@ -0,0 +1,451 @@
+#include "rbtree_conc.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+node_t *new_node(rbtree *, color_t, key_t);
+void free_node(rbtree *, node_t *);
+
+
+
+/*
+	FUNCTION : conc_new	return : rbtree_conc pointer
+	빈 트리와 lock을 만든다
+*/
+rbtree_conc *rbtree_conc_new(void) {
+	rbtree_conc *c = (rbtree_conc *)calloc(1, sizeof(rbtree_conc));
+	if (c == NULL) {
+		return NULL;
+	}
+	c->tree = new_rbtree();
+	if (c->tree == NULL) {
+		free(c);
+		return NULL;
+	}
+	pthread_mutex_init(&c->alloc_lock, NULL);
+	return c;
+}
+
+
+
+/*
+	FUNCTION : conc_delete	return : void
+	다른 thread가 더 이상 쓰지 않을 때 부른다
+*/
+void rbtree_conc_delete(rbtree_conc *c) {
+	pthread_mutex_destroy(&c->alloc_lock);
+	delete_rbtree(c->tree);
+	free(c);
+}
+
+
+
+#ifndef RBTREE_CONC_FINE
+//++++++++++++++++++++++++트리 전체 lock 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : conc_insert / conc_erase / conc_find
+	노드 lock이 없는 build : mutex 하나를 잡고 보통 rbtree 함수를 부른다
+*/
+int rbtree_conc_insert(rbtree_conc *c, const key_t key) {
+	pthread_mutex_lock(&c->alloc_lock);
+	node_t *np = rbtree_insert(c->tree, key);
+	pthread_mutex_unlock(&c->alloc_lock);
+	return np != NULL;
+}
+
+int rbtree_conc_erase(rbtree_conc *c, const key_t key) {
+	pthread_mutex_lock(&c->alloc_lock);
+	node_t *np = rbtree_find(c->tree, key);
+	if (np != NULL) {
+		rbtree_erase(c->tree, np);
+	}
+	pthread_mutex_unlock(&c->alloc_lock);
+	return np != NULL;
+}
+
+int rbtree_conc_find(rbtree_conc *c, const key_t key) {
+	pthread_mutex_lock(&c->alloc_lock);
+	node_t *np = rbtree_find(c->tree, key);
+	pthread_mutex_unlock(&c->alloc_lock);
+	return np != NULL;
+}
+#else
+//++++++++++++++++++++++++노드 lock 구현++++++++++++++++++++++++++++
+
+static inline void node_lock(node_t *x) {
+	for (int spins = 0; __atomic_exchange_n(&x->lock, 1, __ATOMIC_ACQUIRE); spins++) {
+		if (spins >= RBTREE_CONC_SPIN) {	// 잡고 있는 thread가 돌 수 있게 양보
+			sched_yield();
+		}
+	}
+}
+
+static inline void node_unlock(node_t *x) {
+	__atomic_store_n(&x->lock, 0, __ATOMIC_RELEASE);
+}
+
+// dir 0 : left, 1 : right
+static inline node_t *child_of(const rbtree *t, const node_t *x, const int dir) {
+	return dir ? rbtree_right(t, x) : rbtree_left(t, x);
+}
+
+static inline void set_child(const rbtree *t, node_t *x, const int dir, node_t *v) {
+	if (dir) {
+		rbtree_set_right(t, x, v);
+	} else {
+		rbtree_set_left(t, x, v);
+	}
+}
+
+static inline int is_red(const node_t *x) {
+	return rbtree_color(x) == RBTREE_RED;
+}
+
+
+
+/*
+	잠근 경로
+	w[n - 1]이 지금 노드이고 그 위로 부모, 할아버지 ... 순서 (맨 위는 nil일 수 있다 : 루트의 lock)
+	pin은 erase에서 지울 key를 찾은 노드. 경로에서 빠져도 끝날 때까지 놓지 않는다
+*/
+typedef struct {
+	node_t *w[4];
+	int n;
+	node_t *pin;
+} path_t;
+
+static inline void path_drop(const path_t *path, node_t *x) {
+	if (x != path->pin) {
+		node_unlock(x);
+	}
+}
+
+static inline int path_has(const path_t *path, const node_t *x) {
+	for (int i = 0; i < path->n; i++) {
+		if (path->w[i] == x) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// 경로 끝에 x(이미 잠근)를 붙인다. keep개가 넘으면 맨 위 조상을 놓는다
+static inline void path_push(path_t *path, node_t *x, const int keep) {
+	if (path->n == keep) {
+		path_drop(path, path->w[0]);
+		memmove(path->w, path->w + 1, (keep - 1) * sizeof(node_t *));
+		path->n--;
+	}
+	path->w[path->n++] = x;
+}
+
+// 회전 뒤 경로를 a -> b (-> c)로 바꾼다. 빠지는 노드는 놓는다
+static void path_keep(path_t *path, node_t *a, node_t *b, node_t *c) {
+	for (int i = 0; i < path->n; i++) {
+		if (path->w[i] != a && path->w[i] != b && path->w[i] != c) {
+			path_drop(path, path->w[i]);
+		}
+	}
+	path->n = 0;
+	path->w[path->n++] = a;
+	path->w[path->n++] = b;
+	if (c != NULL) {
+		path->w[path->n++] = c;
+	}
+}
+
+static void path_release(path_t *path) {
+	for (int i = 0; i < path->n; i++) {
+		path_drop(path, path->w[i]);
+	}
+	if (path->pin != NULL) {
+		node_unlock(path->pin);
+	}
+	path->n = 0;
+}
+
+
+
+/*
+	FUNCTION : rotate	return : x 자리로 올라온 노드
+	x를 dir 쪽으로 내린다 (반대쪽 자식이 x 자리로 올라온다)
+	부모 포인터를 따라가지 않고 잠가둔 부모 p를 받는다 (nil이면 x가 루트)
+	p, x, 올라오는 자식이 모두 잠겨 있어야 한다
+	자리를 옮기는 손자 서브트리는 잠그지 않아도 된다 : 그 부모 링크는 x와 올라오는 자식이 지킨다
+*/
+static node_t *rotate(rbtree *t, node_t *p, node_t *x, const int dir) {
+	node_t *y = child_of(t, x, !dir);
+	node_t *b = child_of(t, y, dir);
+	set_child(t, x, !dir, b);
+	if (b != t->nil) {
+		rbtree_set_parent(t, b, x);
+	}
+	set_child(t, y, dir, x);
+	rbtree_set_parent(t, x, y);
+	rbtree_set_parent(t, y, p);
+	if (p == t->nil) {
+		t->root = y;
+	} else {
+		set_child(t, p, rbtree_right(t, p) == x, y);
+	}
+	return y;
+}
+
+
+
+/*
+	FUNCTION : split_red	return : void
+	경로 끝의 x와 부모 p가 둘 다 RED일 때 할아버지 g에서 회전 (rbtree_insert_topdown과 같다)
+	g의 부모 gg까지 잠겨 있어야 하고, 끝나면 경로는 gg -> (p ->) x
+	삼촌은 항상 BLACK : RED였다면 g를 지날 때 이미 색을 뒤집었다
+*/
+static void split_red(rbtree *t, path_t *path) {
+	node_t *gg = path->w[path->n - 4];
+	node_t *g = path->w[path->n - 3];
+	node_t *p = path->w[path->n - 2];
+	node_t *x = path->w[path->n - 1];
+	const int pdir = p == rbtree_right(t, g);
+	if ((x == rbtree_right(t, p)) != pdir) {	// 삼각형 : x가 g 자리로
+		rotate(t, g, p, pdir);
+		rotate(t, gg, g, !pdir);
+		rbtree_set_color(x, RBTREE_BLACK);
+		rbtree_set_color(g, RBTREE_RED);
+		node_unlock(p);
+		node_unlock(g);
+		path->w[path->n - 3] = x;
+		path->n -= 2;
+	} else {	// 일직선 : p가 g 자리로
+		rotate(t, gg, g, !pdir);
+		rbtree_set_color(p, RBTREE_BLACK);
+		rbtree_set_color(g, RBTREE_RED);
+		node_unlock(g);
+		path->w[path->n - 3] = p;
+		path->w[path->n - 2] = x;
+		path->n -= 1;
+	}
+}
+
+
+
+//++++++++++++++++++++++++writer 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : conc_insert	return : fail 0 / success 1
+	rbtree_insert와 같이 같은 key도 하나 더 넣는다 (multiset이면 count만 올린다)
+	1. 노드는 트리를 잠그기 전에 미리 만든다 (풀 lock을 경로 lock 안에서 잡지 않게)
+	2. 자식을 잠그고 내려가며, 경로에는 지금 노드와 조상 셋까지만 잠가둔다
+	   자식 둘이 RED면 색을 뒤집고, 부모와 RED가 겹치면 할아버지에서 회전
+	3. leaf 자리에 붙이고, 부모가 RED면 한번 더 회전
+*/
+int rbtree_conc_insert(rbtree_conc *c, const key_t key) {
+	rbtree *t = c->tree;
+	// 1.
+	pthread_mutex_lock(&c->alloc_lock);
+	node_t *z = new_node(t, RBTREE_RED, key);
+	pthread_mutex_unlock(&c->alloc_lock);
+	if (z == NULL) {
+		return 0;
+	}
+	rbtree_set_left(t, z, t->nil);
+	rbtree_set_right(t, z, t->nil);
+	z->lock = 1;	// 붙인 뒤 경로와 같이 놓는다
+
+	// 2.
+	path_t path = {{NULL}, 0, NULL};
+	node_lock(t->nil);
+	path_push(&path, t->nil, 4);
+	node_t *x = t->nil;
+	int dir = 0;
+	for (node_t *next = t->root; next != t->nil; next = child_of(t, x, dir)) {
+		node_lock(next);
+		path_push(&path, next, 4);
+		x = next;
+#ifdef RBTREE_MULTISET
+		if (key == x->key) {
+			x->count++;
+			path_release(&path);
+			pthread_mutex_lock(&c->alloc_lock);
+			free_node(t, z);
+			pthread_mutex_unlock(&c->alloc_lock);
+			__atomic_fetch_add(&t->version, 1, __ATOMIC_RELAXED);
+			return 1;
+		}
+#endif
+		if (is_red(rbtree_left(t, x)) && is_red(rbtree_right(t, x))) {
+			rbtree_set_color(x, RBTREE_RED);
+			rbtree_set_color(rbtree_left(t, x), RBTREE_BLACK);
+			rbtree_set_color(rbtree_right(t, x), RBTREE_BLACK);
+			if (path.w[path.n - 2] == t->nil) {	// 루트
+				rbtree_set_color(x, RBTREE_BLACK);
+			} else if (is_red(path.w[path.n - 2])) {
+				split_red(t, &path);
+			}
+		}
+		dir = !(key < x->key);
+	}
+
+	// 3.
+	rbtree_set_parent(t, z, x);
+	if (x == t->nil) {
+		t->root = z;
+		rbtree_set_color(z, RBTREE_BLACK);
+	} else {
+		set_child(t, x, dir, z);
+	}
+	path_push(&path, z, 4);
+	if (is_red(x)) {
+		split_red(t, &path);
+	}
+	path_release(&path);
+	__atomic_fetch_add(&t->version, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : conc_erase	return : 없었으면 0 / 지웠으면 1
+	key 하나를 지운다 (multiset이면 count만 1 내린다). rbtree_erase_topdown과 같은 방식
+	1. 경로에는 지금 노드 q와 부모, 할아버지까지 잠가둔다 (형제 쪽은 쓸 때만 잠깐 잠근다)
+	2. q와 내려갈 쪽 자식이 모두 BLACK이면 회전이나 색 바꾸기로 q를 RED로 만든다
+	3. key를 찾은 노드 f는 잠근 채로 두고 in-order 앞 노드까지 내려간다
+	4. 그 노드를 떼어내고 key를 f에 옮겨 적는다
+*/
+int rbtree_conc_erase(rbtree_conc *c, const key_t key) {
+	rbtree *t = c->tree;
+	path_t path = {{NULL}, 0, NULL};
+	node_lock(t->nil);
+	path_push(&path, t->nil, 3);
+	node_t *q = t->nil;
+	int dir = 0;
+	for (node_t *next = t->root; next != t->nil; next = child_of(t, q, dir)) {
+		// 1.
+		node_lock(next);
+		path_push(&path, next, 3);
+		q = next;
+		const int last = dir;
+		dir = q->key < key;
+
+		// 3.
+		if (q->key == key) {
+#ifdef RBTREE_MULTISET
+			if (q->count > 1) {
+				q->count--;
+				path_release(&path);
+				__atomic_fetch_add(&t->version, 1, __ATOMIC_RELAXED);
+				return 1;
+			}
+#endif
+			if (path.pin != NULL && !path_has(&path, path.pin)) {
+				node_unlock(path.pin);
+			}
+			path.pin = q;
+		}
+
+		// 2.
+		if (is_red(q) || is_red(child_of(t, q, dir))) {
+			continue;
+		}
+		node_t *p = path.w[path.n - 2];
+		node_t *o = child_of(t, q, !dir);
+		if (is_red(o)) {	// CASE 1 : o를 q 자리로
+			node_lock(o);
+			rotate(t, p, q, dir);
+			rbtree_set_color(q, RBTREE_RED);
+			rbtree_set_color(o, RBTREE_BLACK);
+			path_keep(&path, o, q, NULL);
+			continue;
+		}
+		node_t *s = p != t->nil ? child_of(t, p, !last) : t->nil;
+		if (s == t->nil) {
+			continue;
+		}
+		node_lock(s);
+		if (!is_red(rbtree_left(t, s)) && !is_red(rbtree_right(t, s))) {	// CASE 2
+			rbtree_set_color(p, RBTREE_BLACK);
+			rbtree_set_color(s, RBTREE_RED);
+			rbtree_set_color(q, RBTREE_RED);
+			node_unlock(s);
+			continue;
+		}
+		node_t *g = path.w[path.n - 3];
+		node_t *top = s;
+		if (is_red(child_of(t, s, last))) {	// CASE 3 : s의 꺾인 자식을 s 자리로
+			top = child_of(t, s, last);
+			node_lock(top);
+			rotate(t, p, s, !last);
+		}
+		// CASE 4 : top을 p 자리로
+		rotate(t, g, p, last);
+		rbtree_set_color(q, RBTREE_RED);
+		rbtree_set_color(top, g == t->nil ? RBTREE_BLACK : RBTREE_RED);
+		rbtree_set_color(rbtree_left(t, top), RBTREE_BLACK);
+		rbtree_set_color(rbtree_right(t, top), RBTREE_BLACK);
+		if (top != s) {
+			node_unlock(s);
+		}
+		path_keep(&path, top, p, q);
+	}
+
+	node_t *f = path.pin;
+	if (f == NULL) {
+		path_release(&path);
+		return 0;
+	}
+
+	// 4. q는 RED leaf (루트일 때만 BLACK이고 RED 자식이 하나 있을 수 있다)
+	node_t *p = path.w[path.n - 2];
+	node_t *ch = rbtree_left(t, q) != t->nil ? rbtree_left(t, q) : rbtree_right(t, q);
+	if (p == t->nil) {
+		t->root = ch;
+	} else {
+		set_child(t, p, rbtree_right(t, p) == q, ch);
+	}
+	if (ch != t->nil) {
+		rbtree_set_parent(t, ch, p);
+		rbtree_set_color(ch, RBTREE_BLACK);
+	}
+	if (f != q) {
+		f->key = q->key;
+#ifdef RBTREE_MULTISET
+		f->count = q->count;
+#endif
+	}
+	path_release(&path);
+	pthread_mutex_lock(&c->alloc_lock);
+	free_node(t, q);
+	pthread_mutex_unlock(&c->alloc_lock);
+	__atomic_fetch_add(&t->version, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+
+
+//++++++++++++++++++++++++reader 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : conc_find	return : 없으면 0 / 있으면 1
+	자식을 잠근 뒤 부모를 놓으며 내려간다 (노드 두개씩)
+*/
+int rbtree_conc_find(rbtree_conc *c, const key_t key) {
+	rbtree *t = c->tree;
+	node_lock(t->nil);
+	node_t *held = t->nil;
+	node_t *x = t->root;
+	int found = 0;
+	while (x != t->nil) {
+		node_lock(x);
+		node_unlock(held);
+		held = x;
+		if (key == x->key) {
+			found = 1;
+			break;
+		}
+		x = key < x->key ? rbtree_left(t, x) : rbtree_right(t, x);
+	}
+	node_unlock(held);
+	return found;
+}
+#endif
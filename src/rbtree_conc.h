@@ -0,0 +1,52 @@
+#ifndef _RBTREE_CONC_H_
+#define _RBTREE_CONC_H_
+
+#include <pthread.h>
+
+#include "rbtree.h"
+
+/*
+	writer 여러 명이 같이 고치는 rbtree (lock coupling)
+
+	rbtree_sync는 writer끼리 lock 하나로 줄을 세우므로 쓰기는 core 하나만큼밖에 안 나온다
+	여기서는 트리 전체 lock 대신 노드마다 lock을 두고 (-DRBTREE_CONCURRENT)
+	top-down insert / erase 처럼 내려가는 길에 균형을 맞추면서
+	지금 노드와 그 위 두세 단계만 잠근 채로 내려간다 (hand-over-hand)
+	- 자식을 잠근 뒤에 맨 위 조상의 lock을 놓으므로, 서로 다른 서브트리로 가는 writer들은
+	  갈라진 뒤로는 서로 기다리지 않는다 (루트 근처만 잠깐씩 줄을 선다)
+	- lock은 항상 이미 잡은 노드의 자식만 기다리며 잡으므로 (위에서 아래로) deadlock이 없다
+	- 노드의 링크 / key / count는 그 노드의 lock이,
+	  노드의 색과 부모 링크는 부모 노드의 lock이 지킨다 (루트는 nil의 lock)
+	  회전 / 색 바꾸기는 모두 잠근 노드들 안에서만 일어난다
+	  (그래서 COMPACT처럼 색과 부모가 한 word에 있어도 된다)
+	- 노드는 누군가 그 부모를 잠근 채로만 잡으므로, 떼어낸 노드는 바로 풀에 돌려준다
+	- find도 같은 방식으로 두 노드씩 잠그고 내려간다
+	- erase는 key를 받는다. 지울 key의 노드 대신 in-order 앞 노드를 떼어내고 key를 옮겨 적으므로
+	  이 트리의 노드 포인터를 밖에서 들고있으면 안 된다 (rbtree_sync처럼 key만 주고받는다)
+
+	-DRBTREE_CONCURRENT가 없거나 -DRBTREE_ORDER_STAT / -DRBTREE_INTERVAL이면 (size / max를 조상들이 같이 고쳐야 한다)
+	트리 전체 mutex 하나로 rbtree_insert / rbtree_erase를 부르는 방식으로 돌아간다
+	모든 thread가 끝난 뒤에는 tree를 보통 rbtree로 읽어도 된다
+*/
+#if defined(RBTREE_CONCURRENT) && !defined(RBTREE_ORDER_STAT) && !defined(RBTREE_INTERVAL)
+#define RBTREE_CONC_FINE 1
+#endif
+
+// lock을 이만큼 돌려도 못 잡으면 sched_yield (core보다 thread가 많을 때)
+#ifndef RBTREE_CONC_SPIN
+#define RBTREE_CONC_SPIN 64
+#endif
+
+typedef struct {
+	rbtree *tree;
+	pthread_mutex_t alloc_lock;		// 노드 풀은 thread 하나씩 (fallback에서는 트리 전체 lock)
+} rbtree_conc;
+
+rbtree_conc *rbtree_conc_new(void);
+void rbtree_conc_delete(rbtree_conc *);
+
+int rbtree_conc_insert(rbtree_conc *, const key_t);
+int rbtree_conc_erase(rbtree_conc *, const key_t);
+int rbtree_conc_find(rbtree_conc *, const key_t);
+
+#endif  // _RBTREE_CONC_H_
@@ -0,0 +1,161 @@
+#include "rbtree_frozen.h"
+
+#include <stdlib.h>
+
+// cache line 하나에 들어가는 key 수. 4단계 아래 자손들이 keys[k * 16 ..] 에 모여있다
+#define FROZEN_LINE 64
+#define FROZEN_PREFETCH (FROZEN_LINE / sizeof(key_t))
+
+static void fill(rbtree_frozen *, size_t, node_t **);
+
+
+
+/*
+	FUNCTION : freeze	return : snapshot pointer
+	트리의 지금 상태로 스냅샷을 만든다. 실패하면 NULL
+*/
+rbtree_frozen *rbtree_freeze(const rbtree *t) {
+	rbtree_frozen *f = (rbtree_frozen *)calloc(1, sizeof(rbtree_frozen));
+	if (f == NULL) {
+		return NULL;
+	}
+	f->tree = t;
+	if (!rbtree_refreeze(f)) {
+		rbtree_frozen_delete(f);
+		return NULL;
+	}
+	return f;
+}
+
+
+
+/*
+	FUNCTION : refreeze	return : fail 0 / success 1
+	원본 트리가 바뀌었으면 스냅샷을 다시 만든다 (바뀌지 않았으면 아무것도 안함)
+	1. 노드 수를 세고, 배열이 모자라면 새로 할당
+	2. in-order 순서로 노드를 하나씩 꺼내면서 Eytzinger 위치에 채운다 : O(n)
+*/
+int rbtree_refreeze(rbtree_frozen *f) {
+	if (f->keys != NULL && rbtree_frozen_valid(f)) {
+		return 1;
+	}
+
+	// 1. 노드 수
+	size_t n = 0;
+	for (node_t *p = rbtree_iter_begin(f->tree); p != NULL; p = rbtree_iter_next(f->tree, p)) {
+		n++;
+	}
+	if (f->keys == NULL || n + 1 > f->cap) {
+		// aligned_alloc은 크기가 정렬 단위의 배수여야 한다
+		size_t cap = (n + 1 + FROZEN_PREFETCH - 1) / FROZEN_PREFETCH * FROZEN_PREFETCH;
+		key_t *keys = (key_t *)aligned_alloc(FROZEN_LINE, cap * sizeof(key_t));
+		node_t **nodes = (node_t **)malloc(cap * sizeof(node_t *));
+		if (keys == NULL || nodes == NULL) {
+			free(keys);
+			free(nodes);
+			return 0;
+		}
+		free(f->keys);
+		free(f->nodes);
+		f->keys = keys;
+		f->nodes = nodes;
+		f->cap = cap;
+	}
+
+	// 2. 채우기
+	f->n = n;
+	node_t *cur = rbtree_iter_begin(f->tree);
+	fill(f, 1, &cur);
+	f->version = f->tree->version;
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : fill	return : void
+	k를 루트로 하는 (배열 속) 서브트리를 in-order로 채운다
+	왼쪽(2k) -> 자기 -> 오른쪽(2k + 1) 순서라 cur를 다음 노드로 넘기기만 하면 된다
+	재귀 깊이는 log2(n)
+*/
+static void fill(rbtree_frozen *f, size_t k, node_t **cur) {
+	if (k > f->n) {
+		return;
+	}
+	fill(f, 2 * k, cur);
+	f->keys[k] = (*cur)->key;
+	f->nodes[k] = *cur;
+	*cur = rbtree_iter_next(f->tree, *cur);
+	fill(f, 2 * k + 1, cur);
+}
+
+
+
+/*
+	FUNCTION : frozen_delete	return : void
+	스냅샷만 지운다 (원본 트리는 그대로)
+*/
+void rbtree_frozen_delete(rbtree_frozen *f) {
+	free(f->keys);
+	free(f->nodes);
+	free(f);
+}
+
+
+
+/*
+	FUNCTION : frozen_valid	return : 낡았으면 0 / 1
+	만든 뒤로 원본 트리가 바뀌지 않았는지
+*/
+int rbtree_frozen_valid(const rbtree_frozen *f) {
+	return f->version == f->tree->version;
+}
+
+
+
+/*
+	FUNCTION : frozen_search	return : keys 위치 (없으면 0)
+	key 이상인 첫 key의 위치
+	1. 루트(1)부터 keys[k] < key 이면 오른쪽(2k + 1), 아니면 왼쪽(2k)으로 분기 없이 내려간다
+	2. 마지막으로 왼쪽으로 꺾은 곳이 답 : k의 끝에 붙은 1 bit들(오른쪽으로 간 횟수)과
+	   그 위의 0 bit 하나를 떼어내면 그 위치가 된다. 한번도 꺾지 않았으면 0
+*/
+static inline size_t frozen_search(const rbtree_frozen *f, const key_t key) {
+	const key_t *keys = f->keys;
+	size_t k = 1;
+	while (k <= f->n) {
+		__builtin_prefetch(keys + k * FROZEN_PREFETCH);
+		k = 2 * k + (keys[k] < key);
+	}
+	return k >> __builtin_ffsl((long)~k);
+}
+
+
+
+/*
+	FUNCTION : frozen_lower_bound	return : node pointer
+	rbtree_lower_bound와 같은 답 (key 이상인 첫 노드, 없으면 NULL)
+*/
+node_t *rbtree_frozen_lower_bound(const rbtree_frozen *f, const key_t key) {
+	if (!rbtree_frozen_valid(f)) {
+		return rbtree_lower_bound(f->tree, key);
+	}
+	size_t k = frozen_search(f, key);
+	return k == 0 ? NULL : f->nodes[k];
+}
+
+
+
+/*
+	FUNCTION : frozen_find	return : node pointer
+	rbtree_find와 같이 key 노드가 없으면 NULL
+	같은 key가 여러개면 순회상 첫번째 노드를 준다 (rbtree_find는 그 중 아무거나)
+	key 비교는 배열에서 끝내고 노드는 찾았을 때만 읽는다
+*/
+node_t *rbtree_frozen_find(const rbtree_frozen *f, const key_t key) {
+	if (!rbtree_frozen_valid(f)) {
+		return rbtree_find(f->tree, key);
+	}
+	size_t k = frozen_search(f, key);
+	return k != 0 && f->keys[k] == key ? f->nodes[k] : NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef _RBTREE_FROZEN_H_
+#define _RBTREE_FROZEN_H_
+
+#include "rbtree.h"
+
+/*
+	읽기 전용 스냅샷 (Eytzinger layout)
+
+	rbtree_freeze(t)는 트리의 key들을 BFS 순서의 배열 하나에 담는다
+	keys[1]이 루트, keys[k]의 자식은 keys[2k], keys[2k + 1]
+	- 내려갈 때 다음 위치가 k * 2 + (비교 결과) 라서 분기 없이 내려가고
+	- 4단계 아래 자손 16개가 한 cache line에 모여있어 미리 prefetch 할 수 있다
+	- 노드 포인터는 따로 nodes[]에 두고 찾았을 때만 읽는다
+
+	원본 트리가 insert / erase 되면 (t->version이 바뀌면) 스냅샷은 낡은 것이 된다
+	낡은 스냅샷의 find / lower_bound는 원본 트리에서 직접 찾아서 답이 틀리지 않게 하고
+	rbtree_refreeze로 같은 스냅샷을 다시 만들 수 있다
+	스냅샷이 살아있는 동안 원본 트리를 delete 하면 안된다
+*/
+typedef struct {
+	const rbtree *tree;		// 원본
+	unsigned long version;	// 만들 때의 원본 version
+	size_t n;				// key 개수, keys[1..n]
+	size_t cap;				// keys / nodes 에 할당해둔 칸 수
+	key_t *keys;			// 64바이트 정렬
+	node_t **nodes;			// keys[k]의 원래 노드
+} rbtree_frozen;
+
+rbtree_frozen *rbtree_freeze(const rbtree *);
+int rbtree_refreeze(rbtree_frozen *);
+void rbtree_frozen_delete(rbtree_frozen *);
+int rbtree_frozen_valid(const rbtree_frozen *);
+
+node_t *rbtree_frozen_find(const rbtree_frozen *, const key_t);
+node_t *rbtree_frozen_lower_bound(const rbtree_frozen *, const key_t);
+
+#endif  // _RBTREE_FROZEN_H_
@@ -0,0 +1,453 @@
+#ifndef _RBTREE_GENERIC_H_
+#define _RBTREE_GENERIC_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "rbtree.h"
+
+/*
+    타입별 rbtree 생성 매크로 (key / value map)
+
+    RBTREE_DEFINE(name, K, V, cmp)
+    - name : 만들어질 트리 타입 이름. 함수들은 name_insert 처럼 name_ 으로 시작
+    - K, V : key 타입, 노드 안에 그대로 들어가는 value 타입
+    - cmp  : int cmp(K a, K b) 함수(또는 매크로) 이름. a < b 면 음수, 같으면 0
+             static inline 함수로 주면 함수 포인터 호출 없이 descent 안에 inline 된다
+
+    RBTREE_DEFINE_NUM(name, K, V)
+    - K가 int / long / double 처럼 <, == 로 비교되는 타입일 때
+    - descent가 rbtree_find와 똑같은 기계어(cmov)로 나온다
+      (-1/0/1을 돌려주는 cmp를 거치면 gcc가 매 level마다 그 값을 만들어서
+       int 트리보다 2배 넘게 느려지는 것을 확인했다)
+
+    만들어지는 것
+    - name_node : color / key / value / 부모&자식 포인터
+    - name      : 트리. sentinel 노드를 트리 구조체 안에 들고있고
+                  노드는 rbtree와 같은 방식의 chunk 풀에서 꺼낸다
+    - name *name_new(void) / void name_delete(name *)
+    - name_node *name_insert(t, k, v)  같은 key가 있어도 하나 더 추가 (rbtree_insert와 같음)
+    - name_node *name_put(t, k, v)     같은 key가 있으면 value만 바꾼다 (map)
+    - name_node *name_find / name_min / name_max / name_lower_bound
+    - name_node *name_next / name_prev  순회, 끝이면 NULL
+    - int name_erase(t, node)
+    - size_t name_keys(t, K *arr, n)   key 순서대로 최대 n개 복사
+
+    ex)
+        RBTREE_DEFINE_NUM(int_map, int, double)
+        static inline int str_cmp(const char *a, const char *b) { return strcmp(a, b); }
+        RBTREE_DEFINE(str_map, const char *, int, str_cmp)
+*/
+
+// name_step(a, b, &go_left) : 한 level의 비교. a == b 면 1,
+// 아니면 0을 돌려주고 *go_left 에 a < b 를 넣는다
+// cmp는 level마다 한 번만 부른다 (strcmp 같은 비싼 cmp를 두 번 부르지 않도록)
+#define RBTREE_DEFINE(name, K, V, cmp)                                          \
+static inline int name##_lt(K a, K b) { return cmp(a, b) < 0; }                \
+static inline int name##_step(K a, K b, int *go_left) {                        \
+	int c = cmp(a, b);                                                          \
+	*go_left = c < 0;                                                           \
+	return c == 0;                                                              \
+}                                                                               \
+RBTREE_DEFINE_IMPL(name, K, V)
+
+#define RBTREE_DEFINE_NUM(name, K, V)                                           \
+static inline int name##_lt(K a, K b) { return a < b; }                        \
+static inline int name##_step(K a, K b, int *go_left) {                        \
+	*go_left = a < b;                                                           \
+	return a == b;                                                              \
+}                                                                               \
+RBTREE_DEFINE_IMPL(name, K, V)
+
+// name_lt / name_step 이 먼저 정의되어 있어야 한다
+#define RBTREE_DEFINE_IMPL(name, K, V)                                          \
+                                                                                \
+typedef struct name##_node {                                                    \
+	color_t color;                                                              \
+	K key;                                                                      \
+	V value;                                                                    \
+	struct name##_node *parent, *left, *right;                                  \
+} name##_node;                                                                  \
+                                                                                \
+typedef struct name##_chunk {                                                   \
+	struct name##_chunk *next;                                                  \
+	size_t cap;                                                                 \
+	name##_node nodes[];                                                        \
+} name##_chunk;                                                                 \
+                                                                                \
+typedef struct {                                                                \
+	name##_node *root;                                                          \
+	name##_node *nil;                                                           \
+	name##_chunk *chunks;                                                       \
+	size_t used;                                                                \
+	name##_node *free_list;                                                     \
+	name##_node sentinel;                                                       \
+} name;                                                                         \
+                                                                                \
+static inline name *name##_new(void) {                                          \
+	name *t = (name *)calloc(1, sizeof(name));                                  \
+	if (t == NULL) {                                                            \
+		return NULL;                                                            \
+	}                                                                           \
+	t->nil = &t->sentinel;                                                      \
+	t->nil->color = RBTREE_BLACK;                                               \
+	t->root = t->nil;                                                           \
+	return t;                                                                   \
+}                                                                               \
+                                                                                \
+static inline void name##_delete(name *t) {                                     \
+	name##_chunk *c = t->chunks;                                                \
+	while (c != NULL) {                                                         \
+		name##_chunk *next = c->next;                                           \
+		free(c);                                                                \
+		c = next;                                                               \
+	}                                                                           \
+	free(t);                                                                    \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_alloc(name *t) {                              \
+	if (t->free_list != NULL) {                                                 \
+		name##_node *np = t->free_list;                                         \
+		t->free_list = np->right;                                               \
+		return np;                                                              \
+	}                                                                           \
+	if (t->chunks == NULL || t->used == t->chunks->cap) {                       \
+		size_t cap = t->chunks == NULL ? 64 : t->chunks->cap * 2;               \
+		if (cap > 65536) {                                                      \
+			cap = 65536;                                                        \
+		}                                                                       \
+		name##_chunk *c = (name##_chunk *)malloc(sizeof(name##_chunk) +         \
+		                                         cap * sizeof(name##_node));     \
+		if (c == NULL) {                                                        \
+			return NULL;                                                        \
+		}                                                                       \
+		c->cap = cap;                                                           \
+		c->next = t->chunks;                                                    \
+		t->chunks = c;                                                          \
+		t->used = 0;                                                            \
+	}                                                                           \
+	return &t->chunks->nodes[t->used++];                                        \
+}                                                                               \
+                                                                                \
+static inline void name##_left_rotate(name *t, name##_node *x) {                \
+	name##_node *y = x->right;                                                  \
+	x->right = y->left;                                                         \
+	if (y->left != t->nil) {                                                    \
+		y->left->parent = x;                                                    \
+	}                                                                           \
+	y->parent = x->parent;                                                      \
+	if (x->parent == t->nil) {                                                  \
+		t->root = y;                                                            \
+	} else if (x == x->parent->left) {                                          \
+		x->parent->left = y;                                                    \
+	} else {                                                                    \
+		x->parent->right = y;                                                   \
+	}                                                                           \
+	y->left = x;                                                                \
+	x->parent = y;                                                              \
+}                                                                               \
+                                                                                \
+static inline void name##_right_rotate(name *t, name##_node *y) {               \
+	name##_node *x = y->left;                                                   \
+	y->left = x->right;                                                         \
+	if (x->right != t->nil) {                                                   \
+		x->right->parent = y;                                                   \
+	}                                                                           \
+	x->parent = y->parent;                                                      \
+	if (y->parent == t->nil) {                                                  \
+		t->root = x;                                                            \
+	} else if (y == y->parent->right) {                                         \
+		y->parent->right = x;                                                   \
+	} else {                                                                    \
+		y->parent->left = x;                                                    \
+	}                                                                           \
+	x->right = y;                                                               \
+	y->parent = x;                                                              \
+}                                                                               \
+                                                                                \
+static inline void name##_insert_fixup(name *t, name##_node *z) {               \
+	while (z->parent->color == RBTREE_RED) {                                    \
+		name##_node *g = z->parent->parent;                                     \
+		if (z->parent == g->left) {                                             \
+			name##_node *y = g->right;                                          \
+			if (y->color == RBTREE_RED) {          /* CASE 1 */                 \
+				z->parent->color = RBTREE_BLACK;                                \
+				y->color = RBTREE_BLACK;                                        \
+				g->color = RBTREE_RED;                                          \
+				z = g;                                                          \
+			} else {                                                            \
+				if (z == z->parent->right) {       /* CASE 2 */                 \
+					z = z->parent;                                              \
+					name##_left_rotate(t, z);                                   \
+				}                                  /* CASE 3 */                 \
+				z->parent->color = RBTREE_BLACK;                                \
+				z->parent->parent->color = RBTREE_RED;                          \
+				name##_right_rotate(t, z->parent->parent);                      \
+			}                                                                   \
+		} else {                                                                \
+			name##_node *y = g->left;                                           \
+			if (y->color == RBTREE_RED) {                                       \
+				z->parent->color = RBTREE_BLACK;                                \
+				y->color = RBTREE_BLACK;                                        \
+				g->color = RBTREE_RED;                                          \
+				z = g;                                                          \
+			} else {                                                            \
+				if (z == z->parent->left) {                                     \
+					z = z->parent;                                              \
+					name##_right_rotate(t, z);                                  \
+				}                                                               \
+				z->parent->color = RBTREE_BLACK;                                \
+				z->parent->parent->color = RBTREE_RED;                          \
+				name##_left_rotate(t, z->parent->parent);                       \
+			}                                                                   \
+		}                                                                       \
+	}                                                                           \
+	t->root->color = RBTREE_BLACK;                                              \
+}                                                                               \
+                                                                                \
+/* y (nil이면 루트) 아래에 key 노드를 붙이고 fixup */                         \
+static inline name##_node *name##_link(name *t, name##_node *y, int go_left,    \
+                                       K key, V value) {                        \
+	name##_node *z = name##_alloc(t);                                           \
+	if (z == NULL) {                                                            \
+		return NULL;                                                            \
+	}                                                                           \
+	z->color = RBTREE_RED;                                                      \
+	z->key = key;                                                               \
+	z->value = value;                                                           \
+	z->parent = y;                                                              \
+	z->left = t->nil;                                                           \
+	z->right = t->nil;                                                          \
+	if (y == t->nil) {                                                          \
+		t->root = z;                                                            \
+	} else if (go_left) {                                                       \
+		y->left = z;                                                            \
+	} else {                                                                    \
+		y->right = z;                                                           \
+	}                                                                           \
+	name##_insert_fixup(t, z);                                                  \
+	return z;                                                                   \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_insert(name *t, K key, V value) {             \
+	name##_node *y = t->nil;                                                    \
+	name##_node *x = t->root;                                                   \
+	int go_left = 0;                                                            \
+	while (x != t->nil) {                                                       \
+		y = x;                                                                  \
+		go_left = name##_lt(key, x->key);                                       \
+		x = go_left ? x->left : x->right;                                       \
+	}                                                                           \
+	return name##_link(t, y, go_left, key, value);                              \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_put(name *t, K key, V value) {                \
+	name##_node *y = t->nil;                                                    \
+	name##_node *x = t->root;                                                   \
+	int go_left = 0;                                                            \
+	while (x != t->nil) {                                                       \
+		y = x;                                                                  \
+		if (name##_step(key, x->key, &go_left)) {                               \
+			x->value = value;                                                   \
+			return x;                                                           \
+		}                                                                       \
+		x = go_left ? x->left : x->right;                                       \
+	}                                                                           \
+	return name##_link(t, y, go_left, key, value);                              \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_find(const name *t, K key) {                  \
+	name##_node *x = t->root;                                                   \
+	while (x != t->nil) {                                                       \
+		int go_left;                                                            \
+		if (name##_step(key, x->key, &go_left)) {                               \
+			return x;                                                           \
+		}                                                                       \
+		x = go_left ? x->left : x->right;                                       \
+	}                                                                           \
+	return NULL;                                                                \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_lower_bound(const name *t, K key) {           \
+	name##_node *result = NULL;                                                 \
+	name##_node *x = t->root;                                                   \
+	while (x != t->nil) {                                                       \
+		if (!name##_lt(x->key, key)) {                                          \
+			result = x;                                                         \
+			x = x->left;                                                        \
+		} else {                                                                \
+			x = x->right;                                                       \
+		}                                                                       \
+	}                                                                           \
+	return result;                                                              \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_min(const name *t) {                          \
+	if (t->root == t->nil) {                                                    \
+		return NULL;                                                            \
+	}                                                                           \
+	name##_node *x = t->root;                                                   \
+	while (x->left != t->nil) {                                                 \
+		x = x->left;                                                            \
+	}                                                                           \
+	return x;                                                                   \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_max(const name *t) {                          \
+	if (t->root == t->nil) {                                                    \
+		return NULL;                                                            \
+	}                                                                           \
+	name##_node *x = t->root;                                                   \
+	while (x->right != t->nil) {                                                \
+		x = x->right;                                                           \
+	}                                                                           \
+	return x;                                                                   \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_next(const name *t, const name##_node *p) {   \
+	if (p->right != t->nil) {                                                   \
+		p = p->right;                                                           \
+		while (p->left != t->nil) {                                             \
+			p = p->left;                                                        \
+		}                                                                       \
+		return (name##_node *)p;                                                \
+	}                                                                           \
+	name##_node *y = p->parent;                                                 \
+	while (y != t->nil && p == y->right) {                                      \
+		p = y;                                                                  \
+		y = y->parent;                                                          \
+	}                                                                           \
+	return y == t->nil ? NULL : y;                                              \
+}                                                                               \
+                                                                                \
+static inline name##_node *name##_prev(const name *t, const name##_node *p) {   \
+	if (p->left != t->nil) {                                                    \
+		p = p->left;                                                            \
+		while (p->right != t->nil) {                                            \
+			p = p->right;                                                       \
+		}                                                                       \
+		return (name##_node *)p;                                                \
+	}                                                                           \
+	name##_node *y = p->parent;                                                 \
+	while (y != t->nil && p == y->left) {                                       \
+		p = y;                                                                  \
+		y = y->parent;                                                          \
+	}                                                                           \
+	return y == t->nil ? NULL : y;                                              \
+}                                                                               \
+                                                                                \
+static inline size_t name##_keys(const name *t, K *arr, const size_t n) {       \
+	size_t index = 0;                                                           \
+	for (name##_node *p = name##_min(t); p != NULL && index < n;                \
+	     p = name##_next(t, p)) {                                               \
+		arr[index++] = p->key;                                                  \
+	}                                                                           \
+	return index;                                                               \
+}                                                                               \
+                                                                                \
+static inline void name##_transplant(name *t, name##_node *u, name##_node *v) { \
+	if (u->parent == t->nil) {                                                  \
+		t->root = v;                                                            \
+	} else if (u == u->parent->left) {                                          \
+		u->parent->left = v;                                                    \
+	} else {                                                                    \
+		u->parent->right = v;                                                   \
+	}                                                                           \
+	v->parent = u->parent;                                                      \
+}                                                                               \
+                                                                                \
+static inline void name##_erase_fixup(name *t, name##_node *x) {                \
+	while (x != t->root && x->color == RBTREE_BLACK) {                          \
+		if (x == x->parent->left) {                                             \
+			name##_node *w = x->parent->right;                                  \
+			if (w->color == RBTREE_RED) {              /* CASE 1 */             \
+				w->color = RBTREE_BLACK;                                        \
+				x->parent->color = RBTREE_RED;                                  \
+				name##_left_rotate(t, x->parent);                               \
+				w = x->parent->right;                                           \
+			}                                                                   \
+			if (w->left->color == RBTREE_BLACK &&                               \
+			    w->right->color == RBTREE_BLACK) {         /* CASE 2 */         \
+				w->color = RBTREE_RED;                                          \
+				x = x->parent;                                                  \
+			} else {                                                            \
+				if (w->right->color == RBTREE_BLACK) {     /* CASE 3 */         \
+					w->left->color = RBTREE_BLACK;                              \
+					w->color = RBTREE_RED;                                      \
+					name##_right_rotate(t, w);                                  \
+					w = x->parent->right;                                       \
+				}                                          /* CASE 4 */         \
+				w->color = x->parent->color;                                    \
+				x->parent->color = RBTREE_BLACK;                                \
+				w->right->color = RBTREE_BLACK;                                 \
+				name##_left_rotate(t, x->parent);                               \
+				x = t->root;                                                    \
+			}                                                                   \
+		} else {                                                                \
+			name##_node *w = x->parent->left;                                   \
+			if (w->color == RBTREE_RED) {                                       \
+				w->color = RBTREE_BLACK;                                        \
+				x->parent->color = RBTREE_RED;                                  \
+				name##_right_rotate(t, x->parent);                              \
+				w = x->parent->left;                                            \
+			}                                                                   \
+			if (w->left->color == RBTREE_BLACK &&                               \
+			    w->right->color == RBTREE_BLACK) {                              \
+				w->color = RBTREE_RED;                                          \
+				x = x->parent;                                                  \
+			} else {                                                            \
+				if (w->left->color == RBTREE_BLACK) {                           \
+					w->right->color = RBTREE_BLACK;                             \
+					w->color = RBTREE_RED;                                      \
+					name##_left_rotate(t, w);                                   \
+					w = x->parent->left;                                        \
+				}                                                               \
+				w->color = x->parent->color;                                    \
+				x->parent->color = RBTREE_BLACK;                                \
+				w->left->color = RBTREE_BLACK;                                  \
+				name##_right_rotate(t, x->parent);                              \
+				x = t->root;                                                    \
+			}                                                                   \
+		}                                                                       \
+	}                                                                           \
+	x->color = RBTREE_BLACK;                                                    \
+}                                                                               \
+                                                                                \
+static inline int name##_erase(name *t, name##_node *z) {                       \
+	name##_node *y = z;                                                         \
+	color_t y_original_color = y->color;                                        \
+	name##_node *x;                                                             \
+	if (z->left == t->nil) {                                                    \
+		x = z->right;                                                           \
+		name##_transplant(t, z, z->right);                                      \
+	} else if (z->right == t->nil) {                                            \
+		x = z->left;                                                            \
+		name##_transplant(t, z, z->left);                                       \
+	} else {                                                                    \
+		y = z->right;                                                           \
+		while (y->left != t->nil) {                                             \
+			y = y->left;                                                        \
+		}                                                                       \
+		y_original_color = y->color;                                            \
+		x = y->right;                                                           \
+		if (y->parent == z) {                                                   \
+			x->parent = y;                                                      \
+		} else {                                                                \
+			name##_transplant(t, y, y->right);                                  \
+			y->right = z->right;                                                \
+			y->right->parent = y;                                               \
+		}                                                                       \
+		name##_transplant(t, z, y);                                             \
+		y->left = z->left;                                                      \
+		y->left->parent = y;                                                    \
+		y->color = z->color;                                                    \
+	}                                                                           \
+	z->right = t->free_list;                                                    \
+	t->free_list = z;                                                           \
+	if (y_original_color == RBTREE_BLACK) {                                     \
+		name##_erase_fixup(t, x);                                               \
+	}                                                                           \
+	return 0;                                                                   \
+}
+
+#endif  // _RBTREE_GENERIC_H_
@@ -0,0 +1,355 @@
+#include "rbtree_mmap.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint32_t emit(const rbtree *, const node_t *, rbtree_dnode_t *, uint32_t *);
+static uint32_t emit_sorted(const node_t **, size_t, size_t, rbtree_dnode_t *, uint32_t *, int, int);
+static int emit_live(const rbtree *, const size_t, rbtree_dnode_t *);
+
+// 트리에 tombstone이 남아있는지 (RBTREE_LAZY_DELETE가 아니면 항상 0)
+static inline int has_dead(const rbtree *t) {
+#ifdef RBTREE_LAZY_DELETE
+	return t->dead > 0;
+#else
+	return 0;
+#endif
+}
+
+
+
+/*
+	FUNCTION : save	return : fail 0 / success 1
+	트리를 path에 저장한다
+	1. 노드 수를 세고 path.tmp를 그 크기로 만들어 mmap
+	2. header를 쓰고 노드들을 전위 순회 순서로 채운다 : O(n)
+	   (1.의 n은 살아있는 노드만 센 것이라 tombstone이 있으면 emit_live로)
+	3. 디스크에 내린 뒤 path로 rename (이미 있던 파일은 한번에 바뀐다)
+*/
+int rbtree_save(const rbtree *t, const char *path) {
+	// 1.
+	size_t n = 0;
+	for (node_t *p = rbtree_iter_begin(t); p != NULL; p = rbtree_iter_next(t, p)) {
+		if (rbtree_count(p) > UINT32_MAX >> 1) {	// meta에 31 bit
+			return 0;
+		}
+		n++;
+	}
+	if (n > UINT32_MAX) {	// 링크가 uint32_t
+		return 0;
+	}
+	const size_t len = sizeof(rbtree_dheader_t) + n * sizeof(rbtree_dnode_t);
+	char *tmp = (char *)malloc(strlen(path) + 5);
+	if (tmp == NULL) {
+		return 0;
+	}
+	sprintf(tmp, "%s.tmp", path);
+	int ok = 0;
+	const int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		free(tmp);
+		return 0;
+	}
+	void *base = MAP_FAILED;
+	if (ftruncate(fd, (off_t)len) == 0) {
+		base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+
+	// 2.
+	if (base != MAP_FAILED) {
+		rbtree_dheader_t *h = (rbtree_dheader_t *)base;
+		memset(h, 0, sizeof(*h));
+		h->magic = RBTREE_MMAP_MAGIC;
+		h->key_size = sizeof(key_t);
+		h->node_size = sizeof(rbtree_dnode_t);
+		h->count = n;
+		ok = 1;
+		if (n > 0 && has_dead(t)) {
+			ok = emit_live(t, n, (rbtree_dnode_t *)(h + 1));
+		} else if (n > 0) {
+			uint32_t next = 0;
+			emit(t, t->root, (rbtree_dnode_t *)(h + 1), &next);
+		}
+		ok = ok && msync(base, len, MS_SYNC) == 0;
+		munmap(base, len);
+	}
+
+	// 3.
+	ok = ok && fsync(fd) == 0;
+	ok = close(fd) == 0 && ok;
+	ok = ok && rename(tmp, path) == 0;
+	if (!ok) {
+		unlink(tmp);
+	}
+	free(tmp);
+	return ok;
+}
+
+
+
+/*
+	FUNCTION : emit	return : x를 쓴 칸
+	x를 nodes[*next]에 쓰고 왼쪽, 오른쪽 서브트리를 차례로 그 뒤에 쓴다
+	자식의 칸이 정해진 뒤에 거리를 채운다. 재귀 깊이는 트리 높이
+*/
+static uint32_t emit(const rbtree *t, const node_t *x, rbtree_dnode_t *nodes, uint32_t *next) {
+	const uint32_t i = (*next)++;
+	nodes[i].key = x->key;
+	nodes[i].meta = (uint32_t)rbtree_count(x) << 1 | rbtree_color(x);
+	nodes[i].left = 0;
+	nodes[i].right = 0;
+	if (rbtree_left(t, x) != t->nil) {
+		nodes[i].left = emit(t, rbtree_left(t, x), nodes, next) - i;
+	}
+	if (rbtree_right(t, x) != t->nil) {
+		nodes[i].right = emit(t, rbtree_right(t, x), nodes, next) - i;
+	}
+	return i;
+}
+
+
+
+/*
+	FUNCTION : emit_live	return : fail 0 / success 1
+	tombstone이 있는 트리 : 살아있는 노드 n개를 iterator 순서로 모아서 
+	build_sorted와 같은 모양 (가운데가 루트, 마지막 level이 덜 찼으면 그 level만 RED)으로 쓴다
+*/
+static int emit_live(const rbtree *t, const size_t n, rbtree_dnode_t *nodes) {
+	const node_t **live = (const node_t **)malloc(n * sizeof(node_t *));
+	if (live == NULL) {
+		return 0;
+	}
+	size_t k = 0;
+	for (node_t *p = rbtree_iter_begin(t); p != NULL; p = rbtree_iter_next(t, p)) {
+		live[k++] = p;
+	}
+	int depth = 0;
+	while (((size_t)2 << depth) - 1 < n) {
+		depth++;
+	}
+	const int red_depth = (((size_t)2 << depth) - 1 == n) ? -1 : depth;
+	uint32_t next = 0;
+	emit_sorted(live, 0, n, nodes, &next, 0, red_depth);
+	free(live);
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : emit_sorted	return : live[mid]를 쓴 칸
+	live[lo, hi)의 가운데를 nodes[*next]에 쓰고 왼쪽 절반, 오른쪽 절반을 차례로 그 뒤에 쓴다
+*/
+static uint32_t emit_sorted(const node_t **live, size_t lo, size_t hi, rbtree_dnode_t *nodes, uint32_t *next,
+		int depth, int red_depth) {
+	const size_t mid = lo + (hi - lo) / 2;
+	const uint32_t i = (*next)++;
+	nodes[i].key = live[mid]->key;
+	nodes[i].meta = (uint32_t)rbtree_count(live[mid]) << 1 | (depth == red_depth ? RBTREE_RED : RBTREE_BLACK);
+	nodes[i].left = 0;
+	nodes[i].right = 0;
+	if (lo < mid) {
+		nodes[i].left = emit_sorted(live, lo, mid, nodes, next, depth + 1, red_depth) - i;
+	}
+	if (mid + 1 < hi) {
+		nodes[i].right = emit_sorted(live, mid + 1, hi, nodes, next, depth + 1, red_depth) - i;
+	}
+	return i;
+}
+
+
+
+/*
+	FUNCTION : open_mmap	return : mapped pointer
+	path를 읽기 전용으로 mmap 한다. 노드는 읽지 않고 header만 확인
+	파일이 없거나, 다른 형식이거나, 크기가 header와 맞지 않으면 NULL
+*/
+rbtree_mapped *rbtree_open_mmap(const char *path) {
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	void *base = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(rbtree_dheader_t)) {
+		base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);	// mmap은 fd를 닫아도 남는다
+	if (base == MAP_FAILED) {
+		return NULL;
+	}
+	const size_t len = (size_t)st.st_size;
+	const rbtree_dheader_t *h = (const rbtree_dheader_t *)base;
+	if (h->magic != RBTREE_MMAP_MAGIC || h->key_size != sizeof(key_t)
+		|| h->node_size != sizeof(rbtree_dnode_t) || h->count > UINT32_MAX
+		|| len != sizeof(rbtree_dheader_t) + h->count * sizeof(rbtree_dnode_t)) {
+		munmap(base, len);
+		return NULL;
+	}
+	rbtree_mapped *m = (rbtree_mapped *)malloc(sizeof(rbtree_mapped));
+	if (m == NULL) {
+		munmap(base, len);
+		return NULL;
+	}
+	m->base = base;
+	m->len = len;
+	m->nodes = (const rbtree_dnode_t *)(h + 1);
+	m->n = h->count;
+	return m;
+}
+
+
+
+/*
+	FUNCTION : mapped_close	return : void
+	mmap을 풀고 m을 free
+*/
+void rbtree_mapped_close(rbtree_mapped *m) {
+	munmap(m->base, m->len);
+	free(m);
+}
+
+
+
+//++++++++++++++++++++++++mapped 찾기 구현++++++++++++++++++++++++++++
+
+// nodes[i]에서 d칸 뒤의 자식. NIL이거나 파일 밖이면 0
+static inline size_t child(const rbtree_mapped *m, const size_t i, const uint32_t d) {
+	return d != 0 && d < m->n - i ? i + d : 0;
+}
+
+
+
+/*
+	FUNCTION : mapped_find	return : 없으면 0 / 있으면 1
+	루트부터 거리만큼 건너뛰며 내려간다 (rbtree_find와 같은 비교)
+*/
+int rbtree_mapped_find(const rbtree_mapped *m, const key_t key) {
+	if (m->n == 0) {
+		return 0;
+	}
+	size_t i = 0;
+	do {
+		const rbtree_dnode_t *x = &m->nodes[i];
+		if (x->key == key) {
+			return 1;
+		}
+		i = child(m, i, key < x->key ? x->left : x->right);
+	} while (i != 0);
+	return 0;
+}
+
+
+
+/*
+	FUNCTION : mapped_lower_bound	return : 없으면 0 / 있으면 1
+	key 이상인 첫 key를 *out에
+*/
+int rbtree_mapped_lower_bound(const rbtree_mapped *m, const key_t key, key_t *out) {
+	if (m->n == 0) {
+		return 0;
+	}
+	int found = 0;
+	size_t i = 0;
+	do {
+		const rbtree_dnode_t *x = &m->nodes[i];
+		if (x->key >= key) {
+			*out = x->key;
+			found = 1;
+			i = child(m, i, x->left);
+		} else {
+			i = child(m, i, x->right);
+		}
+	} while (i != 0);
+	return found;
+}
+
+
+
+/*
+	FUNCTION : mapped_range	return : 복사한 key 개수
+	rbtree_range와 같이 [lo, hi]의 key를 순서대로 최대 cap개 out에 복사 (노드마다 count번)
+	부모 링크가 없으므로 snap_range처럼 in-order 순회를 stack으로 한다
+	(깨진 파일이라 stack이 넘치면 거기까지만)
+*/
+size_t rbtree_mapped_range(const rbtree_mapped *m, const key_t lo, const key_t hi, key_t *out, const size_t cap) {
+	if (m->n == 0) {
+		return 0;
+	}
+	size_t stack[RBTREE_MMAP_MAX_DEPTH];
+	int top = 0;
+	size_t count = 0;
+	// 1. lo 이상인 첫 노드까지 내려가며 왼쪽으로 꺾은 노드들을 stack에
+	size_t i = 0;
+	do {
+		const rbtree_dnode_t *x = &m->nodes[i];
+		if (x->key >= lo) {
+			if (top == RBTREE_MMAP_MAX_DEPTH) {
+				return 0;
+			}
+			stack[top++] = i;
+			i = child(m, i, x->left);
+		} else {
+			i = child(m, i, x->right);
+		}
+	} while (i != 0);
+	// 2. 꺼낸 노드를 쓰고, 그 오른쪽 서브트리의 왼쪽 가장자리를 stack에
+	while (top > 0 && count < cap) {
+		i = stack[--top];
+		if (m->nodes[i].key > hi) {
+			break;
+		}
+		for (uint32_t c = m->nodes[i].meta >> 1; c > 0 && count < cap; c--) {
+			out[count++] = m->nodes[i].key;
+		}
+		for (i = child(m, i, m->nodes[i].right); i != 0 && top < RBTREE_MMAP_MAX_DEPTH;
+			 i = child(m, i, m->nodes[i].left)) {
+			stack[top++] = i;
+		}
+	}
+	return count;
+}
+
+
+
+// 가장 왼쪽(dir 0) / 오른쪽(dir 1) 노드의 key
+static key_t edge_key(const rbtree_mapped *m, const int dir) {
+	size_t i = 0;
+	for (size_t c = 0; (c = child(m, i, dir ? m->nodes[i].right : m->nodes[i].left)) != 0;) {
+		i = c;
+	}
+	return m->nodes[i].key;
+}
+
+
+
+/*
+	FUNCTION : mapped_thaw	return : rbtree pointer
+	고칠 수 있는 보통 rbtree로 옮긴다. 실패하면 NULL
+	key들을 (count만큼) 순서대로 꺼내서 rbtree_from_sorted로 세운다 : O(n), 회전 없음
+	(mmap은 그대로 남으므로 필요 없으면 따로 close)
+*/
+rbtree *rbtree_mapped_thaw(const rbtree_mapped *m) {
+	if (m->n == 0) {
+		return new_rbtree();
+	}
+	size_t total = 0;
+	for (size_t i = 0; i < m->n; i++) {
+		total += m->nodes[i].meta >> 1;
+	}
+	key_t *keys = (key_t *)malloc((total ? total : 1) * sizeof(key_t));
+	if (keys == NULL) {
+		return NULL;
+	}
+	rbtree *t = NULL;
+	if (rbtree_mapped_range(m, edge_key(m, 0), edge_key(m, 1), keys, total) == total) {
+		t = rbtree_from_sorted(keys, total);
+	}
+	free(keys);
+	return t;
+}
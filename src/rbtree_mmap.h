@@ -0,0 +1,62 @@
+#ifndef _RBTREE_MMAP_H_
+#define _RBTREE_MMAP_H_
+
+#include <stdint.h>
+
+#include "rbtree.h"
+
+/*
+	파일로 저장한 트리를 mmap으로 바로 읽기
+
+	rbtree_save(t, path)는 트리 모양(과 색, multiset이면 count) 그대로 노드들을 파일 하나에 쓴다
+	- 노드의 링크는 포인터 대신 "이 노드에서 몇 칸 뒤에 있는지" (0은 NIL)
+	  그래서 파일을 어느 주소에 mmap 하든 링크를 고칠 필요가 없다
+	- 노드는 전위 순회(preorder) 순서 : nodes[0]이 루트, 왼쪽 자식은 바로 다음 칸
+	  서브트리 하나가 연속된 구간이라 아래쪽 몇 단계는 page 하나 안에서 끝난다
+	- 자식은 항상 부모보다 뒤에 있으므로 (링크 > 0) 깨진 파일이어도 찾기가 무한히 돌지 않는다
+
+	rbtree_open_mmap(path)는 파일을 읽기 전용으로 mmap만 하고 (header만 확인)
+	역직렬화 없이 mapped_find / lower_bound / range로 파일 위에서 바로 찾는다
+	실제로 읽는 page만 디스크에서 올라온다
+	고쳐야 하면 rbtree_mapped_thaw로 보통 rbtree를 만든다
+	(정렬된 key로 바로 세우므로 O(n), 하나씩 insert 하는 것보다 훨씬 빠르다)
+
+	파일은 만든 기계와 같은 byte order / key_t 크기에서만 열린다
+	저장은 path.tmp에 쓰고 rename 하므로 중간에 죽어도 이전 파일이 깨지지 않는다
+*/
+#define RBTREE_MMAP_MAGIC 0x3230454552544252ull	// "RBTREE02"
+#define RBTREE_MMAP_MAX_DEPTH 128
+
+// 파일 맨 앞 64바이트 (노드 배열이 cache line에 맞게 시작하도록)
+typedef struct {
+	uint64_t magic;
+	uint32_t key_size;		// sizeof(key_t)
+	uint32_t node_size;		// sizeof(rbtree_dnode_t)
+	uint64_t count;			// 노드 수
+	uint64_t reserved[5];
+} rbtree_dheader_t;
+
+// 파일 속 노드 하나 (16바이트)
+typedef struct {
+	key_t key;
+	uint32_t meta;			// 이 노드에 모인 같은 key 개수(rbtree_count) << 1 | color
+	uint32_t left, right;	// 자식까지의 거리 (노드 단위, 0이면 NIL)
+} rbtree_dnode_t;
+
+typedef struct {
+	void *base;						// mmap 한 주소
+	size_t len;						// mmap 한 크기
+	const rbtree_dnode_t *nodes;	// base 바로 뒤 header 다음
+	size_t n;
+} rbtree_mapped;
+
+int rbtree_save(const rbtree *, const char *);
+rbtree_mapped *rbtree_open_mmap(const char *);
+void rbtree_mapped_close(rbtree_mapped *);
+
+int rbtree_mapped_find(const rbtree_mapped *, const key_t);
+int rbtree_mapped_lower_bound(const rbtree_mapped *, const key_t, key_t *);
+size_t rbtree_mapped_range(const rbtree_mapped *, const key_t, const key_t, key_t *, const size_t);
+rbtree *rbtree_mapped_thaw(const rbtree_mapped *);
+
+#endif  // _RBTREE_MMAP_H_
@@ -0,0 +1,632 @@
+#include "rbtree_parallel.h"
+
+#include <sched.h>
+#include <stdlib.h>
+
+void init_node(node_t *, color_t, key_t);
+node_t *reserve_nodes(rbtree *, size_t);
+void delete_node(rbtree *, node_t *);
+#if !defined(RBTREE_NO_POOL) && !defined(RBTREE_COMPACT32)
+node_chunk_t *release_chunks(rbtree *);
+#endif
+
+typedef struct {
+	rbtree_workers *w;
+	int id;				// 자기 deque
+	unsigned seed;		// 훔칠 deque 고르기
+} par_ctx_t;
+
+// 작업마다 이 구조체를 맨 앞에 두고 나머지 인자를 뒤에 붙인다
+struct par_task_t {
+	void (*fn)(par_ctx_t *, par_task_t *);
+	int done;
+};
+
+
+
+//++++++++++++++++++++++++work-stealing pool 구현++++++++++++++++++++++++++++
+
+static int deque_push(par_deque_t *d, par_task_t *task) {
+	pthread_mutex_lock(&d->lock);
+	const int ok = d->bottom - d->top < RBTREE_PAR_DEQUE;
+	if (ok) {
+		d->tasks[d->bottom++ % RBTREE_PAR_DEQUE] = task;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return ok;
+}
+
+// 주인은 가장 최근에 넣은 것부터
+static par_task_t *deque_pop(par_deque_t *d) {
+	par_task_t *task = NULL;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom > d->top) {
+		task = d->tasks[--d->bottom % RBTREE_PAR_DEQUE];
+	}
+	pthread_mutex_unlock(&d->lock);
+	return task;
+}
+
+// 훔치는 쪽은 가장 오래된 것 (= 트리의 위쪽이라 가장 큰 작업)부터
+static par_task_t *deque_steal(par_deque_t *d) {
+	par_task_t *task = NULL;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom > d->top) {
+		task = d->tasks[d->top++ % RBTREE_PAR_DEQUE];
+	}
+	pthread_mutex_unlock(&d->lock);
+	return task;
+}
+
+static par_task_t *steal_any(par_ctx_t *c) {
+	const int threads = c->w->threads;
+	for (int i = 1; i < threads; i++) {
+		const int victim = (c->id + 1 + rand_r(&c->seed) % (threads - 1)) % threads;
+		par_task_t *task = deque_steal(&c->w->deques[victim]);
+		if (task != NULL) {
+			return task;
+		}
+	}
+	return NULL;
+}
+
+static void task_run(par_ctx_t *c, par_task_t *task) {
+	task->fn(c, task);
+	__atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+}
+
+
+
+/*
+	FUNCTION : par_fork	return : void
+	task를 자기 deque에 넣어서 다른 thread가 가져갈 수 있게 한다
+	deque가 꽉 찼으면 그 자리에서 바로 한다
+*/
+static void par_fork(par_ctx_t *c, par_task_t *task, void (*fn)(par_ctx_t *, par_task_t *)) {
+	task->fn = fn;
+	task->done = 0;
+	if (!deque_push(&c->w->deques[c->id], task)) {
+		task_run(c, task);
+	}
+}
+
+
+
+/*
+	FUNCTION : par_join	return : void
+	task가 끝날 때까지 자기 deque의 작업이나 남의 작업을 대신 한다
+	task보다 나중에 fork한 것들은 이미 join 했으므로, 안 훔쳐갔으면 deque 맨 뒤가 task다
+*/
+static void par_join(par_ctx_t *c, par_task_t *task) {
+	while (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+		par_task_t *other = deque_pop(&c->w->deques[c->id]);
+		if (other == NULL) {
+			other = steal_any(c);
+		}
+		if (other != NULL) {
+			task_run(c, other);
+		} else {
+			sched_yield();
+		}
+	}
+}
+
+
+
+/*
+	FUNCTION : worker_main	return : NULL
+	연산이 돌고 있는 동안 남의 deque에서 작업을 훔쳐서 한다 (훔친 작업이 fork한 것은 자기 deque로)
+	연산이 없으면 cv에서 잔다
+*/
+static void *worker_main(void *arg) {
+	par_ctx_t c = *(par_ctx_t *)arg;
+	free(arg);
+	rbtree_workers *w = c.w;
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		while (!w->stop && !w->active) {
+			pthread_cond_wait(&w->cv, &w->lock);
+		}
+		const int stop = w->stop;
+		pthread_mutex_unlock(&w->lock);
+		if (stop) {
+			return NULL;
+		}
+		while (__atomic_load_n(&w->active, __ATOMIC_ACQUIRE)) {
+			par_task_t *task = steal_any(&c);
+			if (task != NULL) {
+				task_run(&c, task);
+			} else {
+				sched_yield();
+			}
+		}
+	}
+}
+
+
+
+/*
+	FUNCTION : par_run	return : void
+	부르는 thread가 deque 0번으로 task를 하고, 그동안 다른 thread들을 깨워둔다
+	task가 돌려주면 거기서 fork한 작업도 모두 끝나있다
+*/
+static void par_run(rbtree_workers *w, par_task_t *task, void (*fn)(par_ctx_t *, par_task_t *)) {
+	pthread_mutex_lock(&w->run_lock);
+	pthread_mutex_lock(&w->lock);
+	__atomic_store_n(&w->active, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&w->cv);
+	pthread_mutex_unlock(&w->lock);
+
+	par_ctx_t c = {w, 0, 1};
+	task->fn = fn;
+	task_run(&c, task);
+
+	pthread_mutex_lock(&w->lock);
+	__atomic_store_n(&w->active, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&w->lock);
+	pthread_mutex_unlock(&w->run_lock);
+}
+
+
+
+/*
+	FUNCTION : workers_new	return : rbtree_workers pointer
+	부르는 thread를 포함해서 threads개 (1이면 thread를 만들지 않고 모두 그 자리에서 한다)
+	thread를 다 못 만들면 만든 만큼만 쓴다
+*/
+rbtree_workers *rbtree_workers_new(const int threads) {
+	rbtree_workers *w = (rbtree_workers *)calloc(1, sizeof(rbtree_workers));
+	if (w == NULL) {
+		return NULL;
+	}
+	const int n = threads < 1 ? 1 : threads;
+	w->deques = (par_deque_t *)aligned_alloc(64, n * sizeof(par_deque_t));
+	w->th = (pthread_t *)calloc(n, sizeof(pthread_t));
+	if (w->deques == NULL || w->th == NULL) {
+		free(w->deques);
+		free(w->th);
+		free(w);
+		return NULL;
+	}
+	for (int i = 0; i < n; i++) {
+		pthread_mutex_init(&w->deques[i].lock, NULL);
+		w->deques[i].top = w->deques[i].bottom = 0;
+	}
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cv, NULL);
+	pthread_mutex_init(&w->run_lock, NULL);
+
+	w->threads = 1;
+	for (int i = 1; i < n; i++) {
+		par_ctx_t *c = (par_ctx_t *)malloc(sizeof(par_ctx_t));
+		if (c == NULL) {
+			break;
+		}
+		*c = (par_ctx_t){w, i, 17u * i + 1};
+		if (pthread_create(&w->th[i], NULL, worker_main, c) != 0) {
+			free(c);
+			break;
+		}
+		w->threads++;
+	}
+	w->depth = 0;
+	while (w->threads > 1 && (1 << w->depth) < 8 * w->threads) {
+		w->depth++;
+	}
+	return w;
+}
+
+
+
+/*
+	FUNCTION : workers_delete	return : void
+	thread들을 깨워서 끝내고 기다린다
+*/
+void rbtree_workers_delete(rbtree_workers *w) {
+	pthread_mutex_lock(&w->lock);
+	w->stop = 1;
+	pthread_cond_broadcast(&w->cv);
+	pthread_mutex_unlock(&w->lock);
+	for (int i = 1; i < w->threads; i++) {
+		pthread_join(w->th[i], NULL);
+	}
+	for (int i = 0; i < w->threads; i++) {
+		pthread_mutex_destroy(&w->deques[i].lock);
+	}
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cv);
+	pthread_mutex_destroy(&w->run_lock);
+	free(w->deques);
+	free(w->th);
+	free(w);
+}
+
+
+
+//++++++++++++++++++++++++병렬 to_array 구현++++++++++++++++++++++++++++
+
+/*
+	위에서 w->depth level까지의 노드는 heap 번호(루트 1, 자식 2i / 2i+1)로 부르고
+	그 서브트리의 key 개수를 cnt[i]에 적어둔다 (ORDER_STAT이면 size가 있으므로 세지 않는다)
+	그 아래 서브트리 하나는 thread 하나가 통째로 맡는다
+*/
+typedef struct {
+	par_task_t task;
+	const rbtree *t;
+	const node_t *x;
+	size_t idx;
+	int depth;
+	size_t *cnt;
+	key_t *arr;
+	size_t off, n;		// fill : x의 서브트리를 arr[off]부터 (n개 까지)
+	size_t result;		// count : x의 서브트리 key 개수
+} array_task_t;
+
+#ifndef RBTREE_ORDER_STAT	// ORDER_STAT이면 size가 있으므로 세지 않는다
+static size_t count_seq(const rbtree *t, const node_t *x) {
+	size_t count = 0;
+	while (x != t->nil) {
+		count += count_seq(t, rbtree_left(t, x)) + rbtree_count(x);
+		x = rbtree_right(t, x);
+	}
+	return count;
+}
+#endif
+
+static void fill_seq(const rbtree *t, const node_t *x, key_t *arr, size_t *off, const size_t n) {
+	while (x != t->nil && *off < n) {
+		fill_seq(t, rbtree_left(t, x), arr, off, n);
+		for (size_t c = rbtree_count(x); c > 0 && *off < n; c--) {
+			arr[(*off)++] = x->key;
+		}
+		x = rbtree_right(t, x);
+	}
+}
+
+#ifndef RBTREE_ORDER_STAT
+/*
+	FUNCTION : count_task
+	왼쪽 서브트리는 fork, 오른쪽은 직접 세고 합쳐서 cnt[idx]에 적는다
+*/
+static void count_task(par_ctx_t *c, par_task_t *task) {
+	array_task_t *a = (array_task_t *)task;
+	const rbtree *t = a->t;
+	if (a->x == t->nil || a->depth == c->w->depth) {
+		a->result = count_seq(t, a->x);
+	} else {
+		array_task_t l = *a, r = *a;
+		l.x = rbtree_left(t, a->x);
+		l.idx = 2 * a->idx;
+		l.depth = r.depth = a->depth + 1;
+		r.x = rbtree_right(t, a->x);
+		r.idx = 2 * a->idx + 1;
+		par_fork(c, &l.task, count_task);
+		count_task(c, &r.task);
+		par_join(c, &l.task);
+		a->result = l.result + r.result + rbtree_count(a->x);
+	}
+	a->cnt[a->idx] = a->result;
+}
+#endif
+
+/*
+	FUNCTION : fill_task
+	왼쪽 서브트리 개수만큼 건너뛴 자리에 x를 쓰고
+	왼쪽은 fork, 오른쪽은 그 뒤부터 직접 채운다
+*/
+static void fill_task(par_ctx_t *c, par_task_t *task) {
+	array_task_t *a = (array_task_t *)task;
+	const rbtree *t = a->t;
+	if (a->x == t->nil || a->off >= a->n) {
+		return;
+	}
+	if (a->depth == c->w->depth) {
+		size_t off = a->off;
+		fill_seq(t, a->x, a->arr, &off, a->n);
+		return;
+	}
+	array_task_t l = *a, r = *a;
+	l.x = rbtree_left(t, a->x);
+	l.idx = 2 * a->idx;
+	l.depth = r.depth = a->depth + 1;
+#ifdef RBTREE_ORDER_STAT
+	size_t pos = a->off + l.x->size;
+#else
+	size_t pos = a->off + a->cnt[l.idx];
+#endif
+	par_fork(c, &l.task, fill_task);
+	for (size_t k = rbtree_count(a->x); k > 0 && pos < a->n; k--) {
+		a->arr[pos++] = a->x->key;
+	}
+	r.x = rbtree_right(t, a->x);
+	r.idx = 2 * a->idx + 1;
+	r.off = pos;
+	fill_task(c, &r.task);
+	par_join(c, &l.task);
+}
+
+
+
+/*
+	FUNCTION : to_array_par	return : fail 0 / success 1
+	rbtree_to_array와 같은 결과 (key 순서대로 n개 까지, multiset이면 count번씩)
+	1. (ORDER_STAT이 아니면) 위쪽 서브트리들의 개수를 병렬로 센다
+	2. 서브트리마다 시작 위치가 정해졌으므로 병렬로 채운다
+*/
+int rbtree_to_array_par(rbtree_workers *w, const rbtree *t, key_t *arr, const size_t n) {
+	if (w->threads == 1 || t->root == t->nil || n == 0) {
+		return rbtree_to_array(t, arr, n);
+	}
+#ifdef RBTREE_LAZY_DELETE
+	if (t->dead > 0) {	// 서브트리 크기로 자리를 나눌 수 없다. tombstone을 건너뛰는 순차 순회로
+		return rbtree_to_array(t, arr, n);
+	}
+#endif
+	array_task_t root = {{NULL, 0}, t, t->root, 1, 0, NULL, arr, 0, n, 0};
+#ifdef RBTREE_ORDER_STAT
+	par_run(w, &root.task, fill_task);
+#else
+	root.cnt = (size_t *)malloc(((size_t)2 << w->depth) * sizeof(size_t));
+	if (root.cnt == NULL) {
+		return rbtree_to_array(t, arr, n);
+	}
+	par_run(w, &root.task, count_task);
+	par_run(w, &root.task, fill_task);
+	free(root.cnt);
+#endif
+	return 1;
+}
+
+
+
+//++++++++++++++++++++++++병렬 bulk build 구현++++++++++++++++++++++++++++
+
+#ifndef RBTREE_NO_POOL	// 노드를 한 덩어리로 잡을 수 있어야 한다
+/*
+	build_sorted와 같은 모양 : arr[lo, hi)의 가운데가 서브트리 루트, 마지막 level만 RED
+	build_sorted는 in-order 순서로 노드를 꺼내므로 arr[i]의 노드는 한 덩어리로 잡은 자리의 i번째다
+	그래서 노드를 미리 다 잡아두면 서브트리끼리 풀을 건드리지 않고 따로 채울 수 있다
+*/
+typedef struct {
+	par_task_t task;
+	rbtree *t;
+	node_t *base;
+	const key_t *arr;
+	const size_t *counts;	// multiset이면 arr[i]의 개수
+	size_t lo, hi;
+	node_t *parent;
+	int depth, red_depth;
+	node_t *result;
+} build_task_t;
+
+// 노드 하나 채우기 (자식 링크는 자식을 만든 뒤에)
+static node_t *build_node(const build_task_t *b, const size_t mid, const int depth, node_t *parent) {
+	node_t *np = b->base + mid;
+	init_node(np, depth == b->red_depth ? RBTREE_RED : RBTREE_BLACK, b->arr[mid]);
+#ifdef RBTREE_MULTISET
+	np->count = b->counts[mid];
+#endif
+	rbtree_set_parent(b->t, np, parent);
+	return np;
+}
+
+static void link_children(const rbtree *t, node_t *np, node_t *l, node_t *r) {
+	rbtree_set_left(t, np, l);
+	rbtree_set_right(t, np, r);
+#ifdef RBTREE_ORDER_STAT
+	np->size = l->size + r->size + rbtree_count(np);
+#endif
+#ifdef RBTREE_INTERVAL
+	np->max = np->hi;
+	if (l->max > np->max) {
+		np->max = l->max;
+	}
+	if (r->max > np->max) {
+		np->max = r->max;
+	}
+#endif
+}
+
+// RBTREE_PAR_GRAIN개 이하 구간은 thread 하나가 재귀로
+static node_t *build_seq(const build_task_t *b, const size_t lo, const size_t hi, node_t *parent, const int depth) {
+	if (lo >= hi) {
+		return b->t->nil;
+	}
+	const size_t mid = lo + (hi - lo) / 2;
+	node_t *np = build_node(b, mid, depth, parent);
+	node_t *l = build_seq(b, lo, mid, np, depth + 1);
+	link_children(b->t, np, l, build_seq(b, mid + 1, hi, np, depth + 1));
+	return np;
+}
+
+static void build_task(par_ctx_t *c, par_task_t *task) {
+	build_task_t *b = (build_task_t *)task;
+	if (b->hi - b->lo <= RBTREE_PAR_GRAIN) {
+		b->result = build_seq(b, b->lo, b->hi, b->parent, b->depth);
+		return;
+	}
+	const size_t mid = b->lo + (b->hi - b->lo) / 2;
+	node_t *np = build_node(b, mid, b->depth, b->parent);
+	build_task_t l = *b, r = *b;
+	l.hi = mid;
+	r.lo = mid + 1;
+	l.parent = r.parent = np;
+	l.depth = r.depth = b->depth + 1;
+	par_fork(c, &l.task, build_task);
+	build_task(c, &r.task);
+	par_join(c, &l.task);
+	link_children(b->t, np, l.result, r.result);
+	b->result = np;
+}
+#endif
+
+
+
+/*
+	FUNCTION : from_sorted_par	return : rbtree pointer
+	rbtree_from_sorted의 병렬판 (arr는 오름차순, 같은 key 허용)
+	1. (multiset이면 같은 key를 모은다)
+	2. 노드 n개를 풀에서 한번에 잡는다
+	3. 구간을 반씩 나눠가며 병렬로 채운다
+	RBTREE_NO_POOL이면 노드를 한 덩어리로 잡을 수 없으므로 (thread가 하나일 때처럼) rbtree_from_sorted를 부른다
+*/
+rbtree *rbtree_from_sorted_par(rbtree_workers *w, const key_t *arr, size_t n) {
+#ifdef RBTREE_NO_POOL
+	return rbtree_from_sorted(arr, n);
+#else
+	if (w->threads == 1) {
+		return rbtree_from_sorted(arr, n);
+	}
+	rbtree *t = new_rbtree();
+	if (t == NULL || n == 0) {
+		return t;
+	}
+	// 1.
+	const size_t *counts = NULL;
+#ifdef RBTREE_MULTISET
+	key_t *uniq = (key_t *)malloc(n * sizeof(key_t));
+	size_t *runs = (size_t *)malloc(n * sizeof(size_t));
+	if (uniq == NULL || runs == NULL) {
+		free(uniq);
+		free(runs);
+		delete_rbtree(t);
+		return NULL;
+	}
+	size_t m = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (m > 0 && uniq[m - 1] == arr[i]) {
+			runs[m - 1]++;
+		} else {
+			uniq[m] = arr[i];
+			runs[m++] = 1;
+		}
+	}
+	arr = uniq;
+	counts = runs;
+	n = m;
+#endif
+	// 2.
+	node_t *base = reserve_nodes(t, n);
+	if (base == NULL) {
+		delete_rbtree(t);
+		t = NULL;
+	} else {
+		// 3. 모양과 색은 from_sorted와 같다
+		int depth = 0;
+		while (((size_t)2 << depth) - 1 < n) {
+			depth++;
+		}
+		const int red_depth = (((size_t)2 << depth) - 1 == n) ? -1 : depth;
+		build_task_t root = {{NULL, 0}, t, base, arr, counts, 0, n, t->nil, 0, red_depth, NULL};
+		par_run(w, &root.task, build_task);
+		t->root = root.result;
+	}
+#ifdef RBTREE_MULTISET
+	free(uniq);
+	free(runs);
+#endif
+	return t;
+#endif
+}
+
+
+
+//++++++++++++++++++++++++병렬 delete 구현++++++++++++++++++++++++++++
+
+/*
+	풀을 쓰면 노드는 chunk 안에 있으므로 chunk들을 나눠서 free 한다 (노드는 보지 않는다)
+	RBTREE_NO_POOL이면 서브트리를 나눠서 각자 delete_node 한다
+	RBTREE_COMPACT32는 예약한 주소공간 하나라서 delete_rbtree와 같다
+*/
+typedef struct {
+	par_task_t task;
+	rbtree *t;
+	node_t *x;
+	int depth;
+	void **chunks;
+	size_t lo, hi;
+} free_task_t;
+
+#if !defined(RBTREE_NO_POOL) && !defined(RBTREE_COMPACT32)
+static void free_chunks_task(par_ctx_t *c, par_task_t *task) {
+	free_task_t *f = (free_task_t *)task;
+	if (f->hi - f->lo == 1) {
+		free(f->chunks[f->lo]);
+		return;
+	}
+	free_task_t l = *f, r = *f;
+	l.hi = r.lo = f->lo + (f->hi - f->lo) / 2;
+	par_fork(c, &l.task, free_chunks_task);
+	free_chunks_task(c, &r.task);
+	par_join(c, &l.task);
+}
+#endif
+
+#ifdef RBTREE_NO_POOL
+static void free_subtree_task(par_ctx_t *c, par_task_t *task) {
+	free_task_t *f = (free_task_t *)task;
+	rbtree *t = f->t;
+	if (f->x == t->nil) {
+		return;
+	}
+	if (f->depth == c->w->depth) {
+		delete_node(t, f->x);
+		return;
+	}
+	free_task_t l = *f, r = *f;
+	l.x = rbtree_left(t, f->x);
+	r.x = rbtree_right(t, f->x);
+	l.depth = r.depth = f->depth + 1;
+	par_fork(c, &l.task, free_subtree_task);
+	free_subtree_task(c, &r.task);
+	par_join(c, &l.task);
+	free(f->x);
+}
+#endif
+
+
+
+/*
+	FUNCTION : delete_par	return : void
+	delete_rbtree의 병렬판
+	chunk가 하나뿐이거나 목록을 배열로 못 만들면 (메모리 부족) 차례로 free 한다
+*/
+void delete_rbtree_par(rbtree_workers *w, rbtree *t) {
+	if (w->threads == 1) {
+		delete_rbtree(t);
+		return;
+	}
+#if defined(RBTREE_COMPACT32)
+	delete_rbtree(t);
+#elif !defined(RBTREE_NO_POOL)
+	// 다른 트리가 아직 든 group의 chunk는 빠진다 (split / join으로 노드를 주고받은 트리)
+	node_chunk_t *list = release_chunks(t);
+	size_t k = 0;
+	for (node_chunk_t *ch = list; ch != NULL; ch = ch->next) {
+		k++;
+	}
+	void **chunks = k > 1 ? (void **)malloc(k * sizeof(void *)) : NULL;
+	if (chunks == NULL) {
+		while (list != NULL) {
+			node_chunk_t *next = list->next;
+			free(list);
+			list = next;
+		}
+		free(t);
+		return;
+	}
+	k = 0;
+	for (node_chunk_t *ch = list; ch != NULL; ch = ch->next) {
+		chunks[k++] = ch;
+	}
+	free_task_t root = {{NULL, 0}, t, NULL, 0, chunks, 0, k};
+	par_run(w, &root.task, free_chunks_task);
+	free(chunks);
+	free(t);
+#else
+	free_task_t root = {{NULL, 0}, t, t->root, 0, NULL, 0, 0};
+	par_run(w, &root.task, free_subtree_task);
+	free(t->nil);
+	free(t);
+#endif
+}
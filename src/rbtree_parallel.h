@@ -0,0 +1,57 @@
+#ifndef _RBTREE_PARALLEL_H_
+#define _RBTREE_PARALLEL_H_
+
+#include <pthread.h>
+
+#include "rbtree.h"
+
+/*
+	큰 트리 전체를 다루는 연산의 병렬판 (work-stealing thread pool)
+
+	- rbtree_to_array_par   : 위쪽 몇 level의 서브트리 크기로 (ORDER_STAT이면 size, 아니면 병렬로 센다)
+	                          서브트리마다 배열의 어디부터 쓸지 정해서 나눠 채운다
+	- rbtree_from_sorted_par : from_sorted와 같은 모양을 만든다. 노드 n개를 풀에서 한 덩어리로 잡고
+	                          arr[i]의 노드는 그 i번째 자리라서 서브트리마다 따로 채울 수 있다
+	- delete_rbtree_par     : 풀의 chunk들을 나눠서 free 한다 (RBTREE_NO_POOL이면 서브트리를 나눠서)
+
+	pool은 rbtree_workers_new(threads)로 한번 만들어 두고 계속 쓴다 (부르는 thread도 하나로 센다)
+	thread가 하나뿐이면 나눌 이유가 없으므로 순차 함수를 그대로 부른다
+	- thread마다 작업 deque를 두고 자기 것은 뒤에서 꺼내고 (LIFO) 일이 없으면 남의 것을 앞에서 훔친다
+	- 작업은 둘로 나눠서 한쪽을 자기 deque에 넣고 (fork) 다른 쪽을 직접 한 뒤
+	  넣어둔 쪽이 끝날 때까지 다른 작업을 하며 기다린다 (join)
+	- 한 workers로는 한번에 하나의 연산만 돈다. 연산이 없을 때 thread들은 condvar에서 잔다
+	서브트리 / 배열 구간이 RBTREE_PAR_GRAIN개 아래거나 thread 수의 8배만큼 나눴으면 더 안 나눈다
+*/
+#ifndef RBTREE_PAR_GRAIN
+#define RBTREE_PAR_GRAIN 4096
+#endif
+// thread마다 쌓아둘 수 있는 작업 수. 넘치면 그 자리에서 바로 한다
+#define RBTREE_PAR_DEQUE 64
+
+typedef struct par_task_t par_task_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	par_task_t *tasks[RBTREE_PAR_DEQUE];
+	size_t top, bottom;			// [top, bottom)에 작업이 있다. 훔치는 쪽은 top, 주인은 bottom
+} __attribute__((aligned(64))) par_deque_t;
+
+typedef struct {
+	int threads;				// 부르는 thread 포함
+	int depth;					// 트리를 이 깊이까지만 나눈다 (thread 수의 8배 조각)
+	pthread_t *th;
+	par_deque_t *deques;		// [0]은 부르는 thread
+	pthread_mutex_t lock;		// active / stop / cv
+	pthread_cond_t cv;
+	int active, stop;
+	pthread_mutex_t run_lock;	// 연산 하나씩
+} rbtree_workers;
+
+rbtree_workers *rbtree_workers_new(const int);
+void rbtree_workers_delete(rbtree_workers *);
+
+int rbtree_to_array_par(rbtree_workers *, const rbtree *, key_t *, const size_t);
+rbtree *rbtree_from_sorted_par(rbtree_workers *, const key_t *, size_t);
+void delete_rbtree_par(rbtree_workers *, rbtree *);
+
+#endif  // _RBTREE_PARALLEL_H_
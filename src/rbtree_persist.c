@@ -0,0 +1,513 @@
+#include "rbtree_persist.h"
+
+#include <stdlib.h>
+
+/*
+	write 하나의 상태
+	root는 새 버전의 루트, path[0..]는 루트부터 내려온 (이번 write 소유의) 노드들
+	fixup 중 CASE 1 회전이 경로에 노드를 하나 끼워넣을 수 있어 한칸 여유를 둔다
+*/
+typedef struct {
+	rbtree_persist *p;
+	unsigned long stamp;
+	pnode_t *root;
+	pnode_t *path[PERSIST_MAX_DEPTH + 2];
+} write_t;
+
+static void release(rbtree_persist *, pnode_t *, const int);
+
+
+
+/*
+	FUNCTION : persist_new	return : rbtree_persist pointer
+	빈 트리를 만든다
+*/
+rbtree_persist *rbtree_persist_new(void) {
+	rbtree_persist *p = (rbtree_persist *)calloc(1, sizeof(rbtree_persist));
+	if (p == NULL) {
+		return NULL;
+	}
+	atomic_init(&p->nodes, 0);
+	pthread_mutex_init(&p->write_lock, NULL);
+	pthread_mutex_init(&p->root_lock, NULL);
+	return p;
+}
+
+
+
+/*
+	FUNCTION : persist_delete	return : void
+	지금 버전을 놓고 미리 잡아둔 노드들을 free
+	snapshot들을 모두 놓은 뒤에 부른다
+*/
+void rbtree_persist_delete(rbtree_persist *p) {
+	release(p, p->root, 0);
+	while (p->spare != NULL) {
+		pnode_t *next = p->spare->link[1];
+		free(p->spare);
+		p->spare = next;
+	}
+	pthread_mutex_destroy(&p->write_lock);
+	pthread_mutex_destroy(&p->root_lock);
+	free(p);
+}
+
+
+
+//++++++++++++++++++++++++노드 참조 구현++++++++++++++++++++++++++++
+
+static inline int is_red(const pnode_t *n) {
+	return n != NULL && n->color == RBTREE_RED;
+}
+
+static inline void retain(pnode_t *n) {
+	if (n != NULL) {
+		atomic_fetch_add_explicit(&n->refs, 1, memory_order_relaxed);
+	}
+}
+
+
+
+/*
+	FUNCTION : release	return : void
+	n의 참조를 하나 놓는다. 마지막 참조였으면 반환하고 자식들의 참조도 놓는다
+	writer(write_lock 안)에서 부르면 다음 write가 다시 쓰도록 spare로 돌려놓고
+	snapshot을 놓는 reader thread에서 부르면 free 한다
+	(왼쪽은 재귀, 오른쪽은 반복이라 재귀 깊이는 트리 높이 이하)
+*/
+static void release(rbtree_persist *p, pnode_t *n, const int writer) {
+	while (n != NULL && atomic_fetch_sub_explicit(&n->refs, 1, memory_order_acq_rel) == 1) {
+		pnode_t *right = n->link[1];
+		release(p, n->link[0], writer);
+		atomic_fetch_sub_explicit(&p->nodes, 1, memory_order_relaxed);
+		if (writer && p->spares < PERSIST_MAX_SPARES) {
+			n->link[1] = p->spare;
+			p->spare = n;
+			p->spares++;
+		} else {
+			free(n);
+		}
+		n = right;
+	}
+}
+
+
+
+/*
+	FUNCTION : reserve	return : fail 0 / success 1
+	write 하나가 쓸 수 있는 최대 노드 수만큼 미리 잡아둔다 (write_lock 안에서)
+	높이 h인 트리에서 경로 복사 h + 1개, fixup에서 건드리는 형제 / 조카가 h + 5개 이하
+	-> 도중에 malloc이 실패해서 반쯤 고친 채로 멈추는 일이 없다
+	쓰고 남은 노드와 writer가 놓은 노드는 다음 write를 위해 그대로 둔다
+	(snapshot이 없으면 write마다 복사한 만큼 원본이 돌아오므로 malloc을 하지 않는다)
+*/
+static int reserve(rbtree_persist *p) {
+	size_t h = 2;	// 2 * log2(size + 1) 이상
+	for (size_t n = p->size + 1; n > 1; n >>= 1) {
+		h += 2;
+	}
+	while (p->spares < 3 * h + 6) {
+		pnode_t *n = (pnode_t *)malloc(sizeof(pnode_t));
+		if (n == NULL) {
+			return 0;
+		}
+		n->link[1] = p->spare;
+		p->spare = n;
+		p->spares++;
+	}
+	return 1;
+}
+
+// 미리 잡아둔 노드 하나를 이번 write의 노드로
+static pnode_t *take(write_t *w, const key_t key, const color_t color) {
+	pnode_t *n = w->p->spare;
+	w->p->spare = n->link[1];
+	w->p->spares--;
+	atomic_fetch_add_explicit(&w->p->nodes, 1, memory_order_relaxed);
+	n->key = key;
+	n->color = color;
+	atomic_init(&n->refs, 1);
+	n->stamp = w->stamp;
+	n->link[0] = NULL;
+	n->link[1] = NULL;
+	return n;
+}
+
+
+
+/*
+	FUNCTION : own	return : 고쳐도 되는 노드 (*slot)
+	*slot이 이번 write에서 만든 노드가 아니면 복사본으로 바꿔 끼운다
+	복사본도 원래 자식들을 가리키므로 자식들의 참조를 하나씩 늘리고
+	*slot은 더이상 원래 노드를 가리키지 않으므로 원래 노드의 참조를 하나 줄인다
+	(원래 노드는 이전 버전의 부모가 아직 가리키고 있어 free 되지 않는다)
+*/
+static pnode_t *own(write_t *w, pnode_t **slot) {
+	pnode_t *n = *slot;
+	if (n == NULL || n->stamp == w->stamp) {
+		return n;
+	}
+	pnode_t *c = take(w, n->key, n->color);
+	c->link[0] = n->link[0];
+	c->link[1] = n->link[1];
+	retain(c->link[0]);
+	retain(c->link[1]);
+	release(w->p, n, 1);
+	*slot = c;
+	return c;
+}
+
+
+
+//++++++++++++++++++++++++writer 구현++++++++++++++++++++++++++++
+
+// path[i]를 가리키는 자리 (부모의 link 또는 루트)
+static pnode_t **slot_of(write_t *w, const int i) {
+	if (i == 0) {
+		return &w->root;
+	}
+	pnode_t *parent = w->path[i - 1];
+	return &parent->link[parent->link[1] == w->path[i]];
+}
+
+
+
+/*
+	FUNCTION : rotate	return : x 자리에 올라온 노드
+	x를 dir 쪽(0 : 왼쪽, 1 : 오른쪽)으로 내리고 반대쪽 자식 y를 올린다
+	left_rotate(x) == rotate(x, 0), right_rotate(x) == rotate(x, 1)
+	x, y 모두 이번 write 소유여야 한다. 옮겨 붙는 가운데 서브트리는 가리키는 부모만 바뀌므로 참조 수는 그대로
+*/
+static pnode_t *rotate(pnode_t *x, const int dir) {
+	pnode_t *y = x->link[!dir];
+	x->link[!dir] = y->link[dir];
+	y->link[dir] = x;
+	return y;
+}
+
+
+
+/*
+	FUNCTION : commit	return : void
+	새 버전을 지금 버전으로 바꿔 끼우고 이전 버전을 놓는다
+	이전 버전을 들고있는 snapshot이 없으면 이번에 복사된 노드들의 원본이 여기서 free 된다
+*/
+static void commit(write_t *w, const size_t size) {
+	rbtree_persist *p = w->p;
+	if (w->root != NULL) {
+		w->root->color = RBTREE_BLACK;
+	}
+	pthread_mutex_lock(&p->root_lock);
+	pnode_t *old = p->root;
+	p->root = w->root;
+	p->size = size;
+	pthread_mutex_unlock(&p->root_lock);
+	release(p, old, 1);
+}
+
+
+
+/*
+	FUNCTION : insert_fixup	return : void
+	rbtree_insert_fixup과 같은 CASE 1 / 2 / 3
+	부모 포인터 대신 path[d]가 새 노드, path[d - 1]이 부모, path[d - 2]가 할아버지
+	색을 바꿀 삼촌은 먼저 own으로 복사한다
+*/
+static void insert_fixup(write_t *w, int d) {
+	while (d >= 2 && is_red(w->path[d - 1])) {
+		pnode_t *par = w->path[d - 1];
+		pnode_t *g = w->path[d - 2];
+		const int pd = g->link[1] == par;	// 부모가 할아버지의 어느쪽 자식인지
+		if (is_red(g->link[!pd])) {	// CASE 1 : angry uncle
+			pnode_t *u = own(w, &g->link[!pd]);
+			par->color = RBTREE_BLACK;
+			u->color = RBTREE_BLACK;
+			g->color = RBTREE_RED;
+			d -= 2;
+			continue;
+		}
+		if ((par->link[1] == w->path[d]) != pd) {	// CASE 2 : 삼각형
+			g->link[pd] = rotate(par, pd);
+			par = g->link[pd];
+		}
+		// CASE 3 : 일직선
+		pnode_t **gs = slot_of(w, d - 2);
+		par->color = RBTREE_BLACK;
+		g->color = RBTREE_RED;
+		*gs = rotate(g, !pd);
+		break;
+	}
+}
+
+
+
+/*
+	FUNCTION : persist_insert	return : fail 0 / success 1
+	rbtree_insert와 같이 같은 key도 하나 더 넣는다 (오른쪽으로)
+	1. 루트부터 내려가며 경로의 노드들을 복사 (이번 write 소유로)
+	2. 새 노드를 붙이고 insert_fixup
+	3. 새 루트로 바꿔 끼운다
+*/
+int rbtree_persist_insert(rbtree_persist *p, const key_t key) {
+	pthread_mutex_lock(&p->write_lock);
+	if (!reserve(p)) {
+		pthread_mutex_unlock(&p->write_lock);
+		return 0;
+	}
+	write_t w;
+	w.p = p;
+	w.stamp = ++p->stamp;
+	w.root = p->root;
+	retain(w.root);	// 새 버전도 (아직은) 같은 루트를 가리킨다
+
+	// 1.
+	int d = -1;
+	pnode_t **slot = &w.root;
+	while (*slot != NULL) {
+		pnode_t *x = own(&w, slot);
+		w.path[++d] = x;
+		slot = &x->link[key >= x->key];
+	}
+
+	// 2.
+	*slot = take(&w, key, RBTREE_RED);
+	w.path[++d] = *slot;
+	insert_fixup(&w, d);
+
+	// 3.
+	commit(&w, p->size + 1);
+	pthread_mutex_unlock(&p->write_lock);
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : erase_fixup	return : void
+	erase_fixup과 같은 CASE 1 / 2 / 3 / 4
+	x는 path[k]의 xd쪽 자식 (NULL일 수 있다), k < 0 이면 x가 루트
+	색을 바꾸거나 회전할 형제 / 조카는 먼저 own으로 복사한다
+*/
+static void erase_fixup(write_t *w, int k, int xd) {
+	pnode_t *x = k < 0 ? w->root : w->path[k]->link[xd];
+	while (k >= 0 && !is_red(x)) {
+		pnode_t *par = w->path[k];
+		pnode_t *s = own(w, &par->link[!xd]);	// x가 BLACK 하나를 덜 가졌으니 형제는 있다
+		if (is_red(s)) {	// CASE 1 : 형제가 RED -> 회전해서 BLACK 형제로
+			pnode_t **ps = slot_of(w, k);
+			s->color = RBTREE_BLACK;
+			par->color = RBTREE_RED;
+			*ps = rotate(par, xd);
+			w->path[k + 1] = par;	// 경로에 s가 끼어든다
+			w->path[k] = s;
+			k++;
+			s = own(w, &par->link[!xd]);
+		}
+		if (!is_red(s->link[0]) && !is_red(s->link[1])) {	// CASE 2 : 부모에게 미룬다
+			s->color = RBTREE_RED;
+			x = par;
+			k--;
+			if (k >= 0) {
+				xd = w->path[k]->link[1] == x;
+			}
+			continue;
+		}
+		if (!is_red(s->link[!xd])) {	// CASE 3 : 가까운 조카만 RED
+			pnode_t *near = own(w, &s->link[xd]);
+			near->color = RBTREE_BLACK;
+			s->color = RBTREE_RED;
+			par->link[!xd] = rotate(s, !xd);
+			s = par->link[!xd];
+		}
+		// CASE 4 : 먼 조카가 RED
+		pnode_t **ps = slot_of(w, k);
+		pnode_t *far = own(w, &s->link[!xd]);
+		s->color = par->color;
+		par->color = RBTREE_BLACK;
+		far->color = RBTREE_BLACK;
+		*ps = rotate(par, xd);
+		return;
+	}
+	// 루트까지 왔거나 x가 RED
+	pnode_t **xs = k < 0 ? &w->root : &w->path[k]->link[xd];
+	if (*xs != NULL) {
+		own(w, xs)->color = RBTREE_BLACK;
+	}
+}
+
+
+
+/*
+	FUNCTION : persist_erase	return : 없었으면 0 / 지웠으면 1
+	key 노드 하나를 지운다
+	0. 먼저 복사 없이 찾아보고 없으면 끝
+	1. 루트부터 z까지 경로 복사
+	2. z의 자식이 둘이면 successor y까지 경로 복사하고 y의 key를 z로 옮긴 뒤 y를 지운다
+	   (노드를 옮기지 않고 key만 옮겨도 된다 : 노드 포인터를 밖에 내주지 않으므로)
+	3. y 자리에 y의 자식을 붙이고, y가 BLACK이었으면 erase_fixup
+*/
+int rbtree_persist_erase(rbtree_persist *p, const key_t key) {
+	pthread_mutex_lock(&p->write_lock);
+	// 0.
+	const pnode_t *found = p->root;
+	while (found != NULL && found->key != key) {
+		found = found->link[key > found->key];
+	}
+	if (found == NULL || !reserve(p)) {
+		pthread_mutex_unlock(&p->write_lock);
+		return 0;
+	}
+	write_t w;
+	w.p = p;
+	w.stamp = ++p->stamp;
+	w.root = p->root;
+	retain(w.root);
+
+	// 1. 0.과 같은 길로 내려간다
+	int d = -1;
+	pnode_t **slot = &w.root;
+	pnode_t *z;
+	for (;;) {
+		z = own(&w, slot);
+		w.path[++d] = z;
+		if (z->key == key) {
+			break;
+		}
+		slot = &z->link[key > z->key];
+	}
+
+	// 2.
+	if (z->link[0] != NULL && z->link[1] != NULL) {
+		slot = &z->link[1];
+		for (;;) {
+			pnode_t *x = own(&w, slot);
+			w.path[++d] = x;
+			if (x->link[0] == NULL) {
+				break;
+			}
+			slot = &x->link[0];
+		}
+		z->key = w.path[d]->key;
+	}
+
+	// 3. y의 자식 c가 가진 참조는 y에서 y의 부모로 옮겨간다
+	pnode_t *y = w.path[d];
+	pnode_t *c = y->link[y->link[0] == NULL];
+	const int yd = d > 0 && w.path[d - 1]->link[1] == y;
+	const color_t y_color = y->color;
+	*slot_of(&w, d) = c;
+	y->link[0] = NULL;
+	y->link[1] = NULL;
+	release(p, y, 1);
+	if (y_color == RBTREE_BLACK) {
+		erase_fixup(&w, d - 1, yd);
+	}
+
+	commit(&w, p->size - 1);
+	pthread_mutex_unlock(&p->write_lock);
+	return 1;
+}
+
+
+
+//++++++++++++++++++++++++snapshot 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : snapshot	return : rbtree_snap pointer (실패하면 NULL)
+	지금 버전의 루트에 참조를 하나 건다 : O(1)
+	그 뒤로 트리가 바뀌어도 snapshot의 내용은 그대로다
+*/
+rbtree_snap *rbtree_snapshot(rbtree_persist *p) {
+	rbtree_snap *s = (rbtree_snap *)malloc(sizeof(rbtree_snap));
+	if (s == NULL) {
+		return NULL;
+	}
+	s->tree = p;
+	pthread_mutex_lock(&p->root_lock);
+	s->root = p->root;
+	s->size = p->size;
+	retain(s->root);
+	pthread_mutex_unlock(&p->root_lock);
+	return s;
+}
+
+
+
+/*
+	FUNCTION : snap_release	return : void
+	snapshot을 놓는다. 이 버전에만 있던 노드들이 free 된다
+*/
+void rbtree_snap_release(rbtree_snap *s) {
+	release(s->tree, s->root, 0);
+	free(s);
+}
+
+
+
+/*
+	아래 snap_ 함수들은 노드를 고치지 않으므로 lock 없이 여러 thread에서 불러도 된다
+*/
+int rbtree_snap_find(const rbtree_snap *s, const key_t key) {
+	const pnode_t *x = s->root;
+	while (x != NULL && x->key != key) {
+		x = x->link[key > x->key];
+	}
+	return x != NULL;
+}
+
+// 한쪽으로 끝까지 내려간다
+static int snap_edge(const rbtree_snap *s, const int dir, key_t *out) {
+	const pnode_t *x = s->root;
+	if (x == NULL) {
+		return 0;
+	}
+	while (x->link[dir] != NULL) {
+		x = x->link[dir];
+	}
+	*out = x->key;
+	return 1;
+}
+
+int rbtree_snap_min(const rbtree_snap *s, key_t *out) {
+	return snap_edge(s, 0, out);
+}
+
+int rbtree_snap_max(const rbtree_snap *s, key_t *out) {
+	return snap_edge(s, 1, out);
+}
+
+
+
+/*
+	FUNCTION : snap_range	return : 복사한 key 개수
+	rbtree_range와 같이 [lo, hi]의 key를 순서대로 최대 cap개 out에 복사
+	부모 포인터가 없으므로 in-order 순회를 stack으로 한다
+	1. lo 이상인 첫 노드까지 내려가며 왼쪽으로 꺾은 노드들을 stack에 (= 앞으로 방문할 조상들)
+	2. 꺼낸 노드를 쓰고, 그 오른쪽 서브트리의 왼쪽 가장자리를 stack에
+*/
+size_t rbtree_snap_range(const rbtree_snap *s, const key_t lo, const key_t hi, key_t *out, const size_t cap) {
+	const pnode_t *stack[PERSIST_MAX_DEPTH];
+	int top = 0;
+	size_t count = 0;
+	// 1.
+	for (const pnode_t *x = s->root; x != NULL;) {
+		if (x->key >= lo) {
+			stack[top++] = x;
+			x = x->link[0];
+		} else {
+			x = x->link[1];
+		}
+	}
+	// 2.
+	while (top > 0 && count < cap) {
+		const pnode_t *x = stack[--top];
+		if (x->key > hi) {
+			break;
+		}
+		out[count++] = x->key;
+		for (x = x->link[1]; x != NULL; x = x->link[0]) {
+			stack[top++] = x;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,74 @@
+#ifndef _RBTREE_PERSIST_H_
+#define _RBTREE_PERSIST_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "rbtree.h"
+
+/*
+	버전이 남는(persistent) rbtree
+
+	- insert / erase는 노드를 그 자리에서 고치지 않는다
+	  루트부터 바뀌는 노드까지의 경로(와 회전 / 색 바꾸기로 건드리는 형제들)만 복사하고
+	  나머지 서브트리는 이전 버전과 같이 쓴다 : 연산 하나에 O(log n)개 노드
+	- 그래서 rbtree_snapshot은 지금 루트에 참조를 하나 거는 것뿐이다 : O(1)
+	  snapshot은 그 뒤로 트리가 어떻게 바뀌어도 그 시점 그대로이고
+	  snapshot을 읽는 쪽은 lock 없이 아무 thread에서나 읽는다
+	- 부모 포인터가 있으면 자식 하나만 바꿔도 모든 노드를 복사해야 하므로
+	  노드는 부모 포인터 없이 자식 두개만 들고있고, fixup은 내려온 경로를 stack에 쌓아서 한다
+	- 노드마다 자기를 가리키는 부모(또는 버전)의 수를 센다 (reference count)
+	  snapshot을 놓으면 그 버전에만 있던 노드들이 바로 free 된다
+	- 노드는 다른 thread(snapshot을 놓는 reader)에서도 free 되므로
+	  rbtree 노드 풀 대신 malloc / free를 쓴다
+	  writer 안에서 놓인 노드는 free 하지 않고 다음 write에 다시 쓴다
+
+	writer(insert / erase)끼리는 write_lock으로 줄을 세운다
+	root_lock은 루트를 바꿔 끼우는 순간과 snapshot이 루트를 집는 순간에만 잡는다
+	rbtree_persist_delete는 snapshot들을 모두 놓은 뒤에 부른다
+*/
+#define PERSIST_MAX_DEPTH 128
+// writer가 free 하지 않고 다음 write를 위해 들고있을 노드 수 상한
+#define PERSIST_MAX_SPARES 1024
+
+typedef struct pnode_t {
+	key_t key;
+	color_t color;
+	atomic_uint refs;			// 이 노드를 가리키는 부모 노드 / 버전 수
+	unsigned long stamp;		// 이 노드를 만든 write 번호. 같은 write 안에서만 고쳐도 된다
+	struct pnode_t *link[2];	// 0 : left, 1 : right (NIL은 NULL)
+} pnode_t;
+
+typedef struct {
+	pnode_t *root;				// 지금 버전. 트리가 참조 하나를 들고있다
+	size_t size;
+	unsigned long stamp;		// 마지막 write 번호
+	atomic_size_t nodes;		// 모든 버전을 합쳐 살아있는 노드 수
+	pnode_t *spare;				// writer가 미리 잡아둔 노드들 (link[1]로 연결)
+	size_t spares;
+	pthread_mutex_t write_lock;
+	pthread_mutex_t root_lock;
+} rbtree_persist;
+
+// 한 시점의 읽기 전용 트리
+typedef struct {
+	rbtree_persist *tree;
+	pnode_t *root;
+	size_t size;
+} rbtree_snap;
+
+rbtree_persist *rbtree_persist_new(void);
+void rbtree_persist_delete(rbtree_persist *);
+
+int rbtree_persist_insert(rbtree_persist *, const key_t);
+int rbtree_persist_erase(rbtree_persist *, const key_t);
+
+rbtree_snap *rbtree_snapshot(rbtree_persist *);
+void rbtree_snap_release(rbtree_snap *);
+
+int rbtree_snap_find(const rbtree_snap *, const key_t);
+int rbtree_snap_min(const rbtree_snap *, key_t *);
+int rbtree_snap_max(const rbtree_snap *, key_t *);
+size_t rbtree_snap_range(const rbtree_snap *, const key_t, const key_t, key_t *, const size_t);
+
+#endif  // _RBTREE_PERSIST_H_
@@ -0,0 +1,443 @@
+#include "rbtree_sharded.h"
+
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+
+/*
+	FUNCTION : sharded_new	return : rbtree_sharded pointer
+	shard n개를 만들고 key 공간 전체를 n등분해서 경계로 둔다
+	(key 분포를 모르므로 처음에는 고르게 나누고, 몰리면 rebalance가 옮긴다)
+	빈 shard 0을 나누는 것으로 모든 shard가 shard 0의 sentinel을 같이 쓰게 해둔다
+	그러면 rebalance의 split도 join도 노드를 옮기지 않는다 (rbtree.h의 join / split 참고)
+*/
+rbtree_sharded *rbtree_sharded_new(const size_t n) {
+	if (n == 0) {
+		return NULL;
+	}
+	rbtree_sharded *s = (rbtree_sharded *)calloc(1, sizeof(rbtree_sharded));
+	if (s == NULL) {
+		return NULL;
+	}
+	s->shards = (rbtree_shard_t *)aligned_alloc(64, n * sizeof(rbtree_shard_t));
+	if (s->shards == NULL) {
+		free(s);
+		return NULL;
+	}
+	const int64_t width = ((int64_t)INT_MAX - INT_MIN + 1) / (int64_t)n;
+	for (size_t i = 0; i < n; i++) {
+		rbtree_shard_t *sh = &s->shards[i];
+		sh->tree = new_rbtree();
+		if (sh->tree == NULL) {
+			s->n = i;
+			rbtree_sharded_delete(s);
+			return NULL;
+		}
+		if (i > 0) {
+			rbtree_split(s->shards[0].tree, INT_MIN, sh->tree);	// 실패해도 sentinel이 따로일 뿐
+		}
+		pthread_mutex_init(&sh->lock, NULL);
+		sh->lo = (key_t)(INT_MIN + width * (int64_t)i);
+		sh->ops = 0;
+	}
+	s->n = n;
+	s->live = n;
+	pthread_mutex_init(&s->rebalance_lock, NULL);
+	return s;
+}
+
+
+
+/*
+	FUNCTION : sharded_delete	return : void
+	다른 thread가 더 이상 쓰지 않을 때 부른다 (만들다 실패한 것도 정리한다)
+*/
+void rbtree_sharded_delete(rbtree_sharded *s) {
+	for (size_t i = 0; i < s->n; i++) {
+		pthread_mutex_destroy(&s->shards[i].lock);
+		delete_rbtree(s->shards[i].tree);
+	}
+	if (s->live != 0) {
+		pthread_mutex_destroy(&s->rebalance_lock);
+	}
+	free(s->shards);
+	free(s);
+}
+
+
+
+//++++++++++++++++++++++++shard 고르기 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : shard_of	return : key가 들어갈 shard의 index
+	lo <= key 인 마지막 shard를 이분 탐색한다
+	rebalance와 동시에 읽을 수 있으므로 경계는 atomic으로 읽고, 맞는지는 부르는 쪽이 seq로 확인한다
+*/
+static size_t shard_of(rbtree_sharded *s, const key_t key) {
+	size_t lo = 0, hi = __atomic_load_n(&s->live, __ATOMIC_RELAXED);
+	while (hi - lo > 1) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (__atomic_load_n(&s->shards[mid].lo, __ATOMIC_RELAXED) <= key) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+
+
+/*
+	FUNCTION : layout_begin	return : 짝수 seq
+	rebalance 중이면 끝날때까지 양보하며 기다린다
+*/
+static unsigned layout_begin(rbtree_sharded *s) {
+	unsigned seq;
+	while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1) {
+		sched_yield();
+	}
+	return seq;
+}
+
+
+
+/*
+	FUNCTION : lock_key	return : 잠근 shard의 index
+	1. seq를 읽고 경계로 shard를 고른다
+	2. 그 shard를 잠근 뒤 seq가 그대로면 끝
+	   rebalance는 모든 shard를 잠가야 경계를 바꾸므로, 하나라도 잡고 있는 동안은 경계가 안 바뀐다
+	3. 바뀌었으면 놓고 처음부터
+*/
+static size_t lock_key(rbtree_sharded *s, const key_t key) {
+	for (;;) {
+		const unsigned seq = layout_begin(s);
+		const size_t i = shard_of(s, key);
+		pthread_mutex_lock(&s->shards[i].lock);
+		if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+			return i;
+		}
+		pthread_mutex_unlock(&s->shards[i].lock);
+	}
+}
+
+
+
+/*
+	FUNCTION : lock_span	return : 잠근 첫 shard의 index (마지막은 *last)
+	[lo, hi]에 걸친 shard들을 작은 index부터 잠근다
+	rebalance도 작은 index부터 잠그므로 deadlock이 없다
+*/
+static size_t lock_span(rbtree_sharded *s, const key_t lo, const key_t hi, size_t *last) {
+	for (;;) {
+		const unsigned seq = layout_begin(s);
+		const size_t a = shard_of(s, lo), b = shard_of(s, hi);
+		for (size_t i = a; i <= b; i++) {
+			pthread_mutex_lock(&s->shards[i].lock);
+		}
+		if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq) {
+			*last = b;
+			return a;
+		}
+		for (size_t i = a; i <= b; i++) {
+			pthread_mutex_unlock(&s->shards[i].lock);
+		}
+	}
+}
+
+static void unlock_span(rbtree_sharded *s, const size_t a, const size_t b) {
+	for (size_t i = a; i <= b; i++) {
+		pthread_mutex_unlock(&s->shards[i].lock);
+	}
+}
+
+
+
+//++++++++++++++++++++++++key 연산 구현++++++++++++++++++++++++++++
+
+static int rebalance_locked(rbtree_sharded *);
+
+/*
+	FUNCTION : note_write	return : void
+	shard i에 write 하나를 센다 (shard lock을 잡은 채로 부른다)
+	RBTREE_SHARD_PERIOD번째면 lock을 놓은 뒤 경계를 확인한다
+	다른 thread가 이미 확인 중이면 기다리지 않고 넘어간다 (ops가 남아있으니 다음 write가 다시 본다)
+*/
+static void note_write(rbtree_sharded *s, const size_t i) {
+	const int due = ++s->shards[i].ops >= RBTREE_SHARD_PERIOD;
+	pthread_mutex_unlock(&s->shards[i].lock);
+	if (due && pthread_mutex_trylock(&s->rebalance_lock) == 0) {
+		rebalance_locked(s);
+		pthread_mutex_unlock(&s->rebalance_lock);
+	}
+}
+
+
+
+/*
+	FUNCTION : sharded_insert	return : fail 0 / success 1
+*/
+int rbtree_sharded_insert(rbtree_sharded *s, const key_t key) {
+	const size_t i = lock_key(s, key);
+	if (rbtree_insert(s->shards[i].tree, key) == NULL) {
+		pthread_mutex_unlock(&s->shards[i].lock);
+		return 0;
+	}
+	note_write(s, i);
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : sharded_erase	return : 지웠으면 1 / key가 없으면 0
+	multiset이면 rbtree_erase처럼 count를 하나 줄인다
+*/
+int rbtree_sharded_erase(rbtree_sharded *s, const key_t key) {
+	const size_t i = lock_key(s, key);
+	node_t *np = rbtree_find(s->shards[i].tree, key);
+	if (np == NULL) {
+		pthread_mutex_unlock(&s->shards[i].lock);
+		return 0;
+	}
+	rbtree_erase(s->shards[i].tree, np);
+	note_write(s, i);
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : sharded_find	return : 있으면 1 / 없으면 0
+*/
+int rbtree_sharded_find(rbtree_sharded *s, const key_t key) {
+	const size_t i = lock_key(s, key);
+	const int found = rbtree_find(s->shards[i].tree, key) != NULL;
+	pthread_mutex_unlock(&s->shards[i].lock);
+	return found;
+}
+
+
+
+//++++++++++++++++++++++++전체 순회 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : sharded_min	return : 비어있으면 0 / 아니면 1 (*out에 최솟값)
+	첫 shard부터 하나씩 더 잠가가며 (작은 index부터) 비어있지 않은 shard를 찾는다
+	앞의 shard들을 계속 잡고 있으므로 그 사이에 더 작은 key가 들어올 수 없다
+*/
+int rbtree_sharded_min(rbtree_sharded *s, key_t *out) {
+	size_t i;
+	lock_span(s, INT_MIN, INT_MIN, &i);
+	int found = 0;
+	for (;;) {
+		const rbtree *t = s->shards[i].tree;
+		if (t->root != t->nil) {
+			*out = rbtree_min(t)->key;
+			found = 1;
+			break;
+		}
+		if (i + 1 == s->live) {
+			break;
+		}
+		pthread_mutex_lock(&s->shards[++i].lock);
+	}
+	unlock_span(s, 0, i);
+	return found;
+}
+
+
+
+/*
+	FUNCTION : sharded_max	return : 비어있으면 0 / 아니면 1 (*out에 최댓값)
+	뒤에서부터 잠그면 작은 index부터 잠그는 쪽과 deadlock이 나므로 전부 잠근다
+*/
+int rbtree_sharded_max(rbtree_sharded *s, key_t *out) {
+	size_t last;
+	lock_span(s, INT_MIN, INT_MAX, &last);
+	int found = 0;
+	for (size_t i = last + 1; i-- > 0;) {
+		const rbtree *t = s->shards[i].tree;
+		if (t->root != t->nil) {
+			*out = rbtree_max(t)->key;
+			found = 1;
+			break;
+		}
+	}
+	unlock_span(s, 0, last);
+	return found;
+}
+
+
+
+/*
+	FUNCTION : sharded_range	return : 복사한 key 개수
+	[lo, hi]에 걸친 shard들을 잠그고 shard 순서대로 rbtree_range를 이어 붙인다
+	shard들의 key 범위가 겹치지 않고 순서대로라서 그냥 이어 붙이면 정렬되어 있다
+*/
+size_t rbtree_sharded_range(rbtree_sharded *s, const key_t lo, const key_t hi, key_t *out, const size_t cap) {
+	if (lo > hi) {
+		return 0;
+	}
+	size_t last;
+	const size_t first = lock_span(s, lo, hi, &last);
+	size_t count = 0;
+	for (size_t i = first; i <= last && count < cap; i++) {
+		count += rbtree_range(s->shards[i].tree, lo, hi, out + count, cap - count);
+	}
+	unlock_span(s, first, last);
+	return count;
+}
+
+
+
+/*
+	FUNCTION : sharded_to_array	return : fail 0 / success 1
+	rbtree_to_array처럼 key 순서대로 n개 까지
+*/
+int rbtree_sharded_to_array(rbtree_sharded *s, key_t *arr, const size_t n) {
+	return rbtree_sharded_range(s, INT_MIN, INT_MAX, arr, n) > 0;
+}
+
+
+
+//++++++++++++++++++++++++경계 재조정 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : merge_next	return : fail 0 / success 1
+	shard j+1을 j에 합친다 (모든 shard를 잠근 채로)
+	j+1의 최솟값 m으로 join하면 m이 하나 더 생기므로 그 노드를 바로 지운다
+	(multiset이면 join이 m의 count를 합쳐놓으므로 erase는 count만 줄인다)
+	비워진 트리는 live 뒤의 여분 자리로 보낸다. join이 실패하면 아무것도 안 바뀐다
+*/
+static int merge_next(rbtree_sharded *s, const size_t j) {
+	rbtree_shard_t *sh = s->shards;
+	rbtree *b = sh[j + 1].tree;
+	if (b->root != b->nil) {
+		node_t *k = rbtree_join(sh[j].tree, rbtree_min(b)->key, b);
+		if (k == NULL) {
+			return 0;
+		}
+		rbtree_erase(sh[j].tree, k);
+	}
+	const size_t live = s->live;
+	for (size_t i = j + 1; i + 1 < live; i++) {
+		sh[i].tree = sh[i + 1].tree;
+		__atomic_store_n(&sh[i].lo, sh[i + 1].lo, __ATOMIC_RELAXED);
+	}
+	sh[live - 1].tree = b;
+	__atomic_store_n(&s->live, live - 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : split_hot	return : fail 0 / success 1
+	shard h를 루트 key b에서 나눠서 b 이상을 여분 트리로 옮기고, 그 트리를 h 바로 뒤 shard로 끼운다
+	루트는 in-order 가운데쯤이므로 두 shard가 key를 반씩 나눠 갖는다
+	b보다 작은 key가 없으면 (노드 한두개) 나눌 수 없다. split이 실패하면 아무것도 안 바뀐다
+*/
+static int split_hot(rbtree_sharded *s, const size_t h) {
+	rbtree_shard_t *sh = s->shards;
+	rbtree *t = sh[h].tree;
+	const size_t live = s->live;
+	if (live == s->n || t->root == t->nil) {
+		return 0;
+	}
+	const key_t b = t->root->key;
+	rbtree *spare = sh[live].tree;
+	if (rbtree_min(t)->key >= b || !rbtree_split(t, b, spare)) {
+		return 0;
+	}
+	for (size_t i = live; i > h + 1; i--) {
+		sh[i].tree = sh[i - 1].tree;
+		__atomic_store_n(&sh[i].lo, sh[i - 1].lo, __ATOMIC_RELAXED);
+	}
+	sh[h + 1].tree = spare;
+	__atomic_store_n(&sh[h + 1].lo, b, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->live, live + 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : rebalance_locked	return : 경계를 바꿨으면 1 / 아니면 0
+	rebalance_lock을 잡은 채로 부른다
+	1. 모든 shard를 (작은 index부터) 잠그고 seq를 홀수로
+	2. write가 가장 많은 shard h가 평균의 두 배를 넘으면 hot
+	   (앞선 split이 실패해서 shard가 하나 모자라면 그냥 h를 나눈다)
+	3. shard가 꽉 찼으면 h를 빼고 write 합이 가장 적은 이웃 두개를 합친다
+	   그 합이 h의 절반 이하일 때만 (아니면 옮겨봐야 더 고르게 되지 않는다)
+	4. h를 나눈다
+	5. write 수를 모두 0으로 하고 seq를 짝수로, lock을 푼다
+	shard들이 sentinel을 같이 쓰므로 3과 4는 O(log n)이다 (rbtree_sharded_new 참고)
+	3이나 4가 실패하면 그 단계만 취소된다 (shard가 하나 모자란 채로 남아도 된다)
+*/
+static int rebalance_locked(rbtree_sharded *s) {
+	rbtree_shard_t *sh = s->shards;
+	for (size_t i = 0; i < s->n; i++) {
+		pthread_mutex_lock(&sh[i].lock);
+	}
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	// 2. hot shard
+	size_t h = 0, total = 0;
+	for (size_t i = 0; i < s->live; i++) {
+		total += sh[i].ops;
+		if (sh[i].ops > sh[h].ops) {
+			h = i;
+		}
+	}
+	int changed = 0;
+	if (s->live < s->n || sh[h].ops * s->live > 2 * total) {
+		// 3. 가장 한가한 이웃 두개
+		int room = s->live < s->n;
+		if (!room) {
+			size_t j = SIZE_MAX;
+			for (size_t i = 0; i + 1 < s->live; i++) {
+				if (i != h && i + 1 != h &&
+						(j == SIZE_MAX || sh[i].ops + sh[i + 1].ops < sh[j].ops + sh[j + 1].ops)) {
+					j = i;
+				}
+			}
+			if (j != SIZE_MAX && 2 * (sh[j].ops + sh[j + 1].ops) <= sh[h].ops && merge_next(s, j)) {
+				room = 1;
+				changed = 1;
+				h -= h > j;
+			}
+		}
+		// 4. 나누기
+		if (room) {
+			changed |= split_hot(s, h);
+		}
+	}
+
+	// 5. 다시 센다
+	for (size_t i = 0; i < s->n; i++) {
+		sh[i].ops = 0;
+	}
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+	for (size_t i = 0; i < s->n; i++) {
+		pthread_mutex_unlock(&sh[i].lock);
+	}
+	return changed;
+}
+
+
+
+/*
+	FUNCTION : sharded_rebalance	return : 경계를 바꿨으면 1 / 아니면 0
+	write 수를 보고 바로 경계를 재조정한다 (보통은 write가 알아서 부른다)
+*/
+int rbtree_sharded_rebalance(rbtree_sharded *s) {
+	pthread_mutex_lock(&s->rebalance_lock);
+	const int changed = rebalance_locked(s);
+	pthread_mutex_unlock(&s->rebalance_lock);
+	return changed;
+}
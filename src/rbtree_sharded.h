@@ -0,0 +1,63 @@
+#ifndef _RBTREE_SHARDED_H_
+#define _RBTREE_SHARDED_H_
+
+#include <pthread.h>
+
+#include "rbtree.h"
+
+/*
+	key 범위로 나눈 rbtree 여러 개 (sharding)
+
+	노드 lock을 써도 (rbtree_conc) 모든 연산이 루트 근처를 지나가므로 core가 많으면 위쪽에서 막힌다
+	여기서는 key 범위를 shard로 나누고 shard마다 따로 rbtree(와 그 노드 풀)와 mutex를 둔다
+	- shard i는 [lo_i, lo_(i+1)) 의 key를 가진다. lo_0은 key_t의 최솟값
+	  insert / erase / find는 경계를 이분 탐색해서 shard 하나만 잠근다
+	- min / max / to_array / range는 필요한 shard들을 순서대로 (항상 작은 index부터) 잠그고
+	  shard 순서대로 이어붙인다. 다 잠근 뒤에 읽으므로 결과는 어느 한 시점의 전체 트리와 같다
+	- 경계는 적응형이다. shard 하나에 write가 RBTREE_SHARD_PERIOD 번 모이면 write 수를 비교해서
+	  평균의 두 배가 넘게 몰린 (hot) shard를 루트 key에서 둘로 나누고 (rbtree_split)
+	  그만큼 가장 한가한 이웃 shard 두개를 하나로 합친다 (rbtree_join)
+	  key가 한쪽에 몰리면 그쪽 shard가 점점 좁아져서 write가 다시 여러 shard로 퍼진다
+	- 경계를 바꿀 때는 모든 shard를 잠그고 seq를 홀수로 올린다
+	  연산은 seq를 읽고 -> 경계로 shard를 고르고 -> 잠근 뒤 seq가 그대로인지 확인한다
+	  (경계를 읽는 데는 공유 lock이 없다. 바뀌었으면 다시 고른다)
+	- shard들은 sentinel과 노드 풀을 같이 쓰므로 split / join은 노드를 옮기지 않고 O(log n)이다
+	  그래서 모든 shard를 잠그는 시간도 shard 크기와 상관없이 짧다
+	  (RBTREE_COMPACT32는 트리마다 풀이 따로라서 작은 쪽을 복사하고, RBTREE_NO_POOL은 작은 쪽의 NIL 링크를 고친다)
+	- split / join이 실패해도 (메모리 부족) 그 단계만 취소되고 경계는 올바르다
+*/
+#ifndef RBTREE_SHARD_PERIOD
+#define RBTREE_SHARD_PERIOD 16384
+#endif
+
+// 서로 다른 shard의 lock이 같은 cache line에 있지 않게 한다
+typedef struct {
+	pthread_mutex_t lock;
+	rbtree *tree;
+	key_t lo;			// 이 shard의 가장 작은 key
+	size_t ops;			// 마지막으로 경계를 확인한 뒤 이 shard에 들어온 write 수
+} __attribute__((aligned(64))) rbtree_shard_t;
+
+typedef struct {
+	rbtree_shard_t *shards;		// 앞의 live개가 key 순서대로 쓰이는 shard
+	size_t n;					// shard 자리 수 (live <= n)
+	size_t live;
+	unsigned seq;				// 홀수면 경계를 바꾸는 중
+	pthread_mutex_t rebalance_lock;
+} rbtree_sharded;
+
+rbtree_sharded *rbtree_sharded_new(const size_t);
+void rbtree_sharded_delete(rbtree_sharded *);
+
+int rbtree_sharded_insert(rbtree_sharded *, const key_t);
+int rbtree_sharded_erase(rbtree_sharded *, const key_t);
+int rbtree_sharded_find(rbtree_sharded *, const key_t);
+
+int rbtree_sharded_min(rbtree_sharded *, key_t *);
+int rbtree_sharded_max(rbtree_sharded *, key_t *);
+int rbtree_sharded_to_array(rbtree_sharded *, key_t *, const size_t);
+size_t rbtree_sharded_range(rbtree_sharded *, const key_t, const key_t, key_t *, const size_t);
+
+int rbtree_sharded_rebalance(rbtree_sharded *);
+
+#endif  // _RBTREE_SHARDED_H_
@@ -0,0 +1,313 @@
+#include "rbtree_sync.h"
+
+#include <stdlib.h>
+
+// rbtree 높이는 2 * log2(n + 1) 이하. 이보다 깊으면 writer와 엇갈려 헤매는 중이다
+#define SYNC_MAX_DEPTH 128
+
+// reader 한번 읽기. 트리를 읽어서 결과를 arg에 쓰고, 엉킨 트리를 만나면 0
+typedef int (*sync_read_t)(const rbtree *, void *);
+
+static int read_find(const rbtree *, void *);
+static int read_min(const rbtree *, void *);
+static int read_max(const rbtree *, void *);
+static int read_range(const rbtree *, void *);
+
+
+
+/*
+	FUNCTION : sync_new	return : rbtree_sync pointer
+	빈 트리와 lock을 만든다
+*/
+rbtree_sync *rbtree_sync_new(void) {
+	rbtree_sync *s = (rbtree_sync *)calloc(1, sizeof(rbtree_sync));
+	if (s == NULL) {
+		return NULL;
+	}
+	s->tree = new_rbtree();
+	if (s->tree == NULL) {
+		free(s);
+		return NULL;
+	}
+	atomic_init(&s->seq, 0);
+	pthread_rwlock_init(&s->lock, NULL);
+	return s;
+}
+
+
+
+/*
+	FUNCTION : sync_delete	return : void
+	다른 thread가 더 이상 쓰지 않을 때 부른다
+*/
+void rbtree_sync_delete(rbtree_sync *s) {
+	pthread_rwlock_destroy(&s->lock);
+	delete_rbtree(s->tree);
+	free(s);
+}
+
+
+
+//++++++++++++++++++++++++writer 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : write_begin / write_end	return : void
+	writer끼리는 write lock으로 하나씩
+	seq를 홀수로 올린 뒤 트리를 고치고, 다 고치면 짝수로 올린다
+	(release fence로 seq 변경이 트리 수정보다 먼저 보이게 한다)
+*/
+static void write_begin(rbtree_sync *s) {
+	pthread_rwlock_wrlock(&s->lock);
+	atomic_store_explicit(&s->seq, atomic_load_explicit(&s->seq, memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(rbtree_sync *s) {
+	atomic_store_explicit(&s->seq, atomic_load_explicit(&s->seq, memory_order_relaxed) + 1, memory_order_release);
+	pthread_rwlock_unlock(&s->lock);
+}
+
+
+
+/*
+	FUNCTION : sync_insert	return : fail 0 / success 1
+	rbtree_insert와 같이 같은 key도 하나 더 넣는다
+*/
+int rbtree_sync_insert(rbtree_sync *s, const key_t key) {
+	write_begin(s);
+	node_t *np = rbtree_insert(s->tree, key);
+	write_end(s);
+	return np != NULL;
+}
+
+
+
+/*
+	FUNCTION : sync_erase	return : 없었으면 0 / 지웠으면 1
+	key 노드 하나를 찾아서 지운다
+	노드 포인터는 다른 thread에서 이미 지워졌을 수 있으므로 key로 받는다
+*/
+int rbtree_sync_erase(rbtree_sync *s, const key_t key) {
+	write_begin(s);
+	node_t *np = rbtree_find(s->tree, key);
+	if (np != NULL) {
+		rbtree_erase(s->tree, np);
+	}
+	write_end(s);
+	return np != NULL;
+}
+
+
+
+//++++++++++++++++++++++++reader 구현++++++++++++++++++++++++++++
+
+/*
+	FUNCTION : sync_read	return : void
+	1. seq가 짝수(writer 없음)일 때 read로 트리를 읽고
+	2. 그 사이 seq가 바뀌지 않았으면 결과를 그대로 쓴다
+	3. RBTREE_SYNC_SPIN 번 실패하면 read lock을 잡고 읽는다 (그때는 실패하지 않음)
+	static inline이라 read 함수가 그대로 inline 된다
+*/
+static inline void sync_read(rbtree_sync *s, sync_read_t read, void *arg) {
+#ifndef RBTREE_NO_POOL
+	for (int tries = 0; tries < RBTREE_SYNC_SPIN; tries++) {
+		unsigned start = atomic_load_explicit(&s->seq, memory_order_acquire);
+		if (start & 1) {	// writer가 고치는 중
+			continue;
+		}
+		int ok = read(s->tree, arg);
+		atomic_thread_fence(memory_order_acquire);
+		if (ok && atomic_load_explicit(&s->seq, memory_order_relaxed) == start) {
+			return;
+		}
+	}
+#endif
+	pthread_rwlock_rdlock(&s->lock);
+	read(s->tree, arg);
+	pthread_rwlock_unlock(&s->lock);
+}
+
+
+
+/*
+	아래 read_ 함수들은 writer와 엇갈리면 free_list 끝(NULL)이나 고리를 밟을 수 있다
+	NULL은 따로 확인하고, 깊이 / 걸음 수 상한을 넘으면 0을 돌려 다시 읽게 한다
+	writer가 같은 필드를 동시에 고치므로 노드 / root는 _relaxed 접근자로만 읽는다
+	(plain load면 data race라 seq를 다시 확인해도 undefined behaviour)
+*/
+typedef struct {
+	key_t key;
+	int found;
+} find_arg_t;
+
+static int read_find(const rbtree *t, void *arg) {
+	find_arg_t *a = (find_arg_t *)arg;
+	node_t *x = rbtree_root_relaxed(t);
+	for (int depth = 0; depth < SYNC_MAX_DEPTH && x != NULL; depth++) {
+		if (x == t->nil) {
+			a->found = 0;
+			return 1;
+		}
+		const key_t k = rbtree_key_relaxed(x);
+		if (a->key == k) {
+			a->found = 1;
+			return 1;
+		}
+		x = a->key < k ? rbtree_left_relaxed(t, x) : rbtree_right_relaxed(t, x);
+	}
+	return 0;
+}
+
+
+
+/*
+	FUNCTION : sync_find	return : 없으면 0 / 있으면 1
+	lock 없이 key가 있는지 확인
+*/
+int rbtree_sync_find(rbtree_sync *s, const key_t key) {
+	find_arg_t a = {key, 0};
+	sync_read(s, read_find, &a);
+	return a.found;
+}
+
+
+
+typedef struct {
+	key_t key;
+	int found;
+	int right;	// 0 : min, 1 : max
+} edge_arg_t;
+
+// 한쪽으로 끝까지 내려간다
+static int read_edge(const rbtree *t, edge_arg_t *a) {
+	node_t *x = rbtree_root_relaxed(t);
+	if (x == t->nil) {
+		a->found = 0;
+		return 1;
+	}
+	for (int depth = 0; depth < SYNC_MAX_DEPTH && x != NULL; depth++) {
+		node_t *next = a->right ? rbtree_right_relaxed(t, x) : rbtree_left_relaxed(t, x);
+		if (next == t->nil) {
+			a->key = rbtree_key_relaxed(x);
+			a->found = 1;
+			return 1;
+		}
+		x = next;
+	}
+	return 0;
+}
+
+static int read_min(const rbtree *t, void *arg) {
+	((edge_arg_t *)arg)->right = 0;
+	return read_edge(t, (edge_arg_t *)arg);
+}
+
+static int read_max(const rbtree *t, void *arg) {
+	((edge_arg_t *)arg)->right = 1;
+	return read_edge(t, (edge_arg_t *)arg);
+}
+
+
+
+/*
+	FUNCTION : sync_min / sync_max	return : 빈 트리 0 / 1
+	가장 작은(큰) key를 out에 복사
+*/
+int rbtree_sync_min(rbtree_sync *s, key_t *out) {
+	edge_arg_t a = {0, 0, 0};
+	sync_read(s, read_min, &a);
+	if (a.found) {
+		*out = a.key;
+	}
+	return a.found;
+}
+
+int rbtree_sync_max(rbtree_sync *s, key_t *out) {
+	edge_arg_t a = {0, 0, 1};
+	sync_read(s, read_max, &a);
+	if (a.found) {
+		*out = a.key;
+	}
+	return a.found;
+}
+
+
+
+typedef struct {
+	key_t lo, hi;
+	key_t *out;
+	size_t cap;
+	size_t count;
+} range_arg_t;
+
+/*
+	FUNCTION : read_range	return : 엉킨 트리 0 / 1
+	rbtree_range와 같은 순서 (lower_bound -> 다음 노드로)
+	k개를 읽는 in-order 순회는 2k + 2 * 높이 걸음을 넘지 않으므로 그걸 상한으로 둔다
+*/
+static int read_range(const rbtree *t, void *arg) {
+	range_arg_t *a = (range_arg_t *)arg;
+	size_t budget = 2 * a->cap + 4 * SYNC_MAX_DEPTH;
+	a->count = 0;
+
+	// 1. lower_bound
+	node_t *p = NULL;
+	node_t *x = rbtree_root_relaxed(t);
+	for (int depth = 0; x != t->nil; depth++) {
+		if (x == NULL || depth == SYNC_MAX_DEPTH) {
+			return 0;
+		}
+		if (rbtree_key_relaxed(x) >= a->lo) {
+			p = x;
+			x = rbtree_left_relaxed(t, x);
+		} else {
+			x = rbtree_right_relaxed(t, x);
+		}
+	}
+
+	// 2. iter_next 반복. 모든 걸음마다 budget을 쓴다
+	while (p != NULL && rbtree_key_relaxed(p) <= a->hi && a->count < a->cap) {
+		for (size_t c = rbtree_count_relaxed(p); c > 0 && a->count < a->cap; c--) {	// multiset이면 count번
+			a->out[a->count++] = rbtree_key_relaxed(p);
+		}
+		x = rbtree_right_relaxed(t, p);
+		if (x != t->nil) {	// 오른쪽 서브트리의 가장 왼쪽
+			while (x != NULL && rbtree_left_relaxed(t, x) != t->nil && budget > 0) {
+				x = rbtree_left_relaxed(t, x);
+				budget--;
+			}
+		} else {			// 왼쪽 자식으로 올라올 때까지 부모로
+			x = rbtree_parent_relaxed(t, p);
+			while (x != NULL && x != t->nil && p == rbtree_right_relaxed(t, x) && budget > 0) {
+				p = x;
+				x = rbtree_parent_relaxed(t, x);
+				budget--;
+			}
+			if (x == t->nil) {	// 마지막 노드였다
+				break;
+			}
+		}
+		if (x == NULL || budget == 0) {
+			return 0;
+		}
+		budget--;
+		p = x;
+	}
+	return 1;
+}
+
+
+
+/*
+	FUNCTION : sync_range	return : 복사한 key 개수
+	rbtree_range와 같이 [lo, hi]의 key를 최대 cap개 out에 복사 (multiset이면 노드마다 count번)
+	중간에 writer가 지나가면 다시 읽으므로 결과는 어느 한 시점의 트리와 같다
+*/
+size_t rbtree_sync_range(rbtree_sync *s, const key_t lo, const key_t hi, key_t *out, const size_t cap) {
+	range_arg_t a = {lo, hi, out, cap, 0};
+	if (lo > hi || cap == 0) {
+		return 0;
+	}
+	sync_read(s, read_range, &a);
+	return a.count;
+}
@@ -0,0 +1,46 @@
+#ifndef _RBTREE_SYNC_H_
+#define _RBTREE_SYNC_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "rbtree.h"
+
+/*
+	여러 thread가 같이 쓰는 rbtree (seqlock)
+
+	- writer(insert / erase)끼리는 rwlock의 write lock으로 줄을 세운다
+	  쓰는 동안 seq를 홀수로 만들고, 끝나면 다시 짝수로 올린다
+	- reader(find / min / max / range)는 lock을 잡지 않는다
+	  seq를 읽고 -> 트리를 내려가고 -> seq가 그대로면 그 결과를 쓴다
+	  중간에 writer가 지나갔으면 처음부터 다시 읽는다
+	- erase된 노드는 노드 풀의 free_list로 돌아갈 뿐 delete 전까지 free되지 않으므로
+	  reader가 방금 지워진 노드를 밟아도 잘못된 메모리를 읽지는 않는다
+	  (그래서 reader가 노드 포인터를 들고 나갈 수는 없고, key 값만 돌려준다)
+	- 반쯤 고쳐진 트리에서 헤매지 않도록 reader는 깊이 / 걸음 수에 상한을 둔다
+	- writer가 계속 몰려서 RBTREE_SYNC_SPIN 번 연속 실패하면 read lock을 잡고 읽는다
+
+	-DRBTREE_NO_POOL 이면 지워진 노드가 바로 free되므로 reader도 항상 read lock을 잡는다
+*/
+#ifndef RBTREE_SYNC_SPIN
+#define RBTREE_SYNC_SPIN 64
+#endif
+
+typedef struct {
+	rbtree *tree;
+	atomic_uint seq;			// 홀수면 writer가 트리를 고치는 중
+	pthread_rwlock_t lock;
+} rbtree_sync;
+
+rbtree_sync *rbtree_sync_new(void);
+void rbtree_sync_delete(rbtree_sync *);
+
+int rbtree_sync_insert(rbtree_sync *, const key_t);
+int rbtree_sync_erase(rbtree_sync *, const key_t);
+
+int rbtree_sync_find(rbtree_sync *, const key_t);
+int rbtree_sync_min(rbtree_sync *, key_t *);
+int rbtree_sync_max(rbtree_sync *, key_t *);
+size_t rbtree_sync_range(rbtree_sync *, const key_t, const key_t, key_t *, const size_t);
+
+#endif  // _RBTREE_SYNC_H_
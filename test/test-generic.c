@@ -0,0 +1,111 @@
+#include <assert.h>
+#include <rbtree_generic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline int str_cmp(const char *a, const char *b) { return strcmp(a, b); }
+
+RBTREE_DEFINE_NUM(int_map, int, double)
+RBTREE_DEFINE(str_map, const char *, int, str_cmp)
+
+// returns black height, or -1 if a color/search constraint is broken
+static int int_map_check(const int_map *t, const int_map_node *p,
+                         const color_t parent_color) {
+  if (p == t->nil) {
+    return 0;
+  }
+  if (parent_color == RBTREE_RED && p->color == RBTREE_RED) {
+    return -1;
+  }
+  if ((p->left != t->nil && p->left->key > p->key) ||
+      (p->right != t->nil && p->right->key < p->key)) {
+    return -1;
+  }
+  const int l = int_map_check(t, p->left, p->color);
+  const int r = int_map_check(t, p->right, p->color);
+  if (l < 0 || l != r) {
+    return -1;
+  }
+  return l + (p->color == RBTREE_BLACK);
+}
+
+static void test_constraints(const int_map *t) {
+  assert(t->root->color == RBTREE_BLACK);
+  assert(int_map_check(t, t->root, RBTREE_BLACK) >= 0);
+}
+
+// the generic tree should behave like the int rbtree
+void test_int_map(const size_t n, const unsigned int seed) {
+  srand(seed);
+  int_map *m = int_map_new();
+  rbtree *t = new_rbtree();
+  int *arr = calloc(n, sizeof(int));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 2 + 1);
+    int_map_node *p = int_map_insert(m, arr[i], arr[i] * 0.5);
+    assert(p != NULL && p->key == arr[i]);
+    rbtree_insert(t, arr[i]);
+  }
+  test_constraints(m);
+
+  int *res1 = calloc(n, sizeof(int));
+  key_t *res2 = calloc(n, sizeof(key_t));
+  assert(int_map_keys(m, res1, n) == n);
+  rbtree_to_array(t, res2, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res1[i] == res2[i]);
+  }
+  assert(int_map_min(m)->key == rbtree_min(t)->key);
+  assert(int_map_max(m)->key == rbtree_max(t)->key);
+
+  for (size_t i = 0; i < n; i += 2) {
+    int_map_node *p = int_map_find(m, arr[i]);
+    assert(p != NULL && p->key == arr[i] && p->value == arr[i] * 0.5);
+    int_map_erase(m, p);
+  }
+  test_constraints(m);
+  for (size_t i = 1; i < n; i += 2) {
+    assert(int_map_find(m, arr[i]) != NULL);
+  }
+
+  free(res2);
+  free(res1);
+  free(arr);
+  delete_rbtree(t);
+  int_map_delete(m);
+}
+
+// put should update the value of an existing key instead of adding a node
+void test_str_map(void) {
+  const char *words[] = {"red", "black", "tree", "node", "red", "tree", "red"};
+  const size_t n = sizeof(words) / sizeof(words[0]);
+  str_map *m = str_map_new();
+  assert(str_map_min(m) == NULL);
+
+  for (size_t i = 0; i < n; i++) {
+    str_map_node *p = str_map_find(m, words[i]);
+    str_map_put(m, words[i], p == NULL ? 1 : p->value + 1);
+  }
+  assert(str_map_find(m, "red")->value == 3);
+  assert(str_map_find(m, "tree")->value == 2);
+  assert(str_map_find(m, "black")->value == 1);
+  assert(str_map_find(m, "green") == NULL);
+
+  const char *keys[8];
+  assert(str_map_keys(m, keys, 8) == 4);
+  assert(strcmp(keys[0], "black") == 0);
+  assert(strcmp(keys[3], "tree") == 0);
+  assert(strcmp(str_map_lower_bound(m, "o")->key, "red") == 0);
+  assert(str_map_prev(m, str_map_find(m, "node")) == str_map_min(m));
+
+  str_map_delete(m);
+}
+
+int main(void) {
+  test_int_map(1000, 3);
+  test_int_map(10000, 17);
+  test_str_map();
+  printf("Passed all tests!\n");
+}
@@ -1,8 +1,36 @@
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
 #include <rbtree.h>
+#include <rbtree_btree.h>
+#include <rbtree_conc.h>
+#include <rbtree_frozen.h>
+#include <rbtree_mmap.h>
+#include <rbtree_parallel.h>
+#include <rbtree_persist.h>
+#include <rbtree_sharded.h>
+#include <rbtree_sync.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// malloc that can be told to fail: the malloc_fail_at-th call from now returns NULL (0 = never)
+// glibc only, and not under sanitizers (they bring their own malloc)
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define MALLOC_FAILURE_TEST
+extern void *__libc_malloc(size_t);
+static long malloc_fail_at;
+
+void *malloc(size_t size) {
+  if (malloc_fail_at > 0 && --malloc_fail_at == 0) {
+    return NULL;
+  }
+  return __libc_malloc(size);
+}
+#endif
 
 // new_rbtree should return rbtree struct with null root node
 void test_init(void) {
@@ -17,6 +45,24 @@ void test_init(void) {
   delete_rbtree(t);
 }
 
+#ifdef MALLOC_FAILURE_TEST
+// new_rbtree should return NULL (and not crash or leak) whichever of its allocations fails
+void test_init_alloc_failure(void) {
+  for (long k = 1;; k++) {
+    malloc_fail_at = k;
+    rbtree *t = new_rbtree();
+    const bool failed = malloc_fail_at == 0;
+    malloc_fail_at = 0;
+    if (!failed) {
+      assert(t != NULL && t->root == t->nil);
+      delete_rbtree(t);
+      break;
+    }
+    assert(t == NULL);
+  }
+}
+#endif
+
 // root node should have proper values and pointers
 void test_insert_single(const key_t key) {
   rbtree *t = new_rbtree();
@@ -26,9 +72,9 @@ void test_insert_single(const key_t key) {
   assert(p->key == key);
   // assert(p->color == RBTREE_BLACK);  // color of root node should be black
 #ifdef SENTINEL
-  assert(p->left == t->nil);
-  assert(p->right == t->nil);
-  assert(p->parent == t->nil);
+  assert(rbtree_left(t, p) == t->nil);
+  assert(rbtree_right(t, p) == t->nil);
+  assert(rbtree_parent(t, p) == t->nil);
 #else
   assert(p->left == NULL);
   assert(p->right == NULL);
@@ -71,6 +117,14 @@ void test_erase_root(const key_t key) {
   delete_rbtree(t);
 }
 
+// node count for `all` keys of which `distinct` differ
+// (multiset mode keeps one node per distinct key)
+#ifdef RBTREE_MULTISET
+#define NODES(all, distinct) (distinct)
+#else
+#define NODES(all, distinct) (all)
+#endif
+
 static void insert_arr(rbtree *t, const key_t *arr, const size_t n) {
   for (size_t i = 0; i < n; i++) {
     rbtree_insert(t, arr[i]);
@@ -180,8 +234,8 @@ void test_multi_instance() {
 // The values of right subtree should be greater than or equal to the current
 // node
 
-static bool search_traverse(const node_t *p, key_t *min, key_t *max,
-                            node_t *nil) {
+static bool search_traverse(const rbtree *t, const node_t *p, key_t *min,
+                            key_t *max, node_t *nil) {
   if (p == nil) {
     return true;
   }
@@ -191,11 +245,11 @@ static bool search_traverse(const node_t *p, key_t *min, key_t *max,
   key_t l_min, l_max, r_min, r_max;
   l_min = l_max = r_min = r_max = p->key;
 
-  const bool lr = search_traverse(p->left, &l_min, &l_max, nil);
+  const bool lr = search_traverse(t, rbtree_left(t, p), &l_min, &l_max, nil);
   if (!lr || l_max > p->key) {
     return false;
   }
-  const bool rr = search_traverse(p->right, &r_min, &r_max, nil);
+  const bool rr = search_traverse(t, rbtree_right(t, p), &r_min, &r_max, nil);
   if (!rr || r_min < p->key) {
     return false;
   }
@@ -214,7 +268,7 @@ void test_search_constraint(const rbtree *t) {
 #else
   node_t *nil = NULL;
 #endif
-  assert(search_traverse(p, &min, &max, nil));
+  assert(search_traverse(t, p, &min, &max, nil));
 }
 
 // Color constraint
@@ -232,8 +286,9 @@ static void init_color_traverse(void) {
   max_black_depth = 0;
 }
 
-static bool color_traverse(const node_t *p, const color_t parent_color,
-                           const int black_depth, node_t *nil) {
+static bool color_traverse(const rbtree *t, const node_t *p,
+                           const color_t parent_color, const int black_depth,
+                           node_t *nil) {
   if (p == nil) {
     if (!touch_nil) {
       touch_nil = true;
@@ -243,12 +298,13 @@ static bool color_traverse(const node_t *p, const color_t parent_color,
     }
     return true;
   }
-  if (parent_color == RBTREE_RED && p->color == RBTREE_RED) {
+  const color_t color = rbtree_color(p);
+  if (parent_color == RBTREE_RED && color == RBTREE_RED) {
     return false;
   }
-  int next_depth = ((p->color == RBTREE_BLACK) ? 1 : 0) + black_depth;
-  return color_traverse(p->left, p->color, next_depth, nil) &&
-         color_traverse(p->right, p->color, next_depth, nil);
+  int next_depth = ((color == RBTREE_BLACK) ? 1 : 0) + black_depth;
+  return color_traverse(t, rbtree_left(t, p), color, next_depth, nil) &&
+         color_traverse(t, rbtree_right(t, p), color, next_depth, nil);
 }
 
 void test_color_constraint(const rbtree *t) {
@@ -259,10 +315,10 @@ void test_color_constraint(const rbtree *t) {
   node_t *nil = NULL;
 #endif
   node_t *p = t->root;
-  assert(p == nil || p->color == RBTREE_BLACK);
+  assert(p == nil || rbtree_color(p) == RBTREE_BLACK);
 
   init_color_traverse();
-  assert(color_traverse(p, RBTREE_BLACK, 0, nil));
+  assert(color_traverse(t, p, RBTREE_BLACK, 0, nil));
 }
 
 // rbtree should keep search tree and color constraints
@@ -367,17 +423,2131 @@ void test_find_erase_rand(const size_t n, const unsigned int seed) {
   delete_rbtree(t);
 }
 
-int main(void) {
-  test_init();
-  test_insert_single(1024);
-  test_find_single(512, 1024);
-  test_erase_root(128);
-  test_find_erase_fixed();
-  test_minmax_suite();
-  test_to_array_suite();
-  test_distinct_values();
-  test_duplicate_values();
-  test_multi_instance();
-  test_find_erase_rand(10000, 17);
+// bulk-loaded trees should keep search tree and color constraints
+void test_from_sorted(const size_t n) {
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (key_t)(i / 3);  // with duplicates
+  }
+
+  rbtree *t = rbtree_from_sorted(arr, n);
+  assert(t != NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  // the result should be an ordinary tree that can be modified
+  rbtree_insert(t, -1);
+  if (n > 0) {
+    node_t *p = rbtree_find(t, arr[n / 2]);
+    assert(p != NULL);
+    rbtree_erase(t, p);
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+void test_from_unsorted(void) {
+  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  rbtree *t = rbtree_from_unsorted(entries, n);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  qsort((void *)entries, n, sizeof(key_t), comp);
+  key_t res[sizeof(entries) / sizeof(entries[0])];
+  rbtree_to_array(t, res, n);
+  for (size_t i = 0; i < n; i++) {
+    assert(entries[i] == res[i]);
+  }
+  delete_rbtree(t);
+}
+
+void test_from_sorted_suite(void) {
+  for (size_t n = 0; n <= 130; n++) {
+    test_from_sorted(n);
+  }
+  test_from_sorted(10000);
+  test_from_unsorted();
+}
+
+#ifdef MALLOC_FAILURE_TEST
+// from_sorted / from_unsorted should return NULL and free the partly built tree when an allocation fails
+// (RBTREE_NO_POOL mallocs every node, so this fails in the middle of the build)
+void test_from_sorted_alloc_failure(rbtree *(*build)(const key_t *, size_t)) {
+  key_t arr[100];
+  const size_t n = sizeof(arr) / sizeof(arr[0]);
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = (key_t)((i * 37) % n / 2);  // unsorted, with duplicates
+  }
+  key_t sorted[sizeof(arr) / sizeof(arr[0])];
+  memcpy(sorted, arr, sizeof(arr));
+  qsort(sorted, n, sizeof(key_t), comp);
+  if (build == rbtree_from_sorted) {
+    memcpy(arr, sorted, sizeof(arr));
+  }
+
+  for (long k = 1;; k++) {
+    malloc_fail_at = k;
+    rbtree *t = build(arr, n);
+    const bool failed = malloc_fail_at == 0;
+    malloc_fail_at = 0;
+    if (!failed) {
+      assert(t != NULL);
+      key_t res[sizeof(arr) / sizeof(arr[0])];
+      assert(rbtree_to_array(t, res, n) == 1);
+      assert(memcmp(res, sorted, sizeof(res)) == 0);
+      delete_rbtree(t);
+      break;
+    }
+    assert(t == NULL);
+  }
+}
+#endif
+
+// iterators should visit every node in order, both ways
+void test_iter(void) {
+  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  rbtree *t = new_rbtree();
+  assert(rbtree_iter_begin(t) == NULL);
+  assert(rbtree_iter_last(t) == NULL);
+  insert_arr(t, entries, n);
+  qsort((void *)entries, n, sizeof(key_t), comp);
+
+  // a multiset node stands for rbtree_count(p) equal keys
+  size_t i = 0;
+  for (node_t *p = rbtree_iter_begin(t); p != NULL; p = rbtree_iter_next(t, p)) {
+    for (size_t c = rbtree_count(p); c > 0; c--) {
+      assert(i < n);
+      assert(p->key == entries[i++]);
+    }
+  }
+  assert(i == n);
+
+  for (node_t *p = rbtree_iter_last(t); p != NULL; p = rbtree_iter_prev(t, p)) {
+    for (size_t c = rbtree_count(p); c > 0; c--) {
+      assert(i > 0);
+      assert(p->key == entries[--i]);
+    }
+  }
+  assert(i == 0);
+
+  // to_array should stop exactly at the given size
+  key_t res[4] = {-1, -1, -1, -1};
+  rbtree_to_array(t, res, 3);
+  for (i = 0; i < 3; i++) {
+    assert(res[i] == entries[i]);
+  }
+  assert(res[3] == -1);
+
+  delete_rbtree(t);
+}
+
+static int sum_visit(const node_t *p, void *arg) {
+  *(long *)arg += p->key * (long)rbtree_count(p);
+  return 0;
+}
+
+static int stop_visit(const node_t *p, void *arg) {
+  return p->key >= *(key_t *)arg;
+}
+
+// bounds and range queries should agree with a linear scan
+void test_range(void) {
+  key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  rbtree *t = new_rbtree();
+  assert(rbtree_lower_bound(t, 0) == NULL);
+  insert_arr(t, entries, n);
+  qsort((void *)entries, n, sizeof(key_t), comp);
+
+  for (key_t k = 0; k <= 1000; k++) {
+    size_t lo = 0, hi = 0;
+    while (lo < n && entries[lo] < k) lo++;
+    while (hi < n && entries[hi] <= k) hi++;
+
+    node_t *p = rbtree_lower_bound(t, k);
+    assert(lo == n ? p == NULL : (p != NULL && p->key == entries[lo]));
+    if (p != NULL) {
+      assert(rbtree_iter_prev(t, p) == NULL || rbtree_iter_prev(t, p)->key < k);
+    }
+    node_t *q = rbtree_upper_bound(t, k);
+    assert(hi == n ? q == NULL : (q != NULL && q->key == entries[hi]));
+  }
+
+  key_t out[sizeof(entries) / sizeof(entries[0])];
+  size_t cnt = rbtree_range(t, 8, 36, out, n);
+  assert(cnt == 9);
+  for (size_t i = 0; i < cnt; i++) {
+    assert(out[i] == entries[i + 2]);
+  }
+  assert(rbtree_range(t, 8, 36, out, 3) == 3);
+  assert(rbtree_range(t, 37, 66, out, n) == 0);
+  assert(rbtree_range(t, 36, 8, out, n) == 0);
+
+  long sum = 0;
+  assert(rbtree_range_foreach(t, 24, 25, sum_visit, &sum) == NODES(3, 2));
+  assert(sum == 24 + 24 + 25);
+  key_t stop = 23;
+  assert(rbtree_range_foreach(t, 0, 1000, stop_visit, &stop) == 6);
+
+  delete_rbtree(t);
+}
+
+#ifdef RBTREE_ORDER_STAT
+// every node's size should be the number of keys in its subtree
+static size_t size_traverse(const rbtree *t, const node_t *p) {
+  if (p == t->nil) {
+    assert(p->size == 0);
+    return 0;
+  }
+  size_t size = size_traverse(t, rbtree_left(t, p)) +
+                size_traverse(t, rbtree_right(t, p)) + rbtree_count(p);
+  assert(p->size == size);
+  return size;
+}
+
+static void check_order_stat(const rbtree *t, const key_t *sorted,
+                             const size_t n) {
+  assert(size_traverse(t, t->root) == n);
+  assert(rbtree_size(t) == n);
+  for (size_t i = 0; i < n; i++) {
+    node_t *p = rbtree_select(t, i);
+    assert(p != NULL && p->key == sorted[i]);
+    size_t lo = i;
+    while (lo > 0 && sorted[lo - 1] == sorted[i]) lo--;
+    assert(rbtree_rank(t, sorted[i]) == lo);
+  }
+  assert(rbtree_select(t, n) == NULL);
+}
+#endif
+
+// rank/select should agree with to_array after inserts, erases and bulk load
+void test_order_stat(const size_t n, const unsigned int seed) {
+#ifdef RBTREE_ORDER_STAT
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 2 + 1);
+  }
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  check_order_stat(t, arr, n);
+
+  // erase every other key
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i % 2) {
+      rbtree_erase(t, rbtree_find(t, arr[i]));
+    } else {
+      arr[m++] = arr[i];
+    }
+  }
+  check_order_stat(t, arr, m);
+  delete_rbtree(t);
+
+  t = rbtree_from_sorted(arr, m);
+  check_order_stat(t, arr, m);
+  delete_rbtree(t);
+  free(arr);
+#endif
+}
+
+// compact layouts should actually shrink node_t
+void test_node_layout(void) {
+#if defined(RBTREE_COMPACT32) && !defined(RBTREE_ORDER_STAT) && !defined(RBTREE_CONCURRENT) && !defined(RBTREE_LAZY_DELETE) && !defined(RBTREE_INTERVAL)
+  assert(sizeof(node_t) == 16);
+#elif defined(RBTREE_COMPACT) && defined(RBTREE_ORDER_STAT) && !defined(RBTREE_INTERVAL)
+  assert(sizeof(node_t) <= 4 * sizeof(void *));
+#endif
+}
+
+// erased nodes should be recycled by the per-tree node pool
+void test_pool_reuse(void) {
+#ifndef RBTREE_NO_POOL
+  rbtree *t = new_rbtree();
+  node_t *p = rbtree_insert(t, 10);
+  rbtree_insert(t, 20);
+  rbtree_erase(t, p);
+  node_t *q = rbtree_insert(t, 30);
+  assert(p == q);
+  assert(rbtree_find(t, 30) == q);
+  assert(rbtree_find(t, 10) == NULL);
+  delete_rbtree(t);
+#endif
+}
+
+// parent links should mirror child links everywhere
+static void parent_traverse(const rbtree *t, const node_t *p) {
+  if (p == t->nil) {
+    return;
+  }
+  assert(rbtree_left(t, p) == t->nil || rbtree_parent(t, rbtree_left(t, p)) == p);
+  assert(rbtree_right(t, p) == t->nil || rbtree_parent(t, rbtree_right(t, p)) == p);
+  parent_traverse(t, rbtree_left(t, p));
+  parent_traverse(t, rbtree_right(t, p));
+}
+
+#ifdef RBTREE_LAZY_DELETE
+// the node and tombstone counters should match the tree
+static size_t lazy_traverse(const rbtree *t, const node_t *p, size_t *dead) {
+  if (p == t->nil) {
+    return 0;
+  }
+  *dead += rbtree_is_dead(p);
+  return 1 + lazy_traverse(t, rbtree_left(t, p), dead) + lazy_traverse(t, rbtree_right(t, p), dead);
+}
+#endif
+
+#ifdef RBTREE_INTERVAL
+// every node's max should be the largest interval end in its subtree
+static key_t max_traverse(const rbtree *t, const node_t *p) {
+  if (p == t->nil) {
+    assert(p->max == INT_MIN);
+    return INT_MIN;
+  }
+  assert(p->hi >= p->key);
+  key_t m = p->hi;
+  const key_t l = max_traverse(t, rbtree_left(t, p));
+  const key_t r = max_traverse(t, rbtree_right(t, p));
+  m = l > m ? l : m;
+  m = r > m ? r : m;
+  assert(p->max == m);
+  return m;
+}
+#endif
+
+// t should be a valid rbtree holding exactly sorted[0..n)
+static void check_tree(const rbtree *t, const key_t *sorted, const size_t n) {
+  test_color_constraint(t);
+  test_search_constraint(t);
+  assert(t->root == t->nil || rbtree_parent(t, t->root) == t->nil);
+  parent_traverse(t, t->root);
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_to_array(t, res, n + 1) == (n > 0));
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == sorted[i]);
+  }
+  assert(n == 0 || rbtree_iter_next(t, rbtree_max(t)) == NULL);
+  free(res);
+#ifdef RBTREE_ORDER_STAT
+  assert(size_traverse(t, t->root) == n);
+#endif
+#ifdef RBTREE_INTERVAL
+  max_traverse(t, t->root);
+#endif
+#ifdef RBTREE_LAZY_DELETE
+  size_t dead = 0;
+  assert(lazy_traverse(t, t->root, &dead) + 1 == t->nodes && dead == t->dead);
+#endif
+}
+
+static rbtree *random_tree(key_t *arr, const size_t n, const key_t range) {
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+  }
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  return t;
+}
+
+// split then join should round-trip, on both sides of the size balance
+void test_join_split(const size_t n, const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  rbtree *t = random_tree(arr, n, (key_t)n);
+  rbtree *r = new_rbtree();
+  const key_t pivots[] = {-1, 0, 1, (key_t)n / 10, (key_t)n / 2, (key_t)n - 3, (key_t)n};
+  for (size_t i = 0; i < sizeof(pivots) / sizeof(pivots[0]); i++) {
+    const key_t k = pivots[i];
+    size_t lo = 0;
+    while (lo < n && arr[lo] < k) lo++;
+    assert(rbtree_split(t, k, r));
+    check_tree(t, arr, lo);
+    check_tree(r, arr + lo, n - lo);
+    assert(lo == n || rbtree_split(t, k, r) == 0);  // right must be empty
+
+    // join refuses a key outside the gap, and puts k back in the middle
+    assert(lo == 0 || rbtree_join(t, arr[lo - 1] - 1, r) == NULL);
+    assert(lo == n || rbtree_join(t, arr[lo] + 1, r) == NULL);
+    node_t *p = rbtree_join(t, k, r);
+    assert(p != NULL && p->key == k);
+    memmove(arr + lo + 1, arr + lo, (n - lo) * sizeof(key_t));
+    arr[lo] = k;
+    check_tree(t, arr, n + 1);
+    check_tree(r, NULL, 0);
+    rbtree_erase(t, p);
+    memmove(arr + lo, arr + lo + 1, (n - lo) * sizeof(key_t));
+    check_tree(t, arr, n);
+  }
+  // the emptied tree is still usable
+  rbtree_insert(r, 42);
+  assert(rbtree_find(r, 42) != NULL);
+  delete_rbtree(r);
+  delete_rbtree(t);
+
+#ifndef RBTREE_COMPACT32
+  // split hands the nodes over in place: pointers taken before it stay valid,
+  // and the right half outlives the tree it came from
+  t = random_tree(arr, n, (key_t)n);
+  if (arr[0] < arr[n - 1]) {
+    size_t lo = 0;
+    while (arr[lo] < arr[n - 1]) lo++;
+    node_t *first = rbtree_min(t);
+    node_t *last = rbtree_max(t);
+    r = new_rbtree();
+    assert(rbtree_split(t, arr[n - 1], r));
+    assert(rbtree_min(t) == first && rbtree_max(r) == last);
+    delete_rbtree(t);
+    check_tree(r, arr + lo, n - lo);
+    rbtree_erase(r, last);
+    rbtree_insert(r, arr[n - 1]);
+    check_tree(r, arr + lo, n - lo);
+    delete_rbtree(r);
+  } else {
+    delete_rbtree(t);
+  }
+#endif
+  free(arr);
+}
+
+static int contains(const key_t *sorted, const size_t n, const key_t key) {
+  return bsearch(&key, sorted, n, sizeof(key_t), comp) != NULL;
+}
+
+// union/intersection/difference should match a merge of the sorted inputs
+void test_set_ops(const size_t n, const size_t m, const key_t range,
+                  const unsigned int seed) {
+  key_t *a = calloc(n + 1, sizeof(key_t));
+  key_t *b = calloc(m + 1, sizeof(key_t));
+  key_t *expected = calloc(n + m + 1, sizeof(key_t));
+  for (int threads = 1; threads <= 4; threads *= 4) {
+    for (int op = RBTREE_UNION; op <= RBTREE_DIFFERENCE; op++) {
+      srand(seed);
+      rbtree *t1 = random_tree(a, n, range);
+      rbtree *t2 = random_tree(b, m, range);
+      size_t e = 0;
+      if (op == RBTREE_UNION) {
+        memcpy(expected, a, n * sizeof(key_t));
+        memcpy(expected + n, b, m * sizeof(key_t));
+        e = n + m;
+        qsort((void *)expected, e, sizeof(key_t), comp);
+      } else {
+        for (size_t i = 0; i < n; i++) {
+          if (contains(b, m, a[i]) == (op == RBTREE_INTERSECTION)) {
+            expected[e++] = a[i];
+          }
+        }
+      }
+      assert(rbtree_set_op(t1, t2, op, threads));
+      check_tree(t1, expected, e);
+      check_tree(t2, NULL, 0);
+      delete_rbtree(t1);
+      delete_rbtree(t2);
+    }
+  }
+  free(expected);
+  free(b);
+  free(a);
+}
+
+void test_set_ops_suite(void) {
+  rbtree *t1 = new_rbtree(), *t2 = new_rbtree();
+  rbtree_insert(t1, 1);
+  rbtree_insert(t1, 2);
+  rbtree_insert(t2, 2);
+  rbtree_insert(t2, 3);
+  assert(rbtree_intersection(t1, t2));
+  assert(rbtree_find(t1, 2) != NULL && rbtree_find(t1, 1) == NULL);
+  rbtree_insert(t2, 2);
+  assert(rbtree_difference(t1, t2));
+  assert(t1->root == t1->nil);
+  rbtree_insert(t2, 7);
+  assert(rbtree_union(t1, t2));
+  assert(rbtree_find(t1, 7) != NULL && t2->root == t2->nil);
+  delete_rbtree(t1);
+  delete_rbtree(t2);
+
+  test_set_ops(0, 0, 10, 1);
+  test_set_ops(1000, 0, 100, 2);
+  test_set_ops(0, 1000, 100, 3);
+  test_set_ops(1000, 1000, 500, 4);
+  test_set_ops(5000, 30, 100000, 5);
+  test_set_ops(30, 5000, 100000, 6);
+  test_set_ops(3000, 2000, 50, 7);
+}
+
+// batched insert/erase should match inserting/erasing one key at a time,
+// both on the finger-search path (small batch) and the rebuild path
+void test_batch(const size_t n, const size_t m, const key_t range,
+                const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  key_t *batch = calloc(m + 1, sizeof(key_t));
+  key_t *expected = calloc(n + m + 1, sizeof(key_t));
+  rbtree *t = random_tree(arr, n, range);
+  node_t *kept = n > 0 ? rbtree_max(t) : NULL;
+  for (size_t i = 0; i < m; i++) {
+    batch[i] = rand() % range;
+  }
+  qsort((void *)batch, m, sizeof(key_t), comp);
+
+  memcpy(expected, arr, n * sizeof(key_t));
+  memcpy(expected + n, batch, m * sizeof(key_t));
+  qsort((void *)expected, n + m, sizeof(key_t), comp);
+  assert(rbtree_insert_batch(t, batch, m) == m);
+  check_tree(t, expected, n + m);
+  assert(kept == NULL || kept->key == arr[n - 1]);
+
+  // erase the original keys back out: the tree should hold the batch again
+  assert(rbtree_erase_batch(t, arr, n) == n);
+  check_tree(t, batch, m);
+  // absent keys are skipped, every present one goes once per occurrence
+  size_t e = 0;
+  for (size_t i = 0; i < m; i++) {
+    if (i % 3 != 0) {
+      expected[e++] = batch[i];
+    }
+  }
+  for (size_t i = 0; i < m; i += 3) {
+    batch[i / 3] = batch[i];
+  }
+  batch[(m + 2) / 3] = range + 1;
+  assert(rbtree_erase_batch(t, batch, (m + 2) / 3 + 1) == (m + 2) / 3);
+  check_tree(t, expected, e);
+
+  // unsorted batches fall back to one at a time
+  const key_t unsorted[] = {5, 3, 5, 9};
+  assert(rbtree_insert_batch(t, unsorted, 4) == 4);
+  assert(rbtree_erase_batch(t, unsorted, 4) == 4);
+  check_tree(t, expected, e);
+
+  delete_rbtree(t);
+  free(expected);
+  free(batch);
+  free(arr);
+}
+
+// small erase batches take the finger-search path; compare with erase
+static void test_erase_batch_finger(const size_t n, const size_t m,
+                                    const key_t range,
+                                    const unsigned int seed) {
+  srand(seed);
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  key_t *batch = calloc(m + 1, sizeof(key_t));
+  rbtree *t = random_tree(arr, n, range);
+  rbtree *u = new_rbtree();
+  insert_arr(u, arr, n);
+  for (size_t i = 0; i < m; i++) {
+    batch[i] = rand() % (range + 10) - 5;
+  }
+  qsort((void *)batch, m, sizeof(key_t), comp);
+  size_t erased = 0;
+  for (size_t i = 0; i < m; i++) {
+    node_t *p = rbtree_find(u, batch[i]);
+    if (p != NULL) {
+      rbtree_erase(u, p);
+      erased++;
+    }
+  }
+  assert(rbtree_erase_batch(t, batch, m) == erased);
+  rbtree_to_array(u, arr, n - erased);
+  check_tree(t, arr, n - erased);
+  delete_rbtree(u);
+  delete_rbtree(t);
+  free(batch);
+  free(arr);
+}
+
+void test_batch_suite(void) {
+  test_batch(0, 0, 10, 1);
+  test_batch(0, 500, 100, 2);
+  test_batch(10000, 50, 100000, 3);
+  test_batch(10000, 50, 30, 4);
+  test_batch(100, 5000, 1000, 5);
+  test_batch(3000, 1000, 100000, 6);
+  test_erase_batch_finger(10000, 100, 100000, 7);
+  test_erase_batch_finger(10000, 300, 1000, 8);
+}
+
+// batched lookups should return exactly the nodes rbtree_find returns
+void test_find_many(const size_t n, const unsigned int seed) {
+  rbtree *t = new_rbtree();
+  key_t *keys = calloc(2 * n + 1, sizeof(key_t));
+  node_t **out = calloc(2 * n + 1, sizeof(node_t *));
+  assert(rbtree_find_many(t, keys, 3, out) == 0);
+  assert(out[0] == NULL && out[2] == NULL);
+
+  srand(seed);
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % (key_t)n);
+  }
+  for (size_t i = 0; i < 2 * n + 1; i++) {
+    keys[i] = (key_t)i - 1;
+  }
+  for (size_t len = 0; len <= 2 * n + 1; len += len < 40 ? 1 : n) {
+    size_t expected = 0;
+    const size_t found = rbtree_find_many(t, keys, len, out);
+    for (size_t i = 0; i < len; i++) {
+      assert(out[i] == rbtree_find(t, keys[i]));
+      expected += out[i] != NULL;
+    }
+    assert(found == expected);
+  }
+  free(out);
+  free(keys);
+  delete_rbtree(t);
+}
+
+// every probe in [lo, hi] should get the same answer from the snapshot
+static void check_frozen(const rbtree *t, const rbtree_frozen *f, const key_t lo,
+                         const key_t hi) {
+  for (key_t k = lo; k <= hi; k++) {
+    node_t *p = rbtree_find(t, k);
+    node_t *q = rbtree_frozen_find(f, k);
+    assert((p == NULL) == (q == NULL));
+    assert(q == NULL || q->key == k);
+    assert(rbtree_frozen_lower_bound(f, k) == rbtree_lower_bound(t, k));
+  }
+}
+
+// freeze should answer like the tree and fall back once the tree changes
+void test_freeze(const size_t n, const unsigned int seed) {
+  rbtree *t = new_rbtree();
+  rbtree_frozen *f = rbtree_freeze(t);
+  assert(f != NULL && rbtree_frozen_valid(f));
+  assert(rbtree_frozen_find(f, 0) == NULL);
+  assert(rbtree_frozen_lower_bound(f, 0) == NULL);
+  rbtree_frozen_delete(f);
+
+  srand(seed);
+  const key_t range = (key_t)n;
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % range);
+  }
+  f = rbtree_freeze(t);
+  check_frozen(t, f, -1, range);
+
+  // a change makes the snapshot stale, but answers stay right
+  rbtree_insert(t, range + 5);
+  rbtree_erase(t, rbtree_min(t));
+  assert(!rbtree_frozen_valid(f));
+  check_frozen(t, f, -1, range + 6);
+
+  // rebuilt in place, growing the arrays
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand() % (2 * range));
+  }
+  assert(rbtree_refreeze(f) && rbtree_frozen_valid(f));
+  check_frozen(t, f, -1, 2 * range + 1);
+  rbtree_frozen_delete(f);
+  delete_rbtree(t);
+}
+
+// the seqlock wrapper should answer like a plain tree when used by one thread
+void test_sync_basic(void) {
+  rbtree_sync *s = rbtree_sync_new();
+  key_t k, out[8];
+  assert(!rbtree_sync_find(s, 1));
+  assert(!rbtree_sync_min(s, &k));
+  assert(rbtree_sync_range(s, 0, 100, out, 8) == 0);
+  for (key_t i = 10; i > 0; i--) {
+    assert(rbtree_sync_insert(s, i * 3));
+  }
+  assert(rbtree_sync_find(s, 9) && !rbtree_sync_find(s, 10));
+  assert(rbtree_sync_min(s, &k) && k == 3);
+  assert(rbtree_sync_max(s, &k) && k == 30);
+  assert(rbtree_sync_range(s, 4, 13, out, 8) == 3);
+  assert(out[0] == 6 && out[1] == 9 && out[2] == 12);
+  assert(rbtree_sync_range(s, 0, 100, out, 8) == 8 && out[7] == 24);
+  assert(rbtree_sync_erase(s, 9) && !rbtree_sync_erase(s, 9));
+  assert(!rbtree_sync_find(s, 9));
+  rbtree_sync_delete(s);
+}
+
+#define SYNC_KEYS 2048
+#define SYNC_ROUNDS 200
+
+typedef struct {
+  rbtree_sync *s;
+  atomic_int *stop;
+  int errors;
+} sync_arg_t;
+
+// churn odd keys while readers run
+static void *sync_writer(void *p) {
+  sync_arg_t *a = p;
+  for (int r = 0; r < SYNC_ROUNDS; r++) {
+    for (key_t k = 1; k < SYNC_KEYS; k += 2) {
+      rbtree_sync_insert(a->s, k);
+    }
+    for (key_t k = 1; k < SYNC_KEYS; k += 2) {
+      rbtree_sync_erase(a->s, k);
+    }
+  }
+  atomic_store_explicit(a->stop, 1, memory_order_release);
+  return NULL;
+}
+
+// even keys are never erased, so every read must still see them
+static void *sync_reader(void *p) {
+  sync_arg_t *a = p;
+  key_t out[64];
+  for (key_t k = 0; !atomic_load_explicit(a->stop, memory_order_acquire); k = (k + 2) % SYNC_KEYS) {
+    key_t m;
+    a->errors += !rbtree_sync_find(a->s, k);
+    a->errors += !rbtree_sync_min(a->s, &m) || m != 0;
+    size_t c = rbtree_sync_range(a->s, k, k + 40, out, 64);
+    size_t evens = 0;
+    for (size_t i = 0; i < c; i++) {
+      a->errors += out[i] < k || out[i] > k + 40 || (i > 0 && out[i] <= out[i - 1]);
+      evens += out[i] % 2 == 0;
+    }
+    a->errors += evens != (size_t)((k + 40 < SYNC_KEYS ? 40 : SYNC_KEYS - 2 - k) / 2 + 1);
+  }
+  return NULL;
+}
+
+void test_sync_concurrent(void) {
+  rbtree_sync *s = rbtree_sync_new();
+  for (key_t k = 0; k < SYNC_KEYS; k += 2) {
+    rbtree_sync_insert(s, k);
+  }
+  atomic_int stop = 0;
+  sync_arg_t w = {s, &stop, 0};
+  sync_arg_t r[2] = {{s, &stop, 0}, {s, &stop, 0}};
+  pthread_t th[3];
+  pthread_create(&th[0], NULL, sync_writer, &w);
+  pthread_create(&th[1], NULL, sync_reader, &r[0]);
+  pthread_create(&th[2], NULL, sync_reader, &r[1]);
+  for (int i = 0; i < 3; i++) {
+    pthread_join(th[i], NULL);
+  }
+  assert(r[0].errors == 0 && r[1].errors == 0);
+
+  key_t *arr = calloc(SYNC_KEYS, sizeof(key_t));
+  assert(rbtree_sync_range(s, 0, SYNC_KEYS, arr, SYNC_KEYS) == SYNC_KEYS / 2);
+  for (int i = 0; i < SYNC_KEYS / 2; i++) {
+    assert(arr[i] == 2 * i);
+  }
+  free(arr);
+  rbtree_sync_delete(s);
+}
+
+// black height of a persistent subtree; asserts no red-red and equal heights
+static int pnode_check(const pnode_t *n) {
+  if (n == NULL) {
+    return 0;
+  }
+  if (n->color == RBTREE_RED) {
+    assert(n->link[0] == NULL || n->link[0]->color == RBTREE_BLACK);
+    assert(n->link[1] == NULL || n->link[1]->color == RBTREE_BLACK);
+  }
+  assert(n->link[0] == NULL || n->link[0]->key <= n->key);
+  assert(n->link[1] == NULL || n->link[1]->key >= n->key);
+  const int l = pnode_check(n->link[0]);
+  assert(l == pnode_check(n->link[1]));
+  return l + (n->color == RBTREE_BLACK);
+}
+
+// a snapshot should be a valid rbtree holding exactly sorted[0..n)
+static void check_snap(const rbtree_snap *s, const key_t *sorted,
+                       const size_t n) {
+  assert(s->root == NULL || s->root->color == RBTREE_BLACK);
+  pnode_check(s->root);
+  assert(s->size == n);
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_snap_range(s, INT32_MIN, INT32_MAX, res, n + 1) == n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == sorted[i]);
+    assert(rbtree_snap_find(s, sorted[i]));
+  }
+  key_t m;
+  assert(rbtree_snap_min(s, &m) == (n > 0) && (n == 0 || m == sorted[0]));
+  assert(rbtree_snap_max(s, &m) == (n > 0) && (n == 0 || m == sorted[n - 1]));
+  free(res);
+}
+
+// old snapshots keep their contents while the tree keeps changing,
+// and releasing them frees every node no other version uses
+void test_persist(const size_t n, const key_t range, const unsigned int seed) {
+  enum { SNAPS = 8 };
+  rbtree_persist *p = rbtree_persist_new();
+  rbtree *ref = new_rbtree();
+  rbtree_snap *snaps[SNAPS];
+  key_t *expected[SNAPS];
+  size_t sizes[SNAPS];
+  srand(seed);
+  assert(!rbtree_persist_erase(p, 1));
+  for (size_t i = 0; i < SNAPS; i++) {
+    for (size_t j = 0; j < n / SNAPS; j++) {
+      const key_t k = rand() % range;
+      if (rand() % 3 == 0) {
+        node_t *np = rbtree_find(ref, k);
+        assert(rbtree_persist_erase(p, k) == (np != NULL));
+        if (np != NULL) {
+          rbtree_erase(ref, np);
+        }
+      } else {
+        assert(rbtree_persist_insert(p, k));
+        rbtree_insert(ref, k);
+      }
+    }
+    snaps[i] = rbtree_snapshot(p);
+    expected[i] = calloc(n + 1, sizeof(key_t));
+    sizes[i] = 0;
+    for (node_t *x = rbtree_iter_begin(ref); x != NULL; x = rbtree_iter_next(ref, x)) {
+      for (size_t c = rbtree_count(x); c > 0; c--) {
+        expected[i][sizes[i]++] = x->key;
+      }
+    }
+    check_snap(snaps[i], expected[i], sizes[i]);
+  }
+  // empty the tree; every snapshot is untouched
+  for (size_t i = 0; i < sizes[SNAPS - 1]; i++) {
+    assert(rbtree_persist_erase(p, expected[SNAPS - 1][i]));
+  }
+  assert(p->root == NULL && p->size == 0);
+  for (size_t i = 0; i < SNAPS; i += 2) {
+    check_snap(snaps[i], expected[i], sizes[i]);
+    rbtree_snap_release(snaps[i]);
+  }
+  for (size_t i = 1; i < SNAPS; i += 2) {
+    check_snap(snaps[i], expected[i], sizes[i]);
+    rbtree_snap_release(snaps[i]);
+  }
+  assert(atomic_load(&p->nodes) == 0);
+
+  // without snapshots old versions are reclaimed right away
+  for (key_t k = 0; k < 100; k++) {
+    rbtree_persist_insert(p, k);
+  }
+  assert(atomic_load(&p->nodes) == 100);
+  for (size_t i = 0; i < SNAPS; i++) {
+    free(expected[i]);
+  }
+  delete_rbtree(ref);
+  rbtree_persist_delete(p);
+}
+
+#define PERSIST_KEYS 1024
+#define PERSIST_ROUNDS 100
+
+typedef struct {
+  rbtree_persist *p;
+  atomic_int *stop;
+  int errors;
+} persist_arg_t;
+
+// churn odd keys while readers take snapshots
+static void *persist_writer(void *arg) {
+  persist_arg_t *a = arg;
+  for (int r = 0; r < PERSIST_ROUNDS; r++) {
+    for (key_t k = 1; k < PERSIST_KEYS; k += 2) {
+      rbtree_persist_insert(a->p, k);
+    }
+    for (key_t k = 1; k < PERSIST_KEYS; k += 2) {
+      rbtree_persist_erase(a->p, k);
+    }
+  }
+  atomic_store_explicit(a->stop, 1, memory_order_release);
+  return NULL;
+}
+
+// every snapshot must be a whole version: all even keys, sorted, size matches
+static void *persist_reader(void *arg) {
+  persist_arg_t *a = arg;
+  key_t *out = calloc(PERSIST_KEYS, sizeof(key_t));
+  while (!atomic_load_explicit(a->stop, memory_order_acquire)) {
+    rbtree_snap *s = rbtree_snapshot(a->p);
+    const size_t c = rbtree_snap_range(s, 0, PERSIST_KEYS, out, PERSIST_KEYS);
+    size_t evens = 0;
+    a->errors += c != s->size;
+    for (size_t i = 0; i < c; i++) {
+      a->errors += i > 0 && out[i] <= out[i - 1];
+      evens += out[i] % 2 == 0;
+    }
+    a->errors += evens != PERSIST_KEYS / 2;
+    rbtree_snap_release(s);
+  }
+  free(out);
+  return NULL;
+}
+
+void test_persist_concurrent(void) {
+  rbtree_persist *p = rbtree_persist_new();
+  for (key_t k = 0; k < PERSIST_KEYS; k += 2) {
+    rbtree_persist_insert(p, k);
+  }
+  atomic_int stop = 0;
+  persist_arg_t w = {p, &stop, 0};
+  persist_arg_t r[2] = {{p, &stop, 0}, {p, &stop, 0}};
+  pthread_t th[3];
+  pthread_create(&th[0], NULL, persist_writer, &w);
+  pthread_create(&th[1], NULL, persist_reader, &r[0]);
+  pthread_create(&th[2], NULL, persist_reader, &r[1]);
+  for (int i = 0; i < 3; i++) {
+    pthread_join(th[i], NULL);
+  }
+  assert(r[0].errors == 0 && r[1].errors == 0);
+  assert(atomic_load(&p->nodes) == PERSIST_KEYS / 2);
+  rbtree_persist_delete(p);
+}
+
+// the mapped image should have the same shape and colors as the saved tree
+static void mnode_check(const rbtree_mapped *m, const size_t i, const rbtree *t,
+                        const node_t *x) {
+  const rbtree_dnode_t *d = &m->nodes[i];
+  assert(i < m->n && d->key == x->key &&
+         d->meta == ((uint32_t)rbtree_count(x) << 1 | rbtree_color(x)));
+  assert((d->left == 0) == (rbtree_left(t, x) == t->nil));
+  assert((d->right == 0) == (rbtree_right(t, x) == t->nil));
+  assert(d->left == 0 || d->left == 1);  // preorder: left child comes next
+  if (d->left) {
+    mnode_check(m, i + d->left, t, rbtree_left(t, x));
+  }
+  if (d->right) {
+    mnode_check(m, i + d->right, t, rbtree_right(t, x));
+  }
+}
+
+// save, reopen and search the file directly; thaw back into a mutable tree
+void test_mmap(const size_t n, const key_t range, const unsigned int seed) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/test-rbtree-%d.rbt", (int)getpid());
+  srand(seed);
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  rbtree *t = random_tree(arr, n, range);
+  assert(rbtree_save(t, path));
+  rbtree_mapped *m = rbtree_open_mmap(path);
+  size_t nodes = 0;
+  for (node_t *p = rbtree_iter_begin(t); p != NULL; p = rbtree_iter_next(t, p)) {
+    nodes++;
+  }
+  assert(m != NULL && m->n == nodes);
+  if (n > 0) {
+    mnode_check(m, 0, t, t->root);
+  }
+
+  for (key_t k = -1; k <= range; k++) {
+    assert(rbtree_mapped_find(m, k) == (rbtree_find(t, k) != NULL));
+    key_t got;
+    node_t *lb = rbtree_lower_bound(t, k);
+    assert(rbtree_mapped_lower_bound(m, k, &got) == (lb != NULL));
+    assert(lb == NULL || got == lb->key);
+  }
+  key_t *out = calloc(n + 1, sizeof(key_t));
+  key_t *want = calloc(n + 1, sizeof(key_t));
+  for (int i = 0; i < 50; i++) {
+    const key_t lo = rand() % range, hi = lo + rand() % (range / 4 + 1);
+    const size_t cap = rand() % 2 ? n : 7;
+    const size_t got = rbtree_mapped_range(m, lo, hi, out, cap);
+    assert(got == rbtree_range(t, lo, hi, want, cap));
+    assert(memcmp(out, want, got * sizeof(key_t)) == 0);
+  }
+
+  rbtree *thawed = rbtree_mapped_thaw(m);
+  check_tree(thawed, arr, n);
+  rbtree_insert(thawed, range + 1);  // the copy is mutable, the file is not
+  assert(!rbtree_mapped_find(m, range + 1));
+  delete_rbtree(thawed);
+  rbtree_mapped_close(m);
+
+  // saving again replaces the file
+  delete_rbtree(t);
+  t = new_rbtree();
+  assert(rbtree_save(t, path));
+  m = rbtree_open_mmap(path);
+  assert(m != NULL && m->n == 0 && !rbtree_mapped_find(m, 0));
+  assert(rbtree_mapped_range(m, 0, range, out, n) == 0);
+  thawed = rbtree_mapped_thaw(m);
+  assert(thawed != NULL && thawed->root == thawed->nil);
+  delete_rbtree(thawed);
+  rbtree_mapped_close(m);
+
+  free(out);
+  free(want);
+  free(arr);
+  delete_rbtree(t);
+  unlink(path);
+}
+
+// files that are missing, truncated or of another format are rejected
+void test_mmap_invalid(void) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/test-rbtree-bad-%d.rbt", (int)getpid());
+  unlink(path);
+  assert(rbtree_open_mmap(path) == NULL);
+
+  rbtree *t = new_rbtree();
+  for (key_t k = 0; k < 100; k++) {
+    rbtree_insert(t, k);
+  }
+  assert(rbtree_save(t, path));
+  assert(truncate(path, sizeof(rbtree_dheader_t) + 99 * sizeof(rbtree_dnode_t)) == 0);
+  assert(rbtree_open_mmap(path) == NULL);
+
+  FILE *fp = fopen(path, "w");
+  fputs("not a tree, just some text that is long enough for a header.......", fp);
+  fclose(fp);
+  assert(rbtree_open_mmap(path) == NULL);
+
+  assert(!rbtree_save(t, "/nonexistent-dir/tree.rbt"));
+  delete_rbtree(t);
+  unlink(path);
+}
+
+// top-down insert / erase, alone and mixed with the bottom-up ones
+static size_t counts_to_sorted(const size_t *cnt, const key_t range, key_t *out) {
+  size_t m = 0;
+  for (key_t k = 0; k < range; k++) {
+    for (size_t c = 0; c < cnt[k]; c++) {
+      out[m++] = k;
+    }
+  }
+  return m;
+}
+
+void test_topdown(const size_t n, const key_t range, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  size_t *cnt = calloc(range, sizeof(size_t));
+  key_t *sorted = calloc(n + 1, sizeof(key_t));
+  // a node that is never erased must keep its address through all the moves
+  node_t *pinned = rbtree_insert_topdown(t, range);
+  assert(pinned != NULL && pinned->key == range);
+  for (size_t i = 0; i < n; i++) {
+    const key_t k = rand() % range;
+    const int op = rand() % 10;
+    if (op < 5) {
+      node_t *p = rbtree_insert_topdown(t, k);
+      assert(p != NULL && p->key == k);
+      cnt[k]++;
+    } else if (op < 6) {
+      rbtree_insert(t, k);
+      cnt[k]++;
+    } else if (op < 9) {
+      assert(rbtree_erase_topdown(t, k) == (cnt[k] > 0));
+      if (cnt[k] > 0) {
+        cnt[k]--;
+      }
+    } else {
+      node_t *p = rbtree_find(t, k);
+      assert((p != NULL) == (cnt[k] > 0));
+      if (p != NULL) {
+        rbtree_erase(t, p);
+        cnt[k]--;
+      }
+    }
+    if (i % 101 == 0) {
+      assert(rbtree_find(t, range) == pinned);
+      rbtree_erase_topdown(t, range);
+      const size_t m = counts_to_sorted(cnt, range, sorted);
+      check_tree(t, sorted, m);
+      pinned = rbtree_insert_topdown(t, range);
+    }
+  }
+  assert(rbtree_find(t, range) == pinned);
+  assert(rbtree_erase_topdown(t, range) == 1);
+  assert(rbtree_erase_topdown(t, range) == 0);
+  check_tree(t, sorted, counts_to_sorted(cnt, range, sorted));
+
+  // drain with top-down erase only
+  for (key_t k = 0; k < range; k++) {
+    while (cnt[k] > 0) {
+      assert(rbtree_erase_topdown(t, k) == 1);
+      cnt[k]--;
+    }
+    assert(rbtree_erase_topdown(t, k) == 0);
+  }
+  assert(t->root == t->nil);
+  assert(rbtree_erase_topdown(t, 0) == 0);
+
+  // ascending inserts exercise the same rotation side over and over
+  for (size_t i = 0; i < n; i++) {
+    sorted[i] = (key_t)i;
+    rbtree_insert_topdown(t, (key_t)i);
+  }
+  check_tree(t, sorted, n);
+  for (size_t i = n; i-- > 0;) {
+    assert(rbtree_erase_topdown(t, (key_t)i) == 1);
+  }
+  assert(t->root == t->nil);
+  free(sorted);
+  free(cnt);
+  delete_rbtree(t);
+}
+
+void test_conc_basic(void) {
+  rbtree_conc *c = rbtree_conc_new();
+  assert(!rbtree_conc_find(c, 1) && !rbtree_conc_erase(c, 1));
+  key_t arr[64];
+  for (key_t i = 0; i < 64; i++) {
+    arr[i] = i / 2;  // every key twice
+    assert(rbtree_conc_insert(c, (63 - i) / 2));
+  }
+  check_tree(c->tree, arr, 64);
+  for (key_t i = 0; i < 32; i++) {
+    assert(rbtree_conc_find(c, i) && rbtree_conc_erase(c, i));
+    assert(rbtree_conc_find(c, i) && rbtree_conc_erase(c, i));
+    assert(!rbtree_conc_find(c, i) && !rbtree_conc_erase(c, i));
+    check_tree(c->tree, arr + 2 * i + 2, 62 - 2 * i);
+  }
+  assert(c->tree->root == c->tree->nil);
+  rbtree_conc_delete(c);
+}
+
+/*
+  linearizability stress for rbtree_conc
+  - each writer owns the keys k with k % CONC_THREADS == id and keeps its own
+    count of them. Nobody else touches those keys, so in any linearization
+    every find / erase result is fixed by the writer's own history
+  - all writers also insert, find and erase the same few shared keys. Their
+    own copy must be visible from insert until their erase
+  - a reader checks that keys nobody erases are never missed
+  between phases every thread is joined and the tree must pass the same
+  checks as a single-threaded tree and hold exactly the modeled keys
+*/
+#define CONC_THREADS 4
+#define CONC_KEYS 4096
+#define CONC_SHARED 8
+#define CONC_STABLE 256
+#define CONC_OPS 20000
+
+typedef struct {
+  rbtree_conc *c;
+  int id;
+  unsigned seed;
+  atomic_int *stop;
+  size_t *cnt;  // this writer's count per key (only its own keys)
+  int errors;
+} conc_arg_t;
+
+static void *conc_writer(void *p) {
+  conc_arg_t *a = p;
+  for (int i = 0; i < CONC_OPS; i++) {
+    const unsigned r = rand_r(&a->seed);
+    if (r % 8 == 0) {
+      const key_t k = CONC_KEYS + r / 8 % CONC_SHARED;
+      a->errors += !rbtree_conc_insert(a->c, k);
+      a->errors += !rbtree_conc_find(a->c, k);
+      a->errors += !rbtree_conc_erase(a->c, k);
+      continue;
+    }
+    const key_t k = (key_t)(r / 8 % (CONC_KEYS / CONC_THREADS)) * CONC_THREADS + a->id;
+    switch (r % 3) {
+    case 0:
+      a->errors += !rbtree_conc_insert(a->c, k);
+      a->cnt[k]++;
+      break;
+    case 1:
+      a->errors += rbtree_conc_erase(a->c, k) != (a->cnt[k] > 0);
+      if (a->cnt[k] > 0) {
+        a->cnt[k]--;
+      }
+      break;
+    default:
+      a->errors += rbtree_conc_find(a->c, k) != (a->cnt[k] > 0);
+    }
+  }
+  return NULL;
+}
+
+static void *conc_reader(void *p) {
+  conc_arg_t *a = p;
+  for (key_t k = 0; !atomic_load_explicit(a->stop, memory_order_acquire); k = (k + 1) % CONC_STABLE) {
+    a->errors += !rbtree_conc_find(a->c, -1 - k);
+  }
+  return NULL;
+}
+
+void test_conc_stress(const int phases) {
+  rbtree_conc *c = rbtree_conc_new();
+  size_t *cnt = calloc(CONC_KEYS, sizeof(size_t));
+  key_t *expect = calloc(CONC_STABLE + 4 * CONC_OPS * phases, sizeof(key_t));
+  for (key_t k = 0; k < CONC_STABLE; k++) {
+    rbtree_conc_insert(c, -1 - k);
+  }
+  conc_arg_t w[CONC_THREADS + 1];
+  for (int ph = 0; ph < phases; ph++) {
+    atomic_int stop = 0;
+    pthread_t th[CONC_THREADS + 1];
+    for (int i = 0; i <= CONC_THREADS; i++) {
+      w[i] = (conc_arg_t){c, i, 101u * ph + i, &stop, cnt, 0};
+      pthread_create(&th[i], NULL, i < CONC_THREADS ? conc_writer : conc_reader, &w[i]);
+    }
+    for (int i = 0; i < CONC_THREADS; i++) {
+      pthread_join(th[i], NULL);
+    }
+    atomic_store_explicit(&stop, 1, memory_order_release);
+    pthread_join(th[CONC_THREADS], NULL);
+    for (int i = 0; i <= CONC_THREADS; i++) {
+      assert(w[i].errors == 0);
+    }
+
+    size_t m = 0;
+    for (key_t k = -CONC_STABLE; k < 0; k++) {
+      expect[m++] = k;
+    }
+    m += counts_to_sorted(cnt, CONC_KEYS, expect + m);
+    check_tree(c->tree, expect, m);
+  }
+  free(expect);
+  free(cnt);
+  rbtree_conc_delete(c);
+}
+
+// every live shard is a valid tree holding exactly its boundary range, and the
+// merged view matches the model
+static void check_sharded(rbtree_sharded *s, const key_t *sorted, const size_t n) {
+  assert(s->live >= 1 && s->live <= s->n && s->shards[0].lo == INT_MIN);
+  size_t off = 0;
+  for (size_t i = 0; i < s->live; i++) {
+    size_t m = 0;
+    while (off + m < n && (i + 1 == s->live || sorted[off + m] < s->shards[i + 1].lo)) {
+      assert(sorted[off + m] >= s->shards[i].lo);
+      m++;
+    }
+    if (i + 1 < s->live) {
+      assert(s->shards[i].lo < s->shards[i + 1].lo);
+    }
+    check_tree(s->shards[i].tree, sorted + off, m);
+    off += m;
+  }
+  assert(off == n);
+  for (size_t i = s->live; i < s->n; i++) {  // spares stay empty
+    assert(s->shards[i].tree->root == s->shards[i].tree->nil);
+  }
+
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_sharded_to_array(s, res, n + 1) == (n > 0));
+  assert(n == 0 || memcmp(res, sorted, n * sizeof(key_t)) == 0);
+  key_t k;
+  assert(rbtree_sharded_min(s, &k) == (n > 0) && (n == 0 || k == sorted[0]));
+  assert(rbtree_sharded_max(s, &k) == (n > 0) && (n == 0 || k == sorted[n - 1]));
+  free(res);
+}
+
+void test_sharded_basic(void) {
+  rbtree_sharded *s = rbtree_sharded_new(4);
+  assert(rbtree_sharded_new(0) == NULL);
+  check_sharded(s, NULL, 0);
+  assert(!rbtree_sharded_find(s, 0) && !rbtree_sharded_erase(s, 0));
+
+  // keys spread over the whole key space land in every shard
+  const key_t keys[] = {INT_MIN, -1000000000, -5, 0, 7, 1000000000, INT_MAX};
+  const size_t n = sizeof(keys) / sizeof(keys[0]);
+  for (size_t i = n; i-- > 0;) {
+    assert(rbtree_sharded_insert(s, keys[i]));
+  }
+  check_sharded(s, keys, n);
+  for (size_t i = 0; i < s->live; i++) {
+    assert(s->shards[i].tree->root != s->shards[i].tree->nil);
+  }
+  key_t out[8];
+  assert(rbtree_sharded_range(s, -10, 10, out, 8) == 3 && out[0] == -5 && out[2] == 7);
+  assert(rbtree_sharded_range(s, -10, 10, out, 2) == 2 && out[1] == 0);
+  assert(rbtree_sharded_range(s, 10, -10, out, 8) == 0);
+  assert(rbtree_sharded_range(s, INT_MIN, INT_MAX, out, 8) == n);
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_sharded_find(s, keys[i]) && rbtree_sharded_erase(s, keys[i]));
+    assert(!rbtree_sharded_find(s, keys[i]));
+    check_sharded(s, keys + i + 1, n - i - 1);
+  }
+  assert(rbtree_sharded_rebalance(s) == 0);  // no writes since the last check
+  rbtree_sharded_delete(s);
+}
+
+static size_t sharded_expect(const size_t *cnt, const key_t range, key_t *out) {
+  const size_t m = counts_to_sorted(cnt, range, out);
+  for (size_t i = 0; i < m; i++) {
+    out[i] += 1000;
+  }
+  return m;
+}
+
+/*
+  all keys fall into one shard's range. Every RBTREE_SHARD_PERIOD writes the
+  hot shard is split and two idle shards are merged, so the narrow range ends
+  up spread over several shards while the contents stay the same
+*/
+void test_sharded_skew(const size_t n, const key_t range, const unsigned int seed) {
+  srand(seed);
+  rbtree_sharded *s = rbtree_sharded_new(8);
+  size_t *cnt = calloc(range, sizeof(size_t));
+  key_t *sorted = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    const key_t k = rand() % range;
+    assert(rbtree_sharded_insert(s, 1000 + k));
+    cnt[k]++;
+  }
+  size_t m = sharded_expect(cnt, range, sorted);
+  check_sharded(s, sorted, m);
+  assert(s->live == s->n);
+  size_t hot = 0;
+  for (size_t i = 0; i < s->live; i++) {
+    hot += s->shards[i].lo > 1000 && s->shards[i].lo < 1000 + range;
+  }
+  assert(hot > 0);
+
+  // range scans across the new boundaries
+  key_t *out = calloc(m, sizeof(key_t));
+  for (int r = 0; r < 20; r++) {
+    const key_t lo = 1000 + rand() % range, hi = lo + rand() % (range / 4);
+    size_t first = 0, last;
+    while (first < m && sorted[first] < lo) {
+      first++;
+    }
+    for (last = first; last < m && sorted[last] <= hi; last++) {
+    }
+    assert(rbtree_sharded_range(s, lo, hi, out, m) == last - first);
+    assert(memcmp(out, sorted + first, (last - first) * sizeof(key_t)) == 0);
+  }
+
+  // erasing everything keeps the boundaries valid
+  for (key_t k = 0; k < range; k++) {
+    for (; cnt[k] > 0; cnt[k]--) {
+      assert(rbtree_sharded_erase(s, 1000 + k));
+    }
+    assert(!rbtree_sharded_erase(s, 1000 + k));
+    if (k % (range / 8) == 0) {
+      m = sharded_expect(cnt, range, sorted);
+      check_sharded(s, sorted, m);
+    }
+  }
+  check_sharded(s, NULL, 0);
+  free(out);
+  free(sorted);
+  free(cnt);
+  rbtree_sharded_delete(s);
+}
+
+/*
+  writers own the keys k with k % CONC_THREADS == id, all inside one shard's
+  range so boundaries move while they write. A reader checks that every
+  merged scan is sorted and always holds the stable keys below that range
+*/
+typedef struct {
+  rbtree_sharded *s;
+  int id;
+  unsigned seed;
+  atomic_int *stop;
+  size_t *cnt;
+  int errors;
+} sharded_arg_t;
+
+static void *sharded_writer(void *p) {
+  sharded_arg_t *a = p;
+  for (int i = 0; i < CONC_OPS; i++) {
+    const unsigned r = rand_r(&a->seed);
+    const key_t k = (key_t)(r / 4 % (CONC_KEYS / CONC_THREADS)) * CONC_THREADS + a->id;
+    switch (r % 4) {
+    case 0:
+    case 1:
+      a->errors += !rbtree_sharded_insert(a->s, k);
+      a->cnt[k]++;
+      break;
+    case 2:
+      a->errors += rbtree_sharded_erase(a->s, k) != (a->cnt[k] > 0);
+      if (a->cnt[k] > 0) {
+        a->cnt[k]--;
+      }
+      break;
+    default:
+      a->errors += rbtree_sharded_find(a->s, k) != (a->cnt[k] > 0);
+    }
+  }
+  return NULL;
+}
+
+#define SHARDED_BUF (CONC_STABLE + CONC_THREADS * CONC_OPS)
+
+static void *sharded_reader(void *p) {
+  sharded_arg_t *a = p;
+  key_t *buf = calloc(SHARDED_BUF, sizeof(key_t));
+  while (!atomic_load_explicit(a->stop, memory_order_acquire)) {
+    const size_t got = rbtree_sharded_range(a->s, INT_MIN, INT_MAX, buf, SHARDED_BUF);
+    a->errors += got < CONC_STABLE || buf[0] != -CONC_STABLE || buf[CONC_STABLE - 1] != -1;
+    for (size_t i = 1; i < got; i++) {
+      a->errors += buf[i - 1] > buf[i];
+    }
+    key_t k;
+    a->errors += !rbtree_sharded_min(a->s, &k) || k != -CONC_STABLE;
+    a->errors += !rbtree_sharded_find(a->s, -1 - (key_t)(got % CONC_STABLE));
+  }
+  free(buf);
+  return NULL;
+}
+
+void test_sharded_concurrent(void) {
+  rbtree_sharded *s = rbtree_sharded_new(8);
+  size_t *cnt = calloc(CONC_KEYS, sizeof(size_t));
+  key_t *expect = calloc(SHARDED_BUF, sizeof(key_t));
+  for (key_t k = 0; k < CONC_STABLE; k++) {
+    rbtree_sharded_insert(s, -1 - k);
+  }
+  atomic_int stop = 0;
+  sharded_arg_t w[CONC_THREADS + 1];
+  pthread_t th[CONC_THREADS + 1];
+  for (int i = 0; i <= CONC_THREADS; i++) {
+    w[i] = (sharded_arg_t){s, i, 211u + i, &stop, cnt, 0};
+    pthread_create(&th[i], NULL, i < CONC_THREADS ? sharded_writer : sharded_reader, &w[i]);
+  }
+  for (int i = 0; i < CONC_THREADS; i++) {
+    pthread_join(th[i], NULL);
+  }
+  atomic_store_explicit(&stop, 1, memory_order_release);
+  pthread_join(th[CONC_THREADS], NULL);
+  for (int i = 0; i <= CONC_THREADS; i++) {
+    assert(w[i].errors == 0);
+  }
+  size_t m = 0;
+  for (key_t k = -CONC_STABLE; k < 0; k++) {
+    expect[m++] = k;
+  }
+  m += counts_to_sorted(cnt, CONC_KEYS, expect + m);
+  check_sharded(s, expect, m);
+  free(expect);
+  free(cnt);
+  rbtree_sharded_delete(s);
+}
+
+/*
+  the parallel bulk operations must give exactly what the sequential ones
+  give: same keys, same truncation, and from_sorted_par the same shape
+*/
+static void check_same_shape(const rbtree *a, const node_t *x, const rbtree *b, const node_t *y) {
+  assert((x == a->nil) == (y == b->nil));
+  if (x == a->nil) {
+    return;
+  }
+  assert(x->key == y->key && rbtree_color(x) == rbtree_color(y));
+  assert(rbtree_count(x) == rbtree_count(y));
+  check_same_shape(a, rbtree_left(a, x), b, rbtree_left(b, y));
+  check_same_shape(a, rbtree_right(a, x), b, rbtree_right(b, y));
+}
+
+void test_parallel(const size_t n, const int threads, const unsigned int seed) {
+  srand(seed);
+  rbtree_workers *w = rbtree_workers_new(threads);
+  assert(w != NULL && w->threads >= 1 && w->threads <= threads);
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 2 + 1);
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  rbtree *t = rbtree_from_sorted_par(w, arr, n);
+  rbtree *s = rbtree_from_sorted(arr, n);
+  check_tree(t, arr, n);
+  check_same_shape(t, t->root, s, s->root);
+  delete_rbtree(s);
+
+  assert(rbtree_to_array_par(w, t, res, n + 1) == (n > 0));
+  assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  for (size_t cut = 0; cut < n; cut += n / 7 + 1) {
+    res[cut] = -1;
+    assert(rbtree_to_array_par(w, t, res, cut) == (cut > 0));
+    assert(memcmp(res, arr, cut * sizeof(key_t)) == 0 && res[cut] == -1);
+  }
+  delete_rbtree_par(w, t);
+
+  // a tree grown by inserts has a different shape and pool chunks
+  t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, arr[(i * 7919) % n]);
+  }
+  memset(res, 0, (n + 1) * sizeof(key_t));
+  assert(rbtree_to_array_par(w, t, res, n) == (n > 0));
+  assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  delete_rbtree_par(w, t);
+
+  free(res);
+  free(arr);
+  rbtree_workers_delete(w);
+}
+
+/*
+  the B+tree engine: every non-root node at least half full, keys sorted
+  and inside the parent's separators, all leaves at the same depth and
+  chained left to right. size and the contents must follow a count model
+*/
+static size_t check_bnode(const bnode_t *x, const int depth, const int height, const bool root,
+                          const key_t *lo, const key_t *hi, const bnode_t **leaf) {
+  assert(x->n <= RBTREE_BTREE_KEYS);
+  if (!root) {
+    assert(x->n >= (x->leaf ? RBTREE_BTREE_KEYS / 2 : RBTREE_BTREE_KEYS / 2 - 1));
+  }
+  for (uint32_t i = 0; i < x->n; i++) {
+    assert(i == 0 || x->keys[i - 1] < x->keys[i]);
+    assert(lo == NULL || *lo <= x->keys[i]);
+    assert(hi == NULL || x->keys[i] < *hi);
+  }
+  if (x->leaf) {
+    assert(depth == height);
+    assert(*leaf == x);
+    *leaf = x->next;
+    size_t size = 0;
+    for (uint32_t i = 0; i < x->n; i++) {
+      assert(x->count[i] >= 1);
+      size += x->count[i];
+    }
+    return size;
+  }
+  size_t size = 0;
+  for (uint32_t i = 0; i <= x->n; i++) {
+    size += check_bnode(x->child[i], depth + 1, height, false, i > 0 ? &x->keys[i - 1] : lo,
+                        i < x->n ? &x->keys[i] : hi, leaf);
+  }
+  return size;
+}
+
+static void check_btree(const rbtree_btree *b, const int *cnt, const key_t range) {
+  const bnode_t *leaf = b->head;
+  assert(check_bnode(b->root, 1, b->height, true, NULL, NULL, &leaf) == b->size);
+  assert(leaf == NULL);
+
+  key_t *arr = calloc(b->size + 1, sizeof(key_t));
+  size_t n = 0;
+  for (key_t k = 0; k < range; k++) {
+    assert(rbtree_btree_find(b, k) == (cnt[k] > 0));
+    for (int c = 0; c < cnt[k]; c++) {
+      arr[n++] = k;
+    }
+  }
+  assert(n == b->size);
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_btree_to_array(b, res, n + 1) == (n > 0));
+  assert(memcmp(res, arr, n * sizeof(key_t)) == 0);
+  key_t k;
+  assert(rbtree_btree_min(b, &k) == (n > 0) && (n == 0 || k == arr[0]));
+  assert(rbtree_btree_max(b, &k) == (n > 0) && (n == 0 || k == arr[n - 1]));
+  free(res);
+  free(arr);
+}
+
+void test_btree(const size_t n, const key_t range, const unsigned int seed) {
+  srand(seed);
+  rbtree_btree *b = rbtree_btree_new();
+  assert(b != NULL && b->size == 0 && b->height == 1);
+  int *cnt = calloc(range, sizeof(int));
+  check_btree(b, cnt, range);
+  assert(rbtree_btree_erase(b, 0) == 0);
+  assert(!rbtree_btree_find(b, INT_MIN) && !rbtree_btree_find(b, INT_MAX));
+
+  // grow, then shrink to empty with inserts mixed in so nodes both split and merge
+  for (size_t i = 0; i < n; i++) {
+    const key_t k = rand() % range;
+    assert(rbtree_btree_insert(b, k));
+    cnt[k]++;
+    if (i % (n / 8 + 1) == 0) {
+      check_btree(b, cnt, range);
+    }
+  }
+  check_btree(b, cnt, range);
+  assert(!rbtree_btree_find(b, -1) && !rbtree_btree_find(b, range));
+  while (b->size > 0) {
+    key_t k = rand() % range;
+    if (cnt[k] == 0) {
+      assert(rbtree_btree_erase(b, k) == 0);
+      while (cnt[k] == 0) {
+        k = (k + 1) % range;
+      }
+    }
+    assert(rbtree_btree_erase(b, k));
+    cnt[k]--;
+    if (rand() % 4 == 0) {
+      const key_t j = rand() % range;
+      assert(rbtree_btree_insert(b, j));
+      cnt[j]++;
+    }
+    if (b->size % (n / 8 + 1) == 0) {
+      check_btree(b, cnt, range);
+    }
+  }
+  check_btree(b, cnt, range);
+  assert(b->height == 1);
+
+  // ascending and descending runs split and merge only at one edge
+  for (key_t k = 0; k < range; k++) {
+    assert(rbtree_btree_insert(b, k));
+    cnt[k]++;
+  }
+  check_btree(b, cnt, range);
+  for (key_t k = range - 1; k >= 0; k--) {
+    assert(rbtree_btree_erase(b, k));
+    cnt[k]--;
+  }
+  check_btree(b, cnt, range);
+  rbtree_btree_delete(b);
+  free(cnt);
+}
+
+#ifndef RBTREE_NO_POOL
+/*
+  a static tree lives only in the caller's buffer: sentinel at buf[0],
+  every node inside buf, inserts past capacity return NULL and leave the
+  tree intact, erased nodes are reused, and operations that would hand
+  nodes to another pool refuse
+*/
+static void check_in_buffer(const rbtree *t, const node_t *buf, const size_t cap) {
+  assert(t->nil == buf);
+  for (node_t *p = rbtree_iter_begin(t); p != NULL; p = rbtree_iter_next(t, p)) {
+    assert(p > buf && p < buf + cap);
+  }
+}
+
+void test_static(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree st;
+  node_t one;
+  assert(rbtree_init_static(&st, &one, 0) == 0);
+  assert(rbtree_init_static(&st, &one, 1) == 1);  // the sentinel only
+  assert(rbtree_insert(&st, 1) == NULL && st.root == st.nil);
+
+  const size_t cap = RBTREE_STATIC_NODES(n);
+  node_t *buf = calloc(cap, sizeof(node_t));
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_init_static(&st, buf, cap));
+  check_tree(&st, NULL, 0);
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (key_t)(4 * n);
+    if (i % 2) {
+      assert(rbtree_insert(&st, arr[i]) != NULL);
+    } else {
+      assert(rbtree_insert_topdown(&st, arr[i]) != NULL);
+    }
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  check_tree(&st, arr, n);
+  check_in_buffer(&st, buf, cap);
+
+  // full: no allocation, the tree is untouched
+#ifndef RBTREE_MULTISET
+  const unsigned long version = st.version;
+  assert(rbtree_insert(&st, arr[0]) == NULL);
+  assert(rbtree_insert_topdown(&st, arr[n - 1]) == NULL);
+  assert(rbtree_insert(&st, -1) == NULL && st.version == version);
+  check_tree(&st, arr, n);
+#endif
+
+  // erased nodes go back to the buffer's free list
+  for (size_t round = 0; round < 4; round++) {
+    for (size_t i = round % 2; i < n; i += 2) {
+      rbtree_erase(&st, rbtree_find(&st, arr[i]));
+    }
+    for (size_t i = round % 2; i < n; i += 2) {
+      assert(rbtree_insert(&st, arr[i]) != NULL);
+    }
+    check_tree(&st, arr, n);
+    check_in_buffer(&st, buf, cap);
+  }
+
+  // nothing moves between a static tree and a pooled one
+  rbtree *h = new_rbtree();
+  rbtree_insert(h, 5 * (key_t)n);
+  assert(rbtree_join(&st, 4 * (key_t)n, h) == NULL);
+  assert(rbtree_join(h, -2, &st) == NULL);
+  assert(rbtree_split(&st, arr[n / 2], h) == 0);
+  assert(rbtree_union(&st, h) == 0 && rbtree_union(h, &st) == 0);
+  check_tree(&st, arr, n);
+  assert(rbtree_find(h, 5 * (key_t)n) != NULL);
+  delete_rbtree(h);
+
+  // init again: empty, and the whole buffer is available
+  assert(rbtree_init_static(&st, buf, cap));
+  check_tree(&st, NULL, 0);
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_insert(&st, (key_t)i) != NULL);
+  }
+  assert(rbtree_insert(&st, (key_t)n) == NULL);
+  check_in_buffer(&st, buf, cap);
+  free(arr);
+  free(buf);
+}
+#endif
+
+#ifdef RBTREE_INTERVAL
+typedef struct {
+  key_t lo, hi;
+} span_t;
+
+static int comp_span(const void *p1, const void *p2) {
+  const span_t *a = p1, *b = p2;
+  if (a->lo != b->lo) return (a->lo > b->lo) - (a->lo < b->lo);
+  return (a->hi > b->hi) - (a->hi < b->hi);
+}
+
+typedef struct {
+  span_t *out;
+  size_t n, stop;  // stop after this many (0 : never)
+} span_sink_t;
+
+static int collect_span(const node_t *p, void *arg) {
+  span_sink_t *s = arg;
+  assert(s->n == 0 || s->out[s->n - 1].lo <= p->key);  // key order
+  s->out[s->n].lo = p->key;
+  s->out[s->n].hi = p->hi;
+  s->n++;
+  return s->stop != 0 && s->n == s->stop;
+}
+
+// rbtree_overlaps should report exactly the intervals of all[0..m) meeting [a, b]
+static void check_overlaps(const rbtree *t, const span_t *all, const size_t m,
+                           const key_t a, const key_t b) {
+  span_t *expect = calloc(m + 1, sizeof(span_t));
+  span_t *got = calloc(m + 1, sizeof(span_t));
+  size_t e = 0;
+  for (size_t i = 0; i < m; i++) {
+    if (all[i].lo <= b && all[i].hi >= a) expect[e++] = all[i];
+  }
+  span_sink_t sink = {got, 0, 0};
+  assert(rbtree_overlaps(t, a, b, collect_span, &sink) == e && sink.n == e);
+  qsort(expect, e, sizeof(span_t), comp_span);
+  qsort(got, e, sizeof(span_t), comp_span);
+  assert(memcmp(expect, got, e * sizeof(span_t)) == 0);
+
+  // a nonzero return from visit stops the walk
+  sink.n = 0;
+  sink.stop = 1;
+  assert(rbtree_overlaps(t, a, b, collect_span, &sink) == (e > 0));
+  free(got);
+  free(expect);
+}
+
+// overlap queries should match a brute-force scan through inserts, erases and a split
+void test_interval(const size_t n, const size_t queries, const unsigned int seed) {
+  srand(seed);
+  const key_t range = (key_t)(n * 4);
+  rbtree *t = new_rbtree();
+  span_t *all = calloc(n, sizeof(span_t));
+  node_t **nodes = calloc(n, sizeof(node_t *));
+  key_t *sorted = calloc(n, sizeof(key_t));
+
+  assert(rbtree_overlaps(t, 0, range, collect_span, NULL) == 0);
+  assert(rbtree_insert_interval(t, 5, 4) == NULL);
+  for (size_t i = 0; i < n; i++) {
+    all[i].lo = rand() % range;
+    all[i].hi = all[i].lo + (i % 4 == 0 ? 0 : rand() % (range / 16 + 1));
+    nodes[i] = i % 4 == 0 ? rbtree_insert(t, all[i].lo)
+                          : rbtree_insert_interval(t, all[i].lo, all[i].hi);
+    assert(nodes[i] != NULL && nodes[i]->key == all[i].lo && nodes[i]->hi == all[i].hi);
+  }
+  for (size_t i = 0; i < n; i++) sorted[i] = all[i].lo;
+  qsort(sorted, n, sizeof(key_t), comp);
+  check_tree(t, sorted, n);
+  for (size_t q = 0; q < queries; q++) {
+    const key_t a = rand() % range;
+    check_overlaps(t, all, n, a, q % 2 ? a : a + rand() % (range / 8 + 1));
+  }
+  check_overlaps(t, all, n, INT_MIN, INT_MAX);
+  assert(rbtree_overlaps(t, 2, 1, collect_span, NULL) == 0);
+
+  // erase every third interval (the ends shrink through transplant and erase_fixup)
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (i % 3 == 0) {
+      rbtree_erase(t, nodes[i]);
+    } else {
+      all[m++] = all[i];
+    }
+  }
+  for (size_t i = 0; i < m; i++) sorted[i] = all[i].lo;
+  qsort(sorted, m, sizeof(key_t), comp);
+  check_tree(t, sorted, m);
+  for (size_t q = 0; q < queries; q++) {
+    const key_t a = rand() % range;
+    check_overlaps(t, all, m, a, a + rand() % (range / 8 + 1));
+  }
+
+  // split keeps each interval's end, on both sides
+  qsort(all, m, sizeof(span_t), comp_span);
+  const key_t k = m > 0 ? all[m / 2].lo : 0;
+  size_t lo = 0;
+  while (lo < m && all[lo].lo < k) lo++;
+  rbtree *r = new_rbtree();
+  assert(rbtree_split(t, k, r));
+  check_tree(t, sorted, lo);
+  check_tree(r, sorted + lo, m - lo);
+  for (size_t q = 0; q < queries / 4; q++) {
+    const key_t a = rand() % range;
+    const key_t b = a + rand() % (range / 8 + 1);
+    check_overlaps(t, all, lo, a, b);
+    check_overlaps(r, all + lo, m - lo, a, b);
+  }
+  delete_rbtree(r);
+  delete_rbtree(t);
+  free(sorted);
+  free(nodes);
+  free(all);
+}
+#endif
+
+#ifdef RBTREE_STATS
+static size_t tree_height(const rbtree *t, const node_t *p) {
+  if (p == t->nil) {
+    return 0;
+  }
+  const size_t l = tree_height(t, rbtree_left(t, p));
+  const size_t r = tree_height(t, rbtree_right(t, p));
+  return (l > r ? l : r) + 1;
+}
+
+// every rotation comes from exactly one fixup case
+void test_stats(const size_t n, const unsigned int seed) {
+  rbtree *t = new_rbtree();
+  rbtree_stats_t st;
+  rbtree_stats(t, &st);
+  assert(st.allocs == 1 && st.frees == 0);  // the sentinel
+  assert(st.height == 0 && st.black_height == 0 && st.inserts == 0);
+
+  srand(seed);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % (n * 4);
+    rbtree_insert(t, arr[i]);
+  }
+  rbtree_stats(t, &st);
+  assert(st.inserts == n && st.allocs == n + 1);
+  assert(st.rotate_left + st.rotate_right == st.insert_case[1] + st.insert_case[2]);
+  assert(st.insert_case[1] <= st.insert_case[2] && st.insert_case[0] > 0);
+  assert(st.height == tree_height(t, t->root));
+  assert(st.insert_depth_max > 0 && st.insert_depth_sum >= n && st.finds == 0);
+  size_t bh = 0;
+  for (const node_t *p = t->root; p != t->nil; p = rbtree_right(t, p)) {
+    bh += rbtree_color(p) == RBTREE_BLACK;
+  }
+  assert(st.black_height == bh && bh > 0 && st.height <= 2 * bh);
+
+  const size_t rotations = st.rotate_left + st.rotate_right;
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_find(t, arr[i]) != NULL);
+  }
+  assert(rbtree_find(t, -1) == NULL);
+  rbtree_stats_t after;
+  rbtree_stats(t, &after);
+  assert(after.finds == n + 1 && after.find_depth_max <= st.height);
+  assert(after.find_depth_sum >= n && after.find_depth_sum <= (n + 1) * st.height);
+  assert(after.rotate_left + after.rotate_right == rotations);  // finds do not rotate
+
+  for (size_t i = 0; i < n; i++) {
+    rbtree_erase(t, rbtree_find(t, arr[i]));
+  }
+  rbtree_stats(t, &after);
+  assert(after.frees == n && after.height == 0 && after.black_height == 0);
+  assert(after.rotate_left + after.rotate_right - rotations ==
+         after.erase_case[0] + after.erase_case[2] + after.erase_case[3]);
+  assert(after.erase_case[1] > 0 && after.erase_case[3] > 0);
+  free(arr);
+  delete_rbtree(t);
+}
+#endif
+
+#ifdef RBTREE_MULTISET
+// equal keys share one node; insert/erase only move its count
+void test_multiset(const size_t n, const key_t range, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  size_t *occur = calloc(range, sizeof(size_t));
+  node_t **first = calloc(range, sizeof(node_t *));
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+    node_t *p = rbtree_insert(t, arr[i]);
+    assert(first[arr[i]] == NULL || first[arr[i]] == p);
+    first[arr[i]] = p;
+    occur[arr[i]]++;
+    assert(rbtree_count(p) == occur[arr[i]]);
+  }
+  size_t distinct = 0;
+  for (node_t *p = rbtree_iter_begin(t); p != NULL; p = rbtree_iter_next(t, p)) {
+    assert(rbtree_count(p) == occur[p->key] && first[p->key] == p);
+    distinct++;
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  check_tree(t, arr, n);
+
+  // from_sorted collapses runs the same way
+  rbtree *b = rbtree_from_sorted(arr, n);
+  check_tree(b, arr, n);
+  size_t b_nodes = 0;
+  for (node_t *p = rbtree_iter_begin(b); p != NULL; p = rbtree_iter_next(b, p)) {
+    assert(rbtree_count(p) == occur[p->key]);
+    b_nodes++;
+  }
+  assert(b_nodes == distinct);
+  delete_rbtree(b);
+
+  // erase takes one key at a time; the node stays until its last key
+  for (size_t i = 0; i < n; i++) {
+    node_t *p = rbtree_find(t, arr[i]);
+    assert(p == first[arr[i]] && rbtree_count(p) == occur[arr[i]]);
+    rbtree_erase(t, p);
+    if (--occur[arr[i]] > 0) {
+      assert(rbtree_find(t, arr[i]) == p);
+    } else {
+      assert(rbtree_find(t, arr[i]) == NULL);
+    }
+    if (i % 97 == 0) {
+      check_tree(t, arr + i + 1, n - i - 1);
+    }
+  }
+  assert(t->root == t->nil);
+  free(arr);
+  free(first);
+  free(occur);
+  delete_rbtree(t);
+
+  // the seqlock reader copies a key once per occurrence, like rbtree_range
+  rbtree_sync *s = rbtree_sync_new();
+  key_t out[4];
+  for (int i = 0; i < 3; i++) {
+    assert(rbtree_sync_insert(s, 5));
+  }
+  assert(rbtree_sync_insert(s, 7));
+  assert(rbtree_range(s->tree, 0, 10, out, 4) == 4);
+  assert(rbtree_sync_range(s, 0, 10, out, 4) == 4);
+  assert(out[0] == 5 && out[1] == 5 && out[2] == 5 && out[3] == 7);
+  assert(rbtree_sync_range(s, 0, 10, out, 2) == 2 && out[1] == 5);
+  rbtree_sync_delete(s);
+}
+#endif
+
+#ifdef RBTREE_LAZY_DELETE
+// keys of the live nodes, in order, from the count model
+static size_t lazy_model(const size_t *occur, const key_t range, key_t *out) {
+  size_t n = 0;
+  for (key_t k = 0; k < range; k++) {
+    for (size_t c = 0; c < occur[k]; c++) {
+      out[n++] = k;
+    }
+  }
+  return n;
+}
+
+/*
+  erase_lazy only marks nodes: the shape stays, every read skips the marks,
+  insert revives a mark with the same key, and compact removes them all
+  without moving the live nodes
+*/
+void test_lazy(const size_t n, const key_t range, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  size_t *occur = calloc(range, sizeof(size_t));
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    const key_t k = rand() % range;
+    assert(rbtree_insert(t, k) != NULL);
+    occur[k]++;
+  }
+
+  // 1. erase half through find; the auto compaction keeps the ratio bounded
+  for (size_t i = 0; i < n / 2; i++) {
+    const key_t k = rand() % range;
+    node_t *p = rbtree_find(t, k);
+    assert((p != NULL) == (occur[k] > 0));
+    if (p == NULL) {
+      continue;
+    }
+    assert(!rbtree_is_dead(p) && p->key == k);
+    rbtree_erase_lazy(t, p);
+    occur[k]--;
+    assert(RBTREE_TOMBSTONE_RATIO == 0 || t->dead * 100 <= (t->nodes - 1) * RBTREE_TOMBSTONE_RATIO);
+    if (i % (n / 8 + 1) == 0) {
+      check_tree(t, arr, lazy_model(occur, range, arr));
+    }
+  }
+  size_t m = lazy_model(occur, range, arr);
+  check_tree(t, arr, m);
+
+  // save writes only the live keys while tombstones are still in the tree
+  assert(t->dead > 0);
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/test-rbtree-lazy-%d.rbt", (int)getpid());
+  assert(rbtree_save(t, path));
+  rbtree_mapped *mp = rbtree_open_mmap(path);
+  assert(mp != NULL);
+  key_t *saved = calloc(m + 1, sizeof(key_t));
+  assert(rbtree_mapped_range(mp, INT_MIN, INT_MAX, saved, m + 1) == m);
+  assert(memcmp(saved, arr, m * sizeof(key_t)) == 0);
+  for (key_t k = -1; k <= range; k++) {
+    assert(rbtree_mapped_find(mp, k) == (k >= 0 && k < range && occur[k] > 0));
+  }
+  free(saved);
+  rbtree_mapped_close(mp);
+  unlink(path);
+
+  for (key_t k = -1; k <= range; k++) {
+    const int live = k >= 0 && k < range && occur[k] > 0;
+    node_t *p = rbtree_find(t, k);
+    assert((p != NULL) == live && (p == NULL || !rbtree_is_dead(p)));
+    node_t *out = NULL;
+    assert(rbtree_find_many(t, &k, 1, &out) == (size_t)live && out == p);
+    node_t *lb = rbtree_lower_bound(t, k);
+    const key_t *want = arr;
+    while (want < arr + m && *want < k) want++;
+    assert(want == arr + m ? lb == NULL : lb != NULL && lb->key == *want);
+  }
+  key_t buf[64];
+  const size_t got = rbtree_range(t, range / 4, range / 2, buf, 64);
+  for (size_t i = 0; i < got; i++) {
+    assert(occur[buf[i]] > 0 && buf[i] >= range / 4 && buf[i] <= range / 2);
+  }
+
+  // 2. the smallest key alone: min skips its tombstone, insert revives the same node
+  while (t->root != t->nil && rbtree_min(t)->key == arr[0] && occur[arr[0]] > 1) {
+    rbtree_erase(t, rbtree_min(t));
+    occur[arr[0]]--;
+  }
+  m = lazy_model(occur, range, arr);
+  if (m > 1) {
+    node_t *p = rbtree_min(t);
+    const size_t dead = t->dead;
+    rbtree_erase_lazy(t, p);
+    if (t->dead == dead + 1) {  // not compacted away
+      assert(rbtree_is_dead(p) && rbtree_min(t)->key == arr[1] && rbtree_find(t, arr[0]) == NULL);
+      assert(rbtree_iter_prev(t, rbtree_min(t)) == NULL);
+      assert(rbtree_insert(t, arr[0]) == p && !rbtree_is_dead(p) && t->dead == dead);
+    } else {
+      assert(rbtree_insert(t, arr[0]) != NULL);
+    }
+    check_tree(t, arr, m);
+  }
+
+  // 3. compact removes exactly the tombstones and keeps live node pointers
+  node_t *keep = rbtree_max(t);
+  const key_t keep_key = keep == NULL ? 0 : keep->key;
+  const size_t dead = t->dead;
+  assert(rbtree_compact(t) == dead && t->dead == 0);
+  assert(rbtree_compact(t) == 0);
+  check_tree(t, arr, m);
+  assert(keep == NULL || (rbtree_max(t) == keep && keep->key == keep_key));
+
+  // 4. join / split / topdown start by flushing the tombstones
+  for (size_t i = 0; i < m; i += 3) {
+    rbtree_erase_lazy(t, rbtree_find(t, arr[i]));
+    occur[arr[i]]--;
+  }
+  m = lazy_model(occur, range, arr);
+  rbtree *r = new_rbtree();
+  assert(rbtree_split(t, range / 2, r) && t->dead == 0);
+  size_t lo = 0;
+  while (lo < m && arr[lo] < range / 2) lo++;
+  check_tree(t, arr, lo);
+  check_tree(r, arr + lo, m - lo);
+  for (node_t *p = rbtree_iter_begin(r), *next; p != NULL; p = next) {
+    next = rbtree_iter_next(r, p);  // p itself may be compacted away
+    if (p->key % 2 == 0) {
+      occur[p->key]--;
+      rbtree_erase_lazy(r, p);
+    }
+  }
+  assert(rbtree_join(t, range / 2, r) != NULL);
+  occur[range / 2]++;
+  m = lazy_model(occur, range, arr);
+  check_tree(t, arr, m);
+  check_tree(r, NULL, 0);
+  delete_rbtree(r);
+
+  // 5. erase everything lazily
+  for (node_t *p = rbtree_iter_begin(t); p != NULL; p = rbtree_iter_begin(t)) {
+    rbtree_erase_lazy(t, p);
+  }
+  check_tree(t, NULL, 0);
+  assert(t->root == t->nil || rbtree_min(t) == NULL);
+  rbtree_compact(t);
+  assert(t->root == t->nil && t->nodes == 1 && t->dead == 0);
+
+  free(arr);
+  free(occur);
+  delete_rbtree(t);
+}
+#endif
+
+int main(void) {
+  test_init();
+#ifdef MALLOC_FAILURE_TEST
+  test_init_alloc_failure();
+#endif
+  test_insert_single(1024);
+  test_find_single(512, 1024);
+  test_erase_root(128);
+  test_find_erase_fixed();
+  test_minmax_suite();
+  test_to_array_suite();
+  test_distinct_values();
+  test_duplicate_values();
+  test_multi_instance();
+  test_find_erase_rand(10000, 17);
+  test_pool_reuse();
+  test_node_layout();
+  test_from_sorted_suite();
+#ifdef MALLOC_FAILURE_TEST
+  test_from_sorted_alloc_failure(rbtree_from_sorted);
+  test_from_sorted_alloc_failure(rbtree_from_unsorted);
+#endif
+  test_iter();
+  test_range();
+  test_order_stat(1000, 7);
+  test_join_split(1000, 13);
+  test_join_split(5, 17);
+  test_set_ops_suite();
+  test_batch_suite();
+  test_find_many(1000, 11);
+  test_freeze(1000, 3);
+  test_freeze(37, 5);
+  test_sync_basic();
+  test_sync_concurrent();
+  test_persist(4000, 1000, 19);
+  test_persist(4000, 100000, 23);
+  test_persist_concurrent();
+  test_mmap(3000, 1000, 29);
+  test_mmap(1, 10, 31);
+  test_mmap_invalid();
+  test_topdown(20000, 500, 47);
+  test_topdown(3000, 100000, 53);
+  test_conc_basic();
+  test_conc_stress(3);
+  test_sharded_basic();
+  test_sharded_skew(60000, 20000, 59);
+  test_sharded_concurrent();
+  test_parallel(0, 4, 61);
+  test_parallel(1, 4, 61);
+  test_parallel(50000, 4, 67);
+  test_parallel(3000, 1, 71);
+  test_btree(20000, 3000, 73);
+  test_btree(500, 100000, 79);
+#ifndef RBTREE_NO_POOL
+  test_static(3000, 97);
+  test_static(1, 101);
+#endif
+#ifdef RBTREE_STATS
+  test_stats(2000, 37);
+#endif
+#ifdef RBTREE_MULTISET
+  test_multiset(5000, 50, 41);
+  test_multiset(300, 1000, 43);
+#endif
+#ifdef RBTREE_LAZY_DELETE
+  test_lazy(20000, 3000, 83);
+  test_lazy(2000, 100000, 89);
+#endif
+#ifdef RBTREE_INTERVAL
+  test_interval(5000, 400, 103);
+  test_interval(3, 50, 107);
+#endif
   printf("Passed all tests!\n");
 }